@@ -0,0 +1,157 @@
+/*
+ * sockbench - loopback benchmark for the bsdsocket.library emulation
+ *
+ * Measures TCP connections per second and bulk throughput over 127.0.0.1,
+ * with everything done from one task: blocking connect()/accept() pairs
+ * for the first part, non-blocking sockets driven by WaitSelect() for the
+ * second.
+ *
+ * Compile with SAS/C and the AmiTCP SDK:
+ *   sc link sockbench.c
+ *
+ * Usage: sockbench [connections] [kilobytes] [port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <exec/types.h>
+#include <dos/dos.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <proto/exec.h>
+#include <proto/dos.h>
+#include <proto/socket.h>
+
+struct Library *SocketBase;
+
+#define BUFSIZE 8192
+static char buf[BUFSIZE];
+
+static long ticks (void)
+{
+    struct DateStamp ds;
+    DateStamp (&ds);
+    return (ds.ds_Days * 24 * 60 + ds.ds_Minute) * 60 * TICKS_PER_SECOND + ds.ds_Tick;
+}
+
+static void report (const char *what, double amount, const char *unit, long t)
+{
+    double secs = (double)(t > 0 ? t : 1) / TICKS_PER_SECOND;
+    printf ("%-12s %10.0f %s in %6.2f s = %10.1f %s/s\n", what, amount, unit, secs,
+	    amount / secs, unit);
+}
+
+static int bench_connect (struct sockaddr_in *sin, long ls, int n)
+{
+    long i, c, a, t;
+
+    t = ticks ();
+    for (i = 0; i < n; i++) {
+	if ((c = socket (AF_INET, SOCK_STREAM, 0)) < 0)
+	    return 0;
+	if (connect (c, (struct sockaddr *)sin, sizeof *sin) < 0) {
+	    printf ("connect() failed, errno %ld\n", Errno ());
+	    CloseSocket (c);
+	    return 0;
+	}
+	if ((a = accept (ls, NULL, NULL)) < 0) {
+	    printf ("accept() failed, errno %ld\n", Errno ());
+	    CloseSocket (c);
+	    return 0;
+	}
+	CloseSocket (a);
+	CloseSocket (c);
+    }
+    report ("connections", n, "conn", ticks () - t);
+    return 1;
+}
+
+static int bench_stream (struct sockaddr_in *sin, long ls, long kbytes)
+{
+    long c, a, t, one = 1, r;
+    long tosend = kbytes * 1024, received = 0, sent = 0;
+    fd_set rd, wr;
+    long nfds;
+
+    if ((c = socket (AF_INET, SOCK_STREAM, 0)) < 0)
+	return 0;
+    if (connect (c, (struct sockaddr *)sin, sizeof *sin) < 0
+	|| (a = accept (ls, NULL, NULL)) < 0) {
+	printf ("stream setup failed, errno %ld\n", Errno ());
+	CloseSocket (c);
+	return 0;
+    }
+    IoctlSocket (c, FIONBIO, (char *)&one);
+    IoctlSocket (a, FIONBIO, (char *)&one);
+    nfds = (a > c ? a : c) + 1;
+
+    t = ticks ();
+    while (received < tosend) {
+	FD_ZERO (&rd);
+	FD_ZERO (&wr);
+	FD_SET (a, &rd);
+	if (sent < tosend)
+	    FD_SET (c, &wr);
+	if (WaitSelect (nfds, &rd, &wr, NULL, NULL, NULL) < 0) {
+	    printf ("WaitSelect() failed, errno %ld\n", Errno ());
+	    break;
+	}
+	if (FD_ISSET (c, &wr)) {
+	    r = send (c, buf, tosend - sent > BUFSIZE ? BUFSIZE : tosend - sent, 0);
+	    if (r > 0)
+		sent += r;
+	}
+	if (FD_ISSET (a, &rd)) {
+	    r = recv (a, buf, BUFSIZE, 0);
+	    if (r > 0)
+		received += r;
+	    else if (r == 0)
+		break;
+	}
+	if (SetSignal (0, 0) & SIGBREAKF_CTRL_C)
+	    break;
+    }
+    report ("throughput", received / 1024.0, "KB", ticks () - t);
+    CloseSocket (a);
+    CloseSocket (c);
+    return 1;
+}
+
+int main (int argc, char **argv)
+{
+    struct sockaddr_in sin;
+    long ls, one = 1;
+    int conns = argc > 1 ? atoi (argv[1]) : 1000;
+    long kbytes = argc > 2 ? atol (argv[2]) : 16384;
+    int port = argc > 3 ? atoi (argv[3]) : 7777;
+
+    if ((SocketBase = OpenLibrary ("bsdsocket.library", 3)) == NULL) {
+	fprintf (stderr, "Can't open bsdsocket.library\n");
+	return 20;
+    }
+
+    memset (&sin, 0, sizeof sin);
+    sin.sin_len = sizeof sin;
+    sin.sin_family = AF_INET;
+    sin.sin_port = port;
+    sin.sin_addr.s_addr = 0x7f000001;
+
+    ls = socket (AF_INET, SOCK_STREAM, 0);
+    setsockopt (ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (ls < 0 || bind (ls, (struct sockaddr *)&sin, sizeof sin) < 0 || listen (ls, 16) < 0) {
+	fprintf (stderr, "Can't listen on port %d, errno %ld\n", port, Errno ());
+	CloseLibrary (SocketBase);
+	return 20;
+    }
+
+    bench_connect (&sin, ls, conns);
+    bench_stream (&sin, ls, kbytes);
+
+    CloseSocket (ls);
+    CloseLibrary (SocketBase);
+    return 0;
+}
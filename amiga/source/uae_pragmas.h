@@ -76,3 +76,7 @@ static int DebugFunc(void)
 {
     calltrap (15);
 }
+static int GetMetrics(UBYTE *buf, ULONG size)
+{
+    calltrap (36, buf, size);
+}
@@ -22,6 +22,7 @@
 struct UAE_CONFIG      config;
 
 void print_drive_status(void);
+void print_metrics(void);
 void quit_program(int error, char *text);
 
 /************************************
@@ -49,13 +50,14 @@ int main()
 	      printf(" 7) Change language      (Currently : %s)\n", langs[config.keyboard]);
 	      printf(" 8) Eject a disk\n");
 	      printf(" 9) Insert a disk\n");
-	      printf("10) Exit UAE-Control\n\n");
+	      printf("10) Show statistics\n");
+	      printf("11) Exit UAE-Control\n\n");
 	      correct = 0;
 	      while( correct == 0 ) {
 		     printf(" Command : ");
 		     gets( buf );
 		     i = atoi( buf );
-		     if ((i > 0) && (i < 11))
+		     if ((i > 0) && (i < 12))
 		       correct = 1;
 	      }
 	      switch( i ) {
@@ -130,6 +132,9 @@ int main()
 		     }
 		     break;
 	       case 10:
+		     print_metrics();
+		     break;
+	       case 11:
 		     quit = 1;
 		     break;
 	      }
@@ -151,6 +156,25 @@ void print_drive_status(void)
 
 
 
+/******************************************
+ * Prints the performance counters	  *
+ ******************************************/
+void print_metrics(void)
+{
+       static char buf[8192];
+       char *p, *q;
+
+       GetMetrics( (UBYTE *)buf, sizeof buf );
+       /* Leave out the comment lines */
+       for (p = buf; *p; p = q) {
+	      q = strchr( p, '\n' );
+	      q = q ? q + 1 : p + strlen( p );
+	      if (*p != '#')
+		     fwrite( p, 1, q - p, stdout );
+       }
+       printf("\n");
+}
+
 /******************************************
  * Quits the program			  *
  ******************************************/
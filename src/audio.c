@@ -29,6 +29,7 @@
 #include "savestate.h"
 #include "sinctable.h"
 #include "gui.h"
+#include "capture.h"
 
 #define MAX_EV ~0ul
 
@@ -205,6 +206,7 @@ STATIC_INLINE void put_sound_word_right (uae_u32 w)
     }
 
     PUT_SOUND_WORD_RIGHT (w);
+    capture_audio_word (w);
 }
 
 STATIC_INLINE void put_sound_word_left (uae_u32 w)
@@ -222,11 +224,13 @@ STATIC_INLINE void put_sound_word_left (uae_u32 w)
 	tmp = (rnew * mixed_mul2 + lold * mixed_mul1) / MIXED_STEREO_SCALE;
 	tmp += SOUND16_BASE_VAL;
 	PUT_SOUND_WORD_RIGHT (tmp);
+	capture_audio_word (tmp);
 
 	rold = right_word_saved[saved_ptr] - SOUND16_BASE_VAL;
 	w = (lnew * mixed_mul2 + rold * mixed_mul1) / MIXED_STEREO_SCALE;
     }
     PUT_SOUND_WORD_LEFT (w);
+    capture_audio_word (w);
 }
 
 #define DO_CHANNEL(v, c) do { (v) &= audio_channel[c].adk_mask; data += v; } while (0);
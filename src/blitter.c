@@ -17,6 +17,7 @@
 #include "newcpu.h"
 #include "blitter.h"
 #include "blit.h"
+#include "metrics.h"
 
 uae_u16 oldvblts;
 uae_u16 bltcon0, bltcon1;
@@ -271,7 +272,7 @@ STATIC_INLINE void blitter_read (void)
     if (bltcon0 & 0x200) {
 	if (!dmaen (DMA_BLITTER))
 	    return;
-	blt_info.bltcdat = chipmem_bank.wget (bltcpt);
+	blt_info.bltcdat = chipmem_agnus_wget (bltcpt);
     }
     bltstate = BLT_work;
 }
@@ -461,6 +462,8 @@ void do_blitter (void)
 
     blit_firstline_cycles = blit_first_cycle = get_cycles ();
     blit_last_cycle = 0;
+    METRIC_INC (METRIC_BLITS);
+    METRIC_ADD (METRIC_BLIT_WORDS, blt_info.vblitsize * blt_info.hblitsize);
     if (!currprefs.immediate_blits) {
 	if (!blitline) {
 	    blit_cycles = blit_diag[1];
@@ -51,6 +51,12 @@
 
 #include <signal.h>
 #include <arpa/inet.h>
+#include <poll.h>
+
+#ifdef __linux__
+#define BSDSOCK_EPOLL
+#include <sys/epoll.h>
+#endif
 
 //#define DEBUG_BSDSOCKET
 #ifdef DEBUG_BSDSOCKET
@@ -86,12 +92,8 @@
 
 uae_u32 bsdthr_Accept_2 (SB);
 uae_u32 bsdthr_Recv_2 (SB);
-uae_u32 bsdthr_blockingstuff (uae_u32 (*tryfunc)(SB), SB);
-uae_u32 bsdthr_SendRecvAcceptConnect (uae_u32 (*tryfunc)(SB), SB);
 uae_u32 bsdthr_Send_2 (SB);
 uae_u32 bsdthr_Connect_2 (SB);
-uae_u32 bsdthr_WaitSelect (SB);
-uae_u32 bsdthr_Wait (SB);
 void clearsockabort (SB);
 
 static uae_sem_t sem_queue;
@@ -457,23 +459,9 @@ STATIC_INLINE void fd_zero (uae_u32 fdset, uae_u32 nfds)
 	put_long (fdset, 0);
 }
 
-STATIC_INLINE int bsd_amigaside_FD_ISSET (int n, uae_u32 set)
-{
-    uae_u32 foo = get_long (set + (n / 32));
-    if (foo & (1 << (n % 32)))
-	return 1;
-    return 0;
-}
-
-STATIC_INLINE void bsd_amigaside_FD_ZERO (uae_u32 set)
-{
-    put_long (set, 0);
-    put_long (set + 4, 0);
-}
-
 STATIC_INLINE void bsd_amigaside_FD_SET (int n, uae_u32 set)
 {
-    set = set + (n / 32);
+    set = set + (n / 32) * 4;
     put_long (set, get_long (set) | (1 << (n % 32)));
 }
 
@@ -627,107 +615,502 @@ static void copyProtoent (TrapContext *context, SB, const struct protoent *p)
 
 
 
-uae_u32 bsdthr_WaitSelect (SB)
+/**
+ ** Shared socket reactor
+ **
+ ** Host sockets are always non-blocking.  An operation that would block on a
+ ** socket which is blocking on the Amiga side is parked on a single reactor
+ ** thread, shared by all library bases, which retries it once the socket
+ ** becomes ready and then signals the owner task.  WaitSelect() is handled
+ ** the same way.  Name lookups can't be made non-blocking, so they are
+ ** served in order by one resolver thread.
+ **/
+
+static uae_sem_t reactor_lock;		/* protects the reactor state below */
+static uae_sem_t signal_lock;		/* serialises uae_Signal () from socket threads */
+static struct socketbase *reactor_pending;
+static struct socketbase **reactor_fdwaiter;	/* host fd -> base waiting on it */
+static int reactor_fdwaitersize;
+static int reactor_wakepipe[2] = { -1, -1 };
+#ifdef BSDSOCK_EPOLL
+static int reactor_epfd = -1;
+#define REACTOR_MAXEVENTS 256
+#endif
+
+static uae_sem_t resolver_lock;		/* protects the resolver queue */
+static uae_sem_t resolver_busy;		/* held while a lookup is in progress */
+static uae_sem_t resolver_sem;		/* counts queued lookups */
+static struct socketbase *resolver_queue;
+static struct socketbase *resolver_current;
+
+static int reactor_started;
+
+static void reactor_wake (void)
 {
-    fd_set sets [3];
-    int i, s, set, a_s, max;
-    uae_u32 a_set;
-    struct timeval tv;
-    int r;
+    char chr = 0;
+    write (reactor_wakepipe[1], &chr, 1);
+}
 
-    DEBUG_LOG ("WaitSelect: %d 0x%x 0x%x 0x%x 0x%x 0x%x\n",
-	       sb->nfds, sb->sets [0], sb->sets [1], sb->sets [2], sb->timeout, sb->sigmp);
+/*
+ * Host sockets stay registered with the reactor for their whole lifetime,
+ * edge-triggered, so waiting on a socket costs no system call.
+ */
+static void reactor_addsock (int s)
+{
+    fcntl (s, F_SETFL, fcntl (s, F_GETFL) | O_NONBLOCK);
+#ifdef BSDSOCK_EPOLL
+    {
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLET;
+	ev.data.fd = s;
+	if (epoll_ctl (reactor_epfd, EPOLL_CTL_ADD, s, &ev) < 0 && errno != EEXIST)
+	    write_log ("BSDSOCK: Can't register socket %d with reactor (%d)\n", s, errno);
+    }
+#endif
+}
 
-    if (sb->timeout)
-	DEBUG_LOG ("WaitSelect: timeout %d %d\n", get_long (sb->timeout),
-		   get_long (sb->timeout + 4));
-
-    FD_ZERO (&sets [0]);
-    FD_ZERO (&sets [1]);
-    FD_ZERO (&sets [2]);
-
-    /* Set up the abort socket */
-    FD_SET (sb->sockabort[0], &sets[0]);
-    FD_SET (sb->sockabort[0], &sets[2]);
-    max = sb->sockabort[0];
-
-    for (set = 0; set < 3; set++) {
-	if (sb->sets [set] != 0) {
-	    a_set = sb->sets [set];
-	    for (i = 0; i < sb->nfds; i++) {
-		if (bsd_amigaside_FD_ISSET (i, a_set)) {
-		    s = getsock (sb, i + 1);
-		    DEBUG_LOG ("WaitSelect: AmigaSide %d set. NativeSide %d.\n", i, s);
-		    if (s == -1) {
-			write_log ("BSDSOCK: WaitSelect() called with invalid descriptor %d in set %d.\n", i, set);
-		    } else {
-			FD_SET (s, &sets [set]);
-			if (max < s) max = s;
-		    }
-		}
+static void reactor_delsock (int s)
+{
+#ifdef BSDSOCK_EPOLL
+    struct epoll_event ev;
+    epoll_ctl (reactor_epfd, EPOLL_CTL_DEL, s, &ev);
+#endif
+}
+
+/* Following two must be called with reactor_lock held */
+
+static void reactor_watch (SB)
+{
+    int i, s;
+
+    for (i = 0; i < sb->wsnfds; i++) {
+	s = sb->wsfds[i].fd;
+	if (s >= reactor_fdwaitersize) {
+	    int newsize = (s + 64) & ~63;
+	    struct socketbase **n = realloc (reactor_fdwaiter, newsize * sizeof (*n));
+	    if (n == NULL) {
+		write_log ("BSDSOCK: Out of memory for reactor descriptor table\n");
+		continue;
 	    }
+	    memset (n + reactor_fdwaitersize, 0, (newsize - reactor_fdwaitersize) * sizeof (*n));
+	    reactor_fdwaiter = n;
+	    reactor_fdwaitersize = newsize;
 	}
+	reactor_fdwaiter[s] = sb;
     }
+}
+
+static void reactor_unwatch (SB)
+{
+    struct socketbase **psb;
+    int i, s;
 
-    max++;
+    for (psb = &reactor_pending; *psb; psb = &(*psb)->reactnext) {
+	if (*psb == sb) {
+	    *psb = sb->reactnext;
+	    break;
+	}
+    }
+    for (i = 0; i < sb->wsnfds; i++) {
+	s = sb->wsfds[i].fd;
+	if (s < reactor_fdwaitersize && reactor_fdwaiter[s] == sb)
+	    reactor_fdwaiter[s] = NULL;
+    }
+    sb->pending = 0;
+}
 
-    if (sb->timeout) {
-	tv.tv_sec  = get_long (sb->timeout);
-	tv.tv_usec = get_long (sb->timeout + 4);
+static int bsdsock_addwaitfd (SB, int s, short events, int amigafd)
+{
+    if (sb->wsnfds >= sb->wsfdsize) {
+	int newsize = sb->wsfdsize ? sb->wsfdsize * 2 : 16;
+	struct pollfd *fds = realloc (sb->wsfds, newsize * sizeof (*fds));
+	int *amiga = realloc (sb->wsamiga, newsize * sizeof (*amiga));
+
+	if (fds)
+	    sb->wsfds = fds;
+	if (amiga)
+	    sb->wsamiga = amiga;
+	if (fds == NULL || amiga == NULL)
+	    return 0;
+	sb->wsfdsize = newsize;
     }
+    sb->wsfds[sb->wsnfds].fd = s;
+    sb->wsfds[sb->wsnfds].events = events;
+    sb->wsfds[sb->wsnfds].revents = 0;
+    sb->wsamiga[sb->wsnfds] = amigafd;
+    sb->wsnfds++;
+    return 1;
+}
+
+/*
+ * Hand the operation set up in sb to the reactor. The caller then waits
+ * for the socket signal.
+ */
+static void reactor_submit (SB)
+{
+    uae_sem_wait (&reactor_lock);
+    sb->abortreq = 0;
+    sb->ready = 1;		/* recheck once, events may have fired before we got here */
+    sb->pending = 1;
+    sb->reactnext = reactor_pending;
+    reactor_pending = sb;
+    reactor_watch (sb);
+    uae_sem_post (&reactor_lock);
+    reactor_wake ();
+}
+
+/*
+ * Drop whatever operation is still pending for sb. Happens when the task
+ * was interrupted and went on with something else before the reactor
+ * noticed the abort.
+ */
+static void reactor_cancel (SB)
+{
+    uae_sem_wait (&reactor_lock);
+    if (sb->pending)
+	reactor_unwatch (sb);
+    sb->abortreq = 0;
+    uae_sem_post (&reactor_lock);
+}
+
+static void bsdsock_wszero (SB)
+{
+    int set;
+
+    for (set = 0; set < 3; set++)
+	if (sb->sets [set] != 0)
+	    fd_zero (sb->sets [set], sb->nfds);
+}
+
+/*
+ * Copy the poll () results for a WaitSelect () back into the Amiga side
+ * sets, with the usual select () semantics. Returns the number of bits set.
+ */
+static int bsdsock_wsresult (SB)
+{
+    int i, r = 0;
+
+    bsdsock_wszero (sb);
+    for (i = 0; i < sb->wsnfds; i++) {
+	short ev = sb->wsfds[i].events;
+	short rev = sb->wsfds[i].revents;
+	int a_s = sb->wsamiga[i];
 
-    DEBUG_LOG("Select going to select\n");
-    r = select (max, &sets [0], &sets [1], &sets [2], (sb->timeout == 0) ? NULL : &tv);
-    DEBUG_LOG("Select returns %d, errno is %d\n", r, errno);
-    if( r > 0 ) {
-	/* Socket told us to abort */
-	if (FD_ISSET (sb->sockabort[0], &sets[0])) {
-	    /* read from the pipe to reset it */
-	    DEBUG_LOG ("WaitSelect aborted from signal\n");
-	    r = 0;
-	    for (set = 0; set < 3; set++)
-	    if (sb->sets [set] != 0)
-		bsd_amigaside_FD_ZERO (sb->sets [set]);
-	    clearsockabort (sb);
+	if ((ev & POLLIN) && (rev & (POLLIN | POLLHUP | POLLERR))) {
+	    bsd_amigaside_FD_SET (a_s, sb->sets [0]);
+	    r++;
+	}
+	if ((ev & POLLOUT) && (rev & (POLLOUT | POLLHUP | POLLERR))) {
+	    bsd_amigaside_FD_SET (a_s, sb->sets [1]);
+	    r++;
 	}
+	if ((ev & POLLPRI) && (rev & POLLPRI)) {
+	    bsd_amigaside_FD_SET (a_s, sb->sets [2]);
+	    r++;
+	}
+    }
+    return r;
+}
+
+/*
+ * Check a WaitSelect () without blocking. Returns 0 if nothing is ready yet,
+ * otherwise stores the result in sb and returns 1.
+ */
+static int bsdsock_trywaitselect (SB)
+{
+    int r = poll (sb->wsfds, sb->wsnfds, 0);
+
+    if (r == 0)
+	return 0;
+    if (r > 0) {
+	r = bsdsock_wsresult (sb);
+	if (r == 0) {
+	    /* Only POLLNVAL, select () would have failed */
+	    errno = EBADF;
+	    r = -1;
+	}
+    }
+    if (r < 0) {
+	if (errno == EINTR)
+	    return 0;
+	SETERRNO;
+    } else
+	bsdsocklib_seterrno (sb, 0);
+    sb->resultval = r;
+    return 1;
+}
+
+/*
+ * Attempt the send/recv/accept/connect recorded in sb once. Returns 0 if
+ * it would block and has to be retried when the socket becomes ready,
+ * otherwise stores the result in sb and returns 1.
+ */
+static int bsdsock_tryop (SB)
+{
+    int res, err;
+
+    if (sb->action == 5)
+	return bsdsock_trywaitselect (sb);
+
+    res = sb->tryfunc (sb);
+    err = errno;
+
+    if (sb->action == 2 && res >= 0) {
+	/* A blocking send doesn't return until everything is queued */
+	sb->sent += res;
+	if (sb->blocking && (uae_u32)res < sb->len) {
+	    sb->buf = (char *)sb->buf + res;
+	    sb->len -= res;
+	    return 0;
+	}
+	res = sb->sent;
+    } else if (res < 0 && sb->blocking
+	       && (err == EAGAIN || err == EWOULDBLOCK || err == EINPROGRESS || err == EINTR)) {
+	return 0;
+    }
+
+    if (res < 0 && sb->action == 2 && sb->sent)
+	res = sb->sent;
+
+    sb->resultval = res;
+    bsdsocklib_seterrno (sb, res < 0 ? mapErrno (err) : 0);
+    return 1;
+}
+
+/* Called with reactor_lock held. */
+static int reactor_tryop (SB)
+{
+    if (sb->action == 5)
+	return bsdsock_trywaitselect (sb);
+
+    /* Don't retry until the socket really is ready; for a connect
+     * in progress SO_ERROR reads as 0 until then. */
+    if (poll (sb->wsfds, 1, 0) <= 0)
+	return 0;
+    return bsdsock_tryop (sb);
+}
+
+static void reactor_abortop (SB)
+{
+    DEBUG_LOG ("Reactor: operation %d aborted\n", sb->action);
+    if (sb->action == 5) {
+	bsdsock_wszero (sb);
+	sb->resultval = 0;
+    } else {
+	sb->resultval = -1;
+	bsdsocklib_seterrno (sb, mapErrno (EINTR));
+    }
+}
+
+/* Called with reactor_lock held. Returns the epoll/poll timeout in ms */
+static int reactor_timeout (void)
+{
+    struct socketbase *sb;
+    struct timeval now;
+    long ms, timeout = -1;
+
+    gettimeofday (&now, NULL);
+    for (sb = reactor_pending; sb; sb = sb->reactnext) {
+	if (!sb->hasdeadline)
+	    continue;
+	ms = (sb->deadline.tv_sec - now.tv_sec) * 1000
+	    + (sb->deadline.tv_usec - now.tv_usec + 999) / 1000;
+	if (ms < 0)
+	    ms = 0;
+	if (timeout < 0 || ms < timeout)
+	    timeout = ms;
+    }
+    return timeout;
+}
+
+/* Called with reactor_lock held. */
+static void reactor_setready (int s)
+{
+    if (s >= 0 && s < reactor_fdwaitersize && reactor_fdwaiter[s])
+	reactor_fdwaiter[s]->ready = 1;
+}
+
+static void reactor_drainwake (void)
+{
+    char buf[64];
+
+    while (read (reactor_wakepipe[0], buf, sizeof buf) > 0)
+	;
+}
+
+#ifdef BSDSOCK_EPOLL
+
+/* Wait for events and flag the bases waiting on them. Returns with
+ * reactor_lock held. */
+static void reactor_poll (int timeout)
+{
+    struct epoll_event events[REACTOR_MAXEVENTS];
+    int i, n;
+
+    n = epoll_wait (reactor_epfd, events, REACTOR_MAXEVENTS, timeout);
+    uae_sem_wait (&reactor_lock);
+    for (i = 0; i < n; i++) {
+	if (events[i].data.fd == reactor_wakepipe[0])
+	    reactor_drainwake ();
 	else
-	/* This is perhaps slightly inefficient, but I don't care.. */
-	for (set = 0; set < 3; set++) {
-	    a_set = sb->sets [set];
-	    if (a_set != 0) {
-		bsd_amigaside_FD_ZERO (a_set);
-		for (i = 0; i < sb->nfds; i++) {
-		    a_s = getsock (sb, i + 1);
-		    if (a_s != -1) {
-			if (FD_ISSET (a_s, &sets [set])) {
-			    DEBUG_LOG ("WaitSelect: NativeSide %d set. AmigaSide %d.\n", a_s, i);
-
-			    bsd_amigaside_FD_SET (i, a_set);
-		    }
-		}
+	    reactor_setready (events[i].data.fd);
+    }
+}
+
+#else
+
+static struct pollfd *reactor_pollfds;
+static int reactor_pollfdsize;
+
+/* Same, using poll () over everything that is waited on */
+static void reactor_poll (int timeout)
+{
+    struct socketbase *sb;
+    int i, n = 1, nfds, ready;
+
+    uae_sem_wait (&reactor_lock);
+    for (sb = reactor_pending; sb; sb = sb->reactnext)
+	n += sb->wsnfds;
+    if (n > reactor_pollfdsize) {
+	struct pollfd *fds = realloc (reactor_pollfds, n * sizeof (*fds));
+	if (fds) {
+	    reactor_pollfds = fds;
+	    reactor_pollfdsize = n;
+	}
+    }
+    if (reactor_pollfds == 0) {
+	/* Nothing to poll with; just wait out the timeout.  */
+	uae_sem_post (&reactor_lock);
+	poll (0, 0, timeout);
+	uae_sem_wait (&reactor_lock);
+	return;
+    }
+    nfds = 0;
+    reactor_pollfds[nfds].fd = reactor_wakepipe[0];
+    reactor_pollfds[nfds++].events = POLLIN;
+    for (sb = reactor_pending; sb; sb = sb->reactnext) {
+	for (i = 0; i < sb->wsnfds && nfds < reactor_pollfdsize; i++)
+	    reactor_pollfds[nfds++] = sb->wsfds[i];
+    }
+    uae_sem_post (&reactor_lock);
+
+    ready = poll (reactor_pollfds, nfds, timeout);
+
+    uae_sem_wait (&reactor_lock);
+    if (ready > 0) {
+	if (reactor_pollfds[0].revents)
+	    reactor_drainwake ();
+	for (i = 1; i < nfds; i++)
+	    if (reactor_pollfds[i].revents)
+		reactor_setready (reactor_pollfds[i].fd);
+    }
+}
+
+#endif
+
+static void *bsdsock_reactor (void *arg)
+{
+    struct socketbase *sb, *next, *done, **psb;
+    struct timeval now;
+    int timeout, fin;
+
+    DEBUG_LOG ("REACTOR_START\n");
+
+    for (;;) {
+	uae_sem_wait (&reactor_lock);
+	timeout = reactor_timeout ();
+	uae_sem_post (&reactor_lock);
+
+	reactor_poll (timeout);
+
+	gettimeofday (&now, NULL);
+	done = NULL;
+	for (psb = &reactor_pending; (sb = *psb) != NULL; ) {
+	    fin = 0;
+	    if (sb->abortreq) {
+		reactor_abortop (sb);
+		fin = 1;
+	    } else if (sb->ready) {
+		sb->ready = 0;
+		fin = reactor_tryop (sb);
+	    }
+	    if (!fin && sb->hasdeadline && !timercmp (&now, &sb->deadline, <)) {
+		/* WaitSelect timeout. I think we're supposed to clear the sets.. */
+		bsdsock_wszero (sb);
+		sb->resultval = 0;
+		bsdsocklib_seterrno (sb, 0);
+		fin = 1;
 	    }
+	    if (fin) {
+		reactor_unwatch (sb);
+		sb->donenext = done;
+		done = sb;
+	    } else
+		psb = &sb->reactnext;
 	}
+
+	/* Take signal_lock before dropping reactor_lock, so host_sbcleanup ()
+	 * can't free a base we are about to signal. */
+	uae_sem_wait (&signal_lock);
+	uae_sem_post (&reactor_lock);
+	for (sb = done; sb; sb = next) {
+	    next = sb->donenext;
+	    SETSIGNAL;
 	}
-    } else if (r == 0) {         /* Timeout. I think we're supposed to clear the sets.. */
-	for (set = 0; set < 3; set++)
-	    if (sb->sets [set] != 0)
-		bsd_amigaside_FD_ZERO (sb->sets [set]);
+	uae_sem_post (&signal_lock);
     }
-    DEBUG_LOG ("WaitSelect: %d(%d)\n", r, errno);
-    return r;
+    return NULL;
+}
+
+static void *bsdsock_resolver (void *arg)
+{
+    struct socketbase *sb;
+    struct hostent *tmphostent;
+
+    DEBUG_LOG ("RESOLVER_START\n");
+
+    for (;;) {
+	uae_sem_wait (&resolver_sem);
+	uae_sem_wait (&resolver_lock);
+	sb = resolver_queue;
+	if (sb == NULL) {
+	    /* Base was closed while its lookup was queued */
+	    uae_sem_post (&resolver_lock);
+	    continue;
+	}
+	resolver_queue = sb->resolvnext;
+	resolver_current = sb;
+	uae_sem_wait (&resolver_busy);
+	uae_sem_post (&resolver_lock);
+
+	if (sb->action == 4)	/* Gethostbyname */
+	    tmphostent = gethostbyname ((char *)get_real_address (sb->name));
+	else			/* Gethostbyaddr */
+	    tmphostent = gethostbyaddr (get_real_address (sb->name), sb->a_addrlen, sb->flags);
+
+	if (tmphostent) {
+	    copyHostent (tmphostent, sb);
+	    bsdsocklib_setherrno (sb, 0);
+	} else
+	    SETHERRNO;
+
+	uae_sem_wait (&signal_lock);
+	SETSIGNAL;
+	uae_sem_post (&signal_lock);
+	uae_sem_post (&resolver_busy);
+    }
+    return NULL;
 }
 
 uae_u32 bsdthr_Accept_2 (SB)
 {
     int foo, s, s2;
-    long flags;
     struct sockaddr_in addr;
     socklen_t hlen = sizeof (struct sockaddr_in);
 
     if ((s = accept (sb->s, (struct sockaddr *)&addr, &hlen)) >= 0) {
-	if ((flags = fcntl (s, F_GETFL)) == -1)
-	    flags = 0;
-	fcntl (s, F_SETFL, flags & ~O_NONBLOCK); /* @@@ Don't do this if it's supposed to stay nonblocking... */
+	reactor_addsock (s);
 	s2 = getsd (sb, s);
 	sb->ftable[s2-1] = sb->ftable[sb->len];	/* new socket inherits the old socket's properties */
 	DEBUG_LOG ("Accept: AmigaSide %d, NativeSide %d, len %d(%d)",
@@ -787,10 +1170,8 @@ uae_u32 bsdthr_Connect_2 (SB)
 	copysockaddr_a2n (&addr, sb->a_addr, sb->a_addrlen);
 	retval = connect (sb->s, (struct sockaddr *)&addr, len);
 	DEBUG_LOG ("Connect returns %d, errno is %d\n", retval, errno);
-	/* Hack: I need to set the action to something other than
-	 * 1 but I know action == 2 does the correct thing
-	 */
-	sb->action = 2;
+	/* Any retry only needs to pick up the result */
+	sb->action = 8;
 	if (retval == 0) {
 	     errno = 0;
 	}
@@ -808,142 +1189,35 @@ uae_u32 bsdthr_Connect_2 (SB)
     }
 }
 
-uae_u32 bsdthr_SendRecvAcceptConnect (uae_u32 (*tryfunc)(SB), SB)
-{
-    return bsdthr_blockingstuff (tryfunc, sb);
-}
-
-uae_u32 bsdthr_blockingstuff (uae_u32 (*tryfunc)(SB), SB)
+/*
+ * Run a socket operation that may block. It is tried straight away on the
+ * calling thread; only if the host would block and the socket is blocking
+ * on the Amiga side is it parked on the reactor and the task put to sleep.
+ */
+static void bsdsock_blockingop (TrapContext *context, SB, uae_u32 sd, uae_u32 (*tryfunc)(SB))
 {
-    int done = 0, foo;
-    long flags;
-    int nonblock;
-    if ((flags = fcntl (sb->s, F_GETFL)) == -1)
-	flags = 0;
-    nonblock = (flags & O_NONBLOCK);
-    fcntl (sb->s, F_SETFL, flags | O_NONBLOCK);
-    while (!done) {
-	done = 1;
-	foo = tryfunc (sb);
-	if (foo < 0 && !nonblock) {
-	    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINPROGRESS)) {
-		fd_set readset, writeset, exceptset;
-		int maxfd = (sb->s > sb->sockabort[0]) ? sb->s : sb->sockabort[0];
-		int num;
-
-		FD_ZERO (&readset);
-		FD_ZERO (&writeset);
-		FD_ZERO (&exceptset);
-
-		if (sb->action == 3 || sb->action == 6)
-		    FD_SET (sb->s, &readset);
-		if (sb->action == 2 || sb->action == 1 || sb->action == 4)
-		    FD_SET (sb->s, &writeset);
-		FD_SET (sb->sockabort[0], &readset);
-
-		num = select (maxfd + 1, &readset, &writeset, &exceptset, NULL);
-		if (num == -1) {
-		    DEBUG_LOG ("Blocking select(%d) returns -1,errno is %d\n", sb->sockabort[0],errno);
-		    fcntl (sb->s, F_SETFL, flags);
-		   return -1;
-		}
+    sb->tryfunc = tryfunc;
+    sb->blocking = (sb->ftable[sd] & SF_BLOCKING) != 0;
+    sb->sent = 0;
+    sb->hasdeadline = 0;
 
-		if (FD_ISSET (sb->sockabort[0], &readset) || FD_ISSET (sb->sockabort[0], &writeset)) {
-		    /* reset sock abort pipe */
-		    /* read from the pipe to reset it */
-		    DEBUG_LOG ("select aborted from signal\n");
+    if (bsdsock_tryop (sb))
+	return;
 
-		    clearsockabort (sb);
-		    DEBUG_LOG ("Done read\n");
-		    errno = EINTR;
-		    done = 1;
-		} else {
-		    done = 0;
-		}
-	    } else if (errno == EINTR)
-		done = 1;
-	}
+    sb->wsnfds = 0;
+    if (!bsdsock_addwaitfd (sb, sb->s, (sb->action == 3 || sb->action == 6) ? POLLIN : POLLOUT, sd)) {
+	sb->resultval = -1;
+	bsdsocklib_seterrno (sb, 12); /* ENOMEM */
+	return;
     }
-    fcntl (sb->s, F_SETFL, flags);
-    return foo;
-}
-
-
-static void *bsdlib_threadfunc (void *arg)
-{
-    struct socketbase *sb = (struct socketbase *) arg;
-
-    DEBUG_LOG ("THREAD_START\n");
+    reactor_submit (sb);
 
-    while (1) {
-	uae_sem_wait (&sb->sem);
-
-	DEBUG_LOG ("Socket thread got action %d\n", sb->action);
-
-	switch (sb->action) {
-	    case 0:       /* kill thread (CloseLibrary) */
-
-		DEBUG_LOG ("THREAD_END\n");
-
-		uae_sem_destroy (&sb->sem);
-		return NULL;
-
-	    case 1:       /* Connect */
-		sb->resultval = bsdthr_SendRecvAcceptConnect (bsdthr_Connect_2, sb);
-		break;
-
-	    /* @@@ Should check (from|to)len so it's 16.. */
-	    case 2:       /* Send[to] */
-		sb->resultval = bsdthr_SendRecvAcceptConnect (bsdthr_Send_2, sb);
-		break;
-
-	    case 3:       /* Recv[from] */
-		sb->resultval = bsdthr_SendRecvAcceptConnect (bsdthr_Recv_2, sb);
-		break;
-
-	    case 4: {     /* Gethostbyname */
-		struct hostent *tmphostent = gethostbyname ((char *)get_real_address (sb->name));
-
-		if (tmphostent) {
-		    copyHostent (tmphostent, sb);
-		    bsdsocklib_setherrno (sb, 0);
-		} else
-		    SETHERRNO;
-
-		break;
-	    }
-
-	    case 5:       /* WaitSelect */
-		sb->resultval = bsdthr_WaitSelect (sb);
-		break;
-
-	    case 6:       /* Accept */
-		sb->resultval = bsdthr_SendRecvAcceptConnect (bsdthr_Accept_2, sb);
-		break;
-
-	    case 7: {
-		struct hostent *tmphostent = gethostbyaddr (get_real_address (sb->name), sb->a_addrlen, sb->flags);
-
-		if (tmphostent) {
-		    copyHostent (tmphostent, sb);
-		    bsdsocklib_setherrno (sb, 0);
-		} else
-		    SETHERRNO;
-
-		break;
-	    }
-	}
-	SETERRNO;
-	SETSIGNAL;
-    }
-    return NULL;        /* Just to keep GCC happy.. */
+    WAITSIGNAL;
 }
 
-
-
-
 void host_connect (TrapContext *context, SB, uae_u32 sd, uae_u32 name, uae_u32 namelen)
 {
+    reactor_cancel (sb);
     sb->s = getsock (sb, sd + 1);
     if (sb->s == -1) {
 	sb->resultval = -1;
@@ -954,13 +1228,12 @@ void host_connect (TrapContext *context, SB, uae_u32 sd, uae_u32 name, uae_u32 n
     sb->a_addrlen = namelen;
     sb->action    = 1;
 
-    uae_sem_post (&sb->sem);
-
-    WAITSIGNAL;
+    bsdsock_blockingop (context, sb, sd, bsdthr_Connect_2);
 }
 
 void host_sendto (TrapContext *context, SB, uae_u32 sd, uae_u32 msg, uae_u32 len, uae_u32 flags, uae_u32 to, uae_u32 tolen)
 {
+    reactor_cancel (sb);
     sb->s = getsock (sb, sd + 1);
     if (sb->s == -1) {
 	sb->resultval = -1;
@@ -974,14 +1247,15 @@ void host_sendto (TrapContext *context, SB, uae_u32 sd, uae_u32 msg, uae_u32 len
     sb->tolen  = tolen;
     sb->action = 2;
 
-    uae_sem_post (&sb->sem);
-
-    WAITSIGNAL;
+    bsdsock_blockingop (context, sb, sd, bsdthr_Send_2);
 }
 
 void host_recvfrom (TrapContext *context, SB, uae_u32 sd, uae_u32 msg, uae_u32 len, uae_u32 flags, uae_u32 addr, uae_u32 addrlen)
 {
-    int s = getsock (sb, sd + 1);
+    int s;
+
+    reactor_cancel (sb);
+    s = getsock (sb, sd + 1);
 
     DEBUG_LOG ("Recv[from](%lx, %d, %lx, %ld, %lx, %lx, %d)\n",
 	       sb, sd, msg, len, flags, addr, addrlen);
@@ -1000,9 +1274,7 @@ void host_recvfrom (TrapContext *context, SB, uae_u32 sd, uae_u32 msg, uae_u32 l
     sb->fromlen= addrlen;
     sb->action = 3;
 
-    uae_sem_post (&sb->sem);
-
-    WAITSIGNAL;
+    bsdsock_blockingop (context, sb, sd, bsdthr_Recv_2);
 }
 
 void host_setsockopt (SB, uae_u32 sd, uae_u32 level, uae_u32 optname, uae_u32 optval, uae_u32 optlen)
@@ -1099,11 +1371,64 @@ void host_gethostbynameaddr (TrapContext *context, SB, uae_u32 name, uae_u32 nam
     else
 	sb->action = 7;
 
-    uae_sem_post (&sb->sem);
+    reactor_cancel (sb);
+    uae_sem_wait (&resolver_lock);
+    sb->resolvnext = NULL;
+    if (resolver_queue == NULL)
+	resolver_queue = sb;
+    else {
+	struct socketbase *nsb = resolver_queue;
+	while (nsb->resolvnext)
+	    nsb = nsb->resolvnext;
+	nsb->resolvnext = sb;
+    }
+    uae_sem_post (&resolver_lock);
+    uae_sem_post (&resolver_sem);
 
     WAITSIGNAL;
 }
 
+/*
+ * Collect the host sockets of the Amiga side WaitSelect () sets into
+ * sb->wsfds. There is no FD_SETSIZE limit on either side.
+ */
+static int bsdsock_buildwaitset (SB)
+{
+    uae_u32 bits[3];
+    int i, j, set, s;
+    short events;
+
+    sb->wsnfds = 0;
+    for (i = 0; i < sb->nfds; i += 32) {
+	for (set = 0; set < 3; set++)
+	    bits[set] = sb->sets [set] ? get_long (sb->sets [set] + i / 8) : 0;
+	if (!(bits[0] | bits[1] | bits[2]))
+	    continue;
+	for (j = 0; j < 32 && i + j < sb->nfds; j++) {
+	    events = 0;
+	    if (bits[0] & (1 << j))
+		events |= POLLIN;
+	    if (bits[1] & (1 << j))
+		events |= POLLOUT;
+	    if (bits[2] & (1 << j))
+		events |= POLLPRI;
+	    if (!events)
+		continue;
+	    s = getsock (sb, i + j + 1);
+	    DEBUG_LOG ("WaitSelect: AmigaSide %d set. NativeSide %d.\n", i + j, s);
+	    if (s == -1) {
+		write_log ("BSDSOCK: WaitSelect() called with invalid descriptor %d.\n", i + j);
+		continue;
+	    }
+	    if (!bsdsock_addwaitfd (sb, s, events, i + j)) {
+		write_log ("BSDSOCK: WaitSelect() out of memory\n");
+		return 0;
+	    }
+	}
+    }
+    return 1;
+}
+
 void host_WaitSelect (TrapContext *context, SB, uae_u32 nfds, uae_u32 readfds, uae_u32 writefds, uae_u32 exceptfds,
 		      uae_u32 timeout, uae_u32 sigmp)
 {
@@ -1142,6 +1467,8 @@ void host_WaitSelect (TrapContext *context, SB, uae_u32 nfds, uae_u32 readfds, u
 	return;
     }
 
+    reactor_cancel (sb);
+
     sb->nfds = nfds;
     sb->sets [0] = readfds;
     sb->sets [1] = writefds;
@@ -1150,7 +1477,43 @@ void host_WaitSelect (TrapContext *context, SB, uae_u32 nfds, uae_u32 readfds, u
     sb->sigmp    = wssigs;
     sb->action   = 5;
 
-    uae_sem_post (&sb->sem);
+    DEBUG_LOG ("WaitSelect: %d 0x%x 0x%x 0x%x 0x%x 0x%x\n",
+	       sb->nfds, sb->sets [0], sb->sets [1], sb->sets [2], sb->timeout, sb->sigmp);
+
+    if (!bsdsock_buildwaitset (sb)) {
+	sb->resultval = -1;
+	bsdsocklib_seterrno (sb, 12); /* ENOMEM */
+	return;
+    }
+
+    sb->hasdeadline = 0;
+    if (timeout) {
+	struct timeval tv;
+	tv.tv_sec  = get_long (timeout);
+	tv.tv_usec = get_long (timeout + 4);
+	DEBUG_LOG ("WaitSelect: timeout %d %d\n", tv.tv_sec, tv.tv_usec);
+	gettimeofday (&sb->deadline, NULL);
+	timeradd (&sb->deadline, &tv, &sb->deadline);
+	sb->hasdeadline = 1;
+    }
+
+    /* Don't bother the reactor if something is ready already */
+    if (bsdsock_trywaitselect (sb)) {
+	if (sigmp)
+	    put_long (sigmp, 0);
+	return;
+    }
+    if (timeout && !get_long (timeout) && !get_long (timeout + 4)) {
+	/* Just a poll */
+	bsdsock_wszero (sb);
+	sb->resultval = 0;
+	bsdsocklib_seterrno (sb, 0);
+	if (sigmp)
+	    put_long (sigmp, 0);
+	return;
+    }
+
+    reactor_submit (sb);
 
     m68k_dreg (regs, 0) = (((uae_u32)1) << sb->signal) | sb->eintrsigs | wssigs;
     sigs = CallLib (context, get_long (4), -0x13e); // Wait()
@@ -1192,6 +1555,7 @@ void host_WaitSelect (TrapContext *context, SB, uae_u32 nfds, uae_u32 readfds, u
 
 void host_accept (TrapContext *context, SB, uae_u32 sd, uae_u32 name, uae_u32 namelen)
 {
+    reactor_cancel (sb);
     sb->s = getsock (sb, sd + 1);
     if (sb->s == -1) {
 	sb->resultval = -1;
@@ -1205,9 +1569,7 @@ void host_accept (TrapContext *context, SB, uae_u32 sd, uae_u32 name, uae_u32 na
     sb->action    = 6;
     sb->len       = sd;
 
-    uae_sem_post (&sb->sem);
-
-    WAITSIGNAL;
+    bsdsock_blockingop (context, sb, sd, bsdthr_Accept_2);
     DEBUG_LOG ("Accept returns %d\n", sb->resultval);
 }
 
@@ -1228,6 +1590,7 @@ int host_socket (SB, int af, int type, int protocol)
 	int arg = 1;
 	sd = getsd (sb, s);
 	setsockopt (s, SOL_SOCKET, SO_REUSEADDR, &arg, sizeof(arg));
+	reactor_addsock (s);
     }
 
     sb->ftable[sd-1] = SF_BLOCKING;
@@ -1378,19 +1741,8 @@ void host_getservbynameport (TrapContext *context, SB, uae_u32 name, uae_u32 pro
 
 int host_sbinit (TrapContext *context, SB)
 {
-    if (pipe (sb->sockabort) < 0) {
-	return 0;
-    }
-
-    if (fcntl (sb->sockabort[0], F_SETFL, O_NONBLOCK) < 0) {
-	    write_log ("Set nonblock failed %d\n", errno);
-    }
-
-    uae_sem_init (&sb->sem, 0, 0);
-    if (0) {
-	write_log ("BSDSOCK: Failed to create semaphore.\n");
-	close (sb->sockabort[0]);
-	close (sb->sockabort[1]);
+    if (!reactor_started) {
+	write_log ("BSDSOCK: Socket reactor not running.\n");
 	return 0;
     }
 
@@ -1398,40 +1750,45 @@ int host_sbinit (TrapContext *context, SB)
     sb->hostent = uae_AllocMem (context, 1024, 0);
     sb->hostentsize = 1024;
 
-    /* @@@ The thread should be PTHREAD_CREATE_DETACHED */
-    if (uae_start_thread (bsdlib_threadfunc, (void *)sb, &sb->thread)) {
-	write_log ("BSDSOCK: Failed to create thread.\n");
-	uae_sem_destroy (&sb->sem);
-	close (sb->sockabort[0]);
-	close (sb->sockabort[1]);
-
-	return 0;
-    }
     return 1;
 }
 
 void host_sbcleanup (SB)
 {
+    struct socketbase **psb;
     int i;
 
-    uae_thread_id thread = sb->thread;
-    close (sb->sockabort[0]);
-    close (sb->sockabort[1]);
+    /* Make sure neither the reactor nor the resolver touch sb again */
+    reactor_cancel (sb);
+    uae_sem_wait (&signal_lock);
+    uae_sem_post (&signal_lock);
+
+    uae_sem_wait (&resolver_lock);
+    for (psb = &resolver_queue; *psb; psb = &(*psb)->resolvnext) {
+	if (*psb == sb) {
+	    *psb = sb->resolvnext;
+	    break;
+	}
+    }
+    if (resolver_current == sb) {
+	uae_sem_wait (&resolver_busy);
+	uae_sem_post (&resolver_busy);
+    }
+    uae_sem_post (&resolver_lock);
+
     for (i = 0; i < sb->dtablesize; i++) {
 	if (sb->dtable[i] != -1) {
+	    reactor_delsock (sb->dtable[i]);
 	    close(sb->dtable[i]);
 	}
     }
     sb->action = 0;
 
-    uae_sem_post (&sb->sem); /* destroy happens on socket thread */
-
-    /* We need to join with the socket thread to allow the thread to die
-     * and clean up resources when the underlying thread layer is pthreads.
-     * Ideally, this shouldn't be necessary, but, for example, when SDL uses
-     * pthreads, it always creates joinable threads - and we can't do anything
-     * about that. */
-    uae_wait_thread (thread);
+    free (sb->wsfds);
+    free (sb->wsamiga);
+    sb->wsfds = NULL;
+    sb->wsamiga = NULL;
+    sb->wsnfds = sb->wsfdsize = 0;
 }
 
 void host_sbreset (void)
@@ -1496,6 +1853,15 @@ uae_u32 host_shutdown (SB, uae_u32 sd, uae_u32 how)
     return -1;
 }
 
+static int bsdsock_dup (int s)
+{
+    int s2 = dup (s);
+
+    if (s2 != -1)
+	reactor_addsock (s2);
+    return s2;
+}
+
 int host_dup2socket (SB, int fd1, int fd2) {
     int s1, s2;
 
@@ -1512,15 +1878,16 @@ int host_dup2socket (SB, int fd1, int fd2) {
 	    fd2++;
 	    s2 = getsock (sb, fd2);
 	    if (s2 != -1) {
+		reactor_delsock (s2);
 		close (s2);
 	    }
-	    setsd (sb, fd2, dup (s1));
+	    setsd (sb, fd2, bsdsock_dup (s1));
 	    TRACE (("0(%d)\n", getsock (sb, fd2)));
 	    return 0;
 	} else {
 	    fd2 = getsd (sb, 1);
 		if (fd2 != -1) {
-	    setsd (sb, fd2, dup (s1));
+	    setsd (sb, fd2, bsdsock_dup (s1));
 			TRACE (("%d(%d)\n", fd2, getsock (sb, fd2)));
 	    return (fd2 - 1);
 		} else {
@@ -1615,16 +1982,16 @@ uae_u32 host_IoctlSocket (SB, uae_u32 sd, uae_u32 request, uae_u32 arg)
 #	endif
 
 	case 0x8004667E: /* FIONBIO */
-	    r = fcntl (sock, F_SETFL, argval ?
-		       flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+	    /* Host sockets are always non-blocking; only the Amiga side
+	     * view changes */
 	    if (argval) {
 		DEBUG_LOG ("nonblocking\n");
-		sb->ftable[sd-1] &= ~SF_BLOCKING;
+		sb->ftable[sd] &= ~SF_BLOCKING;
 	    } else {
 		DEBUG_LOG ("blocking\n");
-		sb->ftable[sd-1] |= SF_BLOCKING;
+		sb->ftable[sd] |= SF_BLOCKING;
 	    }
-	    return r;
+	    return 0;
 
 	case 0x4004667F: /* FIONREAD */
 	    r = ioctl (sock, FIONREAD, &flags);
@@ -1655,6 +2022,7 @@ int host_CloseSocket (SB, int sd)
     }
     */
     DEBUG_LOG ("CloseSocket Amiga: %d, NativeSide %d\n", sd, s);
+    reactor_delsock (s);
     retval = close (s);
     SETERRNO;
     releasesock (sb, sd + 1);
@@ -1668,6 +2036,7 @@ void host_closesocketquick (int s)
     l.l_linger = 0;
     if (s != -1) {
 	setsockopt (s, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+	reactor_delsock (s);
 	close (s);
     }
 }
@@ -1679,31 +2048,64 @@ uae_u32 host_gethostname (uae_u32 name, uae_u32 namelen)
 
 int init_socket_layer(void)
 {
+    uae_thread_id tid;
+
+    if (reactor_started)
+	return 1;
+
     uae_sem_init(&sem_queue, 0, 1);
-    if (0 /* @@@ */) {
-	DEBUG_LOG("Can't create sem %d\n", errno);
+    uae_sem_init (&reactor_lock, 0, 1);
+    uae_sem_init (&signal_lock, 0, 1);
+    uae_sem_init (&resolver_lock, 0, 1);
+    uae_sem_init (&resolver_busy, 0, 1);
+    uae_sem_init (&resolver_sem, 0, 0);
+
+    if (pipe (reactor_wakepipe) < 0) {
+	write_log ("BSDSOCK: Can't create reactor wakeup pipe (%d)\n", errno);
 	return 0;
     }
+    fcntl (reactor_wakepipe[0], F_SETFL, O_NONBLOCK);
+    fcntl (reactor_wakepipe[1], F_SETFL, O_NONBLOCK);
+
+#ifdef BSDSOCK_EPOLL
+    reactor_epfd = epoll_create (1024);
+    if (reactor_epfd < 0) {
+	write_log ("BSDSOCK: epoll_create() failed (%d)\n", errno);
+	return 0;
+    } else {
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = reactor_wakepipe[0];
+	epoll_ctl (reactor_epfd, EPOLL_CTL_ADD, reactor_wakepipe[0], &ev);
+    }
+#endif
+
+    if (uae_start_thread (bsdsock_reactor, NULL, &tid)
+	|| uae_start_thread (bsdsock_resolver, NULL, &tid)) {
+	write_log ("BSDSOCK: Failed to create socket threads.\n");
+	return 0;
+    }
+    reactor_started = 1;
 
     return 1;
 }
 
 void clearsockabort (SB)
 {
-    int chr;
-    int num;
-
-    while ((num = read (sb->sockabort[0], &chr, sizeof(chr))) >= 0) {
-	DEBUG_LOG ("Sockabort got %d bytes\n", num);
-	;
-    }
+    uae_sem_wait (&reactor_lock);
+    sb->abortreq = 0;
+    uae_sem_post (&reactor_lock);
 }
 
 void sockabort (SB)
 {
-    int chr = 1;
     DEBUG_LOG ("Sock abort!!\n");
-    write (sb->sockabort[1], &chr, sizeof (chr));
+    uae_sem_wait (&reactor_lock);
+    if (sb->pending) {
+	sb->abortreq = 1;
+	reactor_wake ();
+    }
+    uae_sem_post (&reactor_lock);
 }
 
 void locksigqueue (void)
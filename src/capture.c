@@ -0,0 +1,460 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Video and audio capture
+  *
+  * drawing.c hands us every line it draws, audio.c every sample word.  The
+  * lines of a frame are collected in a preallocated slot, samples in
+  * preallocated blocks; finished slots and blocks are queued for a writer
+  * thread, which produces a Y4M (or raw) video stream and a WAV file, or
+  * feeds an external encoder if the file name starts with '|'.
+  *
+  * Video frames are numbered by emulated vertical blanks, and the audio
+  * stream runs at a fixed number of samples per emulated frame, so both
+  * streams stay in sync no matter how fast the emulation runs.  Frames in
+  * which nothing was drawn are written as copies of the previous one.  The
+  * emulation thread never waits for the writer: if all video slots are
+  * queued, the next frame is drawn into the same slot and the writer repeats
+  * a frame; if all audio blocks are queued, the samples are replaced by
+  * silence.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "threaddep/thread.h"
+#include "uae.h"
+#include "memory.h"
+#include "custom.h"
+#include "xwin.h"
+#include "capture.h"
+
+#define CAPTURE_VSLOTS 4
+#define CAPTURE_ABLOCKS 64
+
+struct capture_vslot {
+    char *mem;			/* only the lines marked in dirty are valid */
+    char *dirty;
+    int first, last;
+    unsigned long frame;
+    volatile int ready;
+};
+
+struct capture_ablock {
+    uae_u8 data[CAPTURE_ABLOCK];
+    int len;
+    unsigned long lost;		/* bytes of silence to write before data */
+    volatile int ready;
+};
+
+int capture_video_on, capture_audio_on;
+uae_u8 *capture_abuf;
+int capture_apos;
+
+static FILE *vfile, *afile;
+static int vpipe, apipe;
+static int cap_format, cap_width, cap_height, cap_pixbytes, cap_linebytes, cap_hz;
+static int cap_freq;
+
+static struct capture_vslot vslots[CAPTURE_VSLOTS];
+static int v_fill, v_tail;
+static struct capture_ablock ablocks[CAPTURE_ABLOCKS];
+static int a_fill, a_tail;
+static unsigned long a_lost;
+
+/* Owned by the emulation thread.  */
+static unsigned long cap_frame, v_merged;
+/* Owned by the writer.  */
+static char *picture;
+static unsigned long frames_written, frames_repeated, audio_bytes, audio_silence;
+
+#ifdef SUPPORT_THREADS
+static uae_sem_t v_free, a_free, cap_work;
+static uae_thread_id cap_tid;
+static int cap_running;
+static volatile int cap_quit;
+#endif
+
+static FILE *capture_open (const char *name, int *is_pipe)
+{
+    FILE *f;
+
+    *is_pipe = name[0] == '|';
+    if (*is_pipe)
+	f = popen (name + 1, "w");
+    else
+	f = fopen (name, "wb");
+    if (f == NULL)
+	write_log ("Capture: can't open %s\n", name);
+    return f;
+}
+
+static void capture_close (FILE *f, int is_pipe)
+{
+    if (is_pipe)
+	pclose (f);
+    else
+	fclose (f);
+}
+
+static void put_le32 (uae_u8 *p, uae_u32 v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void write_wav_header (uae_u32 datalen)
+{
+    uae_u8 buf[44];
+
+    memcpy (buf, "RIFF    WAVEfmt                     data    ", 44);
+    put_le32 (buf + 4, datalen + 36);
+    put_le32 (buf + 16, 16);
+    put_le32 (buf + 20, 0x00020001);
+    put_le32 (buf + 24, cap_freq);
+    put_le32 (buf + 28, cap_freq * 4);
+    put_le32 (buf + 32, 0x00100004);
+    put_le32 (buf + 40, datalen);
+    fwrite (buf, 44, 1, afile);
+}
+
+/* Scale a color component of a host pixel to 8 bits.  */
+STATIC_INLINE int pixel_component (uae_u32 p, int c)
+{
+    int bits = xcolor_bits[c];
+    uae_u32 v = (p >> xcolor_shift[c]) & ((1 << bits) - 1);
+
+    if (bits >= 8)
+	return v >> (bits - 8);
+    return (v << (8 - bits)) | (v >> (2 * bits - 8 > 0 ? 2 * bits - 8 : 0));
+}
+
+/* Convert one line of host pixels into the Y, U and V planes of PICTURE,
+ * using the ITU-R BT.601 studio range.  */
+static void convert_line (int y, const char *src)
+{
+    int plane = cap_width * cap_height;
+    uae_u8 *py = (uae_u8 *)picture + y * cap_width;
+    uae_u8 *pu = py + plane, *pv = pu + plane;
+    int x;
+
+    for (x = 0; x < cap_width; x++) {
+	uae_u32 p = cap_pixbytes == 2 ? ((uae_u16 *)src)[x] : ((uae_u32 *)src)[x];
+	int r = pixel_component (p, 0);
+	int g = pixel_component (p, 1);
+	int b = pixel_component (p, 2);
+	py[x] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+	pu[x] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+	pv[x] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+static void write_frame (void)
+{
+    if (cap_format == CAPTURE_Y4M) {
+	fputs ("FRAME\n", vfile);
+	fwrite (picture, cap_width * cap_height, 3, vfile);
+    } else
+	fwrite (picture, cap_linebytes, cap_height, vfile);
+    frames_written++;
+}
+
+static void write_vslot (struct capture_vslot *vs)
+{
+    int y;
+
+    for (; frames_written < vs->frame; frames_repeated++)
+	write_frame ();
+
+    for (y = vs->first; y <= vs->last; y++) {
+	const char *src = vs->mem + y * cap_linebytes;
+	if (! vs->dirty[y])
+	    continue;
+	vs->dirty[y] = 0;
+	if (cap_format == CAPTURE_Y4M)
+	    convert_line (y, src);
+	else
+	    memcpy (picture + y * cap_linebytes, src, cap_linebytes);
+    }
+    vs->first = cap_height;
+    vs->last = -1;
+    write_frame ();
+}
+
+static void write_ablock (struct capture_ablock *ab)
+{
+    static const uae_u8 zero[CAPTURE_ABLOCK];
+    unsigned long lost = ab->lost;
+
+    while (lost > 0) {
+	int n = lost > CAPTURE_ABLOCK ? CAPTURE_ABLOCK : lost;
+	fwrite (zero, n, 1, afile);
+	lost -= n;
+    }
+    fwrite (ab->data, ab->len, 1, afile);
+    audio_silence += ab->lost;
+    audio_bytes += ab->lost + ab->len;
+}
+
+/* Write out one queued slot or block.  Returns 0 if nothing was queued.  */
+static int capture_process (void)
+{
+    if (vslots[v_tail].ready) {
+	write_vslot (vslots + v_tail);
+	vslots[v_tail].ready = 0;
+	v_tail = (v_tail + 1) % CAPTURE_VSLOTS;
+#ifdef SUPPORT_THREADS
+	uae_sem_post (&v_free);
+#endif
+	return 1;
+    }
+    if (ablocks[a_tail].ready) {
+	write_ablock (ablocks + a_tail);
+	ablocks[a_tail].ready = 0;
+	a_tail = (a_tail + 1) % CAPTURE_ABLOCKS;
+#ifdef SUPPORT_THREADS
+	uae_sem_post (&a_free);
+#endif
+	return 1;
+    }
+    return 0;
+}
+
+#ifdef SUPPORT_THREADS
+static void *capture_thread (void *dummy)
+{
+    for (;;) {
+	uae_sem_wait (&cap_work);
+	if (! capture_process () && cap_quit)
+	    break;
+    }
+    return 0;
+}
+
+#define capture_trywait(s) (uae_sem_trywait (s) == 0)
+#define capture_kick() uae_sem_post (&cap_work)
+#else
+/* Without threads, the writer runs synchronously and slots are freed as
+ * soon as they are queued.  */
+#define capture_trywait(s) 1
+#define capture_kick() while (capture_process ())
+#endif
+
+void capture_line (int y, const char *src)
+{
+    struct capture_vslot *vs = vslots + v_fill;
+
+    if (y >= cap_height)
+	return;
+    memcpy (vs->mem + y * cap_linebytes, src, cap_linebytes);
+    vs->dirty[y] = 1;
+    if (y < vs->first)
+	vs->first = y;
+    if (y > vs->last)
+	vs->last = y;
+}
+
+void capture_vsync (void)
+{
+    struct capture_vslot *vs = vslots + v_fill;
+
+    if (! capture_video_on) {
+	cap_frame++;
+	return;
+    }
+    if (gfxvidinfo.width != cap_width || gfxvidinfo.height != cap_height
+	|| gfxvidinfo.pixbytes != cap_pixbytes)
+    {
+	write_log ("Capture: display size changed, video capture stopped.\n");
+	capture_video_on = 0;
+	cap_frame++;
+	return;
+    }
+    if (vblank_hz != cap_hz && cap_frame % 250 == 0)
+	write_log ("Capture: vertical frequency is now %d Hz, video is %d Hz.\n", vblank_hz, cap_hz);
+
+    if (vs->first <= vs->last) {
+	if (capture_trywait (&v_free)) {
+	    vs->frame = cap_frame;
+	    vs->ready = 1;
+	    v_fill = (v_fill + 1) % CAPTURE_VSLOTS;
+	    capture_kick ();
+	} else
+	    v_merged++;
+    }
+    cap_frame++;
+}
+
+void capture_audio_flush (void)
+{
+    struct capture_ablock *ab = ablocks + a_fill;
+
+    ab->len = capture_apos;
+    capture_apos = 0;
+    if (capture_trywait (&a_free)) {
+	ab->lost = a_lost;
+	a_lost = 0;
+	ab->ready = 1;
+	a_fill = (a_fill + 1) % CAPTURE_ABLOCKS;
+	capture_abuf = ablocks[a_fill].data;
+	capture_kick ();
+    } else
+	a_lost += ab->len;
+}
+
+static int capture_start_video (void)
+{
+    int size, i;
+
+    cap_width = gfxvidinfo.width;
+    cap_height = gfxvidinfo.height;
+    cap_pixbytes = gfxvidinfo.pixbytes;
+    cap_linebytes = cap_width * cap_pixbytes;
+    cap_format = currprefs.capture_video_format;
+    if (cap_format == CAPTURE_Y4M
+	&& ((cap_pixbytes != 2 && cap_pixbytes != 4) || xcolor_bits[0] == 0))
+    {
+	write_log ("Capture: Y4M needs a 16 or 32 bit truecolor display, writing raw video.\n");
+	cap_format = CAPTURE_RAW;
+    }
+
+    vfile = capture_open (currprefs.capture_video, &vpipe);
+    if (vfile == NULL)
+	return 0;
+
+    size = cap_height * cap_linebytes;
+    for (i = 0; i < CAPTURE_VSLOTS; i++) {
+	vslots[i].mem = (char *)xmalloc (size);
+	vslots[i].dirty = (char *)calloc (cap_height, 1);
+	vslots[i].first = cap_height;
+	vslots[i].last = -1;
+	vslots[i].ready = 0;
+    }
+    if (cap_format == CAPTURE_Y4M) {
+	picture = (char *)xmalloc (cap_width * cap_height * 3);
+	memset (picture, 16, cap_width * cap_height);
+	memset (picture + cap_width * cap_height, 128, cap_width * cap_height * 2);
+	fprintf (vfile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", cap_width, cap_height, cap_hz);
+    } else {
+	picture = (char *)calloc (size, 1);
+	write_log ("Capture: raw video, %dx%d, %d bytes per pixel, %d frames per second.\n",
+		   cap_width, cap_height, cap_pixbytes, cap_hz);
+    }
+    v_fill = v_tail = 0;
+    return 1;
+}
+
+static int capture_start_audio (void)
+{
+    int i;
+
+    if (currprefs.produce_sound < 2) {
+	write_log ("Capture: audio capture needs sound output to be enabled.\n");
+	return 0;
+    }
+    afile = capture_open (currprefs.capture_audio, &apipe);
+    if (afile == NULL)
+	return 0;
+
+    cap_freq = currprefs.sound_freq;
+    /* Patched in capture_stop if the file is seekable.  */
+    write_wav_header (0x7fffffff);
+    for (i = 0; i < CAPTURE_ABLOCKS; i++)
+	ablocks[i].ready = 0;
+    a_fill = a_tail = 0;
+    a_lost = 0;
+    capture_abuf = ablocks[0].data;
+    capture_apos = 0;
+    return 1;
+}
+
+void capture_start (void)
+{
+    capture_video_on = capture_audio_on = 0;
+    if (currprefs.capture_video[0] == '\0' && currprefs.capture_audio[0] == '\0')
+	return;
+
+    cap_frame = v_merged = 0;
+    cap_hz = vblank_hz;
+    frames_written = frames_repeated = audio_bytes = audio_silence = 0;
+
+#ifdef SUPPORT_THREADS
+    uae_sem_init (&v_free, 0, CAPTURE_VSLOTS - 1);
+    uae_sem_init (&a_free, 0, CAPTURE_ABLOCKS - 1);
+    uae_sem_init (&cap_work, 0, 0);
+    cap_quit = 0;
+#endif
+
+    if (currprefs.capture_video[0] != '\0')
+	capture_video_on = capture_start_video ();
+    if (currprefs.capture_audio[0] != '\0')
+	capture_audio_on = capture_start_audio ();
+
+#ifdef SUPPORT_THREADS
+    cap_running = 0;
+    if (capture_video_on || capture_audio_on) {
+	if (uae_start_thread (capture_thread, 0, &cap_tid) == 0)
+	    cap_running = 1;
+	else {
+	    write_log ("Capture: can't start writer thread.\n");
+	    capture_video_on = capture_audio_on = 0;
+	}
+    }
+#endif
+}
+
+void capture_stop (void)
+{
+    int video = vfile != NULL, audio = afile != NULL;
+    int i;
+
+    if (! video && ! audio)
+	return;
+
+    if (capture_audio_on && capture_apos > 0)
+	capture_audio_flush ();
+    capture_video_on = capture_audio_on = 0;
+
+#ifdef SUPPORT_THREADS
+    if (cap_running) {
+	cap_quit = 1;
+	uae_sem_post (&cap_work);
+	uae_wait_thread (cap_tid);
+	cap_running = 0;
+    }
+    uae_sem_destroy (&v_free);
+    uae_sem_destroy (&a_free);
+    uae_sem_destroy (&cap_work);
+#endif
+
+    if (video) {
+	for (; frames_written < cap_frame; frames_repeated++)
+	    write_frame ();
+	write_log ("Capture: %lu video frames, %lu repeated, %lu merged while the writer was busy.\n",
+		   frames_written, frames_repeated, v_merged);
+	capture_close (vfile, vpipe);
+	vfile = NULL;
+	for (i = 0; i < CAPTURE_VSLOTS; i++) {
+	    free (vslots[i].mem);
+	    free (vslots[i].dirty);
+	}
+	free (picture);
+    }
+    if (audio) {
+	struct capture_ablock *ab = ablocks + a_fill;
+	ab->len = 0;
+	ab->lost = a_lost;
+	write_ablock (ab);
+	write_log ("Capture: %lu audio samples (%lu silent), %lu expected for %lu frames.\n",
+		   audio_bytes / 4, audio_silence / 4,
+		   (unsigned long)((double)cap_frame * cap_freq / cap_hz),
+		   cap_frame);
+	if (! apipe && fseek (afile, 0, SEEK_SET) == 0)
+	    write_wav_header (audio_bytes);
+	capture_close (afile, apipe);
+	afile = NULL;
+    }
+}
@@ -43,6 +43,14 @@ static struct cfg_lines opttable[] =
     {"use_debugger", "Enable the debugger?" },
     {"cpu_speed", "can be max, real, or a number between 1 and 20" },
     {"cpu_type", "Can be 68000, 68010, 68020, 68020/68881" },
+    {"cpu_idle_skip", "Skip idle loops up to the next event" },
+    {"cpu_superinsn", "Use the fused handlers for frequent instruction pairs" },
+    {"cpu_thread", "Run the CPU and the chipset on separate threads with cpu_speed=max" },
+    {"cpu_mmu", "Emulate the 68030/68040 MMU" },
+    {"natmem", "Map Amiga RAM at its addresses in a 4 GB host area" },
+    {"mem_hugepages", "Back Amiga RAM with huge pages: none, transparent or explicit" },
+    {"mem_lock", "Lock Amiga RAM into host memory" },
+    {"mem_numa_node", "NUMA node for Amiga RAM and the emulation thread, -1 for any" },
     {"cpu_24bit_addressing", "must be set to 'no' in order for Z3mem or P96mem to work" },
     {"log_illegal_mem", "print illegal memory access by Amiga software?" },
     {"fastmem_size", "Size in megabytes of fast-memory" },
@@ -53,6 +61,7 @@ static struct cfg_lines opttable[] =
     {"z3mem_size", "Size in megabytes of Zorro-III expansion memory" },
     {"gfx_test_speed", "Test graphics speed?" },
     {"framerate", "Print every nth frame" },
+    {"gfx_framerate_auto", "Skip drawing frames when the host can't keep up" },
     {"gfx_width", "Screen width" },
     {"gfx_height", "Screen height" },
     {"gfx_lores", "Treat display as lo-res?" },
@@ -66,12 +75,20 @@ static struct cfg_lines opttable[] =
     {"32bit_blits", "Enable 32 bit blitter emulation" },
     {"immediate_blits", "Perform blits immediately" },
     {"show_leds", "LED display" },
+    {"capture_video", "Record the display to this file, or to '|command'" },
+    {"capture_video_format", "Can be y4m or raw" },
+    {"capture_audio", "Record the sound output to this WAV file, or to '|command'" },
+    {"fork_server", "Serve jobs on this UNIX socket, forking from a booted snapshot" },
+    {"fork_server_state", "State file to restore before serving jobs" },
+    {"fork_server_frames", "Frames to run before serving jobs" },
+    {"metrics_socket", "Serve performance counters on this UNIX socket" },
     {"sound_output", "" },
     {"sound_frequency", "" },
     {"sound_channels", "" },
     {"sound_max_buff", "" },
     {"parallel_on_demand", "" },
     {"serial_on_demand", "" },
+    {"serial_port", "Serial port device, \"pty\", \"tcp:host:port\" or \"tcp-listen:[host:]port\"" },
     {"joyport0", "" },
     {"joyport1", "" },
     {"kickstart_rom_file", "Kickstart ROM image, (C) Copyright Amiga, Inc." },
@@ -81,6 +98,7 @@ static struct cfg_lines opttable[] =
     {"floppy1", "Diskfile for drive 1" },
     {"floppy2", "Diskfile for drive 2" },
     {"floppy3", "Diskfile for drive 3" },
+    {"floppy_turbo", "Complete floppy DMA transfers instantly" },
     {"hardfile", "access,sectors, surfaces, reserved, blocksize, path format" },
     {"filesystem", "access,'Amiga volume-name':'host directory path' - where 'access' can be 'read-only' or 'read-write'" }
 };
@@ -123,7 +141,9 @@ static const char *interpolmode[] = { "none", "sinc", "anti", 0 };
 static const char *soundfiltermode1[] = { "off", "emulated", "on", 0 };
 static const char *soundfiltermode2[] = { "standard", "enhanced", 0 };
 static const char *collmode[] = { "none", "sprites", "playfields", "full", 0 };
+static const char *capturemode[] = { "y4m", "raw", 0 };
 static const char *idemode[] = { "none", "a600/a1200", "a4000", 0 };
+static const char *hugepagesmode[] = { "none", "transparent", "explicit", 0 };
 
 static const char *obsolete[] = {
     "accuracy", "gfx_opengl", "gfx_32bit_blits", "32bit_blits",
@@ -206,6 +226,7 @@ void save_options (FILE *f, const struct uae_prefs *p)
     str = cfgfile_subst_path (p->path_rom, UNEXPANDED, p->keyfile);
     cfgfile_write (f, "kickstart_key_file=%s\n", str);
     free (str);
+    cfgfile_write (f, "rom_index_file=%s\n", p->romindexfile);
     cfgfile_write (f, "kickshifter=%s\n", p->kickshifter ? "true" : "false");
 
     for (i = 0; i < 4; i++) {
@@ -215,8 +236,10 @@ void save_options (FILE *f, const struct uae_prefs *p)
 	cfgfile_write (f, "floppy%dtype=%d\n", i, p->dfxtype[i]);
     }
     cfgfile_write (f, "nr_floppies=%d\n", p->nr_floppies);
+    cfgfile_write (f, "floppy_turbo=%s\n", p->floppy_turbo ? "true" : "false");
     cfgfile_write (f, "parallel_on_demand=%s\n", p->parallel_demand ? "true" : "false");
     cfgfile_write (f, "serial_on_demand=%s\n", p->serial_demand ? "true" : "false");
+    cfgfile_write (f, "serial_port=%s\n", p->use_serial ? p->sername : "none");
 
     cfgfile_write (f, "sound_output=%s\n", soundmode[p->produce_sound]);
     cfgfile_write (f, "sound_channels=%s\n", stereomode[p->sound_stereo]);
@@ -247,11 +270,19 @@ void save_options (FILE *f, const struct uae_prefs *p)
     cfgfile_write (f, "bsdsocket_emu=%s\n", p->socket_emu ? "true" : "false");
 
     cfgfile_write (f, "gfx_framerate=%d\n", p->gfx_framerate);
+    cfgfile_write (f, "gfx_framerate_auto=%s\n", p->gfx_framerate_auto ? "true" : "false");
     write_gfx_params (f, &p->gfx_w, "windowed");
     write_gfx_params (f, &p->gfx_f, "fullscreen");
     cfgfile_write (f, "gfx_fullscreen_amiga=%s\n", p->gfx_afullscreen ? "true" : "false");
     cfgfile_write (f, "gfx_fullscreen_picasso=%s\n", p->gfx_pfullscreen ? "true" : "false");
     cfgfile_write (f, "gfx_colour_mode=%s\n", colormode1[p->color_mode]);
+    cfgfile_write (f, "capture_video=%s\n", p->capture_video);
+    cfgfile_write (f, "capture_video_format=%s\n", capturemode[p->capture_video_format]);
+    cfgfile_write (f, "capture_audio=%s\n", p->capture_audio);
+    cfgfile_write (f, "fork_server=%s\n", p->fork_server);
+    cfgfile_write (f, "fork_server_state=%s\n", p->fork_server_state);
+    cfgfile_write (f, "fork_server_frames=%d\n", p->fork_server_frames);
+    cfgfile_write (f, "metrics_socket=%s\n", p->metrics_socket);
 
     cfgfile_write (f, "immediate_blits=%s\n", p->immediate_blits ? "true" : "false");
     cfgfile_write (f, "ntsc=%s\n", p->ntscmode ? "true" : "false");
@@ -290,6 +321,14 @@ void save_options (FILE *f, const struct uae_prefs *p)
 	    cfgfile_write (f, "cpu_type=%s\n", cpumode[i]);
 	    break;
 	}
+    cfgfile_write (f, "cpu_idle_skip=%s\n", p->cpu_idle_skip ? "true" : "false");
+    cfgfile_write (f, "cpu_superinsn=%s\n", p->cpu_superinsn ? "true" : "false");
+    cfgfile_write (f, "cpu_thread=%s\n", p->cpu_thread ? "true" : "false");
+    cfgfile_write (f, "cpu_mmu=%s\n", p->cpu_mmu ? "true" : "false");
+    cfgfile_write (f, "natmem=%s\n", p->natmem ? "true" : "false");
+    cfgfile_write (f, "mem_hugepages=%s\n", hugepagesmode[p->mem_hugepages]);
+    cfgfile_write (f, "mem_lock=%s\n", p->mem_lock ? "true" : "false");
+    cfgfile_write (f, "mem_numa_node=%d\n", p->mem_numa_node);
 
     cfgfile_write (f, "log_illegal_mem=%s\n", p->illegal_mem ? "true" : "false");
 
@@ -498,7 +537,9 @@ static int cfgfile_parse_host (struct uae_prefs *p, char *option, char *value)
 	|| cfgfile_intval (option, value, "sound_stereo_separation", &p->sound_stereo_separation, 1)
 	|| cfgfile_intval (option, value, "sound_stereo_mixing_delay", &p->sound_mixed_stereo_delay, 1)
 
+	|| cfgfile_intval (option, value, "fork_server_frames", &p->fork_server_frames, 1)
 	|| cfgfile_intval (option, value, "gfx_framerate", &p->gfx_framerate, 1)
+	|| cfgfile_yesno (option, value, "gfx_framerate_auto", &p->gfx_framerate_auto)
 	|| (cfgfile_intval (option, value, "gfx_width", &p->gfx_w.width, 1)
 	    && cfgfile_intval (option, value, "gfx_width", &p->gfx_f.width, 1))
 	|| cfgfile_intval (option, value, "gfx_width_windowed", &p->gfx_w.width, 1)
@@ -542,7 +583,8 @@ static int cfgfile_parse_host (struct uae_prefs *p, char *option, char *value)
 	|| cfgfile_strval (option, value, "gfx_colour_mode", &p->color_mode, colormode1, 1)
 	|| cfgfile_strval (option, value, "gfx_colour_mode", &p->color_mode, colormode2, 0)
 	|| cfgfile_strval (option, value, "gfx_color_mode", &p->color_mode, colormode1, 1)
-	|| cfgfile_strval (option, value, "gfx_color_mode", &p->color_mode, colormode2, 0))
+	|| cfgfile_strval (option, value, "gfx_color_mode", &p->color_mode, colormode2, 0)
+	|| cfgfile_strval (option, value, "capture_video_format", &p->capture_video_format, capturemode, 0))
 	return 1;
 
     if (strcmp (option, "joyport0") == 0 || strcmp (option, "joyport1") == 0) {
@@ -577,7 +619,12 @@ static int cfgfile_parse_host (struct uae_prefs *p, char *option, char *value)
     }
 
     if (cfgfile_string (option, value, "config_description", p->description, 256)
-	|| cfgfile_string (option, value, "config_sortstr", p->sortstr, 256))
+	|| cfgfile_string (option, value, "config_sortstr", p->sortstr, 256)
+	|| cfgfile_string (option, value, "capture_video", p->capture_video, 256)
+	|| cfgfile_string (option, value, "capture_audio", p->capture_audio, 256)
+	|| cfgfile_string (option, value, "fork_server", p->fork_server, 256)
+	|| cfgfile_string (option, value, "fork_server_state", p->fork_server_state, 256)
+	|| cfgfile_string (option, value, "metrics_socket", p->metrics_socket, 256))
 	return 1;
 
     /* Tricky ones... */
@@ -762,14 +809,22 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, char *option, char *valu
     if (cfgfile_yesno (option, value, "immediate_blits", &p->immediate_blits)
 	|| cfgfile_yesno (option, value, "a1000ram", &p->cs_a1000ram)
 	|| cfgfile_yesno (option, value, "kickshifter", &p->kickshifter)
+	|| cfgfile_yesno (option, value, "floppy_turbo", &p->floppy_turbo)
 	|| cfgfile_yesno (option, value, "ntsc", &p->ntscmode)
 	|| cfgfile_yesno (option, value, "cpu_24bit_addressing", &p->address_space_24)
+	|| cfgfile_yesno (option, value, "cpu_idle_skip", &p->cpu_idle_skip)
+	|| cfgfile_yesno (option, value, "cpu_superinsn", &p->cpu_superinsn)
+	|| cfgfile_yesno (option, value, "cpu_thread", &p->cpu_thread)
+	|| cfgfile_yesno (option, value, "cpu_mmu", &p->cpu_mmu)
+	|| cfgfile_yesno (option, value, "natmem", &p->natmem)
+	|| cfgfile_yesno (option, value, "mem_lock", &p->mem_lock)
 	|| cfgfile_yesno (option, value, "parallel_on_demand", &p->parallel_demand)
 	|| cfgfile_yesno (option, value, "serial_on_demand", &p->serial_demand))
 	return 1;
     
     if (cfgfile_intval (option, value, "fatgary", &p->cs_fatgaryrev, 1)
 	|| cfgfile_intval (option, value, "ramsey", &p->cs_ramseyrev, 1)
+	|| cfgfile_intval (option, value, "mem_numa_node", &p->mem_numa_node, 1)
 	|| cfgfile_uintval (option, value, "fastmem_size", &p->fastmem_size, 0x100000)
 	|| cfgfile_uintval (option, value, "a3000mem_size", &p->mbresmem_low_size, 0x100000)
 	|| cfgfile_uintval (option, value, "mbresmem_size", &p->mbresmem_high_size, 0x100000)
@@ -804,7 +859,8 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, char *option, char *valu
     }
     
     if (cfgfile_strval (option, value, "ide", &p->cs_ide, idemode, 0)
-	|| cfgfile_strval (option, value, "collision_level", &p->collision_level, collmode, 0))
+	|| cfgfile_strval (option, value, "collision_level", &p->collision_level, collmode, 0)
+	|| cfgfile_strval (option, value, "mem_hugepages", &p->mem_hugepages, hugepagesmode, 0))
 	return 1;
 
     if (cfgfile_string (option, value, "floppy0", p->df[0], 256)
@@ -813,9 +869,15 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, char *option, char *valu
 	|| cfgfile_string (option, value, "floppy3", p->df[3], 256)
 	|| cfgfile_string (option, value, "kickstart_rom_file", p->romfile, 256)
 	|| cfgfile_string (option, value, "kickstart_ext_rom_file", p->romextfile, 256)
-	|| cfgfile_string (option, value, "kickstart_key_file", p->keyfile, 256))
+	|| cfgfile_string (option, value, "kickstart_key_file", p->keyfile, 256)
+	|| cfgfile_string (option, value, "rom_index_file", p->romindexfile, 256))
 	return 1;
 
+    if (cfgfile_string (option, value, "serial_port", p->sername, 256)) {
+	p->use_serial = p->sername[0] != '\0' && strcmp (p->sername, "none") != 0;
+	return 1;
+    }
+
     if (cfgfile_strval (option, value, "chipset", &tmpval, csmode, 0)) {
 	set_chipset_mask (p, tmpval);
 	return 1;
@@ -25,6 +25,7 @@
 #include "gui.h"
 #include "savestate.h"
 #include "audio.h"
+#include "cputhread.h"
 
 #define DIV10 (5*CYCLE_UNIT) /* Yes, a bad identifier. */
 
@@ -55,6 +56,13 @@ static unsigned long ciaata, ciaatb, ciabta, ciabtb;
 static unsigned long ciaata_passed, ciaatb_passed, ciabta_passed, ciabtb_passed;
 
 static unsigned long ciaatod, ciabtod, ciaatol, ciabtol, ciaaalarm, ciabalarm;
+/* The CIA B TOD counts horizontal syncs.  Rather than incrementing it on
+   every line, ciabtod holds its value at line ciabtod_line, the current
+   value is worked out when it is read, and cia_hsync_due is set to the line
+   on which the alarm will next match.  */
+static unsigned long ciabtod_line;
+static int ciabtod_armed;
+unsigned long cia_hsyncs, cia_hsync_due;
 static int ciaatlatch, ciabtlatch;
 static int oldled, oldovl;
 
@@ -302,12 +310,42 @@ static int checkalarm (unsigned long tod, unsigned long alarm, int inc)
     return 0;
 }
 
-STATIC_INLINE void ciab_checkalarm (int inc)
+static unsigned long ciab_gettod (void)
 {
-    if (checkalarm (ciabtod, ciabalarm, inc)) {
-	ciabicr |= 4;
-	RethinkICRB ();
+    if (!ciabtodon)
+	return ciabtod;
+    return (ciabtod + cia_hsyncs - ciabtod_line) & 0xFFFFFF;
+}
+
+/* Work out how many lines from now checkalarm () will first succeed.  */
+static void ciab_schedulealarm (void)
+{
+    unsigned long lines;
+
+    ciabtod_armed = 1;
+    if (!ciabtodon) {
+	/* A stopped TOD that equals the alarm keeps raising it.  */
+	if (ciabtod != ciabalarm) {
+	    ciabtod_armed = 0;
+	    return;
+	}
+	lines = 1;
+    } else {
+	lines = (ciabalarm - ciabtod - 1) & 0xFFFFFF;
+	/* The buggy TODMED also triggers the alarm one step later.  */
+	if ((ciabalarm & 0xfff) == 0 && ((ciabalarm + 0x1000 - ciabtod - 1) & 0xFFFFFF) < lines)
+	    lines = (ciabalarm + 0x1000 - ciabtod - 1) & 0xFFFFFF;
+	lines++;
     }
+    cia_hsync_due = ciabtod_line + lines;
+}
+
+static void ciab_settod (unsigned long tod, int on)
+{
+    ciabtod = tod & 0xFFFFFF;
+    ciabtod_line = cia_hsyncs;
+    ciabtodon = on;
+    ciab_schedulealarm ();
 }
 
 STATIC_INLINE void ciaa_checkalarm (int inc)
@@ -322,19 +360,14 @@ void CIA_hsync_handler (void)
 {
     static unsigned int keytime = 0, sleepyhead = 0;
 
-    if (ciabtodon) {
-	ciabtod++;
-	ciabtod &= 0xFFFFFF;
-	ciab_checkalarm (1);
-    }
-
-    if (ciabtod == ciabalarm) {
+    if (ciabtod_armed && cia_hsyncs == cia_hsync_due) {
+	ciab_settod (ciab_gettod (), ciabtodon);
 	ciabicr |= 4; RethinkICRB ();
     }
 
     /* check wether the serial port gets some data */
-    if (doreadser)
-	doreadser = SERDATS();
+    if (currprefs.use_serial)
+	serial_hsync ();
 
     if (keys_available() && kback && (ciaacra & 0x40) == 0 && (++keytime & 15) == 0) {
 	/*
@@ -383,7 +416,6 @@ void CIA_vsync_handler ()
 	ciaa_checkalarm (1);
     }
 
-    doreadser = 1;
     serstat = -1;
     serial_flush_buffer();
 }
@@ -424,7 +456,7 @@ static uae_u8 ReadCIAA (unsigned int addr)
     switch (addr & 0xf) {
     case 0:
 	if (currprefs.use_serial && (serstat < 0)) /* Only read status when needed */
-	    serstat=serial_readstatus();		/* and only once per frame */
+	    serstat=serial_readstatus(&ciabpra);		/* and only once per frame */
 
 	tmp = (DISK_status() & 0x3C);
 	tmp |= handle_joystick_buttons (ciaadra);
@@ -489,7 +521,7 @@ static uae_u8 ReadCIAB (unsigned int addr)
     switch (addr & 0xf) {
     case 0:
 	if (currprefs.use_serial && serstat < 0) /* Only read status when needed */
-	    serstat=serial_readstatus();	 /* and only once per frame      */
+	    serstat=serial_readstatus(&ciabpra);	 /* and only once per frame      */
 	/* Returning some 1 bits is necessary for Tie Break - otherwise its joystick
 	   code won't work.  */
 	return ciabpra | (prtopen ? 0 : 3);
@@ -512,15 +544,15 @@ static uae_u8 ReadCIAB (unsigned int addr)
 	    ciabtlatch = 0;
 	    return ciabtol & 0xff;
 	} else
-	    return ciabtod & 0xff;
+	    return ciab_gettod () & 0xff;
     case 9:
 	if (ciabtlatch)
 	    return (ciabtol >> 8) & 0xff;
 	else
-	    return (ciabtod >> 8) & 0xff;
+	    return (ciab_gettod () >> 8) & 0xff;
     case 10:
 	ciabtlatch = 1;
-	ciabtol = ciabtod;
+	ciabtol = ciab_gettod ();
 	return (ciabtol >> 16) & 0xff;
     case 12:
 	return ciabsdr;
@@ -722,25 +754,25 @@ static void WriteCIAB (uae_u16 addr, uae_u8 val)
     case 8:
 	if (ciabcrb & 0x80) {
 	    ciabalarm = (ciabalarm & ~0xff) | val;
+	    ciab_settod (ciab_gettod (), ciabtodon);
 	} else {
-	    ciabtod = (ciabtod & ~0xff) | val;
-	    ciabtodon = 1;
+	    ciab_settod ((ciab_gettod () & ~0xff) | val, 1);
 	}
 	break;
     case 9:
 	if (ciabcrb & 0x80) {
 	    ciabalarm = (ciabalarm & ~0xff00) | (val << 8);
+	    ciab_settod (ciab_gettod (), ciabtodon);
 	} else {
-	    ciabtod = (ciabtod & ~0xff00) | (val << 8);
-	    ciabtodon = 0;
+	    ciab_settod ((ciab_gettod () & ~0xff00) | (val << 8), 0);
 	}
 	break;
     case 10:
 	if (ciabcrb & 0x80) {
 	    ciabalarm = (ciabalarm & ~0xff0000) | (val << 16);
+	    ciab_settod (ciab_gettod (), ciabtodon);
 	} else {
-	    ciabtod = (ciabtod & ~0xff0000) | (val << 16);
-	    ciabtodon = 0;
+	    ciab_settod ((ciab_gettod () & ~0xff0000) | (val << 16), 0);
 	}
 	break;
     case 12:
@@ -780,7 +812,8 @@ void CIA_reset (void)
     if (!savestate_state) {
 	ciaatlatch = ciabtlatch = 0;
 	ciaapra = 3;
-	ciaatod = ciabtod = 0; ciaatodon = ciabtodon = 0;
+	ciaatod = 0; ciaatodon = 0;
+	ciab_settod (0, 0);
 	ciaaicr = ciabicr = ciaaimask = ciabimask = 0;
 	ciaacra = ciaacrb = ciabcra = ciabcrb = 0x4; /* outmode = toggle; */
 	ciaala = ciaalb = ciabla = ciablb = ciaata = ciaatb = ciabta = ciabtb = 0xFFFF;
@@ -809,7 +842,7 @@ void dumpcia (void)
 	   (int)ciaacra, (int)ciaacrb, (int)ciaaimask, ciaatod,
 	   ciaatlatch ? "L" : "", ciaata, ciaala, ciaatb, ciaalb);
     printf("B: CRA: %02x, CRB: %02x, IMASK: %02x, TOD: %08lx %7s TA: %04lx (%04lx), TB: %04lx (%04lx)\n",
-	   (int)ciabcra, (int)ciabcrb, (int)ciabimask, ciabtod,
+	   (int)ciabcra, (int)ciabcrb, (int)ciabimask, ciab_gettod (),
 	   ciabtlatch ? "L" : "", ciabta, ciabla, ciabtb, ciablb);
 }
 
@@ -825,13 +858,19 @@ static void cia_bput (uaecptr, uae_u32) REGPARAM;
 addrbank cia_bank = {
     cia_lget, cia_wget, cia_bget,
     cia_lput, cia_wput, cia_bput,
-    default_xlate, default_check, NULL, "CIA"
+    default_xlate, default_check, NULL, "CIA",
+    0
 };
 
 static void cia_wait (void)
 {
     if (!div10)
 	return;
+    /* Chipset events belong to the chipset thread.  */
+    if (cputhread_running) {
+	cputhread_do_cycles (DIV10 - div10 + CYCLE_UNIT);
+	return;
+    }
     do_cycles (DIV10 - div10 + CYCLE_UNIT);
     CIA_handler ();
 }
@@ -935,7 +974,8 @@ static void clock_bput (uaecptr, uae_u32) REGPARAM;
 addrbank clock_bank = {
     clock_lget, clock_wget, clock_bget,
     clock_lput, clock_wput, clock_bput,
-    default_xlate, default_check, NULL, "Battery backed up clock"
+    default_xlate, default_check, NULL, "Battery backed up clock",
+    0
 };
 
 uae_u32 REGPARAM2 clock_lget (uaecptr addr)
@@ -1052,6 +1092,7 @@ const uae_u8 *restore_cia (int num, const uae_u8 *src)
     b = restore_u8 ();
     if (num) ciabtlatch = b & 1; else ciaatlatch = b & 1;	/* is TOD latched? */
     if (num) ciabtodon = b & 2; else ciaatodon = b & 2;		/* is TOD stopped? */
+    if (num) ciab_settod (ciabtod, ciabtodon);
     if (num) {
 	div10 = CYCLE_UNIT * restore_u8 ();
     }
@@ -1084,11 +1125,11 @@ uae_u8 *save_cia (int num, int *len, uae_u8 *dstptr)
     save_u16 (t);
     t = (num ? ciabtb - ciabtb_passed : ciaatb - ciaatb_passed);/* 8 TB */
     save_u16 (t);
-    b = (num ? ciabtod : ciaatod);			/* 8 TODL */
+    b = (num ? ciab_gettod () : ciaatod);		/* 8 TODL */
     save_u8 (b);
-    b = (num ? ciabtod >> 8 : ciaatod >> 8);		/* 9 TODM */
+    b = (num ? ciab_gettod () >> 8 : ciaatod >> 8);	/* 9 TODM */
     save_u8 (b);
-    b = (num ? ciabtod >> 16 : ciaatod >> 16);		/* A TODH */
+    b = (num ? ciab_gettod () >> 16 : ciaatod >> 16);	/* A TODH */
     save_u8 (b);
     save_u8 (0);						/* B unused */
     b = num ? ciabsdr : ciaasdr;				/* C SDR */
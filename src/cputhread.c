@@ -0,0 +1,379 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Separate CPU and chipset threads
+  *
+  * cputhread_run starts the CPU loop on a new thread and runs the chipset
+  * on the calling thread until the CPU loop returns.  The chipset goes
+  * ahead a chunk at a time, never past the next hsync and never past the
+  * CPU's clock, and holds the chipset lock while it does.  While the CPU
+  * is halted by STOP, the chipset runs freely until an interrupt is due.
+  *
+  * Before the hsync that ends a frame, the chipset waits for the frame
+  * rate hack's deadline and then parks the CPU at an instruction boundary,
+  * so that vsync_handler - which saves state, applies changed prefs and
+  * talks to the GUI - sees the CPU standing still.
+  *
+  * Every thread that goes through the banks keeps its own count of the
+  * chipset lock: the CPU thread, and the filesystem and bsdsocket threads,
+  * which reach chip memory on their own.  An extended trap thread runs
+  * between a calltrap, which takes the lock on the CPU thread, and the
+  * matching return to 68k code, so it uses the lock the CPU thread holds
+  * for it.  The chipset thread itself goes through the banks without
+  * locking.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <sched.h>
+
+#include "options.h"
+#include "threaddep/thread.h"
+#include "uae.h"
+#include "memory.h"
+#include "custom.h"
+#include "events.h"
+#include "newcpu.h"
+#include "debug.h"
+#include "cputhread.h"
+
+volatile int cputhread_running;
+volatile unsigned long cputhread_cpu_clock, cputhread_chip_clock;
+unsigned long cputhread_lead;
+
+int cputhread_usable (void)
+{
+    static const char *last_why = "";
+    const char *why = 0;
+
+    if (! currprefs.cpu_thread)
+	return 0;
+#ifndef SUPPORT_THREADS
+    why = "this version has no thread support";
+#else
+    if (currprefs.m68k_speed != -1)
+	why = "cpu_speed isn't max";
+    else if (currprefs.cpu_model < 68020)
+	why = "it needs a 68020 or better";
+    else if (currprefs.cpu_mmu)
+	why = "cpu_mmu is set";
+    else if (natmem_offset)
+	why = "natmem is on";
+    else if (currprefs.fork_server[0] != '\0')
+	why = "the fork server forks from the main thread";
+    else if (debugging)
+	why = "the debugger is active";
+#endif
+    if (why != last_why) {
+	if (why)
+	    write_log ("CPU thread: not used, %s.\n", why);
+	else
+	    write_log ("CPU thread: running the CPU on its own thread.\n");
+	last_why = why;
+    }
+    return why == 0;
+}
+
+#ifdef SUPPORT_THREADS
+
+static uae_sem_t chipset_sem, cpu_ack, cpu_resume;
+static uae_wakeup_t cpu_wake;
+static int cpu_wake_initialized;
+static __thread int lock_depth;
+/* The chipset thread holds the lock whenever it runs emulation code, which
+   may well read Amiga memory through the banks.  */
+static __thread int on_chipset_thread;
+static __thread int on_trap_thread;
+static volatile int chipset_wants_lock, cpu_wants_lock;
+static volatile int cpu_done, cpu_idle;
+static void (*run_cpu_loop) (void);
+
+static addrbank *real_banks[65536];
+
+void cputhread_trap_thread (void)
+{
+    on_trap_thread = 1;
+}
+
+void cputhread_lock (void)
+{
+    if (! cputhread_running || on_chipset_thread || on_trap_thread
+	|| lock_depth++ > 0)
+	return;
+    /* Semaphores aren't fair; let the chipset in first if it's waiting.  */
+    while (chipset_wants_lock)
+	sched_yield ();
+    cpu_wants_lock = 1;
+    uae_sem_wait (&chipset_sem);
+    cpu_wants_lock = 0;
+}
+
+void cputhread_unlock (void)
+{
+    if (! cputhread_running || on_chipset_thread || on_trap_thread
+	|| --lock_depth > 0)
+	return;
+    uae_sem_post (&chipset_sem);
+}
+
+static void chipset_lock (void)
+{
+    chipset_wants_lock = 1;
+    uae_sem_wait (&chipset_sem);
+    chipset_wants_lock = 0;
+}
+
+static void chipset_unlock (void)
+{
+    uae_sem_post (&chipset_sem);
+    if (cpu_wants_lock)
+	sched_yield ();
+}
+
+/* Called by the CPU thread when it sees SPCFLAG_PARK.  */
+void cputhread_park (void)
+{
+    unset_special (SPCFLAG_PARK);
+    uae_sem_post (&cpu_ack);
+    uae_sem_wait (&cpu_resume);
+}
+
+/* Returns 0 if the CPU loop has ended instead.  */
+static int park_cpu (void)
+{
+    if (cpu_done)
+	return 0;
+    set_special (SPCFLAG_PARK);
+    uae_wakeup_post (&cpu_wake);
+    uae_sem_wait (&cpu_ack);
+    if (cpu_done) {
+	unset_special (SPCFLAG_PARK);
+	return 0;
+    }
+    return 1;
+}
+
+/* Called by the CPU thread while it is halted by STOP, without the lock.  */
+void cputhread_stopped (void)
+{
+    cpu_idle = 1;
+    while (! (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT | SPCFLAG_BRK
+			       | SPCFLAG_MODE_CHANGE | SPCFLAG_PARK)))
+	uae_wakeup_wait (&cpu_wake, 1000);
+    cpu_idle = 0;
+    /* Idle time isn't made up for.  */
+    cputhread_cpu_clock = cputhread_chip_clock;
+}
+
+/* Memory banks the CPU may use without the lock.  Gfx card memory is left
+   out because the Picasso96 code treats it as a device.  */
+static int bank_is_private (addrbank *b)
+{
+    if (b->flags & ABFLAG_ROM)
+	return 1;
+    return (b->flags & ABFLAG_RAM) && b != &chipmem_bank;
+}
+
+#define SYNC_GET(name, func) \
+static uae_u32 name (uaecptr) REGPARAM; \
+static uae_u32 REGPARAM2 name (uaecptr addr) \
+{ \
+    uae_u32 v; \
+    cputhread_lock (); \
+    v = real_banks[bankindex (addr)]->func (addr); \
+    cputhread_unlock (); \
+    return v; \
+}
+
+#define SYNC_PUT(name, func) \
+static void name (uaecptr, uae_u32) REGPARAM; \
+static void REGPARAM2 name (uaecptr addr, uae_u32 v) \
+{ \
+    cputhread_lock (); \
+    real_banks[bankindex (addr)]->func (addr, v); \
+    cputhread_unlock (); \
+}
+
+SYNC_GET (sync_lget, lget)
+SYNC_GET (sync_wget, wget)
+SYNC_GET (sync_bget, bget)
+SYNC_PUT (sync_lput, lput)
+SYNC_PUT (sync_wput, wput)
+SYNC_PUT (sync_bput, bput)
+
+static uae_u8 *sync_xlate (uaecptr) REGPARAM;
+static int sync_check (uaecptr, uae_u32) REGPARAM;
+
+static uae_u8 REGPARAM2 *sync_xlate (uaecptr addr)
+{
+    return real_banks[bankindex (addr)]->xlateaddr (addr);
+}
+
+static int REGPARAM2 sync_check (uaecptr addr, uae_u32 size)
+{
+    return real_banks[bankindex (addr)]->check (addr, size);
+}
+
+static addrbank sync_bank = {
+    sync_lget, sync_wget, sync_bget,
+    sync_lput, sync_wput, sync_bput,
+    sync_xlate, sync_check, NULL, "Chipset lock",
+    0
+};
+
+/* Called by map_banks while the CPU thread runs, and when it starts.  */
+void cputhread_notice_banks (void)
+{
+    int i;
+
+    for (i = 0; i < 65536; i++) {
+	addrbank *b = mem_banks[i];
+	if (b == &sync_bank)
+	    continue;
+	real_banks[i] = b;
+	if (! bank_is_private (b))
+	    mem_banks[i] = &sync_bank;
+    }
+}
+
+static void restore_banks (void)
+{
+    int i;
+
+    for (i = 0; i < 65536; i++)
+	if (mem_banks[i] == &sync_bank)
+	    mem_banks[i] = real_banks[i];
+}
+
+static void *cpu_thread (void *arg)
+{
+    (*run_cpu_loop) ();
+    cpu_done = 1;
+    uae_sem_post (&cpu_ack);
+    return 0;
+}
+
+/* The frame rate hack's deadline, as in do_cycles_stopped.  The CPU keeps
+   running meanwhile; its clock stops at the lead.  */
+static void chipset_pace (void)
+{
+    if (! is_lastline)
+	return;
+    if ((long int)(get_current_time (0) - vsyncmintime) < 0) {
+	if (idle_sleep (vsyncmintime))
+	    vsyncmintime = get_current_time (0);
+    }
+    /* Make do_cycles look at the time right away.  */
+    gtod_counter = nr_gtod_to_skip;
+}
+
+static void chipset_step (void)
+{
+    unsigned long step, n;
+    long int room;
+    int parked = 0;
+
+    for (;;) {
+	chipset_lock ();
+	room = (long int)(cputhread_cpu_clock - get_cycles ());
+	if (room <= 0 && ! cpu_idle && ! parked) {
+	    chipset_unlock ();
+	    sched_yield ();
+	    return;
+	}
+	step = eventtab[ev_hsync].evtime - get_cycles ();
+	if (room > 0 && (unsigned long)room < step && ! cpu_idle && ! parked)
+	    step = room;
+	else if (vpos + 1 >= maxvpos && ! parked) {
+	    /* This step includes the vsync.  */
+	    chipset_unlock ();
+	    chipset_pace ();
+	    if (! park_cpu ())
+		return;
+	    parked = 1;
+	    continue;
+	}
+	break;
+    }
+
+    while (step > 0) {
+	n = nextevent - get_cycles ();
+	if ((regs.spcflags & SPCFLAG_COPPER) && n > 4 * CYCLE_UNIT)
+	    n = 4 * CYCLE_UNIT;
+	if (n > step)
+	    n = step;
+	do_cycles (n);
+	step -= n;
+	if (regs.spcflags & SPCFLAG_COPPER)
+	    do_copper ();
+    }
+    cputhread_chip_clock = get_cycles ();
+    chipset_unlock ();
+
+    if (parked)
+	uae_sem_post (&cpu_resume);
+    if (cpu_idle && (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT | SPCFLAG_BRK
+				      | SPCFLAG_MODE_CHANGE)))
+	uae_wakeup_post (&cpu_wake);
+}
+
+/* Returns 0 if the thread couldn't be started.  */
+int cputhread_run (void (*cpu_loop) (void))
+{
+    uae_thread_id tid;
+
+    if (! cpu_wake_initialized) {
+	uae_wakeup_init (&cpu_wake);
+	cpu_wake_initialized = 1;
+    }
+    uae_sem_init (&chipset_sem, 0, 1);
+    uae_sem_init (&cpu_ack, 0, 0);
+    uae_sem_init (&cpu_resume, 0, 0);
+    unset_special (SPCFLAG_PARK);
+    cpu_done = cpu_idle = 0;
+    chipset_wants_lock = cpu_wants_lock = 0;
+    cputhread_lead = maxhpos * CYCLE_UNIT;
+    cputhread_chip_clock = cputhread_cpu_clock = get_cycles ();
+    run_cpu_loop = cpu_loop;
+
+    cputhread_notice_banks ();
+    cputhread_running = 1;
+    if (uae_start_thread (cpu_thread, 0, &tid) != 0) {
+	write_log ("CPU thread: can't start a thread.\n");
+	cputhread_running = 0;
+	restore_banks ();
+	return 0;
+    }
+
+    on_chipset_thread = 1;
+    while (! cpu_done)
+	chipset_step ();
+    on_chipset_thread = 0;
+
+    uae_wait_thread (tid);
+    while (uae_sem_trywait (&cpu_ack) == 0)
+	;
+    cputhread_running = 0;
+    restore_banks ();
+    uae_sem_destroy (&chipset_sem);
+    uae_sem_destroy (&cpu_ack);
+    uae_sem_destroy (&cpu_resume);
+    return 1;
+}
+
+#else
+
+void cputhread_trap_thread (void) { }
+void cputhread_lock (void) { }
+void cputhread_unlock (void) { }
+void cputhread_park (void) { }
+void cputhread_stopped (void) { }
+void cputhread_notice_banks (void) { }
+
+int cputhread_run (void (*cpu_loop) (void))
+{
+    return 0;
+}
+
+#endif
@@ -13,33 +13,181 @@
 
 #include "crc32.h"
 
-static unsigned long crc_table32[256];
+#if defined __GNUC__ && defined __x86_64__
+#define X86_HASH_INSNS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/* crc_table32[0] is the usual byte-at-a-time table; tables 1..7 let
+   get_crc32 fold in eight bytes per step ("slice-by-8").  */
+static uae_u32 crc_table32[8][256];
 static unsigned short crc_table16[256];
 static void make_crc_table()
 {
-    unsigned long c;
+    uae_u32 c;
     unsigned short w;
     int n, k;
     for (n = 0; n < 256; n++) {
-	c = (unsigned long)n;
+	c = (uae_u32)n;
 	w = n << 8;
 	for (k = 0; k < 8; k++) {
 	    c = (c >> 1) ^ (c & 1 ? 0xedb88320 : 0);
 	    w = (w << 1) ^ ((w & 0x8000) ? 0x1021 : 0);
 	}
-	crc_table32[n] = c;
+	crc_table32[0][n] = c;
 	crc_table16[n] = w;
     }
+    for (n = 0; n < 256; n++) {
+	c = crc_table32[0][n];
+	for (k = 1; k < 8; k++) {
+	    c = crc_table32[0][c & 0xff] ^ (c >> 8);
+	    crc_table32[k][n] = c;
+	}
+    }
+}
+
+#ifdef X86_HASH_INSNS
+
+static int have_pclmul, have_sha;
+
+static void check_hash_insns (void)
+{
+    unsigned int a, b, c, d;
+
+    have_pclmul = have_sha = 0;
+    if (! __get_cpuid (1, &a, &b, &c, &d))
+	return;
+    /* PCLMULQDQ, SSSE3 and SSE4.1.  */
+    if ((c & bit_PCLMUL) && (c & bit_SSSE3) && (c & bit_SSE4_1)) {
+	have_pclmul = 1;
+	if (__get_cpuid_max (0, 0) >= 7) {
+	    __cpuid_count (7, 0, a, b, c, d);
+	    have_sha = (b & (1 << 29)) != 0;
+	}
+    }
+}
+
+/* CRC32 by folding with carry-less multiplies, from Intel's "Fast CRC
+   Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+   LEN is a multiple of 16 and at least 64; CRC is not inverted here.  */
+__attribute__ ((target ("pclmul,sse4.1")))
+static uae_u32 crc32_pclmul (const uae_u8 *buf, int len, uae_u32 crc)
+{
+    static const uae_u64 k1k2[2] __attribute__ ((aligned (16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const uae_u64 k3k4[2] __attribute__ ((aligned (16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const uae_u64 k5k0[2] __attribute__ ((aligned (16))) = { 0x0163cd6124ULL, 0 };
+    static const uae_u64 poly[2] __attribute__ ((aligned (16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128 ((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128 ((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128 ((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128 ((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 (crc));
+    x0 = _mm_load_si128 ((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* Fold four blocks of 16 bytes at a time.  */
+    while (len >= 64) {
+	x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+	x6 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+	x7 = _mm_clmulepi64_si128 (x3, x0, 0x00);
+	x8 = _mm_clmulepi64_si128 (x4, x0, 0x00);
+	x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+	x2 = _mm_clmulepi64_si128 (x2, x0, 0x11);
+	x3 = _mm_clmulepi64_si128 (x3, x0, 0x11);
+	x4 = _mm_clmulepi64_si128 (x4, x0, 0x11);
+	y5 = _mm_loadu_si128 ((const __m128i *)(buf + 0x00));
+	y6 = _mm_loadu_si128 ((const __m128i *)(buf + 0x10));
+	y7 = _mm_loadu_si128 ((const __m128i *)(buf + 0x20));
+	y8 = _mm_loadu_si128 ((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x5), y5);
+	x2 = _mm_xor_si128 (_mm_xor_si128 (x2, x6), y6);
+	x3 = _mm_xor_si128 (_mm_xor_si128 (x3, x7), y7);
+	x4 = _mm_xor_si128 (_mm_xor_si128 (x4, x8), y8);
+	buf += 64;
+	len -= 64;
+    }
+
+    /* Fold the four into one.  */
+    x0 = _mm_load_si128 ((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x3), x5);
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x4), x5);
+
+    while (len >= 16) {
+	x2 = _mm_loadu_si128 ((const __m128i *)buf);
+	x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+	x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+	buf += 16;
+	len -= 16;
+    }
+
+    /* 128 bits to 64.  */
+    x2 = _mm_clmulepi64_si128 (x1, x0, 0x10);
+    x3 = _mm_setr_epi32 (~0, 0, ~0, 0);
+    x1 = _mm_srli_si128 (x1, 8);
+    x1 = _mm_xor_si128 (x1, x2);
+    x0 = _mm_loadl_epi64 ((const __m128i *)k5k0);
+    x2 = _mm_srli_si128 (x1, 4);
+    x1 = _mm_and_si128 (x1, x3);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_xor_si128 (x1, x2);
+
+    /* Barrett reduction to 32 bits.  */
+    x0 = _mm_load_si128 ((const __m128i *)poly);
+    x2 = _mm_and_si128 (x1, x3);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x10);
+    x2 = _mm_and_si128 (x2, x3);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+    x1 = _mm_xor_si128 (x1, x2);
+    return _mm_extract_epi32 (x1, 1);
+}
+
+#endif
+
+/* The checksum functions don't check whether this has been done, so that
+   the ROM scanner's threads can call them without locking.  */
+void crc32_init (void)
+{
+    make_crc_table ();
+#ifdef X86_HASH_INSNS
+    check_hash_insns ();
+#endif
 }
 
 uae_u32 get_crc32 (uae_u8 *buf, int len)
 {
     uae_u32 crc;
-    if (!crc_table32[1])
-	make_crc_table ();
     crc = 0xffffffff;
+#ifdef X86_HASH_INSNS
+    if (have_pclmul && len >= 64) {
+	crc = crc32_pclmul (buf, len & ~15, crc);
+	buf += len & ~15;
+	len &= 15;
+    }
+#endif
+    while (len >= 8) {
+	uae_u32 lo = crc ^ (buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uae_u32)buf[3] << 24));
+	uae_u32 hi = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uae_u32)buf[7] << 24);
+	crc = crc_table32[7][lo & 0xff] ^ crc_table32[6][(lo >> 8) & 0xff]
+	    ^ crc_table32[5][(lo >> 16) & 0xff] ^ crc_table32[4][lo >> 24]
+	    ^ crc_table32[3][hi & 0xff] ^ crc_table32[2][(hi >> 8) & 0xff]
+	    ^ crc_table32[1][(hi >> 16) & 0xff] ^ crc_table32[0][hi >> 24];
+	buf += 8;
+	len -= 8;
+    }
     while (len-- > 0) {
-	crc = crc_table32[(crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
+	crc = crc_table32[0][(crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
     }
     return crc ^ 0xffffffff;
 }
@@ -47,8 +195,6 @@ uae_u32 get_crc32 (uae_u8 *buf, int len)
 uae_u16 get_crc16 (uae_u8 *buf, int len)
 {
     uae_u16 crc;
-    if (!crc_table32[1])
-	make_crc_table ();
     crc = 0xffff;
     while (len-- > 0)
 	crc = (crc << 8) ^ crc_table16[((crc >> 8) ^ (*buf++)) & 0xff];
@@ -77,7 +223,7 @@ uae_u16 get_crc16 (uae_u8 *buf, int len)
 typedef struct
 {
     unsigned long total[2];     /*!< number of bytes processed  */
-    unsigned long state[5];     /*!< intermediate digest state  */
+    uae_u32 state[5];           /*!< intermediate digest state  */
     unsigned char buffer[64];   /*!< data block being processed */
 }
 sha1_context;
@@ -94,9 +240,9 @@ static void sha1_starts( sha1_context *ctx )
     ctx->state[4] = 0xC3D2E1F0;
 }
 
-static void sha1_process( sha1_context *ctx, unsigned char data[64] )
+static void sha1_process( sha1_context *ctx, const unsigned char data[64] )
 {
-    unsigned long temp, W[16], A, B, C, D, E;
+    uae_u32 temp, W[16], A, B, C, D, E;
 
     GET_UINT32_BE( W[0],  data,  0 );
     GET_UINT32_BE( W[1],  data,  4 );
@@ -115,7 +261,7 @@ static void sha1_process( sha1_context *ctx, unsigned char data[64] )
     GET_UINT32_BE( W[14], data, 56 );
     GET_UINT32_BE( W[15], data, 60 );
 
-#define S(x,n) ((x << n) | ((x & 0xFFFFFFFF) >> (32 - n)))
+#define S(x,n) ((x << n) | (x >> (32 - n)))
 
 #define R(t)                                            \
 (                                                       \
@@ -250,6 +396,108 @@ static void sha1_process( sha1_context *ctx, unsigned char data[64] )
     ctx->state[4] += E;
 }
 
+#ifdef X86_HASH_INSNS
+
+/* The SHA extensions do four rounds per sha1rnds4.  Each step below is
+   one such group: it also finishes the schedule for the group after next
+   (sha1msg1, xor, sha1msg2) as in Intel's reference code.  */
+#define SHA1_GROUP(e_in, e_out, m0, m1, m2, m3, f) \
+    e_in = _mm_sha1nexte_epu32 (e_in, m0); \
+    e_out = abcd; \
+    m1 = _mm_sha1msg2_epu32 (m1, m0); \
+    abcd = _mm_sha1rnds4_epu32 (abcd, e_in, f); \
+    m3 = _mm_sha1msg1_epu32 (m3, m0); \
+    m2 = _mm_xor_si128 (m2, m0);
+
+__attribute__ ((target ("sha,ssse3,sse4.1")))
+static void sha1_process_shani (uae_u32 state[5], const unsigned char *data, int blocks)
+{
+    const __m128i mask = _mm_set_epi64x (0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd, abcd_save, e0, e0_save, e1, msg0, msg1, msg2, msg3;
+
+    abcd = _mm_loadu_si128 ((const __m128i *)state);
+    abcd = _mm_shuffle_epi32 (abcd, 0x1b);
+    e0 = _mm_set_epi32 (state[4], 0, 0, 0);
+
+    while (blocks-- > 0) {
+	abcd_save = abcd;
+	e0_save = e0;
+
+	msg0 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 0)), mask);
+	e0 = _mm_add_epi32 (e0, msg0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32 (abcd, e0, 0);
+
+	msg1 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 16)), mask);
+	e1 = _mm_sha1nexte_epu32 (e1, msg1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32 (abcd, e1, 0);
+	msg0 = _mm_sha1msg1_epu32 (msg0, msg1);
+
+	msg2 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 32)), mask);
+	e0 = _mm_sha1nexte_epu32 (e0, msg2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32 (abcd, e0, 0);
+	msg1 = _mm_sha1msg1_epu32 (msg1, msg2);
+	msg0 = _mm_xor_si128 (msg0, msg2);
+
+	msg3 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 48)), mask);
+	e1 = _mm_sha1nexte_epu32 (e1, msg3);
+	e0 = abcd;
+	msg0 = _mm_sha1msg2_epu32 (msg0, msg3);
+	abcd = _mm_sha1rnds4_epu32 (abcd, e1, 0);
+	msg2 = _mm_sha1msg1_epu32 (msg2, msg3);
+	msg1 = _mm_xor_si128 (msg1, msg3);
+
+	SHA1_GROUP (e0, e1, msg0, msg1, msg2, msg3, 0)	/* 16-19 */
+	SHA1_GROUP (e1, e0, msg1, msg2, msg3, msg0, 1)	/* 20-23 */
+	SHA1_GROUP (e0, e1, msg2, msg3, msg0, msg1, 1)
+	SHA1_GROUP (e1, e0, msg3, msg0, msg1, msg2, 1)
+	SHA1_GROUP (e0, e1, msg0, msg1, msg2, msg3, 1)
+	SHA1_GROUP (e1, e0, msg1, msg2, msg3, msg0, 1)
+	SHA1_GROUP (e0, e1, msg2, msg3, msg0, msg1, 2)	/* 40-43 */
+	SHA1_GROUP (e1, e0, msg3, msg0, msg1, msg2, 2)
+	SHA1_GROUP (e0, e1, msg0, msg1, msg2, msg3, 2)
+	SHA1_GROUP (e1, e0, msg1, msg2, msg3, msg0, 2)
+	SHA1_GROUP (e0, e1, msg2, msg3, msg0, msg1, 2)
+	SHA1_GROUP (e1, e0, msg3, msg0, msg1, msg2, 3)	/* 60-63 */
+	SHA1_GROUP (e0, e1, msg0, msg1, msg2, msg3, 3)
+	SHA1_GROUP (e1, e0, msg1, msg2, msg3, msg0, 3)
+	SHA1_GROUP (e0, e1, msg2, msg3, msg0, msg1, 3)
+
+	/* 76-79 */
+	e1 = _mm_sha1nexte_epu32 (e1, msg3);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32 (abcd, e1, 3);
+
+	e0 = _mm_sha1nexte_epu32 (e0, e0_save);
+	abcd = _mm_add_epi32 (abcd, abcd_save);
+	data += 64;
+    }
+
+    abcd = _mm_shuffle_epi32 (abcd, 0x1b);
+    _mm_storeu_si128 ((__m128i *)state, abcd);
+    state[4] = _mm_extract_epi32 (e0, 3);
+}
+
+#undef SHA1_GROUP
+
+#endif
+
+static void sha1_blocks( sha1_context *ctx, const unsigned char *data, int blocks )
+{
+#ifdef X86_HASH_INSNS
+    if (have_sha) {
+	sha1_process_shani (ctx->state, data, blocks);
+	return;
+    }
+#endif
+    while (blocks-- > 0) {
+	sha1_process (ctx, data);
+	data += 64;
+    }
+}
+
 /*
  * SHA-1 process buffer
  */
@@ -274,17 +522,17 @@ static void sha1_update( sha1_context *ctx, unsigned char *input, int ilen )
     {
 	memcpy( (void *) (ctx->buffer + left),
 		(void *) input, fill );
-	sha1_process( ctx, ctx->buffer );
+	sha1_blocks( ctx, ctx->buffer, 1 );
 	input += fill;
 	ilen  -= fill;
 	left = 0;
     }
 
-    while( ilen >= 64 )
+    if( ilen >= 64 )
     {
-	sha1_process( ctx, input );
-	input += 64;
-	ilen  -= 64;
+	sha1_blocks( ctx, input, ilen / 64 );
+	input += ilen & ~63;
+	ilen  &= 63;
     }
 
     if( ilen > 0 )
@@ -39,6 +39,9 @@
 #include "drawing.h"
 #include "savestate.h"
 #include "gayle.h"
+#include "capture.h"
+#include "inputrec.h"
+#include "metrics.h"
 
 #define SPR0_HPOS 0x15
 
@@ -176,7 +179,7 @@ struct copper {
 };
 
 static struct copper cop_state;
-static int copper_enabled_thisline;
+int copper_enabled_thisline;
 static int cop_min_waittime;
 
 /*
@@ -717,12 +720,12 @@ STATIC_INLINE void fetch (int nr, int fm)
 	bplpt[nr] += 2;
 	break;
     case 1:
-	fetched_aga0[nr] = chipmem_lget (p);
+	fetched_aga0[nr] = chipmem_agnus_lget (p);
 	bplpt[nr] += 4;
 	break;
     case 2:
-	fetched_aga1[nr] = chipmem_lget (p);
-	fetched_aga0[nr] = chipmem_lget (p + 4);
+	fetched_aga1[nr] = chipmem_agnus_lget (p);
+	fetched_aga0[nr] = chipmem_agnus_lget (p + 4);
 	bplpt[nr] += 8;
 	break;
     }
@@ -1472,50 +1475,101 @@ static void record_color_change (int hpos, int regno, unsigned long value)
 
 typedef int sprbuf_res_t, cclockres_t, hwres_t, bplres_t;
 
-static void do_playfield_collisions (void)
+/* Collisions are computed lazily.  hsync_handler only records what the
+   collision logic needs to know about the line; the lines are evaluated
+   when CLXDAT is read.  The line data and sprite entries they refer to
+   only stay valid until the next frame starts, so at the end of a frame
+   the lines are folded into CLXDAT if the register has been read in the
+   last CLX_IDLE_FRAMES frames, and dropped otherwise.  Software that
+   polls CLXDAT, if not every frame, thus sees the bits accumulate until
+   it reads them, as on the hardware; software that never looks at CLXDAT
+   doesn't pay anything.  */
+#define CLX_IDLE_FRAMES 50
+
+struct clx_line {
+    int lineno;
+    int plfleft, plfright, nr_planes, bplres;
+    int diwfirstword, diwlastword;
+    int first_sprite_entry, nr_sprites;
+    unsigned int clxcon, bpl_enable, bpl_match;
+};
+
+static struct clx_line clx_lines[MAXVPOS + 1];
+static int clx_nr_lines;
+/* Frames since CLXDAT was last read.  */
+static int clx_idle_frames = CLX_IDLE_FRAMES;
+
+static void do_playfield_collisions (struct clx_line *l)
 {
-    uae_u8 *ld = line_data[next_lineno];
+    uae_u8 *ld = line_data[l->lineno];
     int i;
 
-    if (clxcon_bpl_enable == 0) {
+    if (l->bpl_enable == 0) {
 	clxdat |= 1;
 	return;
     }
 
-    for (i = thisline_decision.plfleft; i < thisline_decision.plfright; i += 2) {
+    for (i = l->plfleft; i < l->plfright; i += 2) {
 	int j;
 	uae_u32 total = 0xFFFFFFFF;
 	for (j = 0; j < 8; j++) {
 	    uae_u32 t = 0;
-	    if ((clxcon_bpl_enable & (1 << j)) == 0)
+	    if ((l->bpl_enable & (1 << j)) == 0)
 		t = 0xFFFFFFFF;
-	    else if (j < thisline_decision.nr_planes) {
-		t = *(uae_u32 *)(line_data[next_lineno] + 2 * i + 2 * j * MAX_WORDS_PER_LINE);
-		t ^= ~(((clxcon_bpl_match >> j) & 1) - 1);
+	    else if (j < l->nr_planes) {
+		t = *(uae_u32 *)(ld + 2 * i + 2 * j * MAX_WORDS_PER_LINE);
+		t ^= ~(((l->bpl_match >> j) & 1) - 1);
 	    }
 	    total &= t;
 	}
-	if (total)
+	if (total) {
 	    clxdat |= 1;
+	    return;
+	}
+    }
+}
+
+/* Sprite-to-sprite collisions.  The sprite buffer holds all sprites of the
+   line ORed together, so looking at the final contents finds the same pairs
+   as checking every sprite against the ones recorded before it.  */
+static void do_sprite_sprite_collisions (struct clx_line *l)
+{
+    unsigned int collision_mask = clxmask[l->clxcon >> 12];
+    int i;
+
+    if (! collision_mask)
+	return;
+
+    for (i = 0; i < l->nr_sprites; i++) {
+	struct sprite_entry *e = curr_sprite_entries + l->first_sprite_entry + i;
+	uae_u16 *buf = spixels + e->first_pixel;
+	int j, n = e->max - e->pos;
+
+	for (j = 0; j < n; j++) {
+	    unsigned int tmp = buf[j] & collision_mask;
+	    if (tmp) {
+		unsigned int shrunk_tmp = sprite_ab_merge[tmp & 255] | (sprite_ab_merge[tmp >> 8] << 2);
+		clxdat |= sprclx[shrunk_tmp];
+	    }
+	}
     }
 }
 
-/* Sprite-to-sprite collisions are taken care of in record_sprite.  This one does
-   playfield/sprite collisions.
+/* This one does playfield/sprite collisions.
    That's the theory.  In practice this doesn't work yet.  I also suspect this code
    is way too slow.  */
-static void do_sprite_collisions (void)
+static void do_sprite_collisions (struct clx_line *l)
 {
-    int nr_sprites = curr_drawinfo[next_lineno].nr_sprites;
-    int first = curr_drawinfo[next_lineno].first_sprite_entry;
+    int nr_sprites = l->nr_sprites;
+    int first = l->first_sprite_entry;
     int i;
-    unsigned int collision_mask = clxmask[clxcon >> 12];
-    int bplres = GET_RES (bplcon0);
-    hwres_t ddf_left = thisline_decision.plfleft * 2 << bplres;
-    hwres_t hw_diwlast = coord_window_to_diw_x (thisline_decision.diwlastword);
-    hwres_t hw_diwfirst = coord_window_to_diw_x (thisline_decision.diwfirstword);
+    unsigned int collision_mask = clxmask[l->clxcon >> 12];
+    int bplres = l->bplres;
+    hwres_t ddf_left = l->plfleft * 2 << bplres;
+    hwres_t hw_diwlast = coord_window_to_diw_x (l->diwlastword);
+    hwres_t hw_diwfirst = coord_window_to_diw_x (l->diwfirstword);
 
-    if (clxcon_bpl_enable == 0) {
+    if (l->bpl_enable == 0) {
 	clxdat |= 0x1FE;
 	return;
     }
@@ -1530,12 +1584,12 @@ static void do_sprite_collisions (void)
 
 	if (maxp1 > hw_diwlast)
 	    maxpos = hw_diwlast << sprite_buffer_res;
-	if (maxp1 > thisline_decision.plfright * 2)
-	    maxpos = thisline_decision.plfright * 2 << sprite_buffer_res;
+	if (maxp1 > l->plfright * 2)
+	    maxpos = l->plfright * 2 << sprite_buffer_res;
 	if (minp1 < hw_diwfirst)
 	    minpos = hw_diwfirst << sprite_buffer_res;
-	if (minp1 < thisline_decision.plfleft * 2)
-	    minpos = thisline_decision.plfleft * 2 << sprite_buffer_res;
+	if (minp1 < l->plfleft * 2)
+	    minpos = l->plfleft * 2 << sprite_buffer_res;
 
 	for (j = minpos; j < maxpos; j++) {
 	    int sprpix = spixels[e->first_pixel + j - e->pos] & collision_mask;
@@ -1551,19 +1605,19 @@ static void do_sprite_collisions (void)
 
 	    /* Loop over number of playfields.  */
 	    for (k = 0; k < 2; k++) {
-		int l;
+		int l1;
 		int match = 1;
 		int planes = ((currprefs.chipset_mask & CSMASK_AGA) ? 8 : 6);
 
-		for (l = k; match && l < planes; l += 2) {
-		    if (clxcon_bpl_enable & (1 << l)) {
+		for (l1 = k; match && l1 < planes; l1 += 2) {
+		    if (l->bpl_enable & (1 << l1)) {
 			int t = 0;
-			if (l < thisline_decision.nr_planes) {
-			    uae_u32 *ldata = (uae_u32 *)(line_data[next_lineno] + 2 * l * MAX_WORDS_PER_LINE);
+			if (l1 < l->nr_planes) {
+			    uae_u32 *ldata = (uae_u32 *)(line_data[l->lineno] + 2 * l1 * MAX_WORDS_PER_LINE);
 			    uae_u32 word = ldata[offs >> 5];
 			    t = (word >> (31 - (offs & 31))) & 1;
 			}
-			if (t != ((clxcon_bpl_match >> l) & 1))
+			if (t != ((l->bpl_match >> l1) & 1))
 			    match = 0;
 		    }
 		}
@@ -1575,6 +1629,68 @@ static void do_sprite_collisions (void)
     }
 }
 
+/* Fold the recorded lines into CLXDAT.  Once every bit the enabled checks
+   can set is already set, the remaining lines can't change anything.  */
+static void clx_flush (void)
+{
+    unsigned int full = 0x7E00;
+    int i;
+
+    if (currprefs.collision_level > 1)
+	full |= 0x1FE;
+    if (currprefs.collision_level > 2)
+	full |= 0x001;
+    for (i = 0; i < clx_nr_lines && (clxdat & full) != full; i++) {
+	struct clx_line *l = clx_lines + i;
+	do_sprite_sprite_collisions (l);
+	if (l->plfleft == -1)
+	    continue;
+	if (currprefs.collision_level > 1)
+	    do_sprite_collisions (l);
+	if (currprefs.collision_level > 2)
+	    do_playfield_collisions (l);
+    }
+    clx_nr_lines = 0;
+}
+
+/* Called at the end of a line, after finish_decisions.  */
+static void clx_record_line (void)
+{
+    struct draw_info *dip = curr_drawinfo + next_lineno;
+    struct clx_line *l;
+
+    if (currprefs.collision_level == 0 || nodraw ())
+	return;
+    if (thisline_decision.plfleft == -1 && dip->nr_sprites == 0)
+	return;
+    if (clx_nr_lines == MAXVPOS + 1)
+	clx_flush ();
+
+    l = clx_lines + clx_nr_lines++;
+    l->lineno = next_lineno;
+    l->plfleft = thisline_decision.plfleft;
+    l->plfright = thisline_decision.plfright;
+    l->nr_planes = thisline_decision.nr_planes;
+    l->bplres = GET_RES (bplcon0);
+    l->diwfirstword = thisline_decision.diwfirstword;
+    l->diwlastword = thisline_decision.diwlastword;
+    l->first_sprite_entry = dip->first_sprite_entry;
+    l->nr_sprites = dip->nr_sprites;
+    l->clxcon = clxcon;
+    l->bpl_enable = clxcon_bpl_enable;
+    l->bpl_match = clxcon_bpl_match;
+}
+
+/* Called before the sprite and line buffers of the frame are recycled.  */
+static void clx_vsync (void)
+{
+    if (clx_idle_frames < CLX_IDLE_FRAMES) {
+	clx_flush ();
+	clx_idle_frames++;
+    } else
+	clx_nr_lines = 0;
+}
+
 static void expand_sprres (void)
 {
     switch ((bplcon3 >> 6) & 3) {
@@ -1597,7 +1713,7 @@ static void expand_sprres (void)
 }
 
 STATIC_INLINE void record_sprite_1 (uae_u16 *buf, uae_u32 datab, int num, int dbl,
-				    unsigned int mask, int do_collisions, uae_u32 collision_mask)
+				    unsigned int mask)
 {
     int j = 0;
     while (datab) {
@@ -1610,13 +1726,6 @@ STATIC_INLINE void record_sprite_1 (uae_u16 *buf, uae_u32 datab, int num, int db
 	    *buf++ = tmp;
 	j++;
 	datab >>= 2;
-	if (do_collisions) {
-	    tmp &= collision_mask;
-	    if (tmp) {
-		unsigned int shrunk_tmp = sprite_ab_merge[tmp & 255] | (sprite_ab_merge[tmp >> 8] << 2);
-		clxdat |= sprclx[shrunk_tmp];
-	    }
-	}
     }
 }
 
@@ -1635,7 +1744,6 @@ static void record_sprite (int line, int num, int sprxp, uae_u16 *data, uae_u16
     int i;
     int word_offs;
     uae_u16 *buf;
-    uae_u32 collision_mask;
     int width = sprite_width;
     int dbl = 0, half = 0;
     unsigned int mask = 0;
@@ -1669,7 +1777,6 @@ static void record_sprite (int line, int num, int sprxp, uae_u16 *data, uae_u16
     e[1].first_pixel = e->first_pixel + ((e->max - e->pos + 3) & ~3);
     next_sprite_forced = 0;
 
-    collision_mask = clxmask[clxcon >> 12];
     word_offs = e->first_pixel + sprxp - e->pos;
 
     for (i = 0; i < sprite_width; i += 16) {
@@ -1679,10 +1786,7 @@ static void record_sprite (int line, int num, int sprxp, uae_u16 *data, uae_u16
 			 | (sprtabb[db & 0xFF] << 16) | sprtabb[db >> 8]);
 
 	buf = spixels + word_offs + ((i << dbl) >> half);
-	if (currprefs.collision_level > 0 && collision_mask)
-	    record_sprite_1 (buf, datab, num, dbl, mask, 1, collision_mask);
-	else
-	    record_sprite_1 (buf, datab, num, dbl, mask, 0, collision_mask);
+	record_sprite_1 (buf, datab, num, dbl, mask);
 	data++;
 	datb++;
     }
@@ -2663,7 +2767,11 @@ static void CLXCON2 (uae_u16 v)
  }
 static uae_u16 CLXDAT (void)
 {
-    uae_u16 v = clxdat;
+    uae_u16 v;
+
+    clx_flush ();
+    clx_idle_frames = 0;
+    v = clxdat;
     clxdat = 0;
     return v;
 }
@@ -2853,6 +2961,30 @@ static int isagnus[]= {
     0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
 };
 
+/* Return the first position after HPOS at which the horizontal comparison
+   of the current WAIT succeeds, or -1 if that doesn't happen in this line.
+   The comparison is masked, so it isn't monotonic in HPOS.  */
+static int copper_wait_target (int hpos)
+{
+    int mask = cop_state.saved_i2 & 0xFE;
+    int h;
+
+    for (h = hpos + 2; h <= maxhpos; h += 2)
+	if ((h & mask) >= cop_state.hcmp)
+	    return h;
+    return -1;
+}
+
+/* Let the copper sleep until HPOS in this line.  Until then, the CPU doesn't
+   need to call do_copper after every instruction.  */
+static void copper_schedule_wakeup (int hpos)
+{
+    eventtab[ev_copper].active = 1;
+    eventtab[ev_copper].evtime = eventtab[ev_hsync].oldcycles + hpos * CYCLE_UNIT;
+    events_schedule ();
+    unset_special (SPCFLAG_COPPER);
+}
+
 static void update_copper (int until_hpos)
 {
     int vp = vpos & (((cop_state.saved_i2 >> 8) & 0x7F) | 0x80);
@@ -2968,6 +3100,7 @@ static void update_copper (int until_hpos)
 	    cop_state.saved_i1 = cop_state.i1;
 	    cop_state.saved_i2 = cop_state.i2;
 	    cop_state.saved_ip = cop_state.ip;
+	    METRIC_INC (METRIC_COPPER_INSNS);
 
 	    if (cop_state.i1 & 1) {
 		if (cop_state.i2 & 1)
@@ -3024,7 +3157,20 @@ static void update_copper (int until_hpos)
 
 	    hp = c_hpos & (cop_state.saved_i2 & 0xFE);
 	    if (vp == cop_state.vcmp && hp < cop_state.hcmp) {
-		/* Position not reached yet.  */
+		/* Position not reached yet.  Instead of testing again every
+		   two cycles, jump to the cycle before the first position that
+		   passes.  If the CPU isn't there yet, sleep until it is.  */
+		int target = copper_wait_target (c_hpos);
+		if (target < 0) {
+		    copper_enabled_thisline = 0;
+		    unset_special (SPCFLAG_COPPER);
+		    goto out;
+		}
+		c_hpos = target - 2;
+		if (c_hpos >= until_hpos) {
+		    copper_schedule_wakeup (c_hpos);
+		    goto out;
+		}
 		break;
 	    }
 
@@ -3104,6 +3250,9 @@ void do_copper (void)
    used from hsync_handler to finish up the line.  */
 STATIC_INLINE void sync_copper_with_cpu (int hpos, int do_schedule)
 {
+    /* A copper sleeping in a WAIT has nothing to do before it wakes up.  */
+    if (eventtab[ev_copper].active && hpos < cop_state.hpos)
+	return;
     /* Need to let the copper advance to the current position.  */
     if (eventtab[ev_copper].active) {
 	eventtab[ev_copper].active = 0;
@@ -3343,7 +3492,10 @@ static void vsync_handler (void)
 
     time_vsync ();
 
+    inputrec_vsync ();
+    inputrec_host_begin ();
     handle_events ();
+    inputrec_host_end ();
 
     INTREQ (0x8020);
     if (bplcon0 & 4)
@@ -3353,7 +3505,10 @@ static void vsync_handler (void)
     if (picasso_on)
 	picasso_handle_vsync ();
 #endif
+    clx_vsync ();
     vsync_handle_redraw (lof, lof_changed);
+    capture_vsync ();
+    metrics_vsync ();
 
     if (quit_program > 0)
 	return;
@@ -3419,17 +3574,13 @@ static void hsync_handler (void)
     sync_copper_with_cpu (maxhpos, 0);
 
     finish_decisions ();
-    if (thisline_decision.plfleft != -1) {
-	if (currprefs.collision_level > 1)
-	    do_sprite_collisions ();
-	if (currprefs.collision_level > 2)
-	    do_playfield_collisions ();
-    }
+    clx_record_line ();
     hsync_record_line_state (next_lineno, nextline_how, thisline_changed);
 
     eventtab[ev_hsync].evtime += get_cycles () - eventtab[ev_hsync].oldcycles;
     eventtab[ev_hsync].oldcycles = get_cycles ();
-    CIA_hsync_handler ();
+    if (++cia_hsyncs == cia_hsync_due || currprefs.use_serial || keys_available ())
+	CIA_hsync_handler ();
 
     if (currprefs.produce_sound > 0)
 	audio_hsync (1);
@@ -3508,6 +3659,9 @@ void init_eventtab (void)
     eventtab[ev_disk].active = 0;
     eventtab[ev_audio].handler = audio_evhandler;
     eventtab[ev_audio].active = 0;
+    eventtab[ev_serial].handler = serial_handler;
+    eventtab[ev_serial].active = 0;
+    serial_reset ();
     events_schedule ();
 }
 
@@ -3521,7 +3675,9 @@ void customreset (void)
 
     /* If we're in a loop of quick successive resets, we should give
        the GUI some time to respond to a "Quit" event.  */
+    inputrec_host_begin ();
     handle_events ();
+    inputrec_host_end ();
 
     if (! savestate_state) {
 	if ((currprefs.chipset_mask & CSMASK_AGA) == 0) {
@@ -3538,6 +3694,8 @@ void customreset (void)
 
 	clx_sprmask = 0xFF;
 	clxdat = 0;
+	clx_nr_lines = 0;
+	clx_idle_frames = CLX_IDLE_FRAMES;
 
 	/* Clear the armed flags of all sprites.  */
 	memset (spr, 0, sizeof spr);
@@ -3675,6 +3833,8 @@ void dumpcustom (void)
 		     (double)frametime / timeframes, timeframes, frametime);
 	if (total_skipped)
 	    console_out ("Skipped frames: %d\n", total_skipped);
+	if (currprefs.gfx_framerate_auto)
+	    dump_frameskip ();
     }
     /*for (i=0; i<256; i++) if (blitcount[i]) console_out ("minterm %x = %d\n",i,blitcount[i]);  blitter debug */
 }
@@ -3754,7 +3914,8 @@ static void custom_bput (uaecptr, uae_u32) REGPARAM;
 addrbank custom_bank = {
     custom_lget, custom_wget, custom_bget,
     custom_lput, custom_wput, custom_bput,
-    default_xlate, default_check, NULL, "Custom chipset"
+    default_xlate, default_check, NULL, "Custom chipset",
+    0
 };
 
 STATIC_INLINE uae_u32 REGPARAM2 custom_wget_1 (uaecptr addr)
@@ -4054,6 +4215,7 @@ const uae_u8 *restore_custom (const uae_u8 *src)
     RW;				/* 00A JOY0DAT */
     RW;				/* 00C JOY1DAT */
     clxdat = RW;		/* 00E CLXDAT */
+    clx_nr_lines = 0;
     RW;				/* 010 ADKCONR */
     RW;				/* 012 POT0DAT* */
     RW;				/* 014 POT1DAT* */
@@ -4202,6 +4364,7 @@ uae_u8 *save_custom (int *len, uae_u8 *dstptr, int full)
     SW (dskdatr);		/* 008 DSKDATR */
     SW (JOY0DAT());		/* 00A JOY0DAT */
     SW (JOY1DAT());		/* 00C JOY1DAT */
+    clx_flush ();
     SW (clxdat);		/* 00E CLXDAT */
     SW (ADKCONR());		/* 010 ADKCONR */
     SW (POT0DAT());		/* 012 POT0DAT */
@@ -4384,11 +4547,13 @@ uae_u8 *save_custom_sprite(int num, int *len)
 void check_prefs_changed_custom (void)
 {
     currprefs.gfx_framerate = changed_prefs.gfx_framerate;
+    currprefs.gfx_framerate_auto = changed_prefs.gfx_framerate_auto;
     if (inputdevice_config_change_test ()) {
 	inputdevice_copyconfig (&changed_prefs, &currprefs);
 	inputdevice_updateconfig (&currprefs);
     }
     currprefs.immediate_blits = changed_prefs.immediate_blits;
+    currprefs.floppy_turbo = changed_prefs.floppy_turbo;
     currprefs.blits_32bit_enabled = changed_prefs.blits_32bit_enabled;
     currprefs.collision_level = changed_prefs.collision_level;
 }
@@ -25,6 +25,7 @@
 #include "disk.h"
 #include "gui.h"
 #include "zfile.h"
+#include "metrics.h"
 #include "autoconf.h"
 #include "newcpu.h"
 #include "xwin.h"
@@ -95,6 +96,27 @@ typedef struct {
 #define DRIVE_ID_525SD 0x55555555 /* 40 track 5.25 drive , kickstart does not recognize this */
 
 typedef enum { ADF_NORMAL, ADF_EXT1, ADF_EXT2 } drive_filetype;
+
+#ifdef SUPPORT_THREADS
+/* Whole-disk cache of MFM encoded AmigaDOS tracks.  The sector data is
+ * copied out of the image when it is inserted, and a helper thread encodes
+ * every track from that copy, so that seeking to a new track is just a
+ * memcpy.  Tracks that are written to are marked stale and from then on
+ * come from the image file again.  */
+typedef enum { TC_NONE, TC_PENDING, TC_READY, TC_STALE } trackcache_state;
+typedef struct {
+    uae_u8 *data;
+    uae_u16 *mfm;
+    int trackwords;
+    int tracklen[MAX_TRACKS];
+    volatile trackcache_state state[MAX_TRACKS];
+    volatile int abort;
+    int running, thread_live;
+    uae_sem_t lock;
+    uae_thread_id thread;
+} trackcache;
+#endif
+
 typedef struct {
     drive_type type;
     struct zfile *diskfile;
@@ -122,6 +144,9 @@ typedef struct {
     int idbit;
     unsigned long drive_id; /* drive id to be reported */
     char newname[256]; /* storage space for new filename during eject delay */
+#ifdef SUPPORT_THREADS
+    trackcache cache;
+#endif
 } drive;
 
 static drive floppy[4];
@@ -209,9 +234,12 @@ static void update_drive_gui (int num)
 }
 
 static void drive_fill_bigbuf (drive *drv);
+static void trackcache_start (drive *drv);
+static void trackcache_free (drive *drv);
 
 static void drive_image_free (drive *drv)
 {
+    trackcache_free (drv);
     drv->filetype = -1;
     if (!drv->diskfile)
 	return;
@@ -361,6 +389,7 @@ static int drive_insert (drive *drv, int dnum, const char *fname)
     drive_settype_id (drv);	/* Set DD or HD drive */
     drv->buffered_side = 2;	/* will force read */
     drive_fill_bigbuf (drv);
+    trackcache_start (drv);
     return 1;
 }
 
@@ -568,19 +597,18 @@ static void mfmcode (uae_u16 * mfm, int words)
     }
 }
 
-static void decode_amigados (drive *drv)
+/* Encode the sector data of AmigaDOS track TR into DSTMFMBUF, returns the
+ * track length in bits.  Called from the track cache thread as well, so it
+ * must not touch anything but its arguments and the drive geometry.  */
+static int decode_amigados (drive *drv, int tr, const uae_u8 *data, uae_u16 *dstmfmbuf)
 {
     /* Normal AmigaDOS format track */
-    int tr = drv->cyl * 2 + side;
     int sec;
     int dstmfmoffset = 0;
-    uae_u16 *dstmfmbuf = drv->bigmfmbuf;
     int len = drv->num_secs * 544 + FLOPPY_GAP_LEN;
-    trackid *ti = drv->trackdata + tr;
 
     memset (dstmfmbuf, 0xaa, len * 2);
     dstmfmoffset += FLOPPY_GAP_LEN;
-    drv->tracklen = len * 2 * 8;
 
     for (sec = 0; sec < drv->num_secs; sec++) {
 	uae_u8 secbuf[544];
@@ -599,7 +627,7 @@ static void decode_amigados (drive *drv)
 	for (i = 8; i < 24; i++)
 	    secbuf[i] = 0;
 
-	read_floppy_data (drv->diskfile, ti, sec * 512, &secbuf[32], 512);
+	memcpy (&secbuf[32], data + sec * 512, 512);
 
 	mfmbuf[0] = mfmbuf[1] = 0xaaaa;
 	mfmbuf[2] = mfmbuf[3] = 0x4489;
@@ -658,8 +686,177 @@ static void decode_amigados (drive *drv)
 #ifdef DISK_DEBUG
     write_log ("amigados read track %d\n", tr);
 #endif
+    return len * 2 * 8;
+}
+
+#ifdef SUPPORT_THREADS
+
+static void *trackcache_thread (void *v)
+{
+    drive *drv = v;
+    trackcache *tc = &drv->cache;
+    int tracksize = drv->num_secs * 512;
+    int tr;
+
+    for (tr = 0; tr < MAX_TRACKS && !tc->abort; tr++) {
+	int len;
+	if (tc->state[tr] != TC_PENDING)
+	    continue;
+	len = decode_amigados (drv, tr, tc->data + tr * tracksize, tc->mfm + tr * tc->trackwords);
+	uae_sem_wait (&tc->lock);
+	if (tc->state[tr] == TC_PENDING) {
+	    tc->tracklen[tr] = len;
+	    tc->state[tr] = TC_READY;
+	}
+	uae_sem_post (&tc->lock);
+    }
+    return 0;
+}
+
+static int trackcache_spawn (drive *drv)
+{
+    trackcache *tc = &drv->cache;
+
+    tc->abort = 0;
+    if (uae_start_thread (trackcache_thread, drv, &tc->thread) != 0)
+	return 0;
+    tc->thread_live = 1;
+    return 1;
+}
+
+static void trackcache_start (drive *drv)
+{
+    trackcache *tc = &drv->cache;
+    int tracksize = drv->num_secs * 512;
+    int num_tracks = drv->num_tracks < MAX_TRACKS ? drv->num_tracks : MAX_TRACKS;
+    int tr, count = 0;
+
+    for (tr = 0; tr < num_tracks; tr++) {
+	if (drv->trackdata[tr].type == TRACK_AMIGADOS)
+	    count++;
+    }
+    if (count == 0)
+	return;
+
+    tc->trackwords = drv->num_secs * 544 + FLOPPY_GAP_LEN;
+    tc->data = malloc (num_tracks * tracksize);
+    tc->mfm = malloc (num_tracks * tc->trackwords * 2);
+    if (!tc->data || !tc->mfm) {
+	free (tc->data);
+	free (tc->mfm);
+	tc->data = 0;
+	tc->mfm = 0;
+	return;
+    }
+    for (tr = 0; tr < num_tracks; tr++) {
+	if (drv->trackdata[tr].type != TRACK_AMIGADOS)
+	    continue;
+	read_floppy_data (drv->diskfile, drv->trackdata + tr, 0, tc->data + tr * tracksize, tracksize);
+	tc->state[tr] = TC_PENDING;
+    }
+
+    uae_sem_init (&tc->lock, 0, 1);
+    if (! trackcache_spawn (drv)) {
+	write_log ("DF%d: can't start track cache thread\n", drv - floppy);
+	uae_sem_destroy (&tc->lock);
+	trackcache_free (drv);
+	return;
+    }
+    tc->running = 1;
 }
 
+static void trackcache_free (drive *drv)
+{
+    trackcache *tc = &drv->cache;
+
+    if (tc->running) {
+	tc->abort = 1;
+	if (tc->thread_live)
+	    uae_wait_thread (tc->thread);
+	tc->thread_live = 0;
+	uae_sem_destroy (&tc->lock);
+	tc->running = 0;
+    }
+    free (tc->data);
+    free (tc->mfm);
+    tc->data = 0;
+    tc->mfm = 0;
+    memset ((void *)tc->state, 0, sizeof tc->state);
+}
+
+/* Copy track TR to the drive buffer if the cache thread has got to it.  */
+static int trackcache_fetch (drive *drv, int tr)
+{
+    trackcache *tc = &drv->cache;
+    int ready;
+
+    if (!tc->running)
+	return 0;
+    uae_sem_wait (&tc->lock);
+    ready = tc->state[tr] == TC_READY;
+    uae_sem_post (&tc->lock);
+    if (!ready)
+	return 0;
+    memcpy (drv->bigmfmbuf, tc->mfm + tr * tc->trackwords, tc->trackwords * 2);
+    drv->tracklen = tc->tracklen[tr];
+    return 1;
+}
+
+static void trackcache_invalidate (drive *drv, int tr)
+{
+    trackcache *tc = &drv->cache;
+
+    if (!tc->running)
+	return;
+    uae_sem_wait (&tc->lock);
+    tc->state[tr] = TC_STALE;
+    uae_sem_post (&tc->lock);
+}
+
+/* For the fork server, before it forks: a child would get the caches but
+ * not the threads filling them, and perhaps a lock held by one of them.
+ * The threads are left to finish, which doesn't take long, so the jobs
+ * usually start with every track encoded.  */
+void disk_stop_threads (void)
+{
+    int dr;
+
+    for (dr = 0; dr < 4; dr++) {
+	trackcache *tc = &floppy[dr].cache;
+	if (tc->thread_live) {
+	    uae_wait_thread (tc->thread);
+	    tc->thread_live = 0;
+	}
+    }
+}
+
+/* In a forked job: restart the threads for any tracks still pending.  */
+void disk_start_threads (void)
+{
+    int dr, tr;
+
+    for (dr = 0; dr < 4; dr++) {
+	trackcache *tc = &floppy[dr].cache;
+	if (!tc->running || tc->thread_live)
+	    continue;
+	for (tr = 0; tr < MAX_TRACKS && tc->state[tr] != TC_PENDING; tr++)
+	    ;
+	if (tr < MAX_TRACKS && ! trackcache_spawn (floppy + dr))
+	    write_log ("DF%d: can't restart track cache thread\n", dr);
+    }
+}
+
+#else
+
+static void trackcache_start (drive *drv) { }
+static void trackcache_free (drive *drv) { }
+static int trackcache_fetch (drive *drv, int tr) { return 0; }
+static void trackcache_invalidate (drive *drv, int tr) { }
+void disk_stop_threads (void) { }
+void disk_start_threads (void) { }
+
+#endif
+
 static void drive_fill_bigbuf (drive * drv)
 {
     int tr = drv->cyl * 2 + side;
@@ -678,7 +875,11 @@ static void drive_fill_bigbuf (drive * drv)
 	decode_pcdos (drv);
 
     } else if (ti->type == TRACK_AMIGADOS) {
-	decode_amigados (drv);
+	if (!trackcache_fetch (drv, tr)) {
+	    uae_u8 data[512 * 22];
+	    read_floppy_data (drv->diskfile, ti, 0, data, drv->num_secs * 512);
+	    drv->tracklen = decode_amigados (drv, tr, data, drv->bigmfmbuf);
+	}
     } else {
 	int i;
 	int base_offset = ti->type == TRACK_RAW ? 0 : 1;
@@ -870,6 +1071,7 @@ static void drive_write_data (drive * drv)
     int ret;
     if (drive_writeprotected (drv))
 	return;
+    trackcache_invalidate (drv, drv->cyl * 2 + side);
     switch (drv->filetype) {
     case ADF_NORMAL:
 	drive_write_adf_amigados (drv);
@@ -1141,9 +1343,10 @@ static void disk_doupdate_write (drive * drv)
 	    bitoffset++;
 	    bitoffset &= 15;
 	    if (!bitoffset) {
-		drv->bigmfmbuf[drv->mfmpos >> 4] = get_word (dskpt);
+		drv->bigmfmbuf[drv->mfmpos >> 4] = chipmem_agnus_wget (dskpt);
 		dskpt += 2;
 		dsklength--;
+		METRIC_INC (METRIC_DISK_WORDS);
 		if (dsklength == 0) {
 		    disk_dmafinished ();
 		    drive_write_data (drv);
@@ -1246,9 +1449,10 @@ static void dodmafetch (void)
     i = 0;
     while (dma_tab[i] != 0xffffffff && dskdmaen == 2 && (dmacon & 0x210) == 0x210) {
 	if (dsklength > 0) {
-	    put_word (dskpt, dma_tab[i++]);
+	    chipmem_agnus_wput (dskpt, dma_tab[i++]);
 	    dskpt += 2;
 	    dsklength--;
+	    METRIC_INC (METRIC_DISK_WORDS);
 	}
 	if (dsklength == 0) {
 	    disk_dmafinished ();
@@ -1399,13 +1603,14 @@ void DSKLEN (uae_u16 v, int hpos)
        also it seems some copy protections require this fix */
     DISK_start ();
 
-    /* Try to make floppy access from Kickstart faster.  */
+    /* Try to make floppy access from Kickstart faster.  With floppy_turbo,
+       do the same for every read, whoever started it.  */
     if (dskdmaen != 2)
 	return;
     {
 	int dr;
 	uaecptr pc = m68k_getpc ();
-	if ((pc & 0xF80000) != 0xF80000)
+	if ((pc & 0xF80000) != 0xF80000 && !currprefs.floppy_turbo)
 	    return;
 	for (dr = 0; dr < 4; dr++) {
 	    drive *drv = &floppy[dr];
@@ -1430,8 +1635,9 @@ void DSKLEN (uae_u16 v, int hpos)
 		    if (i >= drv->tracklen)
 			return;
 		}
+		METRIC_ADD (METRIC_DISK_WORDS, dsklength);
 		while (dsklength-- > 0) {
-		    put_word (dskpt, drv->bigmfmbuf[pos >> 4]);
+		    chipmem_agnus_wput (dskpt, drv->bigmfmbuf[pos >> 4]);
 		    dskpt += 2;
 		    pos += 16;
 		    pos %= drv->tracklen;
@@ -37,6 +37,7 @@
 #include "uae.h"
 #include "memory.h"
 #include "custom.h"
+#include "events.h"
 #include "newcpu.h"
 #include "xwin.h"
 #include "autoconf.h"
@@ -44,6 +45,9 @@
 #include "picasso96.h"
 #include "drawing.h"
 #include "savestate.h"
+#include "capture.h"
+#include "forkserver.h"
+#include "metrics.h"
 
 int lores_factor, lores_shift;
 
@@ -167,11 +171,101 @@ int framecnt = 0;
 static int frame_redraw_necessary;
 static int picasso_redraw_necessary;
 
+/* Adaptive frame skipping (gfx_framerate_auto).  The host time used by a
+   frame is split into the part spent drawing and the rest, and both are
+   averaged.  A frame is drawn only if the averages say that emulation plus
+   drawing fits into the frame time, so that the chipset and the sound
+   never fall behind.  With cpu_speed=max the CPU takes up all the time
+   there is, so we look at whether the previous frame missed its deadline
+   instead.  */
+#define FRAMESKIP_MAX 4
+#define FRAMESKIP_HISTORY 64
+
+static long int fs_last_busy, fs_draw_usecs;
+static long int fs_emu_avg, fs_draw_avg;
+static int fs_frames, fs_skipped_in_row;
+static unsigned long fs_drawn, fs_skipped;
+static char fs_history[FRAMESKIP_HISTORY];
+static int fs_history_pos;
+
+/* Host time in microseconds that counts against the frame budget.  Use the
+   thread's CPU time where possible, since the time spent waiting for the
+   sound device or for the next frame is not a cost.  */
+static long int busy_usecs (void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+#endif
+    {
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+    }
+}
+
+static int frameskip_decide (void)
+{
+    long int now = busy_usecs ();
+    long int total = now - fs_last_busy;
+    long int budget = 1000000L / vblank_hz * fs_frames;
+    int skip;
+
+    fs_last_busy = now;
+    if (total < 0 || total > 1000000L) {
+	/* First frame, or we were paused; nothing useful to learn.  */
+	fs_draw_usecs = 0;
+	return 0;
+    }
+    fs_emu_avg += ((total - fs_draw_usecs) / fs_frames - fs_emu_avg) / 8;
+    if (fs_draw_usecs > 0)
+	fs_draw_avg += (fs_draw_usecs / fs_frames - fs_draw_avg) / 4;
+    fs_draw_usecs = 0;
+
+    if (currprefs.m68k_speed == -1 && ! sync_with_sound)
+	skip = vsync_lateness > (long int)(vsynctime / 8);
+    else
+	skip = (fs_emu_avg + fs_draw_avg) * fs_frames > budget - budget / 8;
+    if (fs_skipped_in_row >= FRAMESKIP_MAX)
+	skip = 0;
+    return skip;
+}
+
 STATIC_INLINE void count_frame (void)
 {
+    if (currprefs.gfx_framerate_auto) {
+	framecnt = frameskip_decide ();
+	fs_frames = 0;
+	if (framecnt) {
+	    fs_skipped_in_row++;
+	    fs_skipped++;
+	    METRIC_INC (METRIC_FRAMES_SKIPPED);
+	} else {
+	    fs_skipped_in_row = 0;
+	    fs_drawn++;
+	}
+	fs_history[fs_history_pos++ % FRAMESKIP_HISTORY] = framecnt ? '.' : 'D';
+	return;
+    }
     framecnt++;
     if (framecnt >= currprefs.gfx_framerate)
 	framecnt = 0;
+    if (framecnt)
+	METRIC_INC (METRIC_FRAMES_SKIPPED);
+}
+
+void dump_frameskip (void)
+{
+    char buf[FRAMESKIP_HISTORY + 1];
+    int i, n = fs_history_pos < FRAMESKIP_HISTORY ? fs_history_pos : FRAMESKIP_HISTORY;
+
+    for (i = 0; i < n; i++)
+	buf[i] = fs_history[(fs_history_pos - n + i) % FRAMESKIP_HISTORY];
+    buf[n] = 0;
+    console_out ("Auto frame skip: %lu drawn, %lu skipped, emulation %ld us, drawing %ld us per frame\n",
+		 fs_drawn, fs_skipped, fs_emu_avg, fs_draw_avg);
+    console_out ("Last frames (D = drawn): %s\n", buf);
 }
 
 int coord_native_to_amiga_x (int x)
@@ -555,6 +649,17 @@ static unsigned int ham_lastcolor;
 
 static int ham_decode_pixel;
 
+#include "hamdecode.c"
+
+static void ham_setup (void)
+{
+    int aga = (currprefs.chipset_mask & CSMASK_AGA) != 0;
+
+    ham_build_tables (ham_select_mode (bplham, bplplanecnt, aga), aga,
+		      colors_for_drawing.color_regs_ecs,
+		      colors_for_drawing.color_regs_aga);
+}
+
 /* Decode HAM in the invisible portion of the display (left of VISIBLE_LEFT_BORDER),
    but don't draw anything in.  This is done to prepare HAM_LASTCOLOR for later,
    when decode_ham runs.  */
@@ -564,48 +669,14 @@ static void init_ham_decoding (void)
     ham_decode_pixel = src_pixel;
     ham_lastcolor = color_reg_get (&colors_for_drawing, 0);
 
-    if (! bplham || (bplplanecnt != 6 && ((currprefs.chipset_mask & CSMASK_AGA) == 0 || bplplanecnt != 8))) {
-	if (unpainted_amiga > 0) {
-	    int pv = pixdata.apixels[ham_decode_pixel + unpainted_amiga - 1];
-	    if (currprefs.chipset_mask & CSMASK_AGA)
-		ham_lastcolor = colors_for_drawing.color_regs_aga[pv];
-	    else
-		ham_lastcolor = colors_for_drawing.color_regs_ecs[pv];
-	}
-    } else if (currprefs.chipset_mask & CSMASK_AGA) {
-	if (bplplanecnt == 8) { /* AGA mode HAM8 */
-	    while (unpainted_amiga-- > 0) {
-		int pv = pixdata.apixels[ham_decode_pixel++];
-		switch (pv & 0x3) {
-		case 0x0: ham_lastcolor = colors_for_drawing.color_regs_aga[pv >> 2]; break;
-		case 0x1: ham_lastcolor &= 0xFFFF03; ham_lastcolor |= (pv & 0xFC); break;
-		case 0x2: ham_lastcolor &= 0x03FFFF; ham_lastcolor |= (pv & 0xFC) << 16; break;
-		case 0x3: ham_lastcolor &= 0xFF03FF; ham_lastcolor |= (pv & 0xFC) << 8; break;
-		}
-	    }
-	} else if (bplplanecnt == 6) { /* AGA mode HAM6 */
-	    while (unpainted_amiga-- > 0) {
-		int pv = pixdata.apixels[ham_decode_pixel++];
-		switch (pv & 0x30) {
-		case 0x00: ham_lastcolor = colors_for_drawing.color_regs_aga[pv]; break;
-		case 0x10: ham_lastcolor &= 0xFFFF00; ham_lastcolor |= (pv & 0xF) << 4; break;
-		case 0x20: ham_lastcolor &= 0x00FFFF; ham_lastcolor |= (pv & 0xF) << 20; break;
-		case 0x30: ham_lastcolor &= 0xFF00FF; ham_lastcolor |= (pv & 0xF) << 12; break;
-		}
-	    }
-	}
-    } else {
-	if (bplplanecnt == 6) { /* OCS/ECS mode HAM6 */
-	    while (unpainted_amiga-- > 0) {
-		int pv = pixdata.apixels[ham_decode_pixel++];
-		switch (pv & 0x30) {
-		case 0x00: ham_lastcolor = colors_for_drawing.color_regs_ecs[pv]; break;
-		case 0x10: ham_lastcolor &= 0xFF0; ham_lastcolor |= (pv & 0xF); break;
-		case 0x20: ham_lastcolor &= 0x0FF; ham_lastcolor |= (pv & 0xF) << 8; break;
-		case 0x30: ham_lastcolor &= 0xF0F; ham_lastcolor |= (pv & 0xF) << 4; break;
-		}
-	    }
-	}
+    ham_setup ();
+    if (ham_tables_mode == ham_none) {
+	if (unpainted_amiga > 0)
+	    ham_lastcolor = ham_or[pixdata.apixels[ham_decode_pixel + unpainted_amiga - 1]];
+    } else if (unpainted_amiga > 0) {
+	ham_lastcolor = ham_decode_span (pixdata.apixels + ham_decode_pixel, 0,
+					 unpainted_amiga, ham_lastcolor);
+	ham_decode_pixel += unpainted_amiga;
     }
 }
 
@@ -613,54 +684,13 @@ static void decode_ham (int pix, int stoppos)
 {
     int todraw_amiga = res_shift_from_window (stoppos - pix);
 
-    if (! bplham || (bplplanecnt != 6 && ((currprefs.chipset_mask & CSMASK_AGA) == 0 || bplplanecnt != 8))) {
-	while (todraw_amiga-- > 0) {
-	    int pv = pixdata.apixels[ham_decode_pixel];
-	    if (currprefs.chipset_mask & CSMASK_AGA)
-		ham_lastcolor = colors_for_drawing.color_regs_aga[pv];
-	    else
-		ham_lastcolor = colors_for_drawing.color_regs_ecs[pv];
-
-	    ham_linebuf[ham_decode_pixel++] = ham_lastcolor;
-	}
-    } else if (currprefs.chipset_mask & CSMASK_AGA) {
-	if (bplplanecnt == 8) { /* AGA mode HAM8 */
-	    while (todraw_amiga-- > 0) {
-		int pv = pixdata.apixels[ham_decode_pixel];
-		switch (pv & 0x3) {
-		case 0x0: ham_lastcolor = colors_for_drawing.color_regs_aga[pv >> 2]; break;
-		case 0x1: ham_lastcolor &= 0xFFFF03; ham_lastcolor |= (pv & 0xFC); break;
-		case 0x2: ham_lastcolor &= 0x03FFFF; ham_lastcolor |= (pv & 0xFC) << 16; break;
-		case 0x3: ham_lastcolor &= 0xFF03FF; ham_lastcolor |= (pv & 0xFC) << 8; break;
-		}
-		ham_linebuf[ham_decode_pixel++] = ham_lastcolor;
-	    }
-	} else if (bplplanecnt == 6) { /* AGA mode HAM6 */
-	    while (todraw_amiga-- > 0) {
-		int pv = pixdata.apixels[ham_decode_pixel];
-		switch (pv & 0x30) {
-		case 0x00: ham_lastcolor = colors_for_drawing.color_regs_aga[pv]; break;
-		case 0x10: ham_lastcolor &= 0xFFFF00; ham_lastcolor |= (pv & 0xF) << 4; break;
-		case 0x20: ham_lastcolor &= 0x00FFFF; ham_lastcolor |= (pv & 0xF) << 20; break;
-		case 0x30: ham_lastcolor &= 0xFF00FF; ham_lastcolor |= (pv & 0xF) << 12; break;
-		}
-		ham_linebuf[ham_decode_pixel++] = ham_lastcolor;
-	    }
-	}
-    } else {
-	if (bplplanecnt == 6) { /* OCS/ECS mode HAM6 */
-	    while (todraw_amiga-- > 0) {
-		int pv = pixdata.apixels[ham_decode_pixel];
-		switch (pv & 0x30) {
-		case 0x00: ham_lastcolor = colors_for_drawing.color_regs_ecs[pv]; break;
-		case 0x10: ham_lastcolor &= 0xFF0; ham_lastcolor |= (pv & 0xF); break;
-		case 0x20: ham_lastcolor &= 0x0FF; ham_lastcolor |= (pv & 0xF) << 8; break;
-		case 0x30: ham_lastcolor &= 0xF0F; ham_lastcolor |= (pv & 0xF) << 4; break;
-		}
-		ham_linebuf[ham_decode_pixel++] = ham_lastcolor;
-	    }
-	}
-    }
+    if (todraw_amiga <= 0)
+	return;
+    ham_setup ();
+    ham_lastcolor = ham_decode_span (pixdata.apixels + ham_decode_pixel,
+				     ham_linebuf + ham_decode_pixel,
+				     todraw_amiga, ham_lastcolor);
+    ham_decode_pixel += todraw_amiga;
 }
 
 static void gen_pfield_tables (void)
@@ -887,6 +917,45 @@ STATIC_INLINE void draw_sprites_ecs (struct sprite_entry *e)
 
 #define GETLONG(P) (*(uae_u32 *)P)
 
+/* Convert 32 pixels of up to eight planes (B7 is plane 0) into one byte
+   per pixel at PIXELS.  */
+STATIC_INLINE void planar_to_chunky (uae_u32 *pixels, uae_u32 b0, uae_u32 b1, uae_u32 b2, uae_u32 b3,
+				     uae_u32 b4, uae_u32 b5, uae_u32 b6, uae_u32 b7)
+{
+    MERGE (b0, b1, 0x55555555, 1);
+    MERGE (b2, b3, 0x55555555, 1);
+    MERGE (b4, b5, 0x55555555, 1);
+    MERGE (b6, b7, 0x55555555, 1);
+
+    MERGE (b0, b2, 0x33333333, 2);
+    MERGE (b1, b3, 0x33333333, 2);
+    MERGE (b4, b6, 0x33333333, 2);
+    MERGE (b5, b7, 0x33333333, 2);
+
+    MERGE (b0, b4, 0x0f0f0f0f, 4);
+    MERGE (b1, b5, 0x0f0f0f0f, 4);
+    MERGE (b2, b6, 0x0f0f0f0f, 4);
+    MERGE (b3, b7, 0x0f0f0f0f, 4);
+
+    MERGE (b0, b1, 0x00ff00ff, 8);
+    MERGE (b2, b3, 0x00ff00ff, 8);
+    MERGE (b4, b5, 0x00ff00ff, 8);
+    MERGE (b6, b7, 0x00ff00ff, 8);
+
+    MERGE (b0, b2, 0x0000ffff, 16);
+    do_put_mem_long (pixels, b0);
+    do_put_mem_long (pixels + 4, b2);
+    MERGE (b1, b3, 0x0000ffff, 16);
+    do_put_mem_long (pixels + 2, b1);
+    do_put_mem_long (pixels + 6, b3);
+    MERGE (b4, b6, 0x0000ffff, 16);
+    do_put_mem_long (pixels + 1, b4);
+    do_put_mem_long (pixels + 5, b6);
+    MERGE (b5, b7, 0x0000ffff, 16);
+    do_put_mem_long (pixels + 3, b5);
+    do_put_mem_long (pixels + 7, b7);
+}
+
 /* We use the compiler's inlining ability to ensure that PLANES is in effect a compile time
    constant.  That will cause some unnecessary code to be optimized away.
    Don't touch this if you don't know what you are doing.  */
@@ -907,38 +976,7 @@ STATIC_INLINE void pfield_doline_1 (uae_u32 *pixels, int wordcount, int planes)
 	case 1: b7 = GETLONG ((uae_u32 *)real_bplpt[0]); real_bplpt[0] += 4;
 	}
 
-	MERGE (b0, b1, 0x55555555, 1);
-	MERGE (b2, b3, 0x55555555, 1);
-	MERGE (b4, b5, 0x55555555, 1);
-	MERGE (b6, b7, 0x55555555, 1);
-
-	MERGE (b0, b2, 0x33333333, 2);
-	MERGE (b1, b3, 0x33333333, 2);
-	MERGE (b4, b6, 0x33333333, 2);
-	MERGE (b5, b7, 0x33333333, 2);
-
-	MERGE (b0, b4, 0x0f0f0f0f, 4);
-	MERGE (b1, b5, 0x0f0f0f0f, 4);
-	MERGE (b2, b6, 0x0f0f0f0f, 4);
-	MERGE (b3, b7, 0x0f0f0f0f, 4);
-
-	MERGE (b0, b1, 0x00ff00ff, 8);
-	MERGE (b2, b3, 0x00ff00ff, 8);
-	MERGE (b4, b5, 0x00ff00ff, 8);
-	MERGE (b6, b7, 0x00ff00ff, 8);
-
-	MERGE (b0, b2, 0x0000ffff, 16);
-	do_put_mem_long (pixels, b0);
-	do_put_mem_long (pixels + 4, b2);
-	MERGE (b1, b3, 0x0000ffff, 16);
-	do_put_mem_long (pixels + 2, b1);
-	do_put_mem_long (pixels + 6, b3);
-	MERGE (b4, b6, 0x0000ffff, 16);
-	do_put_mem_long (pixels + 1, b4);
-	do_put_mem_long (pixels + 5, b6);
-	MERGE (b5, b7, 0x0000ffff, 16);
-	do_put_mem_long (pixels + 3, b5);
-	do_put_mem_long (pixels + 7, b7);
+	planar_to_chunky (pixels, b0, b1, b2, b3, b4, b5, b6, b7);
 	pixels += 8;
     }
 }
@@ -985,6 +1023,165 @@ static void pfield_doline (int lineno)
     }
 }
 
+/* The fused converters.  Lines without sprites and HAM don't need the
+   pixdata.apixels pass: the bitplanes are converted 32 pixels at a time
+   and written straight to the host line through a lookup table that is
+   rebuilt for every span from the current colors.  */
+static union {
+    uae_u32 l[8];
+    uae_u8 bytes[32];
+} fused_chunk;
+static int fused_chunk_nr;
+static uae_u8 *fused_line_data;
+static uae_u32 fused_lut[256];
+
+static void fused_decode_chunk (int nr)
+{
+    uae_u8 *ld;
+    uae_u32 b0, b1, b2, b3, b4, b5, b6, b7;
+
+    fused_chunk_nr = nr;
+    if (nr < 0 || nr >= dp_for_drawing->plflinelen) {
+	memset (fused_chunk.l, 0, sizeof fused_chunk.l);
+	return;
+    }
+    ld = fused_line_data + 4 * nr;
+
+#define PLANE_LONG(n) GETLONG ((uae_u32 *)(ld + (n)*MAX_WORDS_PER_LINE*2))
+    b0 = 0, b1 = 0, b2 = 0, b3 = 0, b4 = 0, b5 = 0, b6 = 0, b7 = 0;
+    switch (bplplanecnt) {
+    case 8: b0 = PLANE_LONG (7);
+    case 7: b1 = PLANE_LONG (6);
+    case 6: b2 = PLANE_LONG (5);
+    case 5: b3 = PLANE_LONG (4);
+    case 4: b4 = PLANE_LONG (3);
+    case 3: b5 = PLANE_LONG (2);
+    case 2: b6 = PLANE_LONG (1);
+    case 1: b7 = PLANE_LONG (0);
+    }
+#undef PLANE_LONG
+    planar_to_chunky (fused_chunk.l, b0, b1, b2, b3, b4, b5, b6, b7);
+}
+
+/* Must produce exactly what linetoscr.c would for each pixel value.  */
+static void fused_build_lut (void)
+{
+    int aga = (currprefs.chipset_mask & CSMASK_AGA) != 0;
+    uae_u8 xor_val = (uae_u8)(dp_for_drawing->bplcon4 >> 8);
+    int n = 1 << bplplanecnt;
+    int i;
+
+    if (bpldualpf && aga) {
+	int *lookup = bpldualpfpri ? dblpf_ind2_aga : dblpf_ind1_aga;
+	int *lookup_no = bpldualpfpri ? dblpf_2nd2 : dblpf_2nd1;
+	for (i = 0; i < n; i++) {
+	    int val = lookup[i];
+	    if (lookup_no[i] == 2)
+		val += dblpfofs[bpldualpf2of];
+	    fused_lut[i] = colors_for_drawing.acolors[val];
+	}
+    } else if (bpldualpf) {
+	int *lookup = bpldualpfpri ? dblpf_ind2 : dblpf_ind1;
+	for (i = 0; i < n; i++)
+	    fused_lut[i] = colors_for_drawing.acolors[lookup[i]];
+    } else if (bplehb) {
+	for (i = 0; i < n; i++) {
+	    if (aga && i >= 32 && i < 64)
+		fused_lut[i] = (colors_for_drawing.color_regs_aga[(i - 32) ^ xor_val] >> 1) & 0x7F7F7F;
+	    else if (! aga && i >= 32)
+		fused_lut[i] = xcolors[(colors_for_drawing.color_regs_ecs[i - 32] >> 1) & 0x777];
+	    else
+		fused_lut[i] = colors_for_drawing.acolors[i];
+	}
+    } else if (aga) {
+	for (i = 0; i < n; i++)
+	    fused_lut[i] = colors_for_drawing.acolors[i ^ xor_val];
+    } else {
+	for (i = 0; i < n; i++)
+	    fused_lut[i] = colors_for_drawing.acolors[i];
+    }
+}
+
+#define TYPE uae_u8
+#define LNAME fusedtoscr_8
+#define SRC_INC 1
+#define HDOUBLE 0
+#include "linetoscr_fused.c"
+#define LNAME fusedtoscr_8_stretch1
+#define SRC_INC 1
+#define HDOUBLE 1
+#include "linetoscr_fused.c"
+#define LNAME fusedtoscr_8_shrink1
+#define SRC_INC 2
+#define HDOUBLE 0
+#include "linetoscr_fused.c"
+#undef TYPE
+
+#define TYPE uae_u16
+#define LNAME fusedtoscr_16
+#define SRC_INC 1
+#define HDOUBLE 0
+#include "linetoscr_fused.c"
+#define LNAME fusedtoscr_16_stretch1
+#define SRC_INC 1
+#define HDOUBLE 1
+#include "linetoscr_fused.c"
+#define LNAME fusedtoscr_16_shrink1
+#define SRC_INC 2
+#define HDOUBLE 0
+#include "linetoscr_fused.c"
+#undef TYPE
+
+#define TYPE uae_u32
+#define LNAME fusedtoscr_32
+#define SRC_INC 1
+#define HDOUBLE 0
+#include "linetoscr_fused.c"
+#define LNAME fusedtoscr_32_stretch1
+#define SRC_INC 1
+#define HDOUBLE 1
+#include "linetoscr_fused.c"
+#define LNAME fusedtoscr_32_shrink1
+#define SRC_INC 2
+#define HDOUBLE 0
+#include "linetoscr_fused.c"
+#undef TYPE
+
+/* Whether the current line can be drawn by pfield_do_fusedtoscr.  Call
+   after pfield_init_linetoscr.  */
+STATIC_INLINE int pfield_can_fuse (void)
+{
+    if (dip_for_drawing->nr_sprites != 0 || dp_for_drawing->ham_seen)
+	return 0;
+    if (currprefs.chipset_mask & CSMASK_AGA)
+	return 1;
+    return res_shift >= -1 && res_shift <= 1;
+}
+
+static void pfield_do_fusedtoscr (int start, int stop)
+{
+    fused_build_lut ();
+    /* As in pfield_do_linetoscr, AGA treats every upscale as stretch1.  */
+    if (res_shift == 0)
+	switch (gfxvidinfo.pixbytes) {
+	case 1: src_pixel = fusedtoscr_8 (src_pixel, start, stop); break;
+	case 2: src_pixel = fusedtoscr_16 (src_pixel, start, stop); break;
+	case 4: src_pixel = fusedtoscr_32 (src_pixel, start, stop); break;
+	}
+    else if (res_shift > 0)
+	switch (gfxvidinfo.pixbytes) {
+	case 1: src_pixel = fusedtoscr_8_stretch1 (src_pixel, start, stop); break;
+	case 2: src_pixel = fusedtoscr_16_stretch1 (src_pixel, start, stop); break;
+	case 4: src_pixel = fusedtoscr_32_stretch1 (src_pixel, start, stop); break;
+	}
+    else
+	switch (gfxvidinfo.pixbytes) {
+	case 1: src_pixel = fusedtoscr_8_shrink1 (src_pixel, start, stop); break;
+	case 2: src_pixel = fusedtoscr_16_shrink1 (src_pixel, start, stop); break;
+	case 4: src_pixel = fusedtoscr_32_shrink1 (src_pixel, start, stop); break;
+	}
+}
+
 void init_row_map (void)
 {
     int i;
@@ -1073,6 +1270,9 @@ static void init_aspect_maps (void)
  */
 static void do_flush_line_1 (int lineno)
 {
+    if (capture_video_on)
+	capture_line (lineno, gfxvidinfo.linemem ? gfxvidinfo.linemem : row_map[lineno]);
+
     if (lineno < first_drawn_line)
 	first_drawn_line = lineno;
     if (lineno > last_drawn_line)
@@ -1231,6 +1431,7 @@ STATIC_INLINE void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
     static int warned = 0;
     int border = 0;
     int do_double = 0;
+    int fused;
     enum double_how dh;
 
     dp_for_drawing = line_decisions + lineno;
@@ -1293,7 +1494,12 @@ STATIC_INLINE void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 	    curr_gfx->lores = 2;
 
 	pfield_init_linetoscr ();
-	pfield_doline (lineno);
+	fused = pfield_can_fuse ();
+	if (fused) {
+	    fused_line_data = line_data[lineno];
+	    fused_chunk_nr = INT_MAX;
+	} else
+	    pfield_doline (lineno);
 
 	adjust_drawing_colors (dp_for_drawing->ctable, dp_for_drawing->ham_seen || bplehb);
 
@@ -1322,7 +1528,7 @@ STATIC_INLINE void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 	    }
 	}
 
-	do_color_changes (pfield_do_fill_line, pfield_do_linetoscr);
+	do_color_changes (pfield_do_fill_line, fused ? pfield_do_fusedtoscr : pfield_do_linetoscr);
 	if (dh == dh_emerg)
 	    memcpy (row_map[gfx_ypos], xlinebuffer + linetoscr_x_adjust_bytes, gfxvidinfo.pixbytes * gfxvidinfo.width);
 
@@ -1773,12 +1979,16 @@ int check_prefs_changed_gfx (void)
 void vsync_handle_redraw (int long_frame, int lof_changed)
 {
     last_redraw_point++;
+    fs_frames++;
     if (lof_changed || ! interlace_seen || last_redraw_point >= 2 || long_frame) {
 	last_redraw_point = 0;
 	interlace_seen = 0;
 
-	if (framecnt == 0)
+	if (framecnt == 0) {
+	    long int start = busy_usecs ();
 	    finish_drawing_frame ();
+	    fs_draw_usecs = busy_usecs () - start;
+	}
 
 	/* At this point, we have finished both the hardware and the
 	 * drawing frame. Essentially, we are outside of all loops and
@@ -1796,6 +2006,8 @@ void vsync_handle_redraw (int long_frame, int lof_changed)
 	    uae_reset (0);
 	}
 
+	forkserver_vsync ();
+
 	if (quit_program < 0) {
 	    quit_program = -quit_program;
 	    set_inhibit_frame (IHF_QUIT_PROGRAM);
@@ -186,7 +186,8 @@ static void expamem_bput (uaecptr, uae_u32) REGPARAM;
 addrbank expamem_bank = {
     expamem_lget, expamem_wget, expamem_bget,
     expamem_lput, expamem_wput, expamem_bput,
-    default_xlate, default_check, NULL, "Autoconfig"
+    default_xlate, default_check, NULL, "Autoconfig",
+    0
 };
 
 static uae_u32 REGPARAM2 expamem_lget (uaecptr addr)
@@ -378,7 +379,8 @@ static uae_u8 REGPARAM2 *fastmem_xlate (uaecptr addr)
 addrbank fastmem_bank = {
     fastmem_lget, fastmem_wget, fastmem_bget,
     fastmem_lput, fastmem_wput, fastmem_bput,
-    fastmem_xlate, fastmem_check, NULL, "Fast memory"
+    fastmem_xlate, fastmem_check, NULL, "Fast memory",
+    ABFLAG_RAM
 };
 
 
@@ -445,7 +447,8 @@ static void REGPARAM2 filesys_bput (uaecptr addr, uae_u32 b)
 addrbank filesys_bank = {
     filesys_lget, filesys_wget, filesys_bget,
     filesys_lput, filesys_wput, filesys_bput,
-    default_xlate, default_check, NULL, "Filesystem Autoconfig Area"
+    default_xlate, default_check, NULL, "Filesystem Autoconfig Area",
+    0
 };
 
 /*
@@ -534,7 +537,8 @@ static uae_u8 REGPARAM2 *z3fastmem_xlate (uaecptr addr)
 addrbank z3fastmem_bank = {
     z3fastmem_lget, z3fastmem_wget, z3fastmem_bget,
     z3fastmem_lput, z3fastmem_wput, z3fastmem_bput,
-    z3fastmem_xlate, z3fastmem_check, NULL, "ZorroIII Fast RAM"
+    z3fastmem_xlate, z3fastmem_check, NULL, "ZorroIII Fast RAM",
+    ABFLAG_RAM
 };
 
 /* Z3-based UAEGFX-card */
@@ -40,6 +40,7 @@
 #include "fsusage.h"
 #include "native2amiga.h"
 #include "scsidev.h"
+#include "metrics.h"
 #include "fsdb.h"
 
 /* Count the number of FS packets waiting to be serviced, for the benefit
@@ -2921,7 +2922,7 @@ static uae_u32 exter_int_helper (TrapContext *dummy)
     return 0;
 }
 
-static int handle_packet (Unit *unit, dpacket pck)
+static int handle_packet_1 (Unit *unit, dpacket pck)
 {
     uae_s32 type = GET_PCK_TYPE (pck);
     PUT_PCK_RES2 (pck, 0);
@@ -2977,6 +2978,16 @@ static int handle_packet (Unit *unit, dpacket pck)
     return 1;
 }
 
+static int handle_packet (Unit *unit, dpacket pck)
+{
+    unsigned long start = metrics_usecs ();
+    int result = handle_packet_1 (unit, pck);
+
+    METRIC_INC (METRIC_FS_PACKETS);
+    metrics_observe (METRIC_FS_LATENCY, metrics_usecs () - start);
+    return result;
+}
+
 #ifdef UAE_FILESYS_THREADS
 static void *filesys_thread (void *unit_v)
 {
@@ -3014,6 +3025,7 @@ static void *filesys_thread (void *unit_v)
 	/* The message is sent by our interrupt handler, so make sure an interrupt
 	 * happens. */
 	uae_int_requested = 1;
+	idle_wakeup ();
  
 	uae_sem_wait (&packet_counter_sem);
 	active_fs_packets--;
@@ -3131,6 +3143,31 @@ void filesys_start_threads (void)
     }
 }
 
+/* After fork () only the calling thread exists in the child.  Give every
+ * unit a new thread; packets still queued in the pipe are picked up by it,
+ * a packet the old thread was working on is lost.  */
+void filesys_restart_threads (void)
+{
+#ifdef UAE_FILESYS_THREADS
+    UnitInfo *uip;
+    int i;
+
+    if (current_mountinfo == 0)
+	return;
+    uip = current_mountinfo->ui;
+    for (i = 0; i < current_mountinfo->num_units; i++) {
+	smp_comm_pipe *p = uip[i].unit_pipe;
+	if (p == 0)
+	    continue;
+	p->reader_waiting = p->writer_waiting = 0;
+	uae_sem_init (&p->lock, 0, 1);
+	uae_sem_init (&p->reader_wait, 0, 0);
+	uae_sem_init (&p->writer_wait, 0, 0);
+	uae_start_thread (filesys_thread, (void *)(uip + i), &uip[i].tid);
+    }
+#endif
+}
+
 void filesys_reset (void)
 {
     Unit *u, *u1;
@@ -0,0 +1,330 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Fork server
+  *
+  * With fork_server=path, the emulator boots (or restores fork_server_state)
+  * and runs for fork_server_frames frames.  Then it stops emulating and
+  * listens on a UNIX domain socket at path.  A client connects and sends
+  * config file lines with the settings for one job, ending with an empty
+  * line.  The server fork()s.  The child carries on from the snapshot, with
+  * the connection as its stdin, stdout and stderr.  Fast and ROM memory
+  * are shared with the server copy-on-write, so starting a job costs a fork
+  * instead of a boot.  Chip memory is a shared mapping when it is mirrored
+  * (CHIPMEM_MIRROR), so each job copies it first.  When the child exits,
+  * the server writes "exit <status>" to the connection and closes it.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "threaddep/thread.h"
+#include "uae.h"
+#include "gensound.h"
+#include "audio.h"
+#include "memory.h"
+#include "custom.h"
+#include "xwin.h"
+#include "drawing.h"
+#include "savestate.h"
+#include "filesys.h"
+#include "capture.h"
+#include "metrics.h"
+#include "disk.h"
+#include "serial.h"
+#include "forkserver.h"
+
+#if defined(__unix) && !defined(__BEOS__) && !defined(__DOS__)
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+#define FS_MAXJOBS 256
+#define FS_MAXLINE 1024
+/* How many seconds a client gets to send its settings.  */
+#define FS_JOB_TIMEOUT 5
+
+int forkserver_child;
+
+static int fs_waiting;
+static int fs_frames;
+static int fs_sock = -1;
+static int fs_serial;
+
+static struct {
+    pid_t pid;
+    int fd;
+} fs_jobs[FS_MAXJOBS];
+static int fs_njobs;
+
+void forkserver_init (void)
+{
+    if (currprefs.fork_server[0] == '\0')
+	return;
+
+    fs_waiting = 1;
+    fs_frames = currprefs.fork_server_frames;
+    if (currprefs.fork_server_state[0] != '\0') {
+	savestate_filename = currprefs.fork_server_state;
+	savestate_state = STATE_DORESTORE;
+    }
+}
+
+static int fs_listen (const char *path)
+{
+    struct sockaddr_un addr;
+    int s;
+
+    if (strlen (path) >= sizeof addr.sun_path) {
+	write_log ("Fork server: socket path too long.\n");
+	return -1;
+    }
+    s = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0)
+	return -1;
+    memset (&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+    unlink (path);
+    if (bind (s, (struct sockaddr *)&addr, sizeof addr) < 0 || listen (s, 16) < 0) {
+	write_log ("Fork server: can't listen on %s: %s\n", path, strerror (errno));
+	close (s);
+	return -1;
+    }
+    return s;
+}
+
+/* Read the job's settings, one line at a time, up to an empty line.  This
+ * goes a byte at a time, because what follows is the job's standard input.
+ * Returns -1 if the client takes longer than FS_JOB_TIMEOUT seconds; the
+ * server can't serve anyone else meanwhile.  */
+static int fs_read_job (int fd, char *buf, int size)
+{
+    time_t end = time (0) + FS_JOB_TIMEOUT;
+    int len = 0;
+
+    while (len < size - 1) {
+	struct timeval tv;
+	fd_set rd;
+	time_t now = time (0);
+	int n;
+
+	if (now >= end)
+	    return -1;
+	FD_ZERO (&rd);
+	FD_SET (fd, &rd);
+	tv.tv_sec = end - now;
+	tv.tv_usec = 0;
+	n = select (fd + 1, &rd, 0, 0, &tv);
+	if (n == 0 || (n < 0 && errno == EINTR))
+	    continue;
+	if (n < 0)
+	    break;
+	n = read (fd, buf + len, 1);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	len++;
+	if (len >= 2 && buf[len - 1] == '\n' && buf[len - 2] == '\n')
+	    break;
+	if (len == 1 && buf[0] == '\n')
+	    break;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/* Tell a client something.  It may have gone away; that mustn't raise
+ * SIGPIPE in the server.  */
+static void fs_send (int fd, const char *msg)
+{
+#ifdef MSG_NOSIGNAL
+    send (fd, msg, strlen (msg), MSG_NOSIGNAL);
+#else
+    write (fd, msg, strlen (msg));
+#endif
+}
+
+static void fs_reap (void)
+{
+    int status, i;
+    pid_t pid;
+
+    while ((pid = waitpid (-1, &status, WNOHANG)) > 0) {
+	for (i = 0; i < fs_njobs; i++) {
+	    char msg[64];
+	    if (fs_jobs[i].pid != pid)
+		continue;
+	    sprintf (msg, "exit %d\n", WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status));
+	    fs_send (fs_jobs[i].fd, msg);
+	    close (fs_jobs[i].fd);
+	    fs_jobs[i] = fs_jobs[--fs_njobs];
+	    break;
+	}
+    }
+}
+
+/* In the child: apply the job's settings and bring back the parts of the
+ * emulator that the server shut down, or that don't survive fork ().  */
+static void fs_start_job (int fd, char *job)
+{
+    char *line, *next;
+
+    close (fs_sock);
+    signal (SIGPIPE, SIG_DFL);
+    dup2 (fd, 0);
+    dup2 (fd, 1);
+    dup2 (fd, 2);
+    close (fd);
+    forkserver_child = 1;
+    fs_waiting = 0;
+#ifdef CHIPMEM_MIRROR
+    if (! chipmem_unshare ()) {
+	write_log ("Fork server: can't copy chip memory for the job.\n");
+	exit (1);
+    }
+#endif
+
+    for (line = job; *line; line = next) {
+	next = strchr (line, '\n');
+	if (next)
+	    *next++ = '\0';
+	else
+	    next = line + strlen (line);
+	if (*line)
+	    cfgfile_parse_line (&changed_prefs, line);
+    }
+    /* Only read at startup.  */
+    strcpy (currprefs.capture_video, changed_prefs.capture_video);
+    strcpy (currprefs.capture_audio, changed_prefs.capture_audio);
+    currprefs.capture_video_format = changed_prefs.capture_video_format;
+    strcpy (currprefs.metrics_socket, changed_prefs.metrics_socket);
+
+    printf ("started %d\n", (int)getpid ());
+    fflush (stdout);
+
+    filesys_restart_threads ();
+    disk_start_threads ();
+    if (fs_serial)
+	serial_open ();
+    if (! graphics_setup () || ! graphics_init ()) {
+	write_log ("Fork server: can't initialize graphics in job.\n");
+	exit (1);
+    }
+    reset_drawing ();
+    notice_screen_contents_lost ();
+    notice_new_xcolors ();
+    if (currprefs.produce_sound >= 2 && ! init_audio ()) {
+	write_log ("Sound driver unavailable: Sound output disabled\n");
+	currprefs.produce_sound = changed_prefs.produce_sound = 0;
+    }
+    capture_start ();
+    metrics_start ();
+}
+
+static void fs_serve (void)
+{
+    fs_sock = fs_listen (currprefs.fork_server);
+    if (fs_sock < 0) {
+	write_log ("Fork server not started, running normally.\n");
+	fs_waiting = 0;
+	return;
+    }
+
+    /* Clients that went away must not take the server with them; fs_send
+     * covers hosts without MSG_NOSIGNAL.  */
+    signal (SIGPIPE, SIG_IGN);
+
+    /* No helper threads may be running when we fork.  The serial device
+     * goes with its I/O thread; every job opens its own.  */
+    disk_stop_threads ();
+    fs_serial = serial_is_open ();
+    serial_close ();
+
+    /* Give the host devices back; every job opens its own.  */
+    graphics_leave ();
+    if (currprefs.produce_sound >= 2)
+	close_sound ();
+    write_log ("Fork server ready on %s\n", currprefs.fork_server);
+
+    for (;;) {
+	char job[FS_MAXLINE * 8];
+	struct timeval tv;
+	fd_set rd;
+	pid_t pid;
+	int fd;
+
+	fs_reap ();
+	FD_ZERO (&rd);
+	FD_SET (fs_sock, &rd);
+	tv.tv_sec = 0;
+	tv.tv_usec = 200000;
+	if (select (fs_sock + 1, &rd, 0, 0, &tv) <= 0)
+	    continue;
+	fd = accept (fs_sock, 0, 0);
+	if (fd < 0)
+	    continue;
+	if (fs_njobs == FS_MAXJOBS) {
+	    fs_send (fd, "busy\n");
+	    close (fd);
+	    continue;
+	}
+	if (fs_read_job (fd, job, sizeof job) < 0) {
+	    write_log ("Fork server: client sent no job in time.\n");
+	    close (fd);
+	    continue;
+	}
+
+	fflush (stdout);
+	fflush (stderr);
+	pid = fork ();
+	if (pid == 0) {
+	    fs_start_job (fd, job);
+	    return;
+	}
+	if (pid < 0) {
+	    write_log ("Fork server: fork failed: %s\n", strerror (errno));
+	    fs_send (fd, "exit 255\n");
+	    close (fd);
+	    continue;
+	}
+	fs_jobs[fs_njobs].pid = pid;
+	fs_jobs[fs_njobs].fd = fd;
+	fs_njobs++;
+    }
+}
+
+/* Called once per frame from vsync_handle_redraw, where the frame has been
+ * completed and no hardware state is half-updated.  */
+void forkserver_vsync (void)
+{
+    if (! fs_waiting)
+	return;
+    if (savestate_state == STATE_DORESTORE || savestate_state == STATE_RESTORE)
+	return;
+    if (fs_frames > 0) {
+	fs_frames--;
+	return;
+    }
+    fs_serve ();
+}
+
+#else
+
+int forkserver_child;
+
+void forkserver_init (void)
+{
+    if (currprefs.fork_server[0] != '\0')
+	write_log ("Fork server not supported on this system.\n");
+}
+
+void forkserver_vsync (void)
+{
+}
+
+#endif
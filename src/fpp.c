@@ -18,7 +18,7 @@
 #include "events.h"
 #include "newcpu.h"
 #include "ersatz.h"
-#include "md-fpp.h"
+#include "fpp.h"
 #include "savestate.h"
 
 #if 1
@@ -29,8 +29,6 @@
 #define FFLAG_N   0x0100
 #define FFLAG_NAN 0x0400
 
-#define MAKE_FPSR(r)  regs.fp_result=(r)
-
 static __inline__ void native_set_fpucw (uae_u32 m68k_cw)
 {
 }
@@ -55,25 +53,6 @@ static int get_fpu_version(void)
     return v;
 }
 
-#if defined(uae_s64) /* Close enough for government work? */
-static __inline__ uae_s64 toint (fptype src)
-#else
-static __inline__ uae_s32 toint (fptype src)
-#endif
-{
-    switch ((regs.fpcr >> 4) & 0x3) {
-    case 0:
-	return (int) (src + 0.5);
-    case 1:
-	return (int) src;
-    case 2:
-	return floor (src);
-    case 3:
-	return ceil (src);
-    }
-    return src; /* Should never be reached */
-}
-
 static uae_u32 get_fpsr (void)
 {
     uae_u32 answer = regs.fpsr & 0x00ffffff;
@@ -157,7 +136,9 @@ STATIC_INLINE fptype to_pack (uae_u32 wrd1, uae_u32 wrd2, uae_u32 wrd3)
     *cp++ = ((wrd1 >> 20) & 0xf) + '0';
     *cp++ = ((wrd1 >> 16) & 0xf) + '0';
     *cp = 0;
-    sscanf (str, "%le", &d);
+    /* Nothing parses if the first digit is above 9.  */
+    if (sscanf (str, "%le", &d) != 1)
+	d = 0;
     return d;
 }
 
@@ -221,6 +202,7 @@ static void fpu_op_illg (uae_u32 opcode, int pcoffset)
 	    m68k_areg (regs, 7) = regs.isp;
 	}
 	regs.s = 1;
+	mmu_set_super (1);
 	m68k_areg (regs, 7) -= 4;
 	put_long (m68k_areg (regs, 7), oldpc);
 	m68k_areg (regs, 7) -= 4;
@@ -241,7 +223,7 @@ static void fpu_op_illg (uae_u32 opcode, int pcoffset)
 
 STATIC_INLINE int fault_if_no_fpu (uae_u32 opcode, int pcoffset)
 {
-    if ((regs.pcr & 2) || currprefs.fpu_model <= 0) {
+    if (! fpu_enabled ()) {
 	fpu_op_illg (opcode, pcoffset);
 	return 1;
     }
@@ -563,93 +545,6 @@ STATIC_INLINE int get_fp_ad (uae_u32 opcode, uae_u32 * ad)
     return 1;
 }
 
-STATIC_INLINE int fpp_cond (uae_u32 opcode, int contition)
-{
-    int N = (regs.fp_result < 0);
-    int Z = (regs.fp_result == 0);
-    /* int I = (regs.fpsr & 0x2000000) != 0; */
-    int NotANumber = 0;
-
-#ifdef HAVE_ISNAN
-    NotANumber = isnan (regs.fp_result);
-#endif
-
-    if (NotANumber)
-	N=Z=0;
-
-    switch (contition) {
-    case 0x00:
-	return 0;
-    case 0x01:
-	return Z;
-    case 0x02:
-	return !(NotANumber || Z || N);
-    case 0x03:
-	return Z || !(NotANumber || N);
-    case 0x04:
-	return N && !(NotANumber || Z);
-    case 0x05:
-	return Z || (N && !NotANumber);
-    case 0x06:
-	return !(NotANumber || Z);
-    case 0x07:
-	return !NotANumber;
-    case 0x08:
-	return NotANumber;
-    case 0x09:
-	return NotANumber || Z;
-    case 0x0a:
-	return NotANumber || !(N || Z);
-    case 0x0b:
-	return NotANumber || Z || !N;
-    case 0x0c:
-	return NotANumber || (N && !Z);
-    case 0x0d:
-	return NotANumber || Z || N;
-    case 0x0e:
-	return !Z;
-    case 0x0f:
-	return 1;
-    case 0x10:
-	return 0;
-    case 0x11:
-	return Z;
-    case 0x12:
-	return !(NotANumber || Z || N);
-    case 0x13:
-	return Z || !(NotANumber || N);
-    case 0x14:
-	return N && !(NotANumber || Z);
-    case 0x15:
-	return Z || (N && !NotANumber);
-    case 0x16:
-	return !(NotANumber || Z);
-    case 0x17:
-	return !NotANumber;
-    case 0x18:
-	return NotANumber;
-    case 0x19:
-	return NotANumber || Z;
-    case 0x1a:
-	return NotANumber || !(N || Z);
-    case 0x1b:
-	return NotANumber || Z || !N;
-    case 0x1c:
-#if 0
-	return NotANumber || (Z && N); /* This is wrong, compare 0x0c */
-#else
-	return NotANumber || (N && !Z);
-#endif
-    case 0x1d:
-	return NotANumber || Z || N;
-    case 0x1e:
-	return !Z;
-    case 0x1f:
-	return 1;
-    }
-    return -1;
-}
-
 void fdbcc_opp (uae_u32 opcode, uae_u16 extra)
 {
     uaecptr pc = (uae_u32) m68k_getpc ();
@@ -438,7 +438,8 @@ static void gayle_bput (uaecptr, uae_u32) REGPARAM;
 addrbank gayle_bank = {
     gayle_lget, gayle_wget, gayle_bget,
     gayle_lput, gayle_wput, gayle_bput,
-    default_xlate, default_check, NULL, "Gayle (low)"
+    default_xlate, default_check, NULL, "Gayle (low)",
+    0
 };
 
 #if 0
@@ -572,7 +573,8 @@ static void gayle2_bput (uaecptr, uae_u32) REGPARAM;
 addrbank gayle2_bank = {
     gayle2_lget, gayle2_wget, gayle2_bget,
     gayle2_lput, gayle2_wput, gayle2_bput,
-    default_xlate, default_check, NULL, "Gayle (high)"
+    default_xlate, default_check, NULL, "Gayle (high)",
+    0
 };
 
 static uae_u32 REGPARAM2 gayle2_lget (uaecptr addr)
@@ -755,7 +757,8 @@ static void REGPARAM2 mbres_bput (uaecptr addr, uae_u32 value)
 addrbank mbres_bank = {
     mbres_lget, mbres_wget, mbres_bget,
     mbres_lput, mbres_wput, mbres_bput,
-    default_xlate, default_check, NULL, "Motherboard Resources"
+    default_xlate, default_check, NULL, "Motherboard Resources",
+    0
 };
 
 void gayle_hsync (void)
@@ -813,7 +816,8 @@ static void gayle_attr_bput (uaecptr, uae_u32) REGPARAM;
 addrbank gayle_attr_bank = {
     gayle_attr_lget, gayle_attr_wget, gayle_attr_bget,
     gayle_attr_lput, gayle_attr_wput, gayle_attr_bput,
-    default_xlate, default_check, NULL, "Gayle PCMCIA attribute"
+    default_xlate, default_check, NULL, "Gayle PCMCIA attribute",
+    0
 };
 
 static uae_u32 REGPARAM2 gayle_attr_lget (uaecptr addr)
@@ -51,9 +51,22 @@ static int *opcode_map;
 static int *opcode_next_clev;
 static int *opcode_last_postfix;
 static unsigned long *counts;
+static int *stbl_postfix;
 
 static int generate_stbl;
 
+/* Fused handlers: each of up to MAX_PAIRHEADS instructions may be
+ * followed by one of up to MAX_PAIRTAILS others.  */
+#define MAX_PAIRHEADS 32
+#define MAX_PAIRTAILS 4
+
+static struct {
+    unsigned long opcode;
+    int ntails;
+    unsigned long tails[MAX_PAIRTAILS];
+} pairheads[MAX_PAIRHEADS];
+static int npairheads;
+
 static void read_counts (void)
 {
     FILE *file;
@@ -65,7 +78,7 @@ static void read_counts (void)
     file = fopen ("frequent.68k", "r");
     if (file) {
 	fscanf (file, "Total: %lu\n", &total);
-	while (fscanf (file, "%lx: %lu %s\n", &opcode, &count, name) == 3) {
+	while (fscanf (file, "%lx: %lu %19s\n", &opcode, &count, name) == 3) {
 	    opcode_next_clev[nr] = 6;
 	    opcode_last_postfix[nr] = -1;
 	    opcode_map[nr++] = opcode;
@@ -89,6 +102,51 @@ static void read_counts (void)
 	abort ();
 }
 
+/* Pick the most frequent pairs.  A fused handler only recognizes the
+ * second instruction if its table entry is the plain handler, so no
+ * instruction may both start one pair and end another.  */
+static void read_pairs (void)
+{
+    FILE *file;
+    unsigned long first, second, count, total;
+    char name1[20], name2[20];
+    char *is_head, *is_tail;
+    int i;
+
+    file = fopen ("frequent_pairs.68k", "r");
+    if (! file)
+	return;
+    is_head = (char *) xmalloc (65536);
+    is_tail = (char *) xmalloc (65536);
+    memset (is_head, 0, 65536);
+    memset (is_tail, 0, 65536);
+    fscanf (file, "Total: %lu\n", &total);
+    while (fscanf (file, "%lx %lx: %lu %19s %19s\n", &first, &second, &count, name1, name2) == 5) {
+	if (first > 0xffff || second > 0xffff
+	    || table68k[first].mnemo == i_ILLG || table68k[first].handler != -1
+	    || table68k[second].mnemo == i_ILLG || table68k[second].handler != -1
+	    || is_tail[first] || is_head[second])
+	    continue;
+	for (i = 0; i < npairheads; i++)
+	    if (pairheads[i].opcode == first)
+		break;
+	if (i == npairheads) {
+	    if (npairheads == MAX_PAIRHEADS)
+		continue;
+	    pairheads[npairheads].opcode = first;
+	    pairheads[npairheads++].ntails = 0;
+	}
+	if (pairheads[i].ntails == MAX_PAIRTAILS)
+	    continue;
+	pairheads[i].tails[pairheads[i].ntails++] = second;
+	is_head[first] = 1;
+	is_tail[second] = 1;
+    }
+    fclose (file);
+    free (is_head);
+    free (is_tail);
+}
+
 static char endlabelstr[80];
 static int endlabelno = 0;
 static int need_endlabel;
@@ -726,19 +784,24 @@ static void genflags_normal (flagtypes type, wordsizes size, char *value, char *
     char vstr[100], sstr[100], dstr[100];
     char usstr[100], udstr[100];
     char unsstr[100], undstr[100];
+    char *lazy_size;
+    int lazy;
 
     switch (size) {
      case sz_byte:
 	strcpy (vstr, "((uae_s8)(");
 	strcpy (usstr, "((uae_u8)(");
+	lazy_size = "LAZYF_BYTE";
 	break;
      case sz_word:
 	strcpy (vstr, "((uae_s16)(");
 	strcpy (usstr, "((uae_u16)(");
+	lazy_size = "LAZYF_WORD";
 	break;
      case sz_long:
 	strcpy (vstr, "((uae_s32)(");
 	strcpy (usstr, "((uae_u32)(");
+	lazy_size = "LAZYF_LONG";
 	break;
      default:
 	abort ();
@@ -789,6 +852,31 @@ static void genflags_normal (flagtypes type, wordsizes size, char *value, char *
 	break;
     }
 
+    lazy = type == flag_logical || type == flag_add || type == flag_sub || type == flag_cmp;
+    if (lazy) {
+	printf ("\n#ifdef LAZY_FLAGS\n");
+	switch (type) {
+	 case flag_logical:
+	    printf ("\tSET_LAZY_FLAGS (LAZYF_LOGICAL + %s, 0, 0, %s);\n", lazy_size, value);
+	    break;
+	 case flag_add:
+	    printf ("\tSET_LAZY_FLAGS (LAZYF_ADD + %s, %s, %s, %s);\n", lazy_size, src, dst, value);
+	    printf ("\tSET_XFLG (%s < %s);\n", undstr, usstr);
+	    break;
+	 case flag_sub:
+	    printf ("\tSET_LAZY_FLAGS (LAZYF_SUB + %s, %s, %s, %s);\n", lazy_size, src, dst, value);
+	    printf ("\tSET_XFLG (%s > %s);\n", usstr, udstr);
+	    break;
+	 case flag_cmp:
+	    printf ("\tSET_LAZY_FLAGS (LAZYF_CMP + %s, %s, %s, %s);\n", lazy_size, src, dst, value);
+	    break;
+	 default:
+	    break;
+	}
+	/* Not start_brace (), which would only be closed outside the #else.  */
+	printf ("#else\n\t{\n");
+    }
+
     switch (type) {
      case flag_logical_noclobber:
      case flag_logical:
@@ -802,7 +890,8 @@ static void genflags_normal (flagtypes type, wordsizes size, char *value, char *
      case flag_cmp:
      case flag_av:
      case flag_sv:
-	start_brace ();
+	if (! lazy)
+	    start_brace ();
 	printf ("\t" BOOL_TYPE " flgs = %s < 0;\n", sstr);
 	printf ("\t" BOOL_TYPE " flgo = %s < 0;\n", dstr);
 	printf ("\t" BOOL_TYPE " flgn = %s < 0;\n", vstr);
@@ -860,6 +949,8 @@ static void genflags_normal (flagtypes type, wordsizes size, char *value, char *
 	printf ("\tSET_NFLG (flgn != 0);\n");
 	break;
     }
+    if (lazy)
+	printf ("\t}\n#endif\n");
 }
 
 static void genflags (flagtypes type, wordsizes size, char *value, char *src, char *dst)
@@ -973,6 +1064,238 @@ static int source_is_imm1_8 (struct instr *i)
     return i->stype == 3;
 }
 
+/* The FPU operations that FPP handlers do inline, for the common source
+ * formats of their addressing mode.  Everything else goes to fpp_opp.
+ * The rounding ones also come as FSxxx (opmode | 0x40) and FDxxx
+ * (opmode | 0x44).  */
+static const struct {
+    int opmode;
+    const char *name;
+    int rounds;
+    const char *code;
+} fpp_ops[] = {
+    { 0x00, "FMOVE", 1, "regs.fp[reg] = src;" },
+    { 0x20, "FDIV", 1, "regs.fp[reg] /= src;" },
+    { 0x22, "FADD", 1, "regs.fp[reg] += src;" },
+    { 0x23, "FMUL", 1, "regs.fp[reg] *= src;" },
+    { 0x28, "FSUB", 1, "regs.fp[reg] -= src;" },
+    { 0x38, "FCMP", 0, "regs.fpsr = 0;\n\t\tMAKE_FPSR (regs.fp[reg] - src);" },
+    { 0x3a, "FTST", 0, "regs.fpsr = 0;\n\t\tMAKE_FPSR (src);" },
+    { -1 }
+};
+
+static const char fpp_fmt_names[] = "LSXPWDB";
+static const int fpp_fmt_size[7] = { 4, 4, 12, 12, 2, 8, 1 };
+
+/* Computes the address of an operand in ad, the way get_fp_value and
+ * put_fp_value do.  */
+static void gen_fpp_ea (amodes mode, int fmt)
+{
+    int size = fpp_fmt_size[fmt];
+
+    switch (mode) {
+    case Aind:
+	printf ("\t\tad = m68k_areg (regs, dstreg);\n");
+	break;
+    case Aipi:
+	printf ("\t\tad = m68k_areg (regs, dstreg);\n");
+	if (size == 1)
+	    printf ("\t\tm68k_areg (regs, dstreg) += areg_byteinc[dstreg];\n");
+	else
+	    printf ("\t\tm68k_areg (regs, dstreg) += %d;\n", size);
+	break;
+    case Apdi:
+	if (size == 1)
+	    printf ("\t\tm68k_areg (regs, dstreg) -= areg_byteinc[dstreg];\n");
+	else
+	    printf ("\t\tm68k_areg (regs, dstreg) -= %d;\n", size);
+	printf ("\t\tad = m68k_areg (regs, dstreg);\n");
+	break;
+    case Ad16:
+	printf ("\t\tad = m68k_areg (regs, dstreg) + (uae_s32) (uae_s16) next_iword ();\n");
+	break;
+    case Ad8r:
+	printf ("\t\tad = get_disp_ea_020 (m68k_areg (regs, dstreg), next_iword ());\n");
+	break;
+    case absw:
+	printf ("\t\tad = (uae_s32) (uae_s16) next_iword ();\n");
+	break;
+    case absl:
+	printf ("\t\tad = next_ilong ();\n");
+	break;
+    case PC16:
+	printf ("\t\tad = m68k_getpc ();\n");
+	printf ("\t\tad += (uae_s32) (uae_s16) next_iword ();\n");
+	break;
+    case PC8r:
+	printf ("\t\tad = m68k_getpc ();\n");
+	printf ("\t\tad = get_disp_ea_020 (ad, next_iword ());\n");
+	break;
+    case imm:
+	printf ("\t\tad = m68k_getpc ();\n");
+	printf ("\t\tm68k_setpc (ad + %d);\n", size);
+	break;
+    default:
+	abort ();
+    }
+}
+
+/* fmt -1 is a register source.  */
+static void gen_fpp_source (amodes mode, int fmt)
+{
+    static const char *dreg[7] = {
+	"(fptype) (uae_s32) m68k_dreg (regs, dstreg)",
+	"to_single (m68k_dreg (regs, dstreg))", 0, 0,
+	"(fptype) (uae_s16) m68k_dreg (regs, dstreg)", 0,
+	"(fptype) (uae_s8) m68k_dreg (regs, dstreg)"
+    };
+    static const char *mem[7] = {
+	"(fptype) (uae_s32) get_long (ad)",
+	"to_single (get_long (ad))", 0, 0,
+	"(fptype) (uae_s16) get_word (ad)",
+	"to_double (wrd1, wrd2)",
+	"(fptype) (uae_s8) get_byte (ad)"
+    };
+
+    if (fmt == -1) {
+	printf ("\t\tsrc = regs.fp[(extra >> 10) & 7];\n");
+	return;
+    }
+    if (mode == Dreg) {
+	printf ("\t\tsrc = %s;\n", dreg[fmt]);
+	return;
+    }
+    gen_fpp_ea (mode, fmt);
+    if (fmt == 5) {
+	printf ("\t\twrd1 = get_long (ad);\n");
+	printf ("\t\twrd2 = get_long (ad + 4);\n");
+    }
+    printf ("\t\tsrc = %s;\n", mem[fmt]);
+}
+
+static void gen_fpp_case (amodes mode, int fmt, int op, int opmode)
+{
+    int key = fmt == -1 ? opmode : 0x4000 | (fmt << 10) | opmode;
+
+    printf ("\tcase 0x%04x: /* %s%s", key,
+	    (opmode & 0x44) == 0x40 ? "FS" : (opmode & 0x44) == 0x44 ? "FD" : "",
+	    fpp_ops[op].name + ((opmode & 0x40) ? 1 : 0));
+    if (fmt == -1)
+	printf (" FPm,FPn */\n");
+    else
+	printf (".%c <ea>,FPn */\n", fpp_fmt_names[fmt]);
+    printf ("\t{\n");
+    if (fmt != -1 && mode != Dreg)
+	printf ("\t\tuaecptr ad;\n");
+    if (fmt == 5)
+	printf ("\t\tuae_u32 wrd1, wrd2;\n");
+    printf ("\t\tfptype src;\n");
+    printf ("\t\tint reg = (extra >> 7) & 7;\n");
+    gen_fpp_source (mode, fmt);
+    printf ("\t\t%s\n", fpp_ops[op].code);
+    if (fpp_ops[op].rounds) {
+	if ((opmode & 0x44) == 0x40)
+	    printf ("\t\tregs.fp[reg] = (float)regs.fp[reg];\n");
+	printf ("\t\tMAKE_FPSR (regs.fp[reg]);\n");
+    }
+    printf ("\t\tbreak;\n");
+    printf ("\t}\n");
+}
+
+/* FMOVE FPn,<ea>.  */
+static void gen_fpp_store (amodes mode, int fmt)
+{
+    static const char *dreg[7] = {
+	"toint (regs.fp[reg])",
+	"from_single (regs.fp[reg])", 0, 0,
+	"(toint (regs.fp[reg]) & 0xffff) | (m68k_dreg (regs, dstreg) & ~0xffff)", 0,
+	"(toint (regs.fp[reg]) & 0xff) | (m68k_dreg (regs, dstreg) & ~0xff)"
+    };
+
+    printf ("\tcase 0x%04x: /* FMOVE.%c FPn,<ea> */\n", 0x6000 | (fmt << 10), fpp_fmt_names[fmt]);
+    printf ("\t{\n");
+    if (mode != Dreg)
+	printf ("\t\tuaecptr ad;\n");
+    if (fmt == 5)
+	printf ("\t\tuae_u32 wrd1, wrd2;\n");
+    printf ("\t\tint reg = (extra >> 7) & 7;\n");
+    if (mode == Dreg) {
+	printf ("\t\tm68k_dreg (regs, dstreg) = %s;\n", dreg[fmt]);
+    } else {
+	gen_fpp_ea (mode, fmt);
+	switch (fmt) {
+	case 0:
+	    printf ("\t\tput_long (ad, toint (regs.fp[reg]));\n");
+	    break;
+	case 1:
+	    printf ("\t\tput_long (ad, from_single (regs.fp[reg]));\n");
+	    break;
+	case 4:
+	    printf ("\t\tput_word (ad, (uae_s16) toint (regs.fp[reg]));\n");
+	    break;
+	case 5:
+	    printf ("\t\tfrom_double (regs.fp[reg], &wrd1, &wrd2);\n");
+	    printf ("\t\tput_long (ad, wrd1);\n");
+	    printf ("\t\tput_long (ad + 4, wrd2);\n");
+	    break;
+	case 6:
+	    printf ("\t\tput_byte (ad, (uae_s8) toint (regs.fp[reg]));\n");
+	    break;
+	}
+    }
+    printf ("\t\tbreak;\n");
+    printf ("\t}\n");
+}
+
+/* The body of an FPP handler.  The addressing mode is fixed, so the switch
+ * picks the operation and the source format; the condition codes are left
+ * for fpp_cond and get_fpsr to work out from regs.fp_result.  Extended and
+ * packed operands, FMOVECR, the control registers, FMOVEM and the less
+ * common operations go through fpp_opp, as does everything if the FPU is
+ * missing or disabled.  */
+static void gen_fpp (amodes mode)
+{
+    int fmt, op;
+    int store = mode != imm && mode != PC16 && mode != PC8r;
+
+    if (mode == Areg) {
+	printf ("\tfpp_opp(opcode,extra);\n");
+	return;
+    }
+    printf ("\tswitch (! fpu_enabled () ? -1\n");
+    printf ("\t\t: extra & 0x4000 ? extra & 0xfc7f : extra & 0xe07f) {\n");
+    /* Assemblers put FPm,FPn in the Dn handler.  */
+    for (op = 0; mode == Dreg && fpp_ops[op].opmode != -1; op++) {
+	gen_fpp_case (mode, -1, op, fpp_ops[op].opmode);
+	if (fpp_ops[op].rounds) {
+	    gen_fpp_case (mode, -1, op, fpp_ops[op].opmode | 0x40);
+	    gen_fpp_case (mode, -1, op, fpp_ops[op].opmode | 0x44);
+	}
+    }
+    for (fmt = 0; fmt < 7; fmt++) {
+	if (fmt == 2 || fmt == 3)
+	    continue;
+	if (mode == Dreg && fmt == 5)
+	    continue;
+	/* get_fp_value reads an immediate byte from the wrong half.  */
+	if (mode == imm && fmt == 6)
+	    continue;
+	for (op = 0; fpp_ops[op].opmode != -1; op++) {
+	    gen_fpp_case (mode, fmt, op, fpp_ops[op].opmode);
+	    if (fpp_ops[op].rounds) {
+		gen_fpp_case (mode, fmt, op, fpp_ops[op].opmode | 0x40);
+		gen_fpp_case (mode, fmt, op, fpp_ops[op].opmode | 0x44);
+	    }
+	}
+	if (store)
+	    gen_fpp_store (mode, fmt);
+    }
+    printf ("\tdefault:\n");
+    printf ("\t\tfpp_opp(opcode,extra);\n");
+    printf ("\t\tbreak;\n");
+    printf ("\t}\n");
+}
+
 static void gen_opcode (unsigned long int opcode)
 {
     struct instr *curi = table68k + opcode;
@@ -2308,7 +2631,7 @@ static void gen_opcode (unsigned long int opcode)
 	    printf ("\t}\n");
 	}
 	break;
-    case i_MOVES:		/* ignore DFC and SFC because we have no MMU */
+    case i_MOVES:		/* DFC and SFC only select the MMU's user or supervisor tables */
     {
 	int old_brace_level;
 	genamode (curi->smode, "srcreg", curi->size, "extra", 1, 0, 0);
@@ -2317,11 +2640,15 @@ static void gen_opcode (unsigned long int opcode)
 	start_brace ();
 	printf ("\tuae_u32 src = regs.regs[(extra >> 12) & 15];\n");
 	genamode (curi->dmode, "dstreg", curi->size, "dst", 2, 0, 0);
+	printf ("\tmmu_set_super (regs.dfc & 4);\n");
 	genastore ("src", curi->dmode, "dstreg", curi->size, "dst");
+	printf ("\tmmu_set_super (regs.s);\n");
 	pop_braces (old_brace_level);
 	printf ("else");
 	start_brace ();
+	printf ("\tmmu_set_super (regs.sfc & 4);\n");
 	genamode (curi->dmode, "dstreg", curi->size, "src", 1, 0, 0);
+	printf ("\tmmu_set_super (regs.s);\n");
 	printf ("\tif (extra & 0x8000) {\n");
 	switch (curi->size) {
 	case sz_byte: printf ("\tm68k_areg (regs, (extra >> 12) & 7) = (uae_s32)(uae_s8)src;\n"); break;
@@ -2493,7 +2820,7 @@ static void gen_opcode (unsigned long int opcode)
     case i_FPP:
 	genamode (curi->smode, "srcreg", curi->size, "extra", 1, 0, 0);
 	sync_m68k_pc ();
-	printf ("\tfpp_opp(opcode,extra);\n");
+	gen_fpp (curi->dmode);
 	break;
     case i_FDBcc:
 	genamode (curi->smode, "srcreg", curi->size, "extra", 1, 0, 0);
@@ -2520,7 +2847,13 @@ static void gen_opcode (unsigned long int opcode)
 	printf ("\tuaecptr pc = m68k_getpc ();\n");
 	genamode (curi->dmode, "srcreg", curi->size, "extra", 1, 0, 0);
 	sync_m68k_pc ();
-	printf ("\tfbcc_opp(opcode,pc,extra);\n");
+	if ((opcode & 0x3f) < 0x20) {
+	    printf ("\tif (! fpu_enabled ())\n");
+	    printf ("\t\tfbcc_opp(opcode,pc,extra);\n");
+	    printf ("\telse if (fpp_cond (opcode, %d))\n", (int)(opcode & 0x3f));
+	    printf ("\t\tm68k_setpc (pc + extra);\n");
+	} else
+	    printf ("\tfbcc_opp(opcode,pc,extra);\n");
 	break;
     case i_FSAVE:
 	sync_m68k_pc ();
@@ -2575,18 +2908,20 @@ static void gen_opcode (unsigned long int opcode)
 	break;
     case i_MMUOP30A:
 	printf ("\tuaecptr pc = m68k_getpc ();\n");
+	/* The command word comes before the operand's extension words.  */
+	printf ("\tuae_u16 next = %s;\n", gen_nextiword (0));
 	if (curi->smode == Areg || curi->smode == Dreg)
 	    printf("\tuae_u16 extraa = 0;\n");
 	else
 	    genamode (curi->smode, "srcreg", curi->size, "extra", 0, 0, 0);
 	sync_m68k_pc ();
-	printf ("\tmmu_op30 (pc, opcode, 1, extraa);\n");
+	printf ("\tmmu_op30 (pc, opcode, 1, next, extraa);\n");
 	break;
     case i_MMUOP30B:
 	printf ("\tuaecptr pc = m68k_getpc ();\n");
 	genamode (curi->smode, "srcreg", curi->size, "extra", 0, 0, 0);
 	sync_m68k_pc ();
-	printf ("\tmmu_op30 (pc, opcode, 0, 0);\n");
+	printf ("\tmmu_op30 (pc, opcode, 0, 0, 0);\n");
 	break;
     default:
 	abort ();
@@ -2605,14 +2940,26 @@ static void generate_includes (FILE * f)
     fprintf (f, "#include \"options.h\"\n");
     fprintf (f, "#include \"memory.h\"\n");
     fprintf (f, "#include \"custom.h\"\n");
+    fprintf (f, "#include \"events.h\"\n");
     fprintf (f, "#include \"newcpu.h\"\n");
+    fprintf (f, "#include \"fpp.h\"\n");
+    fprintf (f, "#include \"metrics.h\"\n");
+    fprintf (f, "#include \"cputhread.h\"\n");
+    fprintf (f, "#include \"superinsn.h\"\n");
     fprintf (f, "#include \"cpu_prefetch.h\"\n");
     fprintf (f, "#include \"cputbl.h\"\n");
 
-    fprintf (f, "#define CPUFUNC(x) x##_ff\n"
+    /* Compiled a second time with NATMEM_CORE for the natmem accessors in
+     * memory.h, on hosts that have natmem.  */
+    fprintf (f, "#ifdef NATMEM_CORE\n"
+	     "#define CPUFUNC(x) x##_nm\n"
+	     "#else\n"
+	     "#define CPUFUNC(x) x##_ff\n"
+	     "#endif\n"
 	     "#ifdef NOFLAGS\n"
 	     "#include \"noflags.h\"\n"
-	     "#endif\n");
+	     "#endif\n"
+	     "#if !defined(NATMEM_CORE) || defined(NATMEM)\n");
 }
 
 static int postfix;
@@ -2639,12 +2986,15 @@ static void generate_one_opcode (int rp)
 	if (opcode_next_clev[rp] != cpu_level) {
 	    fprintf (stblfile, "{ CPUFUNC(op_%lx_%d), 0, %ld }, /* %s */\n", opcode, opcode_last_postfix[rp],
 		     opcode, lookuptab[i].name);
+	    stbl_postfix[opcode] = opcode_last_postfix[rp];
 	    return;
 	}
 	fprintf (stblfile, "{ CPUFUNC(op_%lx_%d), 0, %ld }, /* %s */\n", opcode, postfix, opcode, lookuptab[i].name);
+	stbl_postfix[opcode] = postfix;
     }
     fprintf (headerfile, "extern cpuop_func op_%lx_%d_nf;\n", opcode, postfix);
     fprintf (headerfile, "extern cpuop_func op_%lx_%d_ff;\n", opcode, postfix);
+    fprintf (headerfile, "extern cpuop_func op_%lx_%d_nm;\n", opcode, postfix);
     printf ("unsigned long REGPARAM2 CPUFUNC(op_%lx_%d)(uae_u32 opcode) /* %s */\n{\n", opcode, postfix, lookuptab[i].name);
 
     switch (table68k[opcode].stype) {
@@ -2725,6 +3075,58 @@ static void generate_one_opcode (int rp)
     opcode_last_postfix[rp] = postfix;
 }
 
+/* The fused handlers for the current CPU level, and their table.  */
+static void generate_pairs (void)
+{
+    int i, j;
+
+    fprintf (stblfile, "const struct cpupairtbl CPUFUNC(op_pairtbl_%d)[] = {\n", postfix);
+    printf ("#ifdef PART_8\n");
+    for (i = 0; i < npairheads; i++) {
+	unsigned long first = pairheads[i].opcode;
+	int k;
+
+	if (stbl_postfix[first] < 0)
+	    continue;
+	for (j = 0; j < pairheads[i].ntails; j++)
+	    if (stbl_postfix[pairheads[i].tails[j]] >= 0)
+		break;
+	if (j == pairheads[i].ntails)
+	    continue;
+	for (k = 0; lookuptab[k].name[0]; k++) {
+	    if (table68k[first].mnemo == lookuptab[k].mnemo)
+		break;
+	}
+
+	fprintf (stblfile, "{ CPUFUNC(op_pair_%lx_%d), CPUFUNC(op_%lx_%d), %ld }, /* %s */\n",
+		 first, postfix, first, stbl_postfix[first], first, lookuptab[k].name);
+	fprintf (headerfile, "extern cpuop_func op_pair_%lx_%d_nf;\n", first, postfix);
+	fprintf (headerfile, "extern cpuop_func op_pair_%lx_%d_ff;\n", first, postfix);
+	fprintf (headerfile, "extern cpuop_func op_pair_%lx_%d_nm;\n", first, postfix);
+	printf ("unsigned long REGPARAM2 CPUFUNC(op_pair_%lx_%d)(uae_u32 opcode) /* %s */\n{\n",
+		first, postfix, lookuptab[k].name);
+	printf ("\tunsigned long cycles = CPUFUNC(op_%lx_%d)(opcode);\n", first, stbl_postfix[first]);
+	printf ("\tuae_u32 next;\n");
+	printf ("\tcpuop_func *f;\n");
+	printf ("\tif (regs.spcflags)\n");
+	printf ("\t\treturn cycles;\n");
+	printf (using_prefetch ? "\tnext = regs.ir;\n" : "\tnext = get_iword (0);\n");
+	printf ("\tf = cpufunctbl[next];\n");
+	for (j = 0; j < pairheads[i].ntails; j++) {
+	    unsigned long second = pairheads[i].tails[j];
+	    if (stbl_postfix[second] < 0)
+		continue;
+	    printf ("\tif (f == CPUFUNC(op_%lx_%d))\n", second, stbl_postfix[second]);
+	    printf ("\t\treturn superinsn_continue (cycles) ? CPUFUNC(op_%lx_%d)(next) : cycles;\n",
+		    second, stbl_postfix[second]);
+	}
+	printf ("\treturn cycles;\n");
+	printf ("}\n");
+    }
+    printf ("#endif\n\n");
+    fprintf (stblfile, "{ 0, 0, 0 }};\n");
+}
+
 static void generate_func (void)
 {
     int i, j, rp;
@@ -2743,6 +3145,8 @@ static void generate_func (void)
 
 	postfix = i;
 	generate_stbl = i != 5;
+	for (rp = 0; rp < 65536; rp++)
+	    stbl_postfix[rp] = -1;
 	if (generate_stbl) {
 	    fprintf (stblfile, "const struct cputbl CPUFUNC(op_smalltbl_%d)[] = {\n", postfix);
 
@@ -2772,8 +3176,10 @@ static void generate_func (void)
 	    printf ("#endif\n\n");
 	}
 
-	if (generate_stbl)
+	if (generate_stbl) {
 	    fprintf (stblfile, "{ 0, 0, 0 }};\n");
+	    generate_pairs ();
+	}
     }
 }
 
@@ -2786,7 +3192,9 @@ int main (int argc, char **argv)
     opcode_last_postfix = (int *) xmalloc (sizeof (int) * nr_cpuop_funcs);
     opcode_next_clev = (int *) xmalloc (sizeof (int) * nr_cpuop_funcs);
     counts = (unsigned long *) xmalloc (65536 * sizeof (unsigned long));
+    stbl_postfix = (int *) xmalloc (65536 * sizeof (int));
     read_counts ();
+    read_pairs ();
 
     /* It would be a lot nicer to put all in one file (we'd also get rid of
      * cputbl.h that way), but cpuopti can't cope.  That could be fixed, but
@@ -2801,6 +3209,9 @@ int main (int argc, char **argv)
 
     generate_func ();
 
+    printf ("#endif\n");
+    fprintf (stblfile, "#endif\n");
+
     free (table68k);
     return 0;
 }
@@ -82,9 +82,19 @@ static unsigned int doColor (int i, int bits, int shift)
     return (i >> shift2) << shift;
 }
 
+/* The layout of truecolor pixels, for code that needs to read them back.  */
+int xcolor_bits[3], xcolor_shift[3];
+
 void alloc_colors64k (int rw, int gw, int bw, int rs, int gs, int bs)
 {
     int i;
+
+    xcolor_bits[0] = rw;
+    xcolor_bits[1] = gw;
+    xcolor_bits[2] = bw;
+    xcolor_shift[0] = rs;
+    xcolor_shift[1] = gs;
+    xcolor_shift[2] = bs;
     for (i = 0; i < 4096; i++) {
 	int r = i >> 8;
 	int g = (i >> 4) & 0xF;
@@ -0,0 +1,120 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Table-driven HAM decoding.  Included by drawing.c, and by
+  * test/hamtest.c, which checks it against the old switch-based decoder.
+  *
+  * Each pixel value PV turns the previous color C into
+  * (C & ham_keep[PV]) | ham_or[PV].  For palette loads the keep mask is
+  * zero and ham_or holds the register contents, so those entries are
+  * refreshed for every span.  The modify entries only depend on the mode.
+  */
+
+enum ham_mode {
+    ham_none, ham_ecs6, ham_aga6, ham_aga8
+};
+static enum ham_mode ham_tables_mode = -1;
+static uae_u32 ham_keep[256], ham_or[256];
+
+static enum ham_mode ham_select_mode (int ham, int planes, int aga)
+{
+    if (! ham || (planes != 6 && (! aga || planes != 8)))
+	return ham_none;
+    if (planes == 8)
+	return ham_aga8;
+    return aga ? ham_aga6 : ham_ecs6;
+}
+
+static void ham_build_tables (enum ham_mode mode, int aga,
+			      const uae_u16 *regs_ecs, const uae_u32 *regs_aga)
+{
+    int i;
+
+    if (mode != ham_tables_mode) {
+	ham_tables_mode = mode;
+	for (i = 0; i < 256; i++) {
+	    int v4 = i & 0xF, v6 = i & 0xFC;
+	    switch (mode) {
+	    case ham_none:
+		ham_keep[i] = 0;
+		break;
+	    case ham_ecs6:
+		switch (i & 0x30) {
+		case 0x00: ham_keep[i] = 0; ham_or[i] = 0; break;
+		case 0x10: ham_keep[i] = 0xFF0; ham_or[i] = v4; break;
+		case 0x20: ham_keep[i] = 0x0FF; ham_or[i] = v4 << 8; break;
+		case 0x30: ham_keep[i] = 0xF0F; ham_or[i] = v4 << 4; break;
+		}
+		break;
+	    case ham_aga6:
+		switch (i & 0x30) {
+		case 0x00: ham_keep[i] = 0; ham_or[i] = 0; break;
+		case 0x10: ham_keep[i] = 0xFFFF00; ham_or[i] = v4 << 4; break;
+		case 0x20: ham_keep[i] = 0x00FFFF; ham_or[i] = v4 << 20; break;
+		case 0x30: ham_keep[i] = 0xFF00FF; ham_or[i] = v4 << 12; break;
+		}
+		break;
+	    case ham_aga8:
+		switch (i & 0x3) {
+		case 0x0: ham_keep[i] = 0; ham_or[i] = 0; break;
+		case 0x1: ham_keep[i] = 0xFFFF03; ham_or[i] = v6; break;
+		case 0x2: ham_keep[i] = 0x03FFFF; ham_or[i] = v6 << 16; break;
+		case 0x3: ham_keep[i] = 0xFF03FF; ham_or[i] = v6 << 8; break;
+		}
+		break;
+	    }
+	}
+    }
+
+    /* The palette loads.  */
+    switch (mode) {
+    case ham_none:
+	if (aga)
+	    for (i = 0; i < 256; i++)
+		ham_or[i] = regs_aga[i];
+	else
+	    for (i = 0; i < 256; i++)
+		ham_or[i] = regs_ecs[i & 31];
+	break;
+    case ham_ecs6:
+	for (i = 0; i < 16; i++)
+	    ham_or[i] = ham_or[i + 64] = ham_or[i + 128] = ham_or[i + 192]
+		= regs_ecs[i];
+	break;
+    case ham_aga6:
+	for (i = 0; i < 16; i++)
+	    ham_or[i] = ham_or[i + 64] = ham_or[i + 128] = ham_or[i + 192]
+		= regs_aga[i];
+	break;
+    case ham_aga8:
+	for (i = 0; i < 64; i++)
+	    ham_or[i << 2] = regs_aga[i];
+	break;
+    }
+}
+
+/* Decode COUNT pixels from SRC, starting with color C, and store the colors
+   in DST unless it is 0.  Returns the last color.  Runs of the same pixel
+   value are done in one step, since applying a palette load or a modify
+   twice gives the same color as doing it once; this catches flat areas as
+   well as the long single-component ramps HAM pictures are full of.  */
+STATIC_INLINE uae_u32 ham_decode_span (const uae_u8 *src, uae_u32 *dst, int count, uae_u32 c)
+{
+    while (count > 0) {
+	int pv = *src;
+	int run = 1;
+
+	c = (c & ham_keep[pv]) | ham_or[pv];
+	while (run < count && src[run] == pv)
+	    run++;
+	if (dst) {
+	    int i;
+	    for (i = 0; i < run; i++)
+		dst[i] = c;
+	    dst += run;
+	}
+	src += run;
+	count -= run;
+    }
+    return c;
+}
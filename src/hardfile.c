@@ -17,6 +17,7 @@
 #include "traps.h"
 #include "autoconf.h"
 #include "execlib.h"
+#include "metrics.h"
 #include "filesys.h"
 
 #define CMD_INVALID	0
@@ -93,6 +94,8 @@ int hdf_write (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 
 static uae_u64 cmd_readx (struct hardfiledata *hfd, uae_u8 *dataptr, uae_u64 offset, uae_u64 len)
 {
+    METRIC_INC (METRIC_HDF_READS);
+    METRIC_ADD (METRIC_HDF_BYTES_READ, len);
     return hdf_read (hfd, dataptr, offset, len);
 }
 static uae_u64 cmd_read (struct hardfiledata *hfd, uaecptr dataptr, uae_u64 offset, uae_u64 len)
@@ -104,6 +107,8 @@ static uae_u64 cmd_read (struct hardfiledata *hfd, uaecptr dataptr, uae_u64 offs
 }
 static uae_u64 cmd_writex (struct hardfiledata *hfd, uae_u8 *dataptr, uae_u64 offset, uae_u64 len)
 {
+    METRIC_INC (METRIC_HDF_WRITES);
+    METRIC_ADD (METRIC_HDF_BYTES_WRITTEN, len);
     return hdf_write (hfd, dataptr, offset, len);
 }
 
@@ -0,0 +1,238 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Host memory placement for Amiga RAM
+  *
+  * Huge pages cut the TLB misses of large Z3 and graphics card memory,
+  * mlock keeps it from being paged out, and binding it and the emulation
+  * thread to one NUMA node keeps it local on multi-socket hosts.  None of
+  * this changes what the memory holds, so every step that the host refuses
+  * is logged and otherwise ignored.
+  */
+
+/* For CPU_SET and friends in sched.h.  */
+#define _GNU_SOURCE
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "hostmem.h"
+
+#if defined(__unix) && !defined(__BEOS__) && !defined(__DOS__)
+#include <sys/mman.h>
+#define HOSTMEM_MMAN
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+/* From linux/mempolicy.h, which isn't always installed.  */
+#define HOSTMEM_MPOL_PREFERRED 1
+#define HOSTMEM_MPOL_BIND 2
+#define HOSTMEM_MAXNODES 256
+
+static size_t hugepagesize;
+static unsigned long numa_mask[HOSTMEM_MAXNODES / (8 * sizeof (unsigned long))];
+static int numa_node = -1;
+
+static const char *hugemode[] = { "none", "transparent", "explicit" };
+
+size_t hostmem_hugepagesize (void)
+{
+    FILE *f;
+    char line[100];
+    unsigned long kb;
+
+    if (hugepagesize)
+	return hugepagesize;
+    hugepagesize = 2 * 1024 * 1024;
+    f = fopen ("/proc/meminfo", "r");
+    if (f == 0)
+	return hugepagesize;
+    while (fgets (line, sizeof line, f))
+	if (sscanf (line, "Hugepagesize: %lu kB", &kb) == 1 && kb > 0) {
+	    hugepagesize = kb * 1024;
+	    break;
+	}
+    fclose (f);
+    return hugepagesize;
+}
+
+#ifdef __linux__
+
+/* Restrict the calling thread to the CPUs of NODE, and have its other
+ * allocations prefer that node.  */
+static int bind_thread (int node)
+{
+    char name[100], list[1024], *s;
+    FILE *f;
+    cpu_set_t set;
+    int n = 0;
+
+    sprintf (name, "/sys/devices/system/node/node%d/cpulist", node);
+    f = fopen (name, "r");
+    if (f == 0)
+	return 0;
+    s = fgets (list, sizeof list, f);
+    fclose (f);
+    if (s == 0)
+	return 0;
+
+    /* "0-3,8-11" */
+    CPU_ZERO (&set);
+    while (*s >= '0' && *s <= '9') {
+	int first = strtol (s, &s, 10), last = first;
+	if (*s == '-')
+	    last = strtol (s + 1, &s, 10);
+	for (; first <= last && first < CPU_SETSIZE; first++, n++)
+	    CPU_SET (first, &set);
+	if (*s == ',')
+	    s++;
+    }
+    if (n == 0 || sched_setaffinity (0, sizeof set, &set) < 0)
+	return 0;
+#ifdef __NR_set_mempolicy
+    syscall (__NR_set_mempolicy, HOSTMEM_MPOL_PREFERRED, numa_mask, HOSTMEM_MAXNODES + 1);
+#endif
+    return n;
+}
+
+/* How much of the mapping that holds P is backed by transparent huge pages
+ * right now.  */
+static unsigned long smaps_huge_kb (uae_u8 *p)
+{
+    FILE *f = fopen ("/proc/self/smaps", "r");
+    char line[256];
+    unsigned long start, end, kb, total = 0;
+    int ours = 0;
+
+    if (f == 0)
+	return 0;
+    while (fgets (line, sizeof line, f)) {
+	if (sscanf (line, "%lx-%lx ", &start, &end) == 2)
+	    ours = start <= (unsigned long)p && (unsigned long)p < end;
+	else if (ours && (sscanf (line, "AnonHugePages: %lu kB", &kb) == 1
+			  || sscanf (line, "ShmemPmdMapped: %lu kB", &kb) == 1))
+	    total += kb;
+    }
+    fclose (f);
+    return total;
+}
+
+#endif
+
+void hostmem_init (void)
+{
+    static int done;
+    int node = currprefs.mem_numa_node;
+
+    if (done)
+	return;
+    done = 1;
+
+    write_log ("HOSTMEM: huge pages %s, mlock %s, NUMA node %d.\n",
+	       hugemode[currprefs.mem_hugepages], currprefs.mem_lock ? "on" : "off", node);
+    if (node < 0)
+	return;
+#ifdef __linux__
+    if (node < HOSTMEM_MAXNODES) {
+	int n;
+	numa_mask[node / (8 * sizeof (unsigned long))] = 1UL << (node % (8 * sizeof (unsigned long)));
+	n = bind_thread (node);
+	if (n > 0) {
+	    write_log ("HOSTMEM: emulation thread bound to the %d CPUs of node %d.\n", n, node);
+	    numa_node = node;
+	    return;
+	}
+    }
+#endif
+    write_log ("HOSTMEM: can't bind to NUMA node %d, memory is not bound either.\n", node);
+}
+
+/* Apply the memory settings to the fresh, untouched block P, and log the
+ * outcome.  HUGETLB says whether it already is made of explicit huge
+ * pages; if not, transparent ones are asked for in either huge page
+ * mode.  */
+void hostmem_setup (uae_u8 *p, size_t size, const char *name, int hugetlb)
+{
+    char report[300];
+    int locked = 0, thp = 0;
+
+    sprintf (report, "HOSTMEM: %s, %lu KB at %p:", name, (unsigned long)(size >> 10), p);
+
+    if (hugetlb)
+	strcat (report, " explicit huge pages");
+#if defined(MADV_HUGEPAGE)
+    else if (currprefs.mem_hugepages != HOSTMEM_HUGE_NONE) {
+	if (madvise (p, size, MADV_HUGEPAGE) == 0) {
+	    strcat (report, " transparent huge pages");
+	    thp = 1;
+	} else
+	    sprintf (report + strlen (report), " no transparent huge pages (%s)", strerror (errno));
+    }
+#endif
+    else
+	strcat (report, " normal pages");
+
+#if defined(__linux__) && defined(__NR_mbind)
+    /* Before mlock faults the pages in.  */
+    if (numa_node >= 0) {
+	if (syscall (__NR_mbind, p, size, HOSTMEM_MPOL_BIND, numa_mask, HOSTMEM_MAXNODES + 1, 0) == 0)
+	    sprintf (report + strlen (report), ", node %d", numa_node);
+	else
+	    sprintf (report + strlen (report), ", not bound (%s)", strerror (errno));
+    }
+#endif
+
+#ifdef HOSTMEM_MMAN
+    if (currprefs.mem_lock) {
+	if (mlock (p, size) == 0) {
+	    strcat (report, ", locked");
+	    locked = 1;
+	} else
+	    sprintf (report + strlen (report), ", not locked (%s)", strerror (errno));
+    }
+#endif
+
+#ifdef __linux__
+    /* Only locked memory is present yet; otherwise huge pages are handed
+     * out as the Amiga touches it.  */
+    if (thp && locked)
+	sprintf (report + strlen (report), ", %lu KB of it in huge pages", smaps_huge_kb (p));
+#endif
+
+    write_log ("%s.\n", report);
+}
+
+/* An unnamed file to back memory that is mapped at more than one host
+ * address: natmem's pieces and the chip memory mirrors.  Returns -1 if
+ * there is no way to make one.  */
+int hostmem_memfd (const char *name)
+{
+#if defined(__linux__) && defined(__NR_memfd_create)
+    int fd = syscall (__NR_memfd_create, name, 1 /* MFD_CLOEXEC */);
+
+    if (fd >= 0)
+	return fd;
+#endif
+#ifdef HOSTMEM_MMAN
+    {
+	static const char *dirs[] = { "/dev/shm", "/tmp" };
+	char tmpl[40];
+	unsigned int i;
+
+	for (i = 0; i < sizeof dirs / sizeof *dirs; i++) {
+	    int fd2;
+	    sprintf (tmpl, "%s/uae-XXXXXX", dirs[i]);
+	    fd2 = mkstemp (tmpl);
+	    if (fd2 >= 0) {
+		unlink (tmpl);
+		return fd2;
+	    }
+	}
+    }
+#endif
+    return -1;
+}
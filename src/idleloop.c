@@ -0,0 +1,359 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Idle loop detection
+  *
+  * Programs that wait for something - a vertical blank, a mouse click, a
+  * blitter to finish - often do it by spinning in a tiny loop.  We wrap the
+  * handlers of short backward branches and of DBF, and once a branch has
+  * been taken a few times in a row, look at the loop.  If all it can do is
+  * read memory or chipset state that only changes when an event is handled,
+  * we advance the clock to the next event instead of executing it over and
+  * over again.  DBF delay loops are fast-forwarded by exactly the number of
+  * iterations that fit before the next event.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "memory.h"
+#include "custom.h"
+#include "events.h"
+#include "newcpu.h"
+#include "idleloop.h"
+#include "cputhread.h"
+
+/* How often a branch must be taken in a row before we examine the loop.  */
+#define IDLE_STREAK 8
+/* Bcc.S displacements we look at: $F0..$FE, i.e. loops of up to 16 bytes.  */
+#define IDLE_MAXWORDS 8
+#define IDLE_HASHSIZE 1024
+
+typedef enum { IDLE_UNKNOWN, IDLE_NONE, IDLE_SPIN, IDLE_POLL, IDLE_DBF } idle_kind;
+
+static const char *idle_kindname[] = { "?", "none", "spin", "poll", "dbf" };
+
+struct idleloop {
+    uaecptr pc, target;
+    idle_kind kind;
+    int nwords;
+    uae_u16 code[IDLE_MAXWORDS];
+    unsigned long hits, skipped;
+};
+
+static struct idleloop idle_table[IDLE_HASHSIZE];
+static uaecptr streak_pc;
+static int streak;
+
+static cpuop_func *orig_bcc[16][16];
+static cpuop_func *orig_dbf[8];
+
+extern unsigned long cycles_mask, cycles_val;
+
+/* Can the CPU read SIZE bytes at ADDR without side effects, and is the
+   value only ever changed by event handlers?  Besides memory, this allows
+   a handful of chipset registers that programs like to poll.  */
+static int idle_readable (uaecptr addr, int size)
+{
+    /* DMACONR, VPOSR, the vertical half of VHPOSR, JOYxDAT, POTGOR,
+       INTENAR, INTREQR.  */
+    static const uae_u32 custom_ok = 0xf0c03c7c;
+    addrbank *ab = &get_mem_bank (addr);
+    int i;
+
+    if (ab->baseaddr)
+	return ab->check (addr, size);
+    if (ab == &custom_bank) {
+	for (i = 0; i < size; i++) {
+	    int r = (addr + i) & 0x1ff;
+	    if (r >= 32 || !(custom_ok & (1 << r)))
+		return 0;
+	}
+	return 1;
+    }
+    /* CIA A PRA: fire buttons and disk status.  */
+    if (ab == &cia_bank)
+	return size == 1 && (addr & 0xffffff) == 0xbfe001;
+    return 0;
+}
+
+/* Skip the extension words of a source operand at *PP.  If CHECKMEM, also
+   make sure a memory operand is something we may poll.  */
+static int idle_source (uaecptr *pp, int mode, int reg, int size, int checkmem)
+{
+    uaecptr addr;
+
+    switch (mode) {
+    case 0:			/* Dn */
+	return 1;
+    case 2:			/* (An) */
+	addr = m68k_areg (regs, reg);
+	break;
+    case 5:			/* d16(An) */
+	addr = m68k_areg (regs, reg) + (uae_s16)get_word (*pp);
+	*pp += 2;
+	break;
+    case 7:
+	switch (reg) {
+	case 0:			/* xxx.W */
+	    addr = (uae_s32)(uae_s16)get_word (*pp);
+	    *pp += 2;
+	    break;
+	case 1:			/* xxx.L */
+	    addr = get_long (*pp);
+	    *pp += 4;
+	    break;
+	case 2:			/* d16(PC) */
+	    addr = *pp + (uae_s16)get_word (*pp);
+	    *pp += 2;
+	    break;
+	case 4:			/* #imm */
+	    *pp += size == 2 ? 4 : 2;
+	    return 1;
+	default:
+	    return 0;
+	}
+	break;
+    default:
+	return 0;
+    }
+    return !checkmem || idle_readable (addr, size == 0 ? 1 : size == 1 ? 2 : 4);
+}
+
+/* Decide whether the loop body from P to END can be repeated without
+   changing anything.  Allowed are TST, CMP, CMPI and BTST, which only set
+   the flags, and MOVE, AND and ANDI to a data register.  The latter are
+   idempotent as long as none of them takes its source from a register
+   that is written inside the loop.  Address registers are never written,
+   so operand addresses stay the same.  */
+static idle_kind idle_scan (uaecptr p, uaecptr end, int checkmem)
+{
+    uae_u32 written = 0, sources = 0;
+
+    while (p < end) {
+	uae_u16 w = get_word (p);
+	int mode = (w >> 3) & 7, reg = w & 7, size = (w >> 6) & 3;
+
+	p += 2;
+	if ((w & 0xff00) == 0x4a00 && size != 3) {		/* TST */
+	    if (!idle_source (&p, mode, reg, size, checkmem))
+		return IDLE_NONE;
+	} else if ((w & 0xff00) == 0x0c00 && size != 3) {	/* CMPI */
+	    p += size == 2 ? 4 : 2;
+	    if (mode == 7 && reg == 4)
+		return IDLE_NONE;
+	    if (!idle_source (&p, mode, reg, size, checkmem))
+		return IDLE_NONE;
+	} else if ((w & 0xffc0) == 0x0800) {			/* BTST #n */
+	    p += 2;
+	    if (mode == 7 && reg == 4)
+		return IDLE_NONE;
+	    if (!idle_source (&p, mode, reg, 0, checkmem))
+		return IDLE_NONE;
+	} else if ((w & 0xf1c0) == 0x0100 && mode != 1) {	/* BTST Dn */
+	    if (!idle_source (&p, mode, reg, 0, checkmem))
+		return IDLE_NONE;
+	} else if ((w & 0xf100) == 0xb000 && size != 3) {	/* CMP <ea>,Dn */
+	    if (!idle_source (&p, mode, reg, size, checkmem))
+		return IDLE_NONE;
+	} else if ((w & 0xff38) == 0x0200 && size != 3) {	/* ANDI #,Dn */
+	    p += size == 2 ? 4 : 2;
+	    written |= 1 << reg;
+	} else if ((w & 0xf100) == 0xc000 && size != 3) {	/* AND <ea>,Dn */
+	    if (!idle_source (&p, mode, reg, size, checkmem))
+		return IDLE_NONE;
+	    if (mode == 0)
+		sources |= 1 << reg;
+	    written |= 1 << ((w >> 9) & 7);
+	} else if ((w & 0xc1c0) == 0 && (w & 0x3000)) {		/* MOVE <ea>,Dn */
+	    static const int movesize[] = { 0, 0, 2, 1 };
+	    if (!idle_source (&p, mode, reg, movesize[(w >> 12) & 3], checkmem))
+		return IDLE_NONE;
+	    if (mode == 0)
+		sources |= 1 << reg;
+	    written |= 1 << ((w >> 9) & 7);
+	} else
+	    return IDLE_NONE;
+    }
+    if (p != end || (written & sources))
+	return IDLE_NONE;
+    return IDLE_POLL;
+}
+
+/* Find the table entry for the loop ending at PC, and check that the code
+   hasn't changed since we looked at it last.  */
+static struct idleloop *idle_lookup (uaecptr pc, uaecptr target, int nwords)
+{
+    struct idleloop *il = idle_table + ((pc >> 1) & (IDLE_HASHSIZE - 1));
+    uae_u16 code[IDLE_MAXWORDS];
+    int i;
+
+    if (!valid_address (target, nwords * 2))
+	return 0;
+    for (i = 0; i < nwords; i++)
+	code[i] = get_word (target + i * 2);
+    if (il->kind != IDLE_UNKNOWN && il->pc == pc && il->target == target
+	&& il->nwords == nwords && memcmp (il->code, code, nwords * 2) == 0)
+	return il;
+
+    il->pc = pc;
+    il->target = target;
+    il->nwords = nwords;
+    memcpy (il->code, code, nwords * 2);
+    il->kind = IDLE_UNKNOWN;
+    il->hits = il->skipped = 0;
+    return il;
+}
+
+STATIC_INLINE int idle_streak (uaecptr pc)
+{
+    /* The chipset has a thread of its own then, and doesn't wait for us.  */
+    if (cputhread_running)
+	return 0;
+    if (pc != streak_pc) {
+	streak_pc = pc;
+	streak = 0;
+	return 0;
+    }
+    if (streak < IDLE_STREAK) {
+	streak++;
+	return 0;
+    }
+    return !regs.spcflags;
+}
+
+static void idle_skip (struct idleloop *il, unsigned long cycles)
+{
+    unsigned long before = get_cycles ();
+
+    do_cycles (cycles);
+    il->hits++;
+    il->skipped += get_cycles () - before;
+}
+
+static void idle_check_bcc (uaecptr pc, uaecptr target)
+{
+    struct idleloop *il = idle_lookup (pc, target, (pc + 2 - target) / 2);
+
+    if (!il)
+	return;
+    if (il->kind == IDLE_UNKNOWN)
+	il->kind = target == pc ? IDLE_SPIN : idle_scan (target, pc, 0);
+    if (il->kind == IDLE_POLL) {
+	/* Reading chipset registers lets the copper catch up with the CPU,
+	   so only skip if the copper has nothing to do on this line, or is
+	   asleep in a WAIT until an event.  The operand addresses depend on
+	   the address registers, so check them every time.  */
+	if ((copper_enabled_thisline && ! eventtab[ev_copper].active)
+	    || idle_scan (target, pc, 1) != IDLE_POLL)
+	    return;
+    } else if (il->kind != IDLE_SPIN)
+	return;
+    idle_skip (il, nextevent - get_cycles ());
+}
+
+static void idle_check_dbf (uaecptr pc, int reg, unsigned long cycles)
+{
+    struct idleloop *il = idle_lookup (pc, pc, 2);
+    unsigned long cost = (cycles & cycles_mask) | cycles_val;
+    unsigned long avail = nextevent - get_cycles ();
+    unsigned long before, n;
+    uae_u32 count = m68k_dreg (regs, reg) & 0xffff;
+
+    if (!il || cost == 0)
+	return;
+    il->kind = IDLE_DBF;
+    /* Every iteration but the last one is taken and costs the same.  Leave
+       room for the one that is being executed now, and stop short of the
+       next event so that it happens at the same cycle it would have.  */
+    n = avail / cost;
+    if (n <= 1)
+	return;
+    n--;
+    if (n > count)
+	n = count;
+    if (n == 0)
+	return;
+    before = get_cycles ();
+    do_cycles (n * cost);
+    n = (get_cycles () - before) / cost;
+    m68k_dreg (regs, reg) = (m68k_dreg (regs, reg) & ~0xffff) | (count - n);
+    il->hits++;
+    il->skipped += n * cost;
+}
+
+static unsigned long REGPARAM2 idle_bcc (uae_u32 opcode)
+{
+    uaecptr pc = m68k_getpc ();
+    unsigned long cycles = (*orig_bcc[(opcode >> 8) & 15][opcode & 15]) (opcode);
+    uaecptr target = pc + 2 + (uae_s8)opcode;
+
+    if (m68k_getpc () == target && idle_streak (pc))
+	idle_check_bcc (pc, target);
+    return cycles;
+}
+
+static unsigned long REGPARAM2 idle_dbf (uae_u32 opcode)
+{
+    uaecptr pc = m68k_getpc ();
+    unsigned long cycles = (*orig_dbf[opcode & 7]) (opcode);
+
+    if (m68k_getpc () == pc && idle_streak (pc))
+	idle_check_dbf (pc, opcode & 7, cycles);
+    return cycles;
+}
+
+/* Hook the Bcc.S instructions with small negative displacements (but not
+   BSR), and DBF.  */
+void idleloop_install (cpuop_func **tbl)
+{
+    int cc, d, r;
+
+    for (cc = 0; cc < 16; cc++) {
+	if (cc == 1)
+	    continue;
+	for (d = 0; d < 15; d++) {
+	    int opcode = 0x6000 | (cc << 8) | 0xf0 | d;
+	    orig_bcc[cc][d] = tbl[opcode];
+	    tbl[opcode] = idle_bcc;
+	}
+    }
+    for (r = 0; r < 8; r++) {
+	orig_dbf[r] = tbl[0x51c8 | r];
+	tbl[0x51c8 | r] = idle_dbf;
+    }
+    streak_pc = 0xffffffff;
+    streak = 0;
+}
+
+static int idle_compare (const void *a, const void *b)
+{
+    const struct idleloop *la = *(const struct idleloop **)a;
+    const struct idleloop *lb = *(const struct idleloop **)b;
+
+    return la->skipped < lb->skipped ? 1 : la->skipped > lb->skipped ? -1 : 0;
+}
+
+void idleloop_dump (void)
+{
+    struct idleloop *sorted[IDLE_HASHSIZE];
+    unsigned long total = 0;
+    int i, n = 0;
+
+    for (i = 0; i < IDLE_HASHSIZE; i++) {
+	if (idle_table[i].hits) {
+	    sorted[n++] = idle_table + i;
+	    total += idle_table[i].skipped;
+	}
+    }
+    if (n == 0)
+	return;
+    qsort (sorted, n, sizeof *sorted, idle_compare);
+    write_log ("Idle loops: %d, %lu cycles skipped\n", n, total / CYCLE_UNIT);
+    for (i = 0; i < n && i < 16; i++) {
+	struct idleloop *il = sorted[i];
+	write_log ("  %08x %-4s %10lu skips %12lu cycles\n", il->pc,
+		   idle_kindname[il->kind], il->hits, il->skipped / CYCLE_UNIT);
+    }
+}
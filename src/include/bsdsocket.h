@@ -64,9 +64,6 @@ struct socketbase {
     void *hEvent;		/* thread event handle */
     unsigned int *mtable;	/* window messages allocated for asynchronous event notification */
 #else
-    uae_sem_t sem;		/* semaphore to notify the socket thread of work */
-    uae_thread_id thread;	/* socket thread */
-    int  sockabort[2];		/* pipe used to tell the thread to abort a select */
     int action;
     int s;			/* for accept */
     uae_u32 name;		/* For gethostbyname */
@@ -80,6 +77,20 @@ struct socketbase {
     uae_u32 sets [3];
     uae_u32 timeout;
     uae_u32 sigmp;
+    uae_u32 sent;		/* bytes already sent by a blocking send */
+    int blocking;		/* operation is on a blocking socket */
+    uae_u32 (*tryfunc) (struct socketbase *);	/* operation retried by the reactor */
+    struct socketbase *reactnext;	/* reactor list of pending operations */
+    struct socketbase *donenext;	/* reactor list of completed operations */
+    struct socketbase *resolvnext;	/* resolver queue */
+    int pending;		/* operation queued on the reactor */
+    int ready;			/* reactor saw an event on one of our sockets */
+    int abortreq;		/* sockabort() while pending */
+    struct timeval deadline;	/* WaitSelect() timeout, if hasdeadline */
+    int hasdeadline;
+    struct pollfd *wsfds;	/* host sockets waited on */
+    int *wsamiga;		/* Amiga descriptor for each entry of wsfds */
+    int wsnfds, wsfdsize;
 #endif
 } *socketbases;
 
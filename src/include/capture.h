@@ -0,0 +1,33 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Video and audio capture
+  */
+
+#define CAPTURE_Y4M 0
+#define CAPTURE_RAW 1
+
+#define CAPTURE_ABLOCK 4096
+
+extern int capture_video_on, capture_audio_on;
+
+extern void capture_start (void);
+extern void capture_stop (void);
+extern void capture_vsync (void);
+extern void capture_line (int y, const char *src);
+extern void capture_audio_flush (void);
+
+extern uae_u8 *capture_abuf;
+extern int capture_apos;
+
+/* Called by audio.c for every sample word, in the same order in which the
+ * words are handed to the sound driver.  WAV data is little endian.  */
+STATIC_INLINE void capture_audio_word (uae_u16 w)
+{
+    if (! capture_audio_on)
+	return;
+    capture_abuf[capture_apos++] = (uae_u8)w;
+    capture_abuf[capture_apos++] = (uae_u8)(w >> 8);
+    if (capture_apos == CAPTURE_ABLOCK)
+	capture_audio_flush ();
+}
@@ -11,6 +11,10 @@ extern void CIA_vsync_handler (void);
 extern void CIA_hsync_handler (void);
 extern void CIA_handler (void);
 
+/* Number of horizontal syncs seen, and the line at which CIA_hsync_handler
+   next has to look at the TOD alarm.  */
+extern unsigned long cia_hsyncs, cia_hsync_due;
+
 extern void cia_diskindex (void);
 
 extern void dumpcia (void);
@@ -0,0 +1,45 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Separate CPU and chipset threads
+  *
+  * With cpu_thread=yes and cpu_speed=max, a 68020 or better without MMU
+  * runs on a thread of its own, while the main thread keeps handling the
+  * chipset events.  The CPU must hold the chipset lock for any access that
+  * isn't fast RAM or ROM; cputhread_start swaps such banks in mem_banks
+  * for one that takes the lock around the real bank functions.
+  *
+  * Each side keeps its own clock.  The chipset never gets ahead of the
+  * CPU, and the CPU never gets more than one scanline ahead of the
+  * chipset - whatever it executes beyond that is free, just like the time
+  * the frame rate hack gives it at the end of a frame.  So an interrupt is
+  * seen at most a line later than it would be otherwise.
+  */
+
+/* Flags that the CPU thread leaves to the chipset.  */
+#define CPUTHREAD_CHIPSET_FLAGS (SPCFLAG_COPPER | SPCFLAG_BLTNASTY)
+
+extern volatile int cputhread_running;
+extern volatile unsigned long cputhread_cpu_clock, cputhread_chip_clock;
+extern unsigned long cputhread_lead;
+
+extern int cputhread_usable (void);
+extern int cputhread_run (void (*cpu_loop) (void));
+extern void cputhread_notice_banks (void);
+
+/* Used by any thread that accesses chipset state outside the banks.  */
+extern void cputhread_lock (void);
+extern void cputhread_unlock (void);
+/* Called by an extended trap thread when it starts.  */
+extern void cputhread_trap_thread (void);
+extern void cputhread_park (void);
+extern void cputhread_stopped (void);
+
+STATIC_INLINE void cputhread_do_cycles (unsigned long cycles)
+{
+    unsigned long c = cputhread_cpu_clock + cycles;
+
+    if ((long int)(c - cputhread_chip_clock) > (long int)cputhread_lead)
+	c = cputhread_chip_clock + cputhread_lead;
+    cputhread_cpu_clock = c;
+}
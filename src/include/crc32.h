@@ -1,3 +1,5 @@
+extern void crc32_init (void);
+
 extern uae_u32 get_crc32 (uae_u8 *p, int size);
 extern uae_u16 get_crc16 (uae_u8 *p, int size);
 
@@ -44,6 +44,7 @@ extern int current_hpos (void);
 extern int vpos;
 
 extern int find_copper_record (uaecptr, int *, int *);
+extern int copper_enabled_thisline;
 
 extern int n_frames;
 
@@ -62,6 +63,7 @@ STATIC_INLINE int dmaen (unsigned int dmamask)
 #define SPCFLAG_DOINT 256
 #define SPCFLAG_BLTNASTY 512
 #define SPCFLAG_EXEC 1024
+#define SPCFLAG_PARK 2048
 #define SPCFLAG_MODE_CHANGE 8192
 #define SPCFLAG_RESTORE_SANITY 16384
 
@@ -28,4 +28,7 @@ extern void DSKPTH (uae_u16);
 
 extern void dumpdisk (void);
 
+extern void disk_stop_threads (void);
+extern void disk_start_threads (void);
+
 #define MAX_PREVIOUS_FLOPPIES 99
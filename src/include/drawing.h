@@ -57,6 +57,7 @@ STATIC_INLINE int coord_window_to_diw_x (int x)
 }
 
 extern int framecnt;
+extern void dump_frameskip (void);
 
 
 /* color values in two formats: 12 (OCS/ECS) or 24 (AGA) bit Amiga RGB (color_regs),
@@ -14,6 +14,7 @@ typedef unsigned long frame_time_t;
 extern frame_time_t vsynctime, vsyncmintime;
 extern frame_time_t gtod_resolution;
 extern int vsyncmintime_valid;
+extern long int vsync_lateness;
 
 extern frame_time_t first_measured_gtod;
 extern unsigned long gtod_secs;
@@ -39,7 +40,7 @@ struct ev
 };
 
 enum {
-    ev_hsync, ev_copper, ev_audio, ev_cia, ev_blitter, ev_disk,
+    ev_hsync, ev_copper, ev_audio, ev_cia, ev_blitter, ev_disk, ev_serial,
     ev_max
 };
 
@@ -51,6 +52,10 @@ extern void time_vsync (void);
 
 extern void init_gtod (void);
 
+extern int idle_sleep (frame_time_t until);
+extern void idle_wakeup (void);
+extern void do_cycles_stopped (void);
+
 STATIC_INLINE frame_time_t get_current_time (int redo_secs)
 {
     struct timeval tv;
@@ -61,6 +61,7 @@ extern void free_mountinfo (struct uaedev_mount_info *);
 extern void filesys_reset (void);
 extern void filesys_prepare_reset (void);
 extern void filesys_start_threads (void);
+extern void filesys_restart_threads (void);
 
 extern void filesys_install (void);
 extern void filesys_install_code (void);
@@ -0,0 +1,10 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Fork server
+  */
+
+extern int forkserver_child;
+
+extern void forkserver_init (void);
+extern void forkserver_vsync (void);
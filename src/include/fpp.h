@@ -0,0 +1,127 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * MC68881 emulation: the parts shared by fpp.c and the generated
+  * CPU handlers
+  *
+  * The FPSR condition codes aren't kept up to date; MAKE_FPSR just
+  * remembers the last result, and get_fpsr and fpp_cond work out N, Z
+  * and NaN from it when somebody asks.
+  */
+
+#include <math.h>
+
+#include "md-fpp.h"
+
+#define MAKE_FPSR(r)  regs.fp_result=(r)
+
+/* Whether FPU instructions execute, rather than trap.  */
+#define fpu_enabled() (!(regs.pcr & 2) && currprefs.fpu_model > 0)
+
+#if defined(uae_s64) /* Close enough for government work? */
+static __inline__ uae_s64 toint (fptype src)
+#else
+static __inline__ uae_s32 toint (fptype src)
+#endif
+{
+    switch ((regs.fpcr >> 4) & 0x3) {
+    case 0:
+	return (int) (src + 0.5);
+    case 1:
+	return (int) src;
+    case 2:
+	return floor (src);
+    case 3:
+	return ceil (src);
+    }
+    return src; /* Should never be reached */
+}
+
+/* Returns -1 for an illegal condition.  Inlined with a constant condition,
+   as in the FBcc handlers, this comes down to a test or two.  */
+STATIC_INLINE int fpp_cond (uae_u32 opcode, int contition)
+{
+    int N = (regs.fp_result < 0);
+    int Z = (regs.fp_result == 0);
+    /* int I = (regs.fpsr & 0x2000000) != 0; */
+    int NotANumber = 0;
+
+#ifdef HAVE_ISNAN
+    NotANumber = isnan (regs.fp_result);
+#endif
+
+    if (NotANumber)
+	N=Z=0;
+
+    switch (contition) {
+    case 0x00:
+	return 0;
+    case 0x01:
+	return Z;
+    case 0x02:
+	return !(NotANumber || Z || N);
+    case 0x03:
+	return Z || !(NotANumber || N);
+    case 0x04:
+	return N && !(NotANumber || Z);
+    case 0x05:
+	return Z || (N && !NotANumber);
+    case 0x06:
+	return !(NotANumber || Z);
+    case 0x07:
+	return !NotANumber;
+    case 0x08:
+	return NotANumber;
+    case 0x09:
+	return NotANumber || Z;
+    case 0x0a:
+	return NotANumber || !(N || Z);
+    case 0x0b:
+	return NotANumber || Z || !N;
+    case 0x0c:
+	return NotANumber || (N && !Z);
+    case 0x0d:
+	return NotANumber || Z || N;
+    case 0x0e:
+	return !Z;
+    case 0x0f:
+	return 1;
+    case 0x10:
+	return 0;
+    case 0x11:
+	return Z;
+    case 0x12:
+	return !(NotANumber || Z || N);
+    case 0x13:
+	return Z || !(NotANumber || N);
+    case 0x14:
+	return N && !(NotANumber || Z);
+    case 0x15:
+	return Z || (N && !NotANumber);
+    case 0x16:
+	return !(NotANumber || Z);
+    case 0x17:
+	return !NotANumber;
+    case 0x18:
+	return NotANumber;
+    case 0x19:
+	return NotANumber || Z;
+    case 0x1a:
+	return NotANumber || !(N || Z);
+    case 0x1b:
+	return NotANumber || Z || !N;
+    case 0x1c:
+#if 0
+	return NotANumber || (Z && N); /* This is wrong, compare 0x0c */
+#else
+	return NotANumber || (N && !Z);
+#endif
+    case 0x1d:
+	return NotANumber || Z || N;
+    case 0x1e:
+	return !Z;
+    case 0x1f:
+	return 1;
+    }
+    return -1;
+}
@@ -0,0 +1,18 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Host memory placement for Amiga RAM
+  *
+  * mapped_malloc and natmem_alloc hand every block they get to
+  * hostmem_setup, which applies the mem_hugepages, mem_lock and
+  * mem_numa_node settings to it and logs what the host actually granted.
+  */
+
+#define HOSTMEM_HUGE_NONE 0
+#define HOSTMEM_HUGE_TRANSPARENT 1
+#define HOSTMEM_HUGE_EXPLICIT 2
+
+extern void hostmem_init (void);
+extern size_t hostmem_hugepagesize (void);
+extern void hostmem_setup (uae_u8 *p, size_t size, const char *name, int hugetlb);
+extern int hostmem_memfd (const char *name);
@@ -0,0 +1,8 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Idle loop detection
+  */
+
+extern void idleloop_install (cpuop_func **tbl);
+extern void idleloop_dump (void);
@@ -0,0 +1,45 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Input recording and playback
+  */
+
+#define INPUTREC_OFF 0
+#define INPUTREC_RECORD 1
+#define INPUTREC_PLAY 2
+
+extern int inputrec_mode;
+extern int inputrec_host;
+
+extern void inputrec_start (void);
+extern void inputrec_stop (void);
+extern void inputrec_vsync (void);
+extern void inputrec_poll (void);
+extern int inputrec_event (int nr, int state, int max, int autofire);
+extern int inputrec_key (int code, int state);
+extern int inputrec_rawkey (int kc);
+
+/* Host input (window system events, joystick and mouse polling) is only
+ * delivered between these two calls.  During playback, this is also where
+ * the recorded input is fed back in.  */
+STATIC_INLINE void inputrec_host_begin (void)
+{
+    if (inputrec_mode != INPUTREC_OFF)
+	inputrec_poll ();
+    inputrec_host++;
+}
+
+STATIC_INLINE void inputrec_host_end (void)
+{
+    inputrec_host--;
+}
+
+/* Nonzero if input comes straight from the host, rather than from inside
+ * the input code or from playback.  The functions through which input
+ * reaches the emulation pass such input to inputrec_event () and friends,
+ * which record it and return nonzero, or return 0 if it must be dropped.
+ * They increment inputrec_host while they run.  */
+STATIC_INLINE int inputrec_from_host (void)
+{
+    return inputrec_host == 1 && inputrec_mode != INPUTREC_OFF;
+}
@@ -17,7 +17,20 @@ typedef int (*check_func)(uaecptr, uae_u32) REGPARAM;
 extern char *address_space, *good_address_map;
 extern uae_u8 *chipmemory;
 
+/* With CHIPMEM_MIRROR, chip memory is mapped once for every mirror the
+ * chip bank or Agnus can address, and again for CHIPMEM_TAIL more bytes.
+ * Any such address is then an offset into chipmemory as it is, and a
+ * pointer from chipmem_bank.xlateaddr is good for CHIPMEM_TAIL bytes past
+ * the end of chip memory, where it wraps round to the start.  */
+#if defined(__unix) && !defined(__BEOS__) && !defined(__DOS__)
+#define CHIPMEM_MIRROR
+#define CHIPMEM_TAIL 0x10000
+#else
+#define CHIPMEM_TAIL 0
+#endif
+
 extern uae_u32 allocated_chipmem;
+extern uae_u32 chipmem_full_mask;
 extern uae_u32 allocated_fastmem;
 extern uae_u32 allocated_bogomem;
 extern uae_u32 allocated_gfxmem;
@@ -69,8 +82,15 @@ typedef struct {
        for this particular bank. */
     uae_u8 *baseaddr;
     const char *name;
+    /* ABFLAG_RAM if the bank is plain memory, which the CPU may also write
+       through xlateaddr.  */
+    int flags;
 } addrbank;
 
+#define ABFLAG_RAM 1
+/* Reads are plain memory, writes need the bank functions.  */
+#define ABFLAG_ROM 2
+
 extern uae_u8 *filesysory;
 extern uae_u8 *rtarea;
 
@@ -154,17 +174,36 @@ extern void byteput(uaecptr addr, uae_u32 b);
 
 #endif
 
+#include "mmu.h"
+#include "natmem.h"
+
+/* These don't test mmu_enabled or natmem_offset.  While the MMU translates,
+ * mem_banks holds mmu.c's translating bank for every page; while natmem is
+ * on, build_cpufunctbl picks the copy of the CPU core that is compiled with
+ * NATMEM_CORE.  Code outside the core always goes through the banks.  */
 STATIC_INLINE uae_u32 get_long (uaecptr addr)
 {
+#ifdef NATMEM_CORE
+    return natmem_get_long (addr);
+#else
     return longget_1(addr);
+#endif
 }
 STATIC_INLINE uae_u32 get_word (uaecptr addr)
 {
+#ifdef NATMEM_CORE
+    return natmem_get_word (addr);
+#else
     return wordget_1(addr);
+#endif
 }
 STATIC_INLINE uae_u32 get_byte (uaecptr addr)
 {
+#ifdef NATMEM_CORE
+    return natmem_get_byte (addr);
+#else
     return byteget_1(addr);
+#endif
 }
 
 /*
@@ -199,15 +238,27 @@ STATIC_INLINE void *get_pointer (uaecptr addr)
 
 STATIC_INLINE void put_long (uaecptr addr, uae_u32 l)
 {
+#ifdef NATMEM_CORE
+    natmem_put_long (addr, l);
+#else
     longput_1(addr, l);
+#endif
 }
 STATIC_INLINE void put_word (uaecptr addr, uae_u32 w)
 {
+#ifdef NATMEM_CORE
+    natmem_put_word (addr, w);
+#else
     wordput_1(addr, w);
+#endif
 }
 STATIC_INLINE void put_byte (uaecptr addr, uae_u32 b)
 {
+#ifdef NATMEM_CORE
+    natmem_put_byte (addr, b);
+#else
     byteput_1(addr, b);
+#endif
 }
 
 /*
@@ -249,7 +300,7 @@ STATIC_INLINE int valid_address(uaecptr addr, uae_u32 size)
     return get_mem_bank(addr).check(addr, size);
 }
 
-/* For faster access in custom chip emulation.  */
+/* Only for addresses in the chip bank.  */
 extern uae_u32 chipmem_lget (uaecptr) REGPARAM;
 extern uae_u32 chipmem_wget (uaecptr) REGPARAM;
 extern uae_u32 chipmem_bget (uaecptr) REGPARAM;
@@ -257,22 +308,32 @@ extern void chipmem_lput (uaecptr, uae_u32) REGPARAM;
 extern void chipmem_wput (uaecptr, uae_u32) REGPARAM;
 extern void chipmem_bput (uaecptr, uae_u32) REGPARAM;
 
-extern uae_u32 chipmem_agnus_wget (uaecptr) REGPARAM;
-extern void chipmem_agnus_wput (uaecptr, uae_u32) REGPARAM;
-
-#ifdef NATMEM_OFFSET
+/* DMA.  Agnus has no more address lines than chipmem_full_mask covers, so
+ * any pointer will do.  Without CHIPMEM_MIRROR, an ECS Agnus with less
+ * than 1 MB of chip memory finds nothing above it: it reads ones and its
+ * writes are lost.  */
+STATIC_INLINE uae_u32 chipmem_agnus_wget (uaecptr addr)
+{
+    return do_get_mem_word ((uae_u16 *)(chipmemory + (addr & chipmem_full_mask)));
+}
 
-typedef struct shmpiece_reg {
-    uae_u8 *native_address;
-    int id;
-    uae_u32 size;
-    struct shmpiece_reg *next;
-    struct shmpiece_reg *prev;
-} shmpiece;
+STATIC_INLINE uae_u32 chipmem_agnus_lget (uaecptr addr)
+{
+    return do_get_mem_long ((uae_u32 *)(chipmemory + (addr & chipmem_full_mask)));
+}
 
-extern shmpiece *shm_start;
-extern int canbang;
+STATIC_INLINE void chipmem_agnus_wput (uaecptr addr, uae_u32 w)
+{
+    addr &= chipmem_full_mask;
+#ifndef CHIPMEM_MIRROR
+    if (addr >= allocated_chipmem)
+	return;
+#endif
+    do_put_mem_word ((uae_u16 *)(chipmemory + addr), w);
+}
 
+#ifdef CHIPMEM_MIRROR
+extern int chipmem_unshare (void);
 #endif
 
 extern uae_u8 *mapped_malloc (size_t, char *);
@@ -0,0 +1,32 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Performance counters
+  */
+
+enum metrics_counter {
+    METRIC_FRAMES, METRIC_FRAMES_SKIPPED, METRIC_CYCLES, METRIC_INSNS,
+    METRIC_BLITS, METRIC_BLIT_WORDS, METRIC_COPPER_INSNS, METRIC_DISK_WORDS,
+    METRIC_FS_PACKETS, METRIC_HDF_READS, METRIC_HDF_WRITES,
+    METRIC_HDF_BYTES_READ, METRIC_HDF_BYTES_WRITTEN,
+    METRIC_MAX
+};
+
+enum metrics_histogram {
+    METRIC_FRAME_TIME, METRIC_FS_LATENCY,
+    METRIC_HIST_MAX
+};
+
+extern uae_u64 metrics_count[METRIC_MAX];
+extern int metrics_sound_fill;
+
+#define METRIC_INC(m) (metrics_count[m]++)
+#define METRIC_ADD(m, n) (metrics_count[m] += (n))
+
+extern unsigned long metrics_usecs (void);
+extern void metrics_observe (int hist, unsigned long usecs);
+extern int metrics_format (char *buf, int size);
+
+extern void metrics_start (void);
+extern void metrics_stop (void);
+extern void metrics_vsync (void);
@@ -0,0 +1,131 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * 68030/68040 MMU
+  *
+  * While translation is on, every CPU access first looks in a direct-mapped
+  * software ATC with one entry per 4K of logical address space, separately
+  * for reads, writes and instruction fetches in user and supervisor mode.
+  * An entry for RAM holds a host pointer, so a hit costs one compare more
+  * than an access through the RAM bank would.  Misses walk the page tables.
+  */
+
+#include <setjmp.h>
+
+#define MMU_PAGE_SHIFT 12
+#define MMU_PAGE_SIZE (1 << MMU_PAGE_SHIFT)
+#define MMU_PAGE_MASK (MMU_PAGE_SIZE - 1)
+#define MMU_ATC_SIZE 256
+
+/* Longest 68030/68040 instruction, in bytes.  */
+#define MMU_MAXINSN 22
+
+/* Tag bits that never match an aligned page address: empty entries, and
+ * pages that must go through the memory bank functions.  */
+#define MMU_ATC_EMPTY 1
+#define MMU_ATC_IO 2
+/* Kept in PHYS; the page survives PFLUSHAN/PFLUSHN on the 68040.  */
+#define MMU_ATC_GLOBAL 1
+
+struct mmu_atc {
+    uaecptr tag;
+    /* Physical minus logical page address, plus MMU_ATC_GLOBAL.  */
+    uae_u32 phys;
+    /* Host address minus logical page address, for tags without IO bit.  */
+    uae_u8 *host;
+};
+
+struct mmu_atcset {
+    struct mmu_atc read[MMU_ATC_SIZE];
+    struct mmu_atc write[MMU_ATC_SIZE];
+    struct mmu_atc insn[MMU_ATC_SIZE];
+};
+
+extern int mmu_enabled;
+extern struct mmu_atcset mmu_atc[2], *mmu_atc_cur;
+
+/* Accesses that fault longjmp to mmu_fault_buf while mmu_fault_armed.  */
+extern jmp_buf mmu_fault_buf;
+extern int mmu_fault_armed;
+
+/* Host addresses from which a whole instruction can be fetched directly;
+ * the CPU loop calls mmu_fetch_pc when regs.pc_p leaves them.  */
+extern uae_u8 *mmu_pc_start, *mmu_pc_end;
+extern uae_u8 mmu_pc_none[];
+
+#define mmu_set_super(s) (mmu_atc_cur = &mmu_atc[(s) ? 1 : 0])
+
+extern uae_u32 mmu_get_long_slow (uaecptr) REGPARAM;
+extern uae_u32 mmu_get_word_slow (uaecptr) REGPARAM;
+extern uae_u32 mmu_get_byte_slow (uaecptr) REGPARAM;
+extern void mmu_put_long_slow (uaecptr, uae_u32) REGPARAM;
+extern void mmu_put_word_slow (uaecptr, uae_u32) REGPARAM;
+extern void mmu_put_byte_slow (uaecptr, uae_u32) REGPARAM;
+
+#define mmu_atc_entry(tbl, addr) ((tbl) + (((addr) >> MMU_PAGE_SHIFT) & (MMU_ATC_SIZE - 1)))
+
+/* The tag is compared with the page of the last byte, so accesses that
+ * cross into the next page miss as well.  */
+STATIC_INLINE uae_u32 mmu_get_long (uaecptr addr)
+{
+    struct mmu_atc *a = mmu_atc_entry (mmu_atc_cur->read, addr);
+    if (a->tag == ((addr + 3) & ~MMU_PAGE_MASK))
+	return do_get_mem_long ((uae_u32 *)(a->host + addr));
+    return mmu_get_long_slow (addr);
+}
+
+STATIC_INLINE uae_u32 mmu_get_word (uaecptr addr)
+{
+    struct mmu_atc *a = mmu_atc_entry (mmu_atc_cur->read, addr);
+    if (a->tag == ((addr + 1) & ~MMU_PAGE_MASK))
+	return do_get_mem_word ((uae_u16 *)(a->host + addr));
+    return mmu_get_word_slow (addr);
+}
+
+STATIC_INLINE uae_u32 mmu_get_byte (uaecptr addr)
+{
+    struct mmu_atc *a = mmu_atc_entry (mmu_atc_cur->read, addr);
+    if (a->tag == (addr & ~MMU_PAGE_MASK))
+	return do_get_mem_byte (a->host + addr);
+    return mmu_get_byte_slow (addr);
+}
+
+STATIC_INLINE void mmu_put_long (uaecptr addr, uae_u32 l)
+{
+    struct mmu_atc *a = mmu_atc_entry (mmu_atc_cur->write, addr);
+    if (a->tag == ((addr + 3) & ~MMU_PAGE_MASK))
+	do_put_mem_long ((uae_u32 *)(a->host + addr), l);
+    else
+	mmu_put_long_slow (addr, l);
+}
+
+STATIC_INLINE void mmu_put_word (uaecptr addr, uae_u32 w)
+{
+    struct mmu_atc *a = mmu_atc_entry (mmu_atc_cur->write, addr);
+    if (a->tag == ((addr + 1) & ~MMU_PAGE_MASK))
+	do_put_mem_word ((uae_u16 *)(a->host + addr), w);
+    else
+	mmu_put_word_slow (addr, w);
+}
+
+STATIC_INLINE void mmu_put_byte (uaecptr addr, uae_u32 b)
+{
+    struct mmu_atc *a = mmu_atc_entry (mmu_atc_cur->write, addr);
+    if (a->tag == (addr & ~MMU_PAGE_MASK))
+	do_put_mem_byte (a->host + addr, b);
+    else
+	mmu_put_byte_slow (addr, b);
+}
+
+extern void mmu_reset (void);
+extern void mmu_update (void);
+extern void mmu_notice_banks (void);
+extern void mmu_flush_all (void);
+extern void mmu_fetch_pc (void);
+
+extern int mmu030_set_tc (uae_u32 tc);
+extern void mmu030_ptest (uaecptr addr, uae_u16 next);
+extern void mmu030_pflush (uaecptr addr, uae_u16 next);
+extern void mmu030_pload (uaecptr addr, uae_u16 next);
+extern void mmu040_ptest (uaecptr addr, int write);
+extern void mmu040_pflush (uaecptr addr, int mode);
@@ -0,0 +1,83 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Natively mapped Amiga address space
+  *
+  * With natmem=yes, 4 GB of host address space are reserved and every RAM
+  * bank is mapped into it at its Amiga address, mirrors included, so that
+  * the CPU reads and writes RAM with one host instruction at
+  * natmem_offset + addr.  ROM is mapped read-only.  Anything else faults;
+  * the SIGSEGV handler in natmem.c decodes the instruction and calls the
+  * bank functions instead.
+  *
+  * Only the accesses below are decoded, so they are written in assembly.
+  */
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define NATMEM
+#endif
+
+#ifdef NATMEM
+
+extern uae_u8 *natmem_offset;
+
+STATIC_INLINE uae_u32 natmem_get_long (uaecptr addr)
+{
+    uae_u32 v;
+    __asm__ __volatile__ ("movl (%1,%2),%0" : "=r" (v) : "r" (natmem_offset), "r" ((uae_u64)addr) : "memory");
+    return do_get_mem_long (&v);
+}
+
+STATIC_INLINE uae_u32 natmem_get_word (uaecptr addr)
+{
+    uae_u32 v;
+    __asm__ __volatile__ ("movzwl (%1,%2),%0" : "=r" (v) : "r" (natmem_offset), "r" ((uae_u64)addr) : "memory");
+    return do_get_mem_word ((uae_u16 *)&v);
+}
+
+STATIC_INLINE uae_u32 natmem_get_byte (uaecptr addr)
+{
+    uae_u32 v;
+    __asm__ __volatile__ ("movzbl (%1,%2),%0" : "=r" (v) : "r" (natmem_offset), "r" ((uae_u64)addr) : "memory");
+    return v;
+}
+
+STATIC_INLINE void natmem_put_long (uaecptr addr, uae_u32 l)
+{
+    uae_u32 v;
+    do_put_mem_long (&v, l);
+    __asm__ __volatile__ ("movl %0,(%1,%2)" : : "r" (v), "r" (natmem_offset), "r" ((uae_u64)addr) : "memory");
+}
+
+STATIC_INLINE void natmem_put_word (uaecptr addr, uae_u32 w)
+{
+    uae_u16 v;
+    do_put_mem_word (&v, w);
+    __asm__ __volatile__ ("movw %0,(%1,%2)" : : "r" (v), "r" (natmem_offset), "r" ((uae_u64)addr) : "memory");
+}
+
+STATIC_INLINE void natmem_put_byte (uaecptr addr, uae_u32 b)
+{
+    __asm__ __volatile__ ("movb %b0,(%1,%2)" : : "q" (b), "r" (natmem_offset), "r" ((uae_u64)addr) : "memory");
+}
+
+extern int natmem_init (void);
+extern void natmem_cleanup (void);
+extern uae_u8 *natmem_alloc (size_t size, const char *name);
+extern void natmem_adopt (uae_u8 *host, size_t size, int fd);
+extern int natmem_free (uae_u8 *p);
+extern void natmem_reset (void);
+extern int natmem_direct (uaecptr addr, int size, int write);
+extern void natmem_map (uaecptr start, uae_u32 size, addrbank *bank);
+
+#else
+
+#define natmem_offset ((uae_u8 *)0)
+#define natmem_get_long(addr) 0
+#define natmem_get_word(addr) 0
+#define natmem_get_byte(addr) 0
+#define natmem_put_long(addr, l) do { } while (0)
+#define natmem_put_word(addr, w) do { } while (0)
+#define natmem_put_byte(addr, b) do { } while (0)
+
+#endif
@@ -54,6 +54,14 @@ struct cputbl {
     uae_u16 opcode;
 };
 
+/* A fused handler for OPCODE and the instructions that often follow it,
+ * and the plain handler for OPCODE.  */
+struct cpupairtbl {
+    cpuop_func *handler;
+    cpuop_func *first;
+    uae_u16 opcode;
+};
+
 extern unsigned long op_illg (uae_u32) REGPARAM;
 
 typedef char flagtype;
@@ -125,14 +133,23 @@ STATIC_INLINE uae_u32 munge24(uae_u32 x)
     return x & regs.address_space_mask;
 }
 
+/* With cpu_thread, the chipset thread changes the flags as well.  */
 STATIC_INLINE void set_special (uae_u32 x)
 {
+#ifdef SUPPORT_THREADS
+    __sync_or_and_fetch (&regs.spcflags, x);
+#else
     regs.spcflags |= x;
+#endif
 }
 
 STATIC_INLINE void unset_special (uae_u32 x)
 {
+#ifdef SUPPORT_THREADS
+    __sync_and_and_fetch (&regs.spcflags, ~x);
+#else
     regs.spcflags &= ~x;
+#endif
 }
 
 #define m68k_dreg(r,num) ((r).regs[(num)])
@@ -140,6 +157,12 @@ STATIC_INLINE void unset_special (uae_u32 x)
 
 STATIC_INLINE void m68k_setpc (uaecptr newpc)
 {
+    if (mmu_enabled) {
+	/* Translated by the CPU loop before the next instruction.  */
+	regs.pc = newpc;
+	regs.pc_p = regs.pc_oldp = mmu_pc_none;
+	return;
+    }
     regs.pc_p = regs.pc_oldp = get_real_address (newpc);
     regs.pc = newpc;
 }
@@ -209,7 +232,7 @@ STATIC_INLINE void m68k_setstopped (int stop)
     /* A traced STOP instruction drops through immediately without
        actually stopping.  */
     if (stop && (regs.spcflags & SPCFLAG_DOTRACE) == 0)
-	regs.spcflags |= SPCFLAG_STOP;
+	set_special (SPCFLAG_STOP);
 }
 
 extern uae_u32 get_disp_ea_020 (uae_u32 base, uae_u32 dp);
@@ -232,7 +255,7 @@ extern void m68k_disasm (FILE *, uaecptr, uaecptr *, int);
 extern void m68k_reset (void);
 
 extern void mmu_op (uae_u32, uae_u16);
-extern void mmu_op30 (uaecptr, uae_u32, int, uaecptr);
+extern void mmu_op30 (uaecptr, uae_u32, int, uae_u16, uaecptr);
 
 extern void fpp_opp (uae_u32, uae_u16);
 extern void fdbcc_opp (uae_u32, uae_u16);
@@ -268,6 +291,30 @@ extern const struct cputbl op_smalltbl_5_ff[];
 /* 68000 slow but compatible.  */
 extern const struct cputbl op_smalltbl_6_ff[];
 
+extern const struct cpupairtbl op_pairtbl_0_ff[];
+extern const struct cpupairtbl op_pairtbl_1_ff[];
+extern const struct cpupairtbl op_pairtbl_2_ff[];
+extern const struct cpupairtbl op_pairtbl_3_ff[];
+extern const struct cpupairtbl op_pairtbl_4_ff[];
+extern const struct cpupairtbl op_pairtbl_6_ff[];
+
+#ifdef NATMEM
+/* The same, compiled with NATMEM_CORE.  */
+extern const struct cputbl op_smalltbl_0_nm[];
+extern const struct cputbl op_smalltbl_1_nm[];
+extern const struct cputbl op_smalltbl_2_nm[];
+extern const struct cputbl op_smalltbl_3_nm[];
+extern const struct cputbl op_smalltbl_4_nm[];
+extern const struct cputbl op_smalltbl_6_nm[];
+
+extern const struct cpupairtbl op_pairtbl_0_nm[];
+extern const struct cpupairtbl op_pairtbl_1_nm[];
+extern const struct cpupairtbl op_pairtbl_2_nm[];
+extern const struct cpupairtbl op_pairtbl_3_nm[];
+extern const struct cpupairtbl op_pairtbl_4_nm[];
+extern const struct cpupairtbl op_pairtbl_6_nm[];
+#endif
+
 extern cpuop_func *cpufunctbl[65536] ASM_SYM_FOR_FUNC ("cpufunctbl");
 
 #ifdef JIT
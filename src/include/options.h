@@ -109,6 +109,7 @@ struct uae_prefs {
     int sound_filter_type;
 
     int gfx_framerate;
+    int gfx_framerate_auto;
     struct gfx_params gfx_w, gfx_f;
     int gfx_afullscreen;
     int gfx_pfullscreen;
@@ -131,14 +132,31 @@ struct uae_prefs {
     unsigned int rom_crc32;
     char romextfile[256];
     char keyfile[256];
+    char romindexfile[256];
     char prtname[256];
     char sername[256];
 
+    char capture_video[256];
+    char capture_audio[256];
+    int capture_video_format;
+    char fork_server[256];
+    char fork_server_state[256];
+    int fork_server_frames;
+    char metrics_socket[256];
+
     char path_floppy[256];
     char path_hardfile[256];
     char path_rom[256];
 
     int m68k_speed;
+    int cpu_idle_skip;
+    int cpu_superinsn;
+    int cpu_thread;
+    int cpu_mmu;
+    int natmem;
+    int mem_hugepages;
+    int mem_lock;
+    int mem_numa_node;
     int cpu_model;
     int fpu_model;
     int address_space_24;
@@ -158,12 +176,14 @@ struct uae_prefs {
 
     int nr_floppies;
     drive_type dfxtype[4];
+    int floppy_turbo;
 
     /* Target specific options */
     int x11_use_low_bandwidth;
     int x11_use_mitshm;
     int x11_use_dgamode;
     int x11_hide_cursor;
+    int x11_present_thread;
     int svga_no_linear;
     int win32_middle_mouse;
     int win32_logfile;
@@ -183,6 +203,10 @@ struct uae_prefs {
     int input_joymouse_speed;
     int input_autofire_framecnt;
     int input_mouse_speed;
+    char input_record[256];
+    char input_playback[256];
+    char input_statefile[256];
+    int input_benchmark;
     struct uae_input_device joystick_settings[MAX_INPUT_SETTINGS + 1][MAX_INPUT_DEVICES];
     struct uae_input_device mouse_settings[MAX_INPUT_SETTINGS + 1][MAX_INPUT_DEVICES];
     struct uae_input_device keyboard_settings[MAX_INPUT_SETTINGS + 1][MAX_INPUT_DEVICES];
@@ -9,17 +9,23 @@
 
 extern void serial_init(void);
 extern void serial_exit(void);
+extern void serial_open (void);
+extern void serial_close (void);
+extern int serial_is_open (void);
 extern void serial_dtr_off(void);
 
 extern uae_u16 SERDATR(void);
-extern int   SERDATS(void);
 extern void  SERPER(uae_u16 w);
 extern void  SERDAT(uae_u16 w);
 
+extern void serial_handler (void);
+extern void serial_hsync (void);
+extern void serial_reset (void);
+
 extern uae_u16 serial_writestatus(int, int);
-extern int serial_readstatus (void);
+extern int serial_readstatus (unsigned int *pra);
 extern uae_u16 serdat;
 
-extern int doreadser, serstat;
+extern int serstat;
 
 extern void serial_flush_buffer(void);
@@ -0,0 +1,37 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Fused handlers for frequent instruction pairs
+  *
+  * gencpu reads pair counts from frequent_pairs.68k and generates a handler
+  * for the first instruction of each frequent pair which, if the next
+  * opcode is one of the instructions that usually follow, calls that
+  * handler directly.  This is only allowed when the main loop would have
+  * gone straight on to the next instruction anyway.
+  */
+
+extern unsigned long cycles_mask, cycles_val;
+
+/* Called between the two instructions of a pair; the first one took CYCLES.
+ * If no special flag is set and no event is due, do what the main loop
+ * does between instructions and return 1.  Otherwise return 0, and the
+ * fused handler must return to the main loop.  On the CPU thread, that is
+ * what m68k_run_thread does; the events belong to the chipset thread.  */
+STATIC_INLINE int superinsn_continue (unsigned long cycles)
+{
+    if (cputhread_running) {
+	if (regs.spcflags & ~CPUTHREAD_CHIPSET_FLAGS)
+	    return 0;
+	METRIC_INC (METRIC_INSNS);
+	cputhread_do_cycles (cycles);
+	return 1;
+    }
+    cycles &= cycles_mask;
+    cycles |= cycles_val;
+    if (regs.spcflags || delaying_for_sound || is_lastline
+	|| nextevent - currcycle <= cycles)
+	return 0;
+    currcycle += cycles;
+    METRIC_INC (METRIC_INSNS);
+    return 1;
+}
@@ -42,6 +42,7 @@
 #include "inputdevice.h"
 #include "keybuf.h"
 #include "savestate.h"
+#include "inputrec.h"
 
 #define DIR_LEFT 1
 #define DIR_RIGHT 2
@@ -311,6 +312,10 @@ void write_inputdevice_config (struct uae_prefs *p, FILE *f)
     cfgfile_write (f, "input.joystick_deadzone=%d\n", p->input_joystick_deadzone);
     cfgfile_write (f, "input.mouse_speed=%d\n", p->input_mouse_speed);
     cfgfile_write (f, "input.autofire=%d\n", p->input_autofire_framecnt);
+    cfgfile_write (f, "input.record=%s\n", p->input_record);
+    cfgfile_write (f, "input.playback=%s\n", p->input_playback);
+    cfgfile_write (f, "input.statefile=%s\n", p->input_statefile);
+    cfgfile_write (f, "input.benchmark=%s\n", p->input_benchmark ? "true" : "false");
     for (id = 1; id <= MAX_INPUT_SETTINGS; id++) {
 	for (i = 0; i < MAX_INPUT_DEVICES; i++)
 	    write_config (f, id, i, "joystick", &p->joystick_settings[id][i], &joysticks2[i]);
@@ -394,6 +399,11 @@ void read_inputdevice_config (struct uae_prefs *pr, char *option, char *value)
 	pr->input_mouse_speed = atol (value);
     if (!strcasecmp (p, "autofire"))
 	pr->input_autofire_framecnt = atol (value);
+    if (cfgfile_string (p, value, "record", pr->input_record, 256)
+	|| cfgfile_string (p, value, "playback", pr->input_playback, 256)
+	|| cfgfile_string (p, value, "statefile", pr->input_statefile, 256)
+	|| cfgfile_yesno (p, value, "benchmark", &pr->input_benchmark))
+	return;
     idnum = atol (p);
     if (idnum <= 0 || idnum > MAX_INPUT_SETTINGS)
 	return;
@@ -541,7 +551,8 @@ static void new_mousehack_helper (void)
 {
     int mousexpos, mouseypos;
 
-    if (!mousehack_allowed ())
+    /* The host pointer position would make recordings nondeterministic.  */
+    if (!mousehack_allowed () || inputrec_mode != INPUTREC_OFF)
 	return;
 #ifdef PICASSO96
     if (picasso_on) {
@@ -661,8 +672,10 @@ static int input_read, input_vpos;
 static void readinput (void)
 {
     if (!input_read && (vpos & ~31) != (input_vpos & ~31)) {
+	inputrec_host_begin ();
 	idev[IDTYPE_JOYSTICK].read ();
 	idev[IDTYPE_MOUSE].read ();
+	inputrec_host_end ();
 	mouseupdate ((vpos - input_vpos) * 100 / maxvpos);
 	input_vpos = vpos;
     }
@@ -911,8 +924,10 @@ void inputdevice_hsync (void)
     if (inputdelay > 0) {
 	inputdelay--;
 	if (inputdelay == 0) {
+	    inputrec_host_begin ();
 	    idev[IDTYPE_JOYSTICK].read ();
 	    idev[IDTYPE_KEYBOARD].read ();
+	    inputrec_host_end ();
 	}
     }
 }
@@ -1039,6 +1054,9 @@ void inputdevice_add_inputcode (int code, int state)
 
 void inputdevice_do_keyboard (int code, int state)
 {
+    if (inputrec_from_host () && ! inputrec_key (code, state))
+	return;
+    inputrec_host++;
     if (code < 0x80) {
 	uae_u8 key = code | (state ? 0x00 : 0x80);
 	keybuf[key & 0x7f] = (key & 0x80) ? 0 : 1;
@@ -1049,9 +1067,9 @@ void inputdevice_do_keyboard (int code, int state)
 	}
 	record_key ((uae_u8)((key << 1) | (key >> 7)));
 	//write_log ("Amiga key %02.2X %d\n", key & 0x7f, key >> 7);
-	return;
-    }
-    inputdevice_add_inputcode (code, state);
+    } else
+	inputdevice_add_inputcode (code, state);
+    inputrec_host--;
 }
 
 void inputdevice_handle_inputcode (void)
@@ -1239,6 +1257,9 @@ void handle_input_event (int nr, int state, int max, int autofire)
 
     if (nr <= 0)
 	return;
+    if (inputrec_from_host () && ! inputrec_event (nr, state, max, autofire))
+	return;
+    inputrec_host++;
     ie = &events[nr];
     //write_log ("'%s' %d %d\n", ie->name, state, max);
     if (autofire) {
@@ -1345,6 +1366,7 @@ void handle_input_event (int nr, int state, int max, int autofire)
 	    inputdevice_do_keyboard (ie->data, state);
 	break;
     }
+    inputrec_host--;
 }
 
 void inputdevice_vsync (void)
@@ -1364,8 +1386,11 @@ void inputdevice_vsync (void)
 	}
     }
     mouseupdate (100);
-    inputdelay = rand () % (maxvpos - 1);
+    /* Recordings need the polls at the same place in every run.  */
+    inputdelay = inputrec_mode != INPUTREC_OFF ? maxvpos / 2 : rand () % (maxvpos - 1);
+    inputrec_host_begin ();
     idev[IDTYPE_MOUSE].read ();
+    inputrec_host_end ();
     input_read = 1;
     input_vpos = 0;
     inputdevice_handle_inputcode ();
@@ -1753,6 +1778,10 @@ void inputdevice_default_prefs (struct uae_prefs *p)
     p->input_joymouse_speed = 10;
     p->input_mouse_speed = 100;
     p->input_autofire_framecnt = 10;
+    strcpy (p->input_record, "");
+    strcpy (p->input_playback, "");
+    strcpy (p->input_statefile, "");
+    p->input_benchmark = 0;
     for (i = 0; i <= MAX_INPUT_SETTINGS; i++) {
 	set_kbr_default (p, i, 0);
 	input_get_default_mouse (p->mouse_settings[i]);
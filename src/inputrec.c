@@ -0,0 +1,364 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Input recording and playback
+  *
+  * Host input reaches the emulation at a few points only: when the window
+  * system events are handled once per frame, and when joystick and mouse
+  * are polled (see inputrec_host_begin).  Both happen at emulated times
+  * that don't depend on the host.  So an input event is timed exactly by
+  * its frame number and by the number of the polling point within that
+  * frame.  The recording is a stream of such timed events.  During playback,
+  * host input is dropped, and the recorded events are injected at the same
+  * polling points.
+  *
+  * At the end of every frame, a hash of chip RAM and the CPU registers is
+  * recorded, and compared during playback, so a recording doubles as a
+  * determinism test.  With input_benchmark, playback runs as fast as the
+  * host allows and reports the frame rate at the end.
+  *
+  * File format: the magic "UAEINP\0\1", then records.  A record is the
+  * frame number relative to the previous record, the polling point, a type
+  * byte and the arguments.  Numbers are stored 7 bits per byte, low bits
+  * first, with the top bit set on all but the last byte; signed numbers
+  * are zigzag encoded.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "uae.h"
+#include "memory.h"
+#include "custom.h"
+#include "newcpu.h"
+#include "inputdevice.h"
+#include "keybuf.h"
+#include "savestate.h"
+#include "crc32.h"
+#include "inputrec.h"
+
+#define IR_END 0
+#define IR_EVENT 1
+#define IR_KEY 2
+#define IR_RAWKEY 3
+#define IR_HASH 4
+
+static const char ir_magic[8] = { 'U', 'A', 'E', 'I', 'N', 'P', 0, 1 };
+
+int inputrec_mode;
+int inputrec_host;
+
+static FILE *ir_file;
+static int ir_active;
+static unsigned long ir_frame, ir_poll, ir_last;
+static uae_u32 ir_hash;
+static unsigned long ir_events, ir_mismatches;
+#ifdef HAVE_GETTIMEOFDAY
+static struct timeval ir_tv;
+#endif
+
+/* Playback: the next record in the file.  */
+static struct {
+    int type;
+    unsigned long frame, poll;
+    int arg[4];
+} ir_next;
+
+static void put_num (unsigned long v)
+{
+    while (v >= 0x80) {
+	putc ((int)(v & 0x7f) | 0x80, ir_file);
+	v >>= 7;
+    }
+    putc ((int)v, ir_file);
+}
+
+static void put_snum (int v)
+{
+    put_num (v < 0 ? ((unsigned long)~v << 1) | 1 : (unsigned long)v << 1);
+}
+
+static unsigned long get_num (void)
+{
+    unsigned long v = 0;
+    int shift = 0, c;
+
+    do {
+	c = getc (ir_file);
+	if (c == EOF) {
+	    ir_next.type = IR_END;
+	    return 0;
+	}
+	v |= (unsigned long)(c & 0x7f) << shift;
+	shift += 7;
+    } while (c & 0x80);
+    return v;
+}
+
+static int get_snum (void)
+{
+    unsigned long v = get_num ();
+    return v & 1 ? ~(int)(v >> 1) : (int)(v >> 1);
+}
+
+static void put_record (int type)
+{
+    put_num (ir_frame - ir_last);
+    put_num (ir_poll);
+    putc (type, ir_file);
+    ir_last = ir_frame;
+}
+
+static void get_record (void)
+{
+    int c;
+
+    ir_next.type = -1;
+    ir_next.frame += get_num ();
+    ir_next.poll = get_num ();
+    c = getc (ir_file);
+    if (ir_next.type == IR_END || c == EOF) {
+	ir_next.type = IR_END;
+	return;
+    }
+    ir_next.type = c;
+    switch (c) {
+     case IR_EVENT:
+	ir_next.arg[0] = get_num ();
+	ir_next.arg[1] = get_snum ();
+	ir_next.arg[2] = get_snum ();
+	ir_next.arg[3] = get_num ();
+	break;
+     case IR_KEY:
+	ir_next.arg[0] = get_num ();
+	ir_next.arg[1] = get_num ();
+	break;
+     case IR_RAWKEY:
+	ir_next.arg[0] = get_num ();
+	break;
+     case IR_HASH:
+	ir_next.arg[0] = get_num ();
+	break;
+     case IR_END:
+	break;
+     default:
+	write_log ("Input playback: bad record type %d.\n", c);
+	ir_next.type = IR_END;
+	break;
+    }
+}
+
+static void put_le32 (uae_u8 *p, uae_u32 v)
+{
+    p[0] = (uae_u8)v;
+    p[1] = (uae_u8)(v >> 8);
+    p[2] = (uae_u8)(v >> 16);
+    p[3] = (uae_u8)(v >> 24);
+}
+
+/* Chained over all frames so far.  Byte order is fixed, so recordings can
+ * be played back on any host.  */
+static uae_u32 frame_hash (void)
+{
+    uae_u8 buf[19 * 4];
+    int i;
+
+    put_le32 (buf, ir_hash);
+    put_le32 (buf + 4, get_crc32 (chipmemory, allocated_chipmem));
+    for (i = 0; i < 16; i++)
+	put_le32 (buf + 8 + i * 4, regs.regs[i]);
+    put_le32 (buf + 72, m68k_getpc ());
+    return get_crc32 (buf, sizeof buf);
+}
+
+static double elapsed_secs (void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec - ir_tv.tv_sec) + (tv.tv_usec - ir_tv.tv_usec) / 1000000.0;
+#else
+    return 0;
+#endif
+}
+
+static void playback_done (void)
+{
+    double secs = elapsed_secs ();
+
+    write_log ("Input playback: %lu frames, %lu events, hash %08X, %lu mismatches\n",
+	       ir_frame, ir_events, ir_hash, ir_mismatches);
+    if (currprefs.input_benchmark && secs > 0)
+	write_log ("Input playback: %.2f seconds, %.1f frames per second\n",
+		   secs, ir_frame / secs);
+    fclose (ir_file);
+    ir_file = 0;
+    inputrec_mode = INPUTREC_OFF;
+    if (currprefs.input_benchmark)
+	uae_quit ();
+}
+
+void inputrec_poll (void)
+{
+    if (! ir_active || inputrec_host != 0)
+	return;
+    ir_poll++;
+    if (inputrec_mode != INPUTREC_PLAY)
+	return;
+
+    while (ir_next.type > IR_END && ir_next.type < IR_HASH
+	   && (ir_next.frame < ir_frame
+	       || (ir_next.frame == ir_frame && ir_next.poll <= ir_poll)))
+    {
+	switch (ir_next.type) {
+	 case IR_EVENT:
+	    handle_input_event (ir_next.arg[0], ir_next.arg[1], ir_next.arg[2], ir_next.arg[3]);
+	    break;
+	 case IR_KEY:
+	    inputdevice_do_keyboard (ir_next.arg[0], ir_next.arg[1]);
+	    break;
+	 case IR_RAWKEY:
+	    record_key (ir_next.arg[0]);
+	    break;
+	}
+	ir_events++;
+	get_record ();
+    }
+}
+
+int inputrec_event (int nr, int state, int max, int autofire)
+{
+    if (inputrec_mode != INPUTREC_RECORD || ! ir_active)
+	return 0;
+    put_record (IR_EVENT);
+    put_num (nr);
+    put_snum (state);
+    put_snum (max);
+    put_num (autofire);
+    ir_events++;
+    return 1;
+}
+
+int inputrec_key (int code, int state)
+{
+    if (inputrec_mode != INPUTREC_RECORD || ! ir_active)
+	return 0;
+    put_record (IR_KEY);
+    put_num (code);
+    put_num (state);
+    ir_events++;
+    return 1;
+}
+
+int inputrec_rawkey (int kc)
+{
+    if (inputrec_mode != INPUTREC_RECORD || ! ir_active)
+	return 0;
+    put_record (IR_RAWKEY);
+    put_num (kc);
+    ir_events++;
+    return 1;
+}
+
+/* Called at the start of vsync_handler, before any host input for the new
+ * frame is handled.  */
+void inputrec_vsync (void)
+{
+    if (inputrec_mode == INPUTREC_OFF)
+	return;
+
+    if (! ir_active) {
+	/* Start with the first frame after the state file is restored.  */
+	if (savestate_state != 0)
+	    return;
+	ir_active = 1;
+	ir_frame = ir_poll = 0;
+#ifdef HAVE_GETTIMEOFDAY
+	gettimeofday (&ir_tv, NULL);
+#endif
+	return;
+    }
+
+    ir_hash = frame_hash ();
+    if (inputrec_mode == INPUTREC_RECORD) {
+	put_record (IR_HASH);
+	put_num (ir_hash);
+    } else {
+	if (ir_next.type == IR_HASH && ir_next.frame == ir_frame) {
+	    if ((uae_u32)ir_next.arg[0] != ir_hash) {
+		if (ir_mismatches == 0)
+		    write_log ("Input playback: frame %lu differs from the recording.\n", ir_frame);
+		ir_mismatches++;
+	    }
+	    get_record ();
+	}
+	if (ir_next.type == IR_END && ir_next.frame <= ir_frame) {
+	    ir_frame++;
+	    playback_done ();
+	    return;
+	}
+    }
+    ir_frame++;
+    ir_poll = 0;
+}
+
+void inputrec_start (void)
+{
+    char magic[sizeof ir_magic];
+
+    if (currprefs.input_record[0] != '\0') {
+	ir_file = fopen (currprefs.input_record, "wb");
+	if (ir_file == 0) {
+	    write_log ("Can't open input recording %s\n", currprefs.input_record);
+	    return;
+	}
+	fwrite (ir_magic, sizeof ir_magic, 1, ir_file);
+	inputrec_mode = INPUTREC_RECORD;
+    } else if (currprefs.input_playback[0] != '\0') {
+	ir_file = fopen (currprefs.input_playback, "rb");
+	if (ir_file == 0
+	    || fread (magic, sizeof magic, 1, ir_file) != 1
+	    || memcmp (magic, ir_magic, sizeof magic) != 0)
+	{
+	    write_log ("%s is not an input recording.\n", currprefs.input_playback);
+	    if (ir_file)
+		fclose (ir_file);
+	    ir_file = 0;
+	    return;
+	}
+	memset (&ir_next, 0, sizeof ir_next);
+	get_record ();
+	inputrec_mode = INPUTREC_PLAY;
+    } else
+	return;
+
+    /* At "max" speed, the amount of work per frame depends on the host.  */
+    if (currprefs.m68k_speed == -1) {
+	write_log ("Input recording needs a fixed CPU speed; using \"real\".\n");
+	currprefs.m68k_speed = changed_prefs.m68k_speed = 0;
+    }
+    if (currprefs.input_statefile[0] != '\0') {
+	savestate_filename = currprefs.input_statefile;
+	savestate_state = STATE_DORESTORE;
+    }
+    ir_active = 0;
+    ir_hash = 0;
+    ir_last = 0;
+    ir_events = ir_mismatches = 0;
+}
+
+void inputrec_stop (void)
+{
+    if (inputrec_mode == INPUTREC_RECORD) {
+	put_record (IR_END);
+	fclose (ir_file);
+	write_log ("Input recording: %lu frames, %lu events, hash %08X\n",
+		   ir_frame, ir_events, ir_hash);
+    } else if (inputrec_mode == INPUTREC_PLAY) {
+	write_log ("Input playback stopped at frame %lu.\n", ir_frame);
+	fclose (ir_file);
+    }
+    ir_file = 0;
+    inputrec_mode = INPUTREC_OFF;
+}
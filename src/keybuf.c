@@ -22,6 +22,7 @@
 #include "inputdevice.h"
 #include "custom.h"
 #include "savestate.h"
+#include "inputrec.h"
 
 static int fakestate[2][7] = { {0},{0} };
 
@@ -62,7 +63,7 @@ static void do_fake (int nr)
     setjoybuttonstate (nr, 2, fake[6]);
 }
 
-void record_key (int kc)
+static void record_key_1 (int kc)
 {
     int fs = 0;
     int kpb_next = kpb_first + 1;
@@ -174,6 +175,15 @@ void record_key (int kc)
     kpb_first = kpb_next;
 }
 
+void record_key (int kc)
+{
+    if (inputrec_from_host () && ! inputrec_rawkey (kc))
+	return;
+    inputrec_host++;
+    record_key_1 (kc);
+    inputrec_host--;
+}
+
 void joystick_setting_changed (void)
 {
     fs_np = fs_ck = fs_se = fs_xa1 = fs_xa2 = 0;
@@ -0,0 +1,29 @@
+
+/* Like linetoscr.c, but reads the bitplanes of the line directly.  Every
+   32 pixels are converted into fused_chunk and mapped through fused_lut,
+   which already has dual playfield, EHB and the AGA color xor folded in.  */
+static NOINLINE int LNAME (int spix, int dpix, int stoppos)
+{
+    TYPE *buf = ((TYPE *)xlinebuffer);
+    uae_u8 *pix = fused_chunk.bytes;
+    int p = spix - MAX_PIXELS_PER_LINE;
+
+    while (dpix < stoppos) {
+	int end;
+	if ((p >> 5) != fused_chunk_nr)
+	    fused_decode_chunk (p >> 5);
+	end = (fused_chunk_nr + 1) << 5;
+	while (dpix < stoppos && p < end) {
+	    TYPE d = (TYPE)fused_lut[pix[p & 31]];
+	    p += SRC_INC;
+	    buf[dpix++] = d;
+	    if (HDOUBLE)
+		buf[dpix++] = d;
+	}
+    }
+    return p + MAX_PIXELS_PER_LINE;
+}
+
+#undef LNAME
+#undef HDOUBLE
+#undef SRC_INC
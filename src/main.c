@@ -38,6 +38,11 @@
 #include "native2amiga.h"
 #include "scsidev.h"
 #include "romlist.h"
+#include "capture.h"
+#include "forkserver.h"
+#include "inputrec.h"
+#include "metrics.h"
+#include "crc32.h"
 
 #ifdef USE_SDL
 #include "SDL.h"
@@ -214,6 +219,7 @@ void default_prefs (struct uae_prefs *p)
     p->sound_filter_type = FILTER_SOUND_TYPE_A500;
 
     p->gfx_framerate = 1;
+    p->gfx_framerate_auto = 0;
     p->gfx_w.width = 800;
     p->gfx_w.height = 600;
     p->gfx_w.lores = 0;
@@ -231,6 +237,7 @@ void default_prefs (struct uae_prefs *p)
     p->x11_use_low_bandwidth = 0;
     p->x11_use_mitshm = 0;
     p->x11_hide_cursor = 1;
+    p->x11_present_thread = 0;
 
     p->svga_no_linear = 0;
 
@@ -243,7 +250,7 @@ void default_prefs (struct uae_prefs *p)
     p->win32_no_overlay = 0;
 
     p->immediate_blits = 0;
-    p->collision_level = 1;
+    p->collision_level = 3;
  
     p->chipset_mask = CSMASK_ECS_AGNUS;
     p->cs_rtc = 2;
@@ -259,6 +266,7 @@ void default_prefs (struct uae_prefs *p)
 
     strcpy (p->romfile, "kick.rom");
     strcpy (p->keyfile, "");
+    strcpy (p->romindexfile, "");
     strcpy (p->prtname, DEFPRTNAME);
     p->rom_crc32 = 0;
 
@@ -269,13 +277,31 @@ void default_prefs (struct uae_prefs *p)
     strcpy (p->prtname, "");
     strcpy (p->sername, "");
 
+    strcpy (p->capture_video, "");
+    strcpy (p->capture_audio, "");
+    p->capture_video_format = CAPTURE_Y4M;
+
+    strcpy (p->fork_server, "");
+    strcpy (p->fork_server_state, "");
+    p->fork_server_frames = 0;
+    strcpy (p->metrics_socket, "");
+
     p->nr_floppies = 2;
     p->dfxtype[0] = DRV_35_DD;
     p->dfxtype[1] = DRV_35_DD;
     p->dfxtype[2] = DRV_NONE;
     p->dfxtype[3] = DRV_NONE;
+    p->floppy_turbo = 0;
 
     p->m68k_speed = 0;
+    p->cpu_idle_skip = 0;
+    p->cpu_superinsn = 1;
+    p->cpu_thread = 0;
+    p->cpu_mmu = 0;
+    p->natmem = 0;
+    p->mem_hugepages = 0;
+    p->mem_lock = 0;
+    p->mem_numa_node = -1;
     p->cpu_model = 68020;
     p->fpu_model = 0;
     p->address_space_24 = 0;
@@ -548,6 +574,9 @@ void do_start_program (void)
 
 void do_leave_program (void)
 {
+    metrics_stop ();
+    inputrec_stop ();
+    capture_stop ();
     graphics_leave ();
     inputdevice_close ();
     close_sound ();
@@ -581,6 +610,7 @@ void real_main (int argc, char **argv)
     SDL_Init (SDL_INIT_EVERYTHING | SDL_INIT_NOPARACHUTE);
 #endif
 
+    crc32_init ();
     default_prefs (&currprefs);
 
 #ifdef SYSTEM_CFGDIR
@@ -663,6 +693,12 @@ void real_main (int argc, char **argv)
 	if (currprefs.start_debugger && debuggable ())
 	    activate_debugger ();
 
+	/* With a fork server, every job starts its own capture.  */
+	if (currprefs.fork_server[0] == '\0')
+	    capture_start ();
+	forkserver_init ();
+	inputrec_start ();
+	metrics_start ();
 	start_program ();
     }
     leave_program ();
@@ -6,6 +6,22 @@
   * Copyright 1996 Bernd Schmidt
   */
 
+/* With LAZY_FLAGS, the common arithmetic and logical instructions only
+ * record what they did (see SET_LAZY_FLAGS); C, Z, N and V are worked out
+ * from that the first time someone asks for one of them.  X is always set
+ * immediately.  The generated code contains both variants; test/cputest.c
+ * is built with NO_LAZY_FLAGS as well, to compare them.  */
+#ifndef NO_LAZY_FLAGS
+#define LAZY_FLAGS
+#endif
+
+#define LAZYF_LOGICAL 0x04
+#define LAZYF_ADD 0x08
+#define LAZYF_SUB 0x0c
+#define LAZYF_CMP 0x10
+#define LAZYF_BYTE 0
+#define LAZYF_WORD 1
+#define LAZYF_LONG 2
 
 struct flag_struct {
     unsigned int c;
@@ -13,9 +29,13 @@ struct flag_struct {
     unsigned int n;
     unsigned int v;
     unsigned int x;
+    /* Pending operation, or 0 if the fields above are valid.  */
+    unsigned int op;
+    uae_u32 src, dst, res;
 };
 
 extern struct flag_struct regflags;
+extern void flush_lazy_flags (void);
 
 #define ZFLG (regflags.z)
 #define NFLG (regflags.n)
@@ -23,8 +43,87 @@ extern struct flag_struct regflags;
 #define VFLG (regflags.v)
 #define XFLG (regflags.x)
 
+#define FLUSH_FLAGS (regflags.op ? flush_lazy_flags () : (void)0)
+
+#define SET_LAZY_FLAGS(o, s, d, r) \
+    (regflags.op = (o), regflags.src = (uae_u32)(s), \
+     regflags.dst = (uae_u32)(d), regflags.res = (uae_u32)(r))
+
+#define SET_CFLG(x) (FLUSH_FLAGS, CFLG = (x))
+#define SET_NFLG(x) (FLUSH_FLAGS, NFLG = (x))
+#define SET_VFLG(x) (FLUSH_FLAGS, VFLG = (x))
+#define SET_ZFLG(x) (FLUSH_FLAGS, ZFLG = (x))
+#define SET_XFLG(x) (XFLG = (x))
+
+#define GET_CFLG (FLUSH_FLAGS, CFLG)
+#define GET_NFLG (FLUSH_FLAGS, NFLG)
+#define GET_VFLG (FLUSH_FLAGS, VFLG)
+#define GET_ZFLG (FLUSH_FLAGS, ZFLG)
+#define GET_XFLG XFLG
+
+#define CLEAR_CZNV do { \
+ regflags.op = 0; \
+ CFLG = ZFLG = NFLG = VFLG = 0; \
+} while (0)
+
+#define COPY_CARRY (SET_XFLG (GET_CFLG))
+
+/* How far to shift the operands of a pending operation to move them to
+ * the top of the word.  */
+#define LAZYF_SHIFT(op) ((0x1018 >> (((op) & 3) * 8)) & 0xff)
+
+/* Most conditions after a compare or a logical operation can be read off
+ * the operands, without working out the flags.  */
+static __inline__ int lazy_cctrue(const int cc)
+{
+    int shift = LAZYF_SHIFT (regflags.op);
+    uae_u32 r = regflags.res << shift;
+    uae_u32 s, d;
+
+    switch (regflags.op & ~3) {
+     case LAZYF_LOGICAL:
+	switch (cc) {
+	 case 2: return r != 0;              /* HI */
+	 case 3: return r == 0;              /* LS */
+	 case 4: case 8: return 1;           /* CC, VC */
+	 case 5: case 9: return 0;           /* CS, VS */
+	 case 6: return r != 0;              /* NE */
+	 case 7: return r == 0;              /* EQ */
+	 case 10: case 12: return (uae_s32)r >= 0; /* PL, GE */
+	 case 11: case 13: return (uae_s32)r < 0;  /* MI, LT */
+	 case 14: return (uae_s32)r > 0;     /* GT */
+	 case 15: return (uae_s32)r <= 0;    /* LE */
+	}
+	break;
+     case LAZYF_SUB:
+     case LAZYF_CMP:
+	s = regflags.src << shift;
+	d = regflags.dst << shift;
+	switch (cc) {
+	 case 2: return d > s;               /* HI */
+	 case 3: return d <= s;              /* LS */
+	 case 4: return d >= s;              /* CC */
+	 case 5: return d < s;               /* CS */
+	 case 6: return r != 0;              /* NE */
+	 case 7: return r == 0;              /* EQ */
+	 case 12: return (uae_s32)d >= (uae_s32)s; /* GE */
+	 case 13: return (uae_s32)d < (uae_s32)s;  /* LT */
+	 case 14: return (uae_s32)d > (uae_s32)s;  /* GT */
+	 case 15: return (uae_s32)d <= (uae_s32)s; /* LE */
+	}
+	break;
+    }
+    flush_lazy_flags ();
+    return -1;
+}
+
 static __inline__ int cctrue(const int cc)
 {
+    if (regflags.op && cc > 1) {
+	int t = lazy_cctrue (cc);
+	if (t >= 0)
+	    return t;
+    }
     switch(cc){
      case 0: return 1;                       /* T */
      case 1: return 0;                       /* F */
@@ -46,4 +145,3 @@ static __inline__ int cctrue(const int cc)
     abort();
     return 0;
 }
-
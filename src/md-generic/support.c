@@ -14,6 +14,37 @@
 
 struct flag_struct regflags;
 
+void flush_lazy_flags (void)
+{
+    /* Move the operands to the top of the word, so the flags come out the
+     * same for all sizes.  */
+    int shift = LAZYF_SHIFT (regflags.op);
+    uae_u32 s = regflags.src << shift;
+    uae_u32 d = regflags.dst << shift;
+    uae_u32 r = regflags.res << shift;
+    int flgs = (uae_s32)s < 0;
+    int flgo = (uae_s32)d < 0;
+    int flgn = (uae_s32)r < 0;
+
+    regflags.z = r == 0;
+    regflags.n = flgn;
+    switch (regflags.op & ~3) {
+     case LAZYF_LOGICAL:
+	regflags.c = regflags.v = 0;
+	break;
+     case LAZYF_ADD:
+	regflags.v = (flgs ^ flgn) & (flgo ^ flgn);
+	regflags.c = ~d < s;
+	break;
+     case LAZYF_SUB:
+     case LAZYF_CMP:
+	regflags.v = (flgs ^ flgo) & (flgn ^ flgo);
+	regflags.c = s > d;
+	break;
+    }
+    regflags.op = 0;
+}
+
 void machdep_init (void)
 {
 }
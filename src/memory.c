@@ -22,6 +22,8 @@
 #include "savestate.h"
 #include "crc32.h"
 #include "gui.h"
+#include "hostmem.h"
+#include "cputhread.h"
 
 #ifdef USE_MAPPED_MEMORY
 #include <sys/mman.h>
@@ -84,7 +86,8 @@ __inline__ void byteput (uaecptr addr, uae_u32 b)
 }
 #endif
 
-static uae_u32 chipmem_mask, chipmem_full_mask;
+uae_u32 chipmem_full_mask;
+static uae_u32 chipmem_mask;
 static uae_u32 kickmem_mask, extendedkickmem_mask, bogomem_mask;
 static uae_u32 a3000lmem_mask, a3000hmem_mask;
 
@@ -184,13 +187,20 @@ uae_u8 *chipmemory;
 static int chipmem_check (uaecptr addr, uae_u32 size) REGPARAM;
 static uae_u8 *chipmem_xlate (uaecptr addr) REGPARAM;
 
+#ifdef CHIPMEM_MIRROR
+/* Every address in the chip bank is inside the mirrors, once the copies
+ * of the bank that map_banks makes for a 24-bit address space are folded
+ * back.  */
+#define chipmem_offset(addr) ((addr) & 0x00ffffff)
+#else
+#define chipmem_offset(addr) (((addr) - (chipmem_start & chipmem_mask)) & chipmem_mask)
+#endif
+
 uae_u32 REGPARAM2 chipmem_lget (uaecptr addr)
 {
     uae_u32 *m;
 
-    addr -= chipmem_start & chipmem_mask;
-    addr &= chipmem_mask;
-    m = (uae_u32 *)(chipmemory + addr);
+    m = (uae_u32 *)(chipmemory + chipmem_offset (addr));
     return do_get_mem_long (m);
 }
 
@@ -198,26 +208,20 @@ uae_u32 REGPARAM2 chipmem_wget (uaecptr addr)
 {
     uae_u16 *m;
 
-    addr -= chipmem_start & chipmem_mask;
-    addr &= chipmem_mask;
-    m = (uae_u16 *)(chipmemory + addr);
+    m = (uae_u16 *)(chipmemory + chipmem_offset (addr));
     return do_get_mem_word (m);
 }
 
 uae_u32 REGPARAM2 chipmem_bget (uaecptr addr)
 {
-    addr -= chipmem_start & chipmem_mask;
-    addr &= chipmem_mask;
-    return chipmemory[addr];
+    return chipmemory[chipmem_offset (addr)];
 }
 
 void REGPARAM2 chipmem_lput (uaecptr addr, uae_u32 l)
 {
     uae_u32 *m;
 
-    addr -= chipmem_start & chipmem_mask;
-    addr &= chipmem_mask;
-    m = (uae_u32 *)(chipmemory + addr);
+    m = (uae_u32 *)(chipmemory + chipmem_offset (addr));
     do_put_mem_long (m, l);
 }
 
@@ -225,44 +229,23 @@ void REGPARAM2 chipmem_wput (uaecptr addr, uae_u32 w)
 {
     uae_u16 *m;
 
-    addr -= chipmem_start & chipmem_mask;
-    addr &= chipmem_mask;
-    m = (uae_u16 *)(chipmemory + addr);
+    m = (uae_u16 *)(chipmemory + chipmem_offset (addr));
     do_put_mem_word (m, w);
 }
 
 void REGPARAM2 chipmem_bput (uaecptr addr, uae_u32 b)
 {
-    addr -= chipmem_start & chipmem_mask;
-    addr &= chipmem_mask;
-    chipmemory[addr] = b;
-}
-
-uae_u32 REGPARAM2 chipmem_agnus_wget (uaecptr addr)
-{
-    uae_u16 *m;
-
-    addr &= chipmem_full_mask;
-    m = (uae_u16 *)(chipmemory + addr);
-    return do_get_mem_word (m);
-}
-
-void REGPARAM2 chipmem_agnus_wput (uaecptr addr, uae_u32 w)
-{
-    uae_u16 *m;
-
-    addr &= chipmem_full_mask;
-    if (addr >= allocated_chipmem)
-	return;
-    m = (uae_u16 *)(chipmemory + addr);
-    do_put_mem_word (m, w);
+    chipmemory[chipmem_offset (addr)] = b;
 }
 
+/* These two take any address, as the playfield code uses them for DMA
+ * pointers.  The pointer is into the first copy of chip memory, which is
+ * what natmem_map expects.  */
 int REGPARAM2 chipmem_check (uaecptr addr, uae_u32 size)
 {
     addr -= chipmem_start & chipmem_mask;
     addr &= chipmem_mask;
-    return (addr + size) <= allocated_chipmem;
+    return (addr + size) <= allocated_chipmem + CHIPMEM_TAIL;
 }
 
 uae_u8 REGPARAM2 *chipmem_xlate (uaecptr addr)
@@ -719,43 +702,50 @@ uae_u8 REGPARAM2 *default_xlate (uaecptr a)
 addrbank dummy_bank = {
     dummy_lget, dummy_wget, dummy_bget,
     dummy_lput, dummy_wput, dummy_bput,
-    default_xlate, dummy_check, NULL, NULL
+    default_xlate, dummy_check, NULL, NULL,
+    0
 };
 
 addrbank chipmem_bank = {
     chipmem_lget, chipmem_wget, chipmem_bget,
     chipmem_lput, chipmem_wput, chipmem_bput,
-    chipmem_xlate, chipmem_check, NULL, "Chip memory"
+    chipmem_xlate, chipmem_check, NULL, "Chip memory",
+    ABFLAG_RAM
 };
 
 addrbank bogomem_bank = {
     bogomem_lget, bogomem_wget, bogomem_bget,
     bogomem_lput, bogomem_wput, bogomem_bput,
-    bogomem_xlate, bogomem_check, NULL, "Slow memory"
+    bogomem_xlate, bogomem_check, NULL, "Slow memory",
+    ABFLAG_RAM
 };
 
 addrbank a3000lmem_bank = {
     a3000lmem_lget, a3000lmem_wget, a3000lmem_bget,
     a3000lmem_lput, a3000lmem_wput, a3000lmem_bput,
-    a3000lmem_xlate, a3000lmem_check, NULL, "RAMSEY memory (low)"
+    a3000lmem_xlate, a3000lmem_check, NULL, "RAMSEY memory (low)",
+    ABFLAG_RAM
 };
 
 addrbank a3000hmem_bank = {
     a3000hmem_lget, a3000hmem_wget, a3000hmem_bget,
     a3000hmem_lput, a3000hmem_wput, a3000hmem_bput,
-    a3000hmem_xlate, a3000hmem_check, NULL, "RAMSEY memory (high)"
+    a3000hmem_xlate, a3000hmem_check, NULL, "RAMSEY memory (high)",
+    ABFLAG_RAM
 };
 
 addrbank kickmem_bank = {
     kickmem_lget, kickmem_wget, kickmem_bget,
     kickmem_lput, kickmem_wput, kickmem_bput,
-    kickmem_xlate, kickmem_check, NULL, "Kickstart ROM"
+    kickmem_xlate, kickmem_check, NULL, "Kickstart ROM",
+    ABFLAG_ROM
 };
 
 addrbank extendedkickmem_bank = {
     extendedkickmem_lget, extendedkickmem_wget, extendedkickmem_bget,
     extendedkickmem_lput, extendedkickmem_wput, extendedkickmem_bput,
-    extendedkickmem_xlate, extendedkickmem_check, NULL, "Extended Kickstart ROM"
+    extendedkickmem_xlate, extendedkickmem_check, NULL, "Extended Kickstart ROM",
+    ABFLAG_ROM
 };
 
 static int kickstart_checksum (uae_u8 *mem, int size)
@@ -1012,165 +1002,194 @@ static int load_kickstart (void)
 char *address_space, *good_address_map;
 int good_address_fd;
 
-#ifndef NATMEM_OFFSET
+#if defined(__unix) && !defined(__BEOS__) && !defined(__DOS__)
 
-uae_u8 *mapped_malloc (size_t s, char *file)
-{
-    return calloc (s, 1);
-}
+#include <sys/mman.h>
+#include <unistd.h>
 
-void mapped_free (uae_u8 *p)
-{
-    free (p);
-}
-#else
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <unistd.h>
-#include <sys/mman.h>
+#ifdef MAP_ANONYMOUS
 
-shmpiece *shm_start = NULL;
-int canbang = 1;
+/* Amiga memory comes from private anonymous mappings, so that a fork ()ed
+ * copy of the emulator (see forkserver.c) shares it copy-on-write.  With
+ * natmem, it must come from natmem_alloc instead.  hostmem_setup applies
+ * the huge page, mlock and NUMA settings to either.  */
+struct mapped_block {
+    uae_u8 *p;
+    size_t size;
+    struct mapped_block *next;
+};
+static struct mapped_block *mapped_blocks;
 
-static void dumplist (void)
+static void mapped_add (uae_u8 *p, size_t size)
 {
-    shmpiece *x = shm_start;
-    printf ("Start Dump:\n");
-    while (x) {
-	printf ("  this=%p, Native %p, id %d, prev=%p, next=%p, size=0x%08x\n",
-		x, x->native_address, x->id, x->prev, x->next, x->size);
-	x = x->next;
-    }
-    printf ("End Dump:\n");
+    struct mapped_block *b = xmalloc (sizeof *b);
+
+    b->p = p;
+    b->size = size;
+    b->next = mapped_blocks;
+    mapped_blocks = b;
 }
 
-static shmpiece *find_shmpiece (uae_u8 *base)
+uae_u8 *mapped_malloc (size_t s, char *file)
 {
-    shmpiece *x = shm_start;
+    size_t page = sysconf (_SC_PAGESIZE), len;
+    uae_u8 *p = MAP_FAILED;
+    int huge = 0;
 
-    while (x && x->native_address != base)
-	x = x->next;
-    if (!x) {
-	printf ("NATMEM: Failure to find mapping at %p\n", base);
-	dumplist ();
-	canbang = 0;
-	return 0;
+    hostmem_init ();
+#ifdef NATMEM
+    if (natmem_offset && (p = natmem_alloc (s, file)) != 0)
+	return p;
+    p = MAP_FAILED;
+#endif
+#ifdef MAP_HUGETLB
+    if (currprefs.mem_hugepages == HOSTMEM_HUGE_EXPLICIT) {
+	size_t hp = hostmem_hugepagesize ();
+	len = (s + hp - 1) & ~(hp - 1);
+	p = mmap (0, len, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED)
+	    write_log ("HOSTMEM: no explicit huge pages for %s: %s\n", file, strerror (errno));
+	else
+	    huge = 1;
     }
-    return x;
+#endif
+    if (p == MAP_FAILED) {
+	len = (s + page - 1) & ~(page - 1);
+	p = mmap (0, len, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+	    return 0;
+    }
+    mapped_add (p, len);
+    hostmem_setup (p, len, file, huge);
+    return p;
 }
 
-static void delete_shmmaps (uae_u32 start, uae_u32 size)
+void mapped_free (uae_u8 *p)
 {
-    if (!canbang)
-	return;
+    struct mapped_block **bp, *b;
 
-    while (size) {
-	uae_u8 *base = mem_banks[bankindex (start)]->baseaddr;
-	if (base) {
-	    shmpiece *x;
-	    base = ((uae_u8 *) NATMEM_OFFSET) + start;
-
-	    x = find_shmpiece (base);
-	    if (!x)
-		return;
-
-	    if (x->size > size) {
-		printf ("NATMEM: Failure to delete mapping at %08x (size %08x, delsize %08x)\n", start, x->size, size);
-		dumplist ();
-		canbang = 0;
-		return;
-	    }
-	    shmdt (x->native_address);
-	    size -= x->size;
-	    start += x->size;
-	    if (x->next)
-		x->next->prev = x->prev;	/* remove this one from the list */
-	    if (x->prev)
-		x->prev->next = x->next;
-	    else
-		shm_start = x->next;
-	    free (x);
-	} else {
-	    size -= 0x10000;
-	    start += 0x10000;
+    if (p == 0)
+	return;
+#ifdef NATMEM
+    if (natmem_free (p))
+	return;
+#endif
+    for (bp = &mapped_blocks; (b = *bp) != 0; bp = &b->next) {
+	if (b->p == p) {
+	    *bp = b->next;
+	    munmap (b->p, b->size);
+	    free (b);
+	    return;
 	}
     }
 }
 
-static void add_shmmaps (uae_u32 start, addrbank *what)
+#ifdef CHIPMEM_MIRROR
+
+/* Chip memory is a memfd mapped over and over across the window: all of
+ * the chip bank, which is at least 2 MB, all that Agnus can reach, and
+ * CHIPMEM_TAIL more.  */
+static size_t chipmem_window (uae_u32 size)
 {
-    shmpiece *x = shm_start;
-    shmpiece *y;
-    uae_u8 *base = what->baseaddr;
+    return (size > 0x200000 ? size : 0x200000) + CHIPMEM_TAIL;
+}
 
-    if (!canbang)
-	return;
-    if (!base)
-	return;
+static int chipmem_map_mirrors (uae_u8 *p, uae_u32 size, int fd)
+{
+    size_t window = chipmem_window (size), off, len;
 
-    x = find_shmpiece (base);
-    if (!x)
-	return;
-    y = malloc (sizeof (shmpiece));
-    *y = *x;
-    base = ((uae_u8 *) NATMEM_OFFSET) + start;
-    y->native_address = shmat (y->id, base, 0);
-    if (y->native_address == (void *) -1) {
-	printf ("NATMEM: Failure to map existing at %08x (%p)\n", start, base);
-	perror ("shmat");
-	dumplist ();
-	canbang = 0;
-	return;
+    for (off = 0; off < window; off += size) {
+	len = window - off < size ? window - off : size;
+	if (mmap (p + off, len, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+	    return 0;
     }
-    y->next = shm_start;
-    y->prev = NULL;
-    if (y->next)
-	y->next->prev = y;
-    shm_start = y;
+    return 1;
 }
 
-uae_u8 *mapped_malloc (size_t s, char *file)
+/* Freed with mapped_free.  */
+static uae_u8 *chipmem_alloc (uae_u32 size)
 {
-    int id;
-    void *answer;
-    shmpiece *x;
+    size_t window = chipmem_window (size);
+    uae_u8 *p;
+    int fd;
 
-    if (!canbang)
-	return malloc (s);
+    hostmem_init ();
+    fd = hostmem_memfd ("chip");
+    if (fd < 0) {
+	write_log ("Can't create a file for chip memory.\n");
+	return 0;
+    }
+    p = mmap (0, window, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED || ftruncate (fd, size) < 0 || ! chipmem_map_mirrors (p, size, fd)) {
+	write_log ("Can't map the chip memory mirrors: %s\n", strerror (errno));
+	if (p != MAP_FAILED)
+	    munmap (p, window);
+	close (fd);
+	return 0;
+    }
+    hostmem_setup (p, size, "chip", 0);
+#ifdef NATMEM
+    if (natmem_offset) {
+	/* natmem_map maps chip memory from the fd as well.  */
+	natmem_adopt (p, window, fd);
+	return p;
+    }
+#endif
+    close (fd);
+    mapped_add (p, window);
+    return p;
+}
+
+/* A fork server job would share the server's chip memory, and that of the
+ * other jobs, so it gets a copy of its own.  Returns 0 on failure.  */
+int chipmem_unshare (void)
+{
+    uae_u32 size = allocated_chipmem, done;
+    int fd;
 
-    id = shmget (IPC_PRIVATE, s, 0x1ff, file);
-    if (id == 1) {
-	canbang = 0;
-	return mapped_malloc (s, file);
+    if (chipmemory == 0)
+	return 1;
+    fd = hostmem_memfd ("chip");
+    if (fd < 0)
+	return 0;
+    if (ftruncate (fd, size) < 0) {
+	close (fd);
+	return 0;
     }
-    answer = shmat (id, 0, 0);
-    shmctl (id, IPC_RMID, NULL);
-    if (answer != (void *) -1) {
-	x = malloc (sizeof (shmpiece));
-	x->native_address = answer;
-	x->id = id;
-	x->size = s;
-	x->next = shm_start;
-	x->prev = NULL;
-	if (x->next)
-	    x->next->prev = x;
-	shm_start = x;
-
-	return answer;
+    for (done = 0; done < size; ) {
+	ssize_t n = pwrite (fd, chipmemory + done, size - done, done);
+	if (n <= 0) {
+	    close (fd);
+	    return 0;
+	}
+	done += n;
     }
-    canbang = 0;
-    return mapped_malloc (s, file);
+    done = chipmem_map_mirrors (chipmemory, size, fd);
+    close (fd);
+    return done != 0;
 }
 
-void mapped_free (uae_u8 *base)
+#endif
+
+#else
+
+uae_u8 *mapped_malloc (size_t s, char *file)
 {
-    shmpiece *x = find_shmpiece (base);
-    if (!x)
-	abort ();
-    shmdt (x->native_address);
+    return calloc (s, 1);
 }
 
+void mapped_free (uae_u8 *p)
+{
+    free (p);
+}
 #endif
 
 static void init_mem_banks (void)
@@ -1191,9 +1210,13 @@ static void allocate_memory (void)
 	memsize = allocated_chipmem = currprefs.chipmem_size;
 	chipmem_mask = allocated_chipmem - 1;
 
+#ifdef CHIPMEM_MIRROR
+	chipmemory = chipmem_alloc (memsize);
+#else
 	if (memsize < 0x100000)
 	    memsize = 0x100000;
 	chipmemory = mapped_malloc (memsize, "chip");
+#endif
 	if (chipmemory == 0) {
 	    write_log ("Fatal error: out of memory for chipmem.\n");
 	    allocated_chipmem = 0;
@@ -1296,8 +1319,8 @@ void memory_reset (void)
 {
     int bnk, bnk_end;
 
-#ifdef NATMEM_OFFSET
-    delete_shmmaps (0, 0xFFFF0000);
+#ifdef NATMEM
+    natmem_reset ();
 #endif
     init_mem_banks ();
 
@@ -1420,6 +1443,10 @@ void memory_reset (void)
 
 void memory_init (void)
 {
+#ifdef NATMEM
+    if (currprefs.natmem)
+	natmem_init ();
+#endif
     allocated_chipmem = 0;
     allocated_bogomem = 0;
     kickmemory = 0;
@@ -1465,6 +1492,9 @@ void memory_cleanup (void)
     kickmemory = 0;
     a1000_bootrom = 0;
     chipmemory = 0;
+#ifdef NATMEM
+    natmem_cleanup ();
+#endif
 }
 
 void memory_hardreset (void)
@@ -1482,6 +1512,15 @@ void memory_hardreset (void)
     expansion_clear ();
 }
 
+#ifdef NATMEM
+/* Bytes from one copy of a bank to the end of the range being mapped.  */
+static uae_u32 natmem_len (int banks_left, int realsize)
+{
+    uae_u32 len = (uae_u32)banks_left << 16;
+    return len < (uae_u32)realsize ? len : (uae_u32)realsize;
+}
+#endif
+
 void map_banks (addrbank *bank, int start, int size, int realsize)
 {
     int bnr;
@@ -1490,9 +1529,7 @@ void map_banks (addrbank *bank, int start, int size, int realsize)
     uae_u32 realstart = start;
 
     flush_icache (1);		/* Sure don't want to keep any old mappings around! */
-#ifdef NATMEM_OFFSET
-    delete_shmmaps (start << 16, size << 16);
-#endif
+    mmu_flush_all ();
 
     if (!realsize)
 	realsize = size << 16;
@@ -1511,13 +1548,17 @@ void map_banks (addrbank *bank, int start, int size, int realsize)
 	    if (!real_left) {
 		realstart = bnr;
 		real_left = realsize >> 16;
-#ifdef NATMEM_OFFSET
-		add_shmmaps (realstart << 16, bank);
+#ifdef NATMEM
+		natmem_map (realstart << 16, natmem_len (start + size - bnr, realsize), bank);
 #endif
 	    }
 	    put_mem_bank (bnr << 16, bank, realstart << 16);
 	    real_left--;
 	}
+	if (cputhread_running)
+	    cputhread_notice_banks ();
+	if (mmu_enabled)
+	    mmu_notice_banks ();
 	return;
     }
     /* Already in currprefs, since we get called after m68k_reset.  */
@@ -1529,14 +1570,18 @@ void map_banks (addrbank *bank, int start, int size, int realsize)
 	    if (!real_left) {
 		realstart = bnr + hioffs;
 		real_left = realsize >> 16;
-#ifdef NATMEM_OFFSET
-		add_shmmaps (realstart << 16, bank);
+#ifdef NATMEM
+		natmem_map (realstart << 16, natmem_len (start + size - bnr, realsize), bank);
 #endif
 	    }
 	    put_mem_bank ((bnr + hioffs) << 16, bank, realstart << 16);
 	    real_left--;
 	}
     }
+    if (cputhread_running)
+	cputhread_notice_banks ();
+    if (mmu_enabled)
+	mmu_notice_banks ();
 }
 
 
@@ -1687,6 +1732,12 @@ void memcpyha_safe (uaecptr dst, const uae_u8 *src, int size)
 
 void memcpyha (uaecptr dst, const uae_u8 *src, int size)
 {
+#ifdef NATMEM
+    if (natmem_offset && ! mmu_enabled && natmem_direct (dst, size, 1)) {
+	memcpy (natmem_offset + dst, src, size);
+	return;
+    }
+#endif
     while (size--)
 	put_byte (dst++, *src++);
 }
@@ -1701,6 +1752,12 @@ void memcpyah_safe (uae_u8 *dst, uaecptr src, int size)
 
 void memcpyah (uae_u8 *dst, uaecptr src, int size)
 {
+#ifdef NATMEM
+    if (natmem_offset && ! mmu_enabled && natmem_direct (src, size, 0)) {
+	memcpy (dst, natmem_offset + src, size);
+	return;
+    }
+#endif
     while (size--)
 	*dst++ = get_byte (src++);
 }
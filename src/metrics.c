@@ -0,0 +1,286 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Performance counters
+  *
+  * The emulation bumps counters in metrics_count[] and records times in a
+  * few histograms.  metrics_format () turns all of it into the Prometheus
+  * text format.  It is served to anyone who connects to the UNIX domain
+  * socket named by metrics_socket, and to Amiga programs through uaelib.
+  * The socket is checked once per frame.  Nothing is locked; the odd update
+  * lost between filesystem threads doesn't matter for statistics.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdarg.h>
+
+#include "options.h"
+#include "uae.h"
+#include "memory.h"
+#include "custom.h"
+#include "events.h"
+#include "metrics.h"
+
+#if defined(__unix) && !defined(__BEOS__) && !defined(__DOS__)
+#define METRICS_SOCKET
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#define METRICS_BUCKETS 11
+
+struct metrics_hist {
+    uae_u64 bucket[METRICS_BUCKETS + 1];
+    uae_u64 count;
+    double sum;
+};
+
+/* Bucket bounds in microseconds; the last bucket is +Inf.  */
+static const unsigned long bounds[METRICS_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 20000, 40000, 80000, 160000
+};
+
+static const char *counter_names[METRIC_MAX][2] = {
+    { "uae_frames_total", "Emulated frames" },
+    { "uae_frames_skipped_total", "Frames that were not drawn" },
+    { "uae_cycles_total", "Emulated CPU cycles" },
+    { "uae_instructions_total", "Executed 68k instructions" },
+    { "uae_blits_total", "Blitter operations" },
+    { "uae_blit_words_total", "Words processed by the blitter" },
+    { "uae_copper_instructions_total", "Executed copper instructions" },
+    { "uae_disk_dma_words_total", "Words transferred by disk DMA" },
+    { "uae_fs_packets_total", "Packets handled by the host filesystem" },
+    { "uae_hardfile_reads_total", "Hardfile read requests" },
+    { "uae_hardfile_writes_total", "Hardfile write requests" },
+    { "uae_hardfile_read_bytes_total", "Bytes read from hardfiles" },
+    { "uae_hardfile_written_bytes_total", "Bytes written to hardfiles" }
+};
+
+static const char *hist_names[METRIC_HIST_MAX][2] = {
+    { "uae_frame_time_seconds", "Host time per emulated frame" },
+    { "uae_fs_packet_seconds", "Time to handle a host filesystem packet" }
+};
+
+uae_u64 metrics_count[METRIC_MAX];
+int metrics_sound_fill = -1;
+
+static struct metrics_hist hists[METRIC_HIST_MAX];
+static double cycles_per_sec;
+static unsigned long last_frame_usecs, rate_usecs;
+static unsigned long last_cycles;
+static uae_u64 rate_cycles;
+static int have_last_frame;
+
+#ifdef METRICS_SOCKET
+static int metrics_fd = -1;
+#endif
+
+unsigned long metrics_usecs (void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000000UL + tv.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+void metrics_observe (int hist, unsigned long usecs)
+{
+    struct metrics_hist *h = &hists[hist];
+    int i;
+
+    for (i = 0; i < METRICS_BUCKETS && usecs > bounds[i]; i++)
+	;
+    h->bucket[i]++;
+    h->count++;
+    h->sum += usecs / 1000000.0;
+}
+
+struct outbuf {
+    char *buf;
+    int size, len;
+};
+
+static void out (struct outbuf *o, const char *fmt, ...)
+{
+    char line[256];
+    int n;
+    va_list ap;
+
+    va_start (ap, fmt);
+    vsprintf (line, fmt, ap);
+    va_end (ap);
+    n = strlen (line);
+    if (o->len + n < o->size)
+	memcpy (o->buf + o->len, line, n + 1);
+    o->len += n;
+}
+
+/* Returns the length of the whole text, which may be more than SIZE - 1;
+ * the text is cut off in that case.  */
+int metrics_format (char *buf, int size)
+{
+    struct outbuf o;
+    int i, j;
+
+    o.buf = buf;
+    o.size = size;
+    o.len = 0;
+    if (size > 0)
+	buf[0] = 0;
+
+    for (i = 0; i < METRIC_MAX; i++) {
+	out (&o, "# HELP %s %s.\n", counter_names[i][0], counter_names[i][1]);
+	out (&o, "# TYPE %s counter\n", counter_names[i][0]);
+	out (&o, "%s %.0f\n", counter_names[i][0], (double)metrics_count[i]);
+    }
+
+    out (&o, "# HELP uae_cycles_per_second Emulated CPU cycles per host second.\n");
+    out (&o, "# TYPE uae_cycles_per_second gauge\n");
+    out (&o, "uae_cycles_per_second %.0f\n", cycles_per_sec);
+    if (metrics_sound_fill >= 0) {
+	out (&o, "# HELP uae_sound_buffer_fill_ratio Fill level of the host sound buffer.\n");
+	out (&o, "# TYPE uae_sound_buffer_fill_ratio gauge\n");
+	out (&o, "uae_sound_buffer_fill_ratio %.2f\n", metrics_sound_fill / 100.0);
+    }
+
+    for (i = 0; i < METRIC_HIST_MAX; i++) {
+	struct metrics_hist *h = &hists[i];
+	uae_u64 cum = 0;
+
+	out (&o, "# HELP %s %s.\n", hist_names[i][0], hist_names[i][1]);
+	out (&o, "# TYPE %s histogram\n", hist_names[i][0]);
+	for (j = 0; j < METRICS_BUCKETS; j++) {
+	    cum += h->bucket[j];
+	    out (&o, "%s_bucket{le=\"%g\"} %.0f\n", hist_names[i][0],
+		 bounds[j] / 1000000.0, (double)cum);
+	}
+	out (&o, "%s_bucket{le=\"+Inf\"} %.0f\n", hist_names[i][0], (double)h->count);
+	out (&o, "%s_sum %f\n", hist_names[i][0], h->sum);
+	out (&o, "%s_count %.0f\n", hist_names[i][0], (double)h->count);
+    }
+    return o.len;
+}
+
+#ifdef METRICS_SOCKET
+static void metrics_serve (void)
+{
+    struct timeval tv;
+    fd_set rd;
+    char *buf;
+    int fd, len, size = 8192;
+
+    tv.tv_sec = tv.tv_usec = 0;
+    FD_ZERO (&rd);
+    FD_SET (metrics_fd, &rd);
+    if (select (metrics_fd + 1, &rd, 0, 0, &tv) <= 0)
+	return;
+    fd = accept (metrics_fd, 0, 0);
+    if (fd < 0)
+	return;
+    buf = malloc (size);
+    len = metrics_format (buf, size);
+    if (len >= size) {
+	size = len + 1;
+	buf = realloc (buf, size);
+	len = metrics_format (buf, size);
+    }
+#ifdef MSG_NOSIGNAL
+    send (fd, buf, len, MSG_NOSIGNAL);
+#else
+    write (fd, buf, len);
+#endif
+    close (fd);
+    free (buf);
+}
+#endif
+
+void metrics_vsync (void)
+{
+    unsigned long now = metrics_usecs ();
+    unsigned long cycles = get_cycles ();
+
+    METRIC_INC (METRIC_FRAMES);
+    /* The cycle counter starts again at zero after a reset.  */
+    METRIC_ADD (METRIC_CYCLES, (cycles >= last_cycles ? cycles - last_cycles : cycles) / CYCLE_UNIT);
+    last_cycles = cycles;
+
+    /* Leave out frames during which the emulator was stopped.  */
+    if (have_last_frame && now - last_frame_usecs < 1000000)
+	metrics_observe (METRIC_FRAME_TIME, now - last_frame_usecs);
+    last_frame_usecs = now;
+    have_last_frame = 1;
+
+    if (now - rate_usecs >= 1000000) {
+	if (rate_usecs != 0)
+	    cycles_per_sec = (metrics_count[METRIC_CYCLES] - rate_cycles) * 1000000.0 / (now - rate_usecs);
+	rate_usecs = now;
+	rate_cycles = metrics_count[METRIC_CYCLES];
+    }
+
+#ifdef METRICS_SOCKET
+    if (metrics_fd >= 0)
+	metrics_serve ();
+#endif
+}
+
+void metrics_stop (void)
+{
+#ifdef METRICS_SOCKET
+    if (metrics_fd < 0)
+	return;
+    close (metrics_fd);
+    metrics_fd = -1;
+    unlink (currprefs.metrics_socket);
+#endif
+}
+
+/* Also called again in fork server jobs, which count from zero and may
+ * have their own socket.  */
+void metrics_start (void)
+{
+    memset (metrics_count, 0, sizeof metrics_count);
+    memset (hists, 0, sizeof hists);
+    cycles_per_sec = 0;
+    rate_usecs = 0;
+    have_last_frame = 0;
+    last_cycles = get_cycles ();
+
+#ifdef METRICS_SOCKET
+    if (metrics_fd >= 0) {
+	/* Inherited; the socket file belongs to the server.  */
+	close (metrics_fd);
+	metrics_fd = -1;
+    }
+    if (currprefs.metrics_socket[0] != '\0') {
+	struct sockaddr_un addr;
+
+	if (strlen (currprefs.metrics_socket) >= sizeof addr.sun_path) {
+	    write_log ("Metrics socket path too long.\n");
+	    return;
+	}
+	memset (&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, currprefs.metrics_socket);
+	unlink (addr.sun_path);
+	metrics_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (metrics_fd >= 0
+	    && (bind (metrics_fd, (struct sockaddr *)&addr, sizeof addr) < 0
+		|| listen (metrics_fd, 4) < 0))
+	{
+	    close (metrics_fd);
+	    metrics_fd = -1;
+	}
+	if (metrics_fd < 0)
+	    write_log ("Can't listen on metrics socket %s: %s\n",
+		       currprefs.metrics_socket, strerror (errno));
+    }
+#else
+    if (currprefs.metrics_socket[0] != '\0')
+	write_log ("Metrics socket not supported on this system.\n");
+#endif
+}
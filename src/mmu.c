@@ -0,0 +1,939 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * 68030/68040 MMU
+  *
+  * The page tables are walked in the formats of the 68030 (TC, CRP, SRP,
+  * TT0/TT1, function code lookup, short and long descriptors, early
+  * termination and indirection) and the 68040 (TCR, URP, SRP, 4K and 8K
+  * pages, ITTx/DTTx).  The result is kept in a software ATC indexed by the
+  * logical page; see mmu.h.  It is larger than the real one, which only
+  * matters to programs that change descriptors without flushing them.
+  *
+  * An access that is not allowed records the fault and longjmps back to the
+  * CPU loop in newcpu.c.  That undoes the instruction and takes a bus error
+  * with an access fault frame; when the handler returns, the instruction
+  * is executed again from the start.  Only the fields operating systems
+  * use to service page faults are filled in.
+  *
+  * Instructions are fetched through a host pointer into the current page.
+  * One that may run into the next page is copied to a buffer first.
+  *
+  * While translation is on, every entry of mem_banks points to mmu_bank,
+  * so the CPU core's get_* and put_* reach the ATC without testing
+  * mmu_enabled.  The banks map_banks set up are kept in phys_banks; the
+  * table walks and the accesses to physical addresses use those.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "memory.h"
+#include "custom.h"
+#include "newcpu.h"
+
+#define MMU_READ 0
+#define MMU_WRITE 1
+#define MMU_INSN 2
+
+#define TC030_E 0x80000000
+#define TC030_SRE 0x02000000
+#define TC030_FCL 0x01000000
+
+#define MMUSR030_B 0x8000
+#define MMUSR030_L 0x4000
+#define MMUSR030_S 0x2000
+#define MMUSR030_W 0x0800
+#define MMUSR030_I 0x0400
+#define MMUSR030_M 0x0200
+#define MMUSR030_T 0x0040
+
+#define TCR040_E 0x8000
+#define TCR040_P 0x4000
+
+#define MMUSR040_G 0x0400
+#define MMUSR040_W 0x0004
+#define MMUSR040_T 0x0002
+#define MMUSR040_R 0x0001
+
+int mmu_enabled;
+struct mmu_atcset mmu_atc[2], *mmu_atc_cur = &mmu_atc[0];
+
+jmp_buf mmu_fault_buf;
+int mmu_fault_armed;
+
+static addrbank *phys_banks[65536];
+
+#define phys_bank(addr) (*(mmu_enabled ? phys_banks : mem_banks)[bankindex (addr)])
+#define phys_longget(addr) (call_mem_get_func (phys_bank (addr).lget, addr))
+#define phys_wordget(addr) (call_mem_get_func (phys_bank (addr).wget, addr))
+#define phys_byteget(addr) (call_mem_get_func (phys_bank (addr).bget, addr))
+#define phys_longput(addr, l) (call_mem_put_func (phys_bank (addr).lput, addr, l))
+#define phys_wordput(addr, w) (call_mem_put_func (phys_bank (addr).wput, addr, w))
+#define phys_byteput(addr, b) (call_mem_put_func (phys_bank (addr).bput, addr, b))
+
+uae_u8 *mmu_pc_start, *mmu_pc_end;
+uae_u8 mmu_pc_none[MMU_MAXINSN];
+static uae_u8 mmu_pc_bounce[2 * MMU_MAXINSN];
+
+/* 68030 pages smaller than MMU_PAGE_SIZE are not cached; each access to
+ * one is translated into this entry.  */
+static struct mmu_atc mmu_atc_tmp;
+static uae_u32 mmu_atc_tmp_size;
+
+/* The result of a table search.  */
+struct mmu_walk {
+    uae_u32 phys;
+    int pageshift;
+    int fault;
+    int global;
+    uae_u32 mmusr;
+    uaecptr descaddr;
+};
+
+void mmu_flush_all (void)
+{
+    struct mmu_atc *a = &mmu_atc[0].read[0];
+    int i, n = 2 * 3 * MMU_ATC_SIZE;
+
+    for (i = 0; i < n; i++)
+	a[i].tag = MMU_ATC_EMPTY;
+    mmu_pc_start = mmu_pc_end = 0;
+}
+
+static void mmu_flush_table (struct mmu_atc *tbl, int nonglobal)
+{
+    int i;
+
+    for (i = 0; i < MMU_ATC_SIZE; i++)
+	if (! nonglobal || ! (tbl[i].phys & MMU_ATC_GLOBAL))
+	    tbl[i].tag = MMU_ATC_EMPTY;
+}
+
+/* Flush the ATC entries for the page of ADDR, which is 1 << SHIFT bytes.  */
+static void mmu_flush_page (struct mmu_atc *tbl, uaecptr addr, int shift, int nonglobal)
+{
+    uaecptr page;
+    int n = shift > MMU_PAGE_SHIFT ? 1 << (shift - MMU_PAGE_SHIFT) : 1;
+
+    page = addr & ~((shift > MMU_PAGE_SHIFT ? 1 << shift : MMU_PAGE_SIZE) - 1);
+    for (; n > 0; n--, page += MMU_PAGE_SIZE) {
+	struct mmu_atc *a = mmu_atc_entry (tbl, page);
+	if ((a->tag & ~MMU_ATC_IO) == page
+	    && (! nonglobal || ! (a->phys & MMU_ATC_GLOBAL)))
+	    a->tag = MMU_ATC_EMPTY;
+    }
+    mmu_pc_start = mmu_pc_end = 0;
+}
+
+static void mmu_flush_set (struct mmu_atcset *set, uaecptr addr, int shift, int nonglobal)
+{
+    mmu_flush_page (set->read, addr, shift, nonglobal);
+    mmu_flush_page (set->write, addr, shift, nonglobal);
+    mmu_flush_page (set->insn, addr, shift, nonglobal);
+}
+
+static int mmu030_tt (uaecptr addr, int fc, int write)
+{
+    uae_u32 tt[2];
+    int i;
+
+    tt[0] = regs.tt0_030;
+    tt[1] = regs.tt1_030;
+    for (i = 0; i < 2; i++) {
+	if (! (tt[i] & 0x8000))
+	    continue;
+	if ((((addr ^ tt[i]) >> 24) & ~(tt[i] >> 16) & 0xff) != 0)
+	    continue;
+	if (((fc ^ (tt[i] >> 4)) & ~tt[i] & 7) != 0)
+	    continue;
+	/* Unless RWM is set, R/W selects reads (1) or writes (0).  */
+	if (! (tt[i] & 0x100) && (int)((tt[i] >> 9) & 1) == write)
+	    continue;
+	return 1;
+    }
+    return 0;
+}
+
+/* Search the 68030 tables for ADDR in function code space FC.  Stops after
+ * MAXLEVEL descriptors, for PTEST.  With UPDATE, the U and M bits are set
+ * as the hardware would.  */
+static void mmu030_walk (uaecptr addr, int fc, int write, int update, int maxlevel, struct mmu_walk *w)
+{
+    uae_u32 tc = regs.tc_030;
+    uae_u64 rp = (fc & 4) && (tc & TC030_SRE) ? regs.srp_030 : regs.crp_030;
+    uae_u32 limit = rp >> 32, tbl = (uae_u32)rp & 0xfffffff0;
+    uae_u32 desc = 0, d1 = 0, pageaddr;
+    uaecptr descaddr = 0;
+    int dt = (rp >> 32) & 3, islong = 1, haslimit = 1;
+    int shift = (tc >> 16) & 15, level, wp = 0, sup = 0, levels = 0;
+
+    memset (w, 0, sizeof *w);
+    w->pageshift = (tc >> 20) & 15;
+    if (dt == 0)
+	goto invalid;
+    if (dt == 1) {
+	/* Early termination in the root pointer.  */
+	pageaddr = (uae_u32)rp & 0xffffff00;
+	islong = 0;
+	goto page;
+    }
+
+    for (level = (tc & TC030_FCL) ? -1 : 0; level < 4; level++) {
+	int bits = level < 0 ? 3 : (tc >> (12 - level * 4)) & 15;
+	int last = level == 3 || (level >= 0 && ((tc >> (8 - level * 4)) & 15) == 0);
+	uae_u32 idx;
+
+	if (level < 0)
+	    idx = fc;
+	else {
+	    idx = (addr << shift) >> (32 - bits);
+	    shift += bits;
+	}
+	if (levels == maxlevel)
+	    goto done;
+	if (haslimit) {
+	    uae_u32 lim = (limit >> 16) & 0x7fff;
+	    if ((limit & 0x80000000) ? idx < lim : idx > lim) {
+		w->mmusr |= MMUSR030_L;
+		goto invalid;
+	    }
+	}
+	islong = dt == 3;
+	descaddr = tbl + idx * (islong ? 8 : 4);
+	desc = phys_longget (descaddr);
+	if (islong)
+	    d1 = phys_longget (descaddr + 4);
+	levels++;
+
+	switch (desc & 3) {
+	 case 0:
+	    goto invalid;
+	 case 1:
+	    pageaddr = (islong ? d1 : desc) & 0xffffff00;
+	    goto page;
+	}
+	wp |= desc & 4;
+	if (islong)
+	    sup |= desc & 0x100;
+	if (last) {
+	    /* Indirect descriptor.  */
+	    islong = (desc & 3) == 3;
+	    descaddr = (islong ? d1 : desc) & 0xfffffffc;
+	    if (levels == maxlevel)
+		goto done;
+	    desc = phys_longget (descaddr);
+	    if (islong)
+		d1 = phys_longget (descaddr + 4);
+	    levels++;
+	    if ((desc & 3) != 1)
+		goto invalid;
+	    pageaddr = (islong ? d1 : desc) & 0xffffff00;
+	    goto page;
+	}
+	if (update && ! (desc & 8))
+	    phys_longput (descaddr, desc | 8);
+	haslimit = islong;
+	limit = desc;
+	tbl = (islong ? d1 : desc) & 0xfffffff0;
+	dt = desc & 3;
+    }
+
+  invalid:
+    w->mmusr |= MMUSR030_I;
+    w->fault = 1;
+    goto done;
+
+  page:
+    wp |= desc & 4;
+    if (islong)
+	sup |= desc & 0x100;
+    if (sup && ! (fc & 4)) {
+	w->mmusr |= MMUSR030_S;
+	w->fault = 1;
+    }
+    if (wp) {
+	w->mmusr |= MMUSR030_W;
+	if (write)
+	    w->fault = 1;
+    }
+    if (update && descaddr) {
+	uae_u32 nd = desc | 8;
+	if (write && ! w->fault)
+	    nd |= 0x10;
+	if (nd != desc)
+	    phys_longput (descaddr, nd);
+	desc = nd;
+    }
+    if (desc & 0x10)
+	w->mmusr |= MMUSR030_M;
+    /* The rest of the logical address is added to the page address; for
+     * early termination that includes the unused index fields.  */
+    w->phys = pageaddr + (shift == 0 ? addr : addr & (0xffffffff >> shift));
+
+  done:
+    w->mmusr |= levels > 7 ? 7 : levels;
+    w->descaddr = descaddr;
+}
+
+static int mmu040_tt (uaecptr addr, int super, int insn, uae_u32 *ttp)
+{
+    uae_u32 tt[2];
+    int i;
+
+    tt[0] = insn ? regs.itt0 : regs.dtt0;
+    tt[1] = insn ? regs.itt1 : regs.dtt1;
+    for (i = 0; i < 2; i++) {
+	int sfield = (tt[i] >> 13) & 3;
+	if (! (tt[i] & 0x8000))
+	    continue;
+	if (sfield < 2 && sfield != super)
+	    continue;
+	if ((((addr ^ tt[i]) >> 24) & ~(tt[i] >> 16) & 0xff) != 0)
+	    continue;
+	*ttp = tt[i];
+	return 1;
+    }
+    return 0;
+}
+
+static void mmu040_walk (uaecptr addr, int super, int write, int update, struct mmu_walk *w)
+{
+    int pshift = (regs.tcr & TCR040_P) ? 13 : 12;
+    uae_u32 desc, wp = 0;
+    uaecptr descaddr;
+
+    memset (w, 0, sizeof *w);
+    w->pageshift = pshift;
+
+    descaddr = ((super ? regs.srp : regs.urp) & 0xfffffe00) | ((addr >> 23) & 0x1fc);
+    desc = phys_longget (descaddr);
+    if (! (desc & 2))
+	goto invalid;
+    if (update && ! (desc & 8))
+	phys_longput (descaddr, desc | 8);
+    wp |= desc;
+
+    descaddr = (desc & 0xfffffe00) | ((addr >> 16) & 0x1fc);
+    desc = phys_longget (descaddr);
+    if (! (desc & 2))
+	goto invalid;
+    if (update && ! (desc & 8))
+	phys_longput (descaddr, desc | 8);
+    wp |= desc;
+
+    if (pshift == 12)
+	descaddr = (desc & 0xffffff00) | ((addr >> 10) & 0xfc);
+    else
+	descaddr = (desc & 0xffffff80) | ((addr >> 11) & 0x7c);
+    desc = phys_longget (descaddr);
+    if ((desc & 3) == 2) {
+	/* Indirect descriptor.  */
+	descaddr = desc & 0xfffffffc;
+	desc = phys_longget (descaddr);
+    }
+    w->descaddr = descaddr;
+    if (! (desc & 1))
+	goto invalid;
+    wp = (wp | desc) & 4;
+
+    if ((desc & 0x80) && ! super)
+	w->fault = 1;
+    if (write && wp)
+	w->fault = 1;
+    if (update) {
+	uae_u32 nd = desc | 8;
+	if (write && ! w->fault)
+	    nd |= 0x10;
+	if (nd != desc)
+	    phys_longput (descaddr, nd);
+	desc = nd;
+    }
+    w->phys = (desc & ~((1 << pshift) - 1)) | (addr & ((1 << pshift) - 1));
+    w->global = (desc & 0x400) != 0;
+    w->mmusr = (w->phys & 0xfffff000) | (desc & 0x7f0) | wp | MMUSR040_R;
+    return;
+
+  invalid:
+    w->fault = 1;
+}
+
+static void mmu_translate (uaecptr addr, int super, int type, int update, struct mmu_walk *w)
+{
+    if (currprefs.cpu_model == 68030) {
+	int fc = (super ? 4 : 0) | (type == MMU_INSN ? 2 : 1);
+	if (mmu030_tt (addr, fc, type == MMU_WRITE)) {
+	    memset (w, 0, sizeof *w);
+	    w->phys = addr;
+	    w->pageshift = MMU_PAGE_SHIFT;
+	    w->mmusr = MMUSR030_T;
+	    return;
+	}
+	mmu030_walk (addr, fc, type == MMU_WRITE, update, 7, w);
+    } else {
+	uae_u32 tt;
+	if (mmu040_tt (addr, super, type == MMU_INSN, &tt)) {
+	    memset (w, 0, sizeof *w);
+	    w->phys = addr;
+	    w->pageshift = MMU_PAGE_SHIFT;
+	    w->global = 1;
+	    w->mmusr = (addr & 0xfffff000) | MMUSR040_T | MMUSR040_R;
+	    if (tt & 4) {
+		w->mmusr |= MMUSR040_W;
+		w->fault = type == MMU_WRITE;
+	    }
+	    return;
+	}
+	mmu040_walk (addr, super, type == MMU_WRITE, update, w);
+    }
+}
+
+/* Record an access fault for the bus error frame built by Exception, and
+ * abandon the instruction.  Returns only outside the CPU loop, e.g. in the
+ * debugger.  */
+static void mmu_fault (uaecptr addr, int type, int size)
+{
+    int fc = (mmu_atc_cur == &mmu_atc[1] ? 4 : 0) | (type == MMU_INSN ? 2 : 1);
+    uae_u16 ssw;
+
+    if (currprefs.cpu_model == 68030) {
+	ssw = fc | (size == 1 ? 0x10 : size == 2 ? 0x20 : 0);
+	if (type == MMU_INSN)
+	    ssw |= 0x5000;	/* FB, RB */
+	else
+	    ssw |= 0x100 | (type == MMU_READ ? 0x40 : 0);	/* DF, RW */
+    } else {
+	ssw = 0x400 | fc | (size == 1 ? 0x20 : size == 2 ? 0x40 : 0);	/* ATC */
+	if (type != MMU_WRITE)
+	    ssw |= 0x100;	/* RW */
+    }
+    regs.mmu_ssw = ssw;
+    regs.mmu_fault_addr = addr;
+    if (mmu_fault_armed)
+	longjmp (mmu_fault_buf, 1);
+}
+
+/* Find the ATC entry for ADDR, searching the tables on a miss.  Returns 0
+ * if the access is not allowed, after raising the fault unless PROBE.  */
+static struct mmu_atc *mmu_lookup (uaecptr addr, int type, int size, int probe)
+{
+    struct mmu_atc *a;
+    struct mmu_walk w;
+    uaecptr page = addr & ~MMU_PAGE_MASK;
+    uae_u32 phys;
+    addrbank *b;
+
+    a = mmu_atc_entry (type == MMU_READ ? mmu_atc_cur->read
+		       : type == MMU_WRITE ? mmu_atc_cur->write
+		       : mmu_atc_cur->insn, addr);
+    if ((a->tag & ~MMU_ATC_IO) == page)
+	return a;
+
+    mmu_translate (addr, mmu_atc_cur == &mmu_atc[1], type, 1, &w);
+    if (w.fault) {
+	if (! probe)
+	    mmu_fault (addr, type, size);
+	return 0;
+    }
+    if (w.pageshift < MMU_PAGE_SHIFT) {
+	mmu_atc_tmp_size = 1 << w.pageshift;
+	page = addr & ~(mmu_atc_tmp_size - 1);
+	a = &mmu_atc_tmp;
+	a->tag = page | MMU_ATC_IO;
+	a->phys = (w.phys & ~(mmu_atc_tmp_size - 1)) - page;
+	a->host = 0;
+	return a;
+    }
+
+    phys = w.phys & ~MMU_PAGE_MASK;
+    a->phys = (phys - page) | (w.global ? MMU_ATC_GLOBAL : 0);
+    b = &phys_bank (phys);
+    if (b->check (phys, MMU_PAGE_SIZE) && (type != MMU_WRITE || (b->flags & ABFLAG_RAM))) {
+	a->host = b->xlateaddr (phys) - page;
+	a->tag = page;
+    } else {
+	a->host = 0;
+	a->tag = page | MMU_ATC_IO;
+    }
+    return a;
+}
+
+#define mmu_phys(a, addr) (((a)->phys & ~MMU_ATC_GLOBAL) + (addr))
+
+static uae_u32 mmu_read (uaecptr addr, int size)
+{
+    struct mmu_atc *a = mmu_lookup (addr, MMU_READ, size, 0);
+
+    if (! a)
+	return 0;
+    if (! (a->tag & MMU_ATC_IO)) {
+	switch (size) {
+	 case 1: return do_get_mem_byte (a->host + addr);
+	 case 2: return do_get_mem_word ((uae_u16 *)(a->host + addr));
+	 default: return do_get_mem_long ((uae_u32 *)(a->host + addr));
+	}
+    }
+    switch (size) {
+     case 1: return phys_byteget (mmu_phys (a, addr));
+     case 2: return phys_wordget (mmu_phys (a, addr));
+     default: return phys_longget (mmu_phys (a, addr));
+    }
+}
+
+static void mmu_write (uaecptr addr, uae_u32 v, int size)
+{
+    struct mmu_atc *a = mmu_lookup (addr, MMU_WRITE, size, 0);
+
+    if (! a)
+	return;
+    if (! (a->tag & MMU_ATC_IO)) {
+	switch (size) {
+	 case 1: do_put_mem_byte (a->host + addr, v); break;
+	 case 2: do_put_mem_word ((uae_u16 *)(a->host + addr), v); break;
+	 default: do_put_mem_long ((uae_u32 *)(a->host + addr), v); break;
+	}
+	return;
+    }
+    switch (size) {
+     case 1: phys_byteput (mmu_phys (a, addr), v); break;
+     case 2: phys_wordput (mmu_phys (a, addr), v); break;
+     default: phys_longput (mmu_phys (a, addr), v); break;
+    }
+}
+
+/* Accesses that cross a page boundary are done a byte at a time.  */
+static uae_u32 mmu_read_split (uaecptr addr, int size)
+{
+    uae_u32 v = 0;
+    int i;
+
+    for (i = 0; i < size; i++)
+	v = (v << 8) | mmu_read (addr + i, 1);
+    return v;
+}
+
+static void mmu_write_split (uaecptr addr, uae_u32 v, int size)
+{
+    int i;
+
+    /* Fault before writing anything, so that the restarted instruction
+     * doesn't find half of its result in memory.  */
+    if (! mmu_lookup (addr, MMU_WRITE, size, 0)
+	|| ! mmu_lookup (addr + size - 1, MMU_WRITE, size, 0))
+	return;
+    for (i = 0; i < size; i++)
+	mmu_write (addr + i, v >> ((size - 1 - i) * 8), 1);
+}
+
+uae_u32 REGPARAM2 mmu_get_long_slow (uaecptr addr)
+{
+    if ((addr & MMU_PAGE_MASK) > MMU_PAGE_SIZE - 4)
+	return mmu_read_split (addr, 4);
+    return mmu_read (addr, 4);
+}
+
+uae_u32 REGPARAM2 mmu_get_word_slow (uaecptr addr)
+{
+    if ((addr & MMU_PAGE_MASK) > MMU_PAGE_SIZE - 2)
+	return mmu_read_split (addr, 2);
+    return mmu_read (addr, 2);
+}
+
+uae_u32 REGPARAM2 mmu_get_byte_slow (uaecptr addr)
+{
+    return mmu_read (addr, 1);
+}
+
+void REGPARAM2 mmu_put_long_slow (uaecptr addr, uae_u32 l)
+{
+    if ((addr & MMU_PAGE_MASK) > MMU_PAGE_SIZE - 4)
+	mmu_write_split (addr, l, 4);
+    else
+	mmu_write (addr, l, 4);
+}
+
+void REGPARAM2 mmu_put_word_slow (uaecptr addr, uae_u32 w)
+{
+    if ((addr & MMU_PAGE_MASK) > MMU_PAGE_SIZE - 2)
+	mmu_write_split (addr, w, 2);
+    else
+	mmu_write (addr, w, 2);
+}
+
+void REGPARAM2 mmu_put_byte_slow (uaecptr addr, uae_u32 b)
+{
+    mmu_write (addr, b, 1);
+}
+
+static uae_u32 mmubank_lget (uaecptr) REGPARAM;
+static uae_u32 mmubank_wget (uaecptr) REGPARAM;
+static uae_u32 mmubank_bget (uaecptr) REGPARAM;
+static void mmubank_lput (uaecptr, uae_u32) REGPARAM;
+static void mmubank_wput (uaecptr, uae_u32) REGPARAM;
+static void mmubank_bput (uaecptr, uae_u32) REGPARAM;
+static uae_u8 *mmubank_xlate (uaecptr) REGPARAM;
+static int mmubank_check (uaecptr, uae_u32) REGPARAM;
+
+static uae_u32 REGPARAM2 mmubank_lget (uaecptr addr)
+{
+    return mmu_get_long (addr);
+}
+
+static uae_u32 REGPARAM2 mmubank_wget (uaecptr addr)
+{
+    return mmu_get_word (addr);
+}
+
+static uae_u32 REGPARAM2 mmubank_bget (uaecptr addr)
+{
+    return mmu_get_byte (addr);
+}
+
+static void REGPARAM2 mmubank_lput (uaecptr addr, uae_u32 l)
+{
+    mmu_put_long (addr, l);
+}
+
+static void REGPARAM2 mmubank_wput (uaecptr addr, uae_u32 w)
+{
+    mmu_put_word (addr, w);
+}
+
+static void REGPARAM2 mmubank_bput (uaecptr addr, uae_u32 b)
+{
+    mmu_put_byte (addr, b);
+}
+
+/* Host pointers for the emulator's own use stay physical, as they were
+ * before translation existed.  */
+static uae_u8 REGPARAM2 *mmubank_xlate (uaecptr addr)
+{
+    return phys_bank (addr).xlateaddr (addr);
+}
+
+static int REGPARAM2 mmubank_check (uaecptr addr, uae_u32 size)
+{
+    return phys_bank (addr).check (addr, size);
+}
+
+static addrbank mmu_bank = {
+    mmubank_lget, mmubank_wget, mmubank_bget,
+    mmubank_lput, mmubank_wput, mmubank_bput,
+    mmubank_xlate, mmubank_check, NULL, "MMU",
+    0
+};
+
+/* Called by map_banks while translation is on, and when it goes on.  */
+void mmu_notice_banks (void)
+{
+    int i;
+
+    for (i = 0; i < 65536; i++) {
+	if (mem_banks[i] == &mmu_bank)
+	    continue;
+	phys_banks[i] = mem_banks[i];
+	mem_banks[i] = &mmu_bank;
+    }
+}
+
+static void mmu_set_enabled (int on)
+{
+    int i;
+
+    if (on)
+	mmu_notice_banks ();
+    else if (mmu_enabled) {
+	for (i = 0; i < 65536; i++)
+	    mem_banks[i] = phys_banks[i];
+    }
+    mmu_enabled = on;
+}
+
+/* Bytes taken by the extension words of an operand, or -1 if they can't be
+ * determined from the AVAIL bytes at P.  */
+static int mmu_ea_length (int mode, int size, uae_u8 *p, int pos, int avail)
+{
+    uae_u16 dp;
+    int n;
+
+    switch (mode) {
+     case Ad16: case PC16: case absw: case imm0: case imm1:
+	return 2;
+     case absl: case imm2:
+	return 4;
+     case imm:
+	return size == sz_long ? 4 : 2;
+     case Ad8r: case PC8r:
+	if (pos + 2 > avail)
+	    return -1;
+	dp = do_get_mem_word ((uae_u16 *)(p + pos));
+	n = 2;
+	if (dp & 0x100) {
+	    if ((dp & 0x30) == 0x20) n += 2;
+	    if ((dp & 0x30) == 0x30) n += 4;
+	    if ((dp & 3) == 2) n += 2;
+	    if ((dp & 3) == 3) n += 4;
+	}
+	return n;
+     default:
+	return 0;
+    }
+}
+
+/* Length of the instruction at P, as far as it can be told from the AVAIL
+ * bytes there; -1 if it needs more.  Only used when the next page is
+ * invalid, to decide whether the instruction runs into it.  */
+static int mmu_insn_length (uae_u8 *p, int avail)
+{
+    static const int fpsize[8] = { 4, 4, 12, 12, 2, 8, 2, 0 };
+    uae_u16 opcode = do_get_mem_word ((uae_u16 *)p);
+    struct instr *dp = table68k + opcode;
+    int len = 2, n, first, second;
+
+    if (dp->mnemo == i_ILLG)
+	return 2;
+    switch (dp->mnemo) {
+     case i_PACK: case i_UNPK: case i_FDBcc: case i_FTRAPcc:
+	len += 2;
+	break;
+     case i_MOVE16:
+	if ((opcode & 0xfff8) == 0xf620)
+	    len += 2;
+	break;
+    }
+    /* The extension word of the 68030 MMU instructions precedes the
+     * operand's.  */
+    first = dp->mnemo == i_MMUOP30A ? 1 : 0;
+    second = ! first;
+    for (n = 0; n < 2; n++) {
+	int which = n == 0 ? first : second;
+	int use = which ? dp->duse : dp->suse;
+	int mode = which ? dp->dmode : dp->smode;
+	int l;
+
+	if (! use)
+	    continue;
+	if (dp->mnemo == i_FPP && mode == imm) {
+	    uae_u16 ext;
+	    if (4 > avail)
+		return -1;
+	    ext = do_get_mem_word ((uae_u16 *)(p + 2));
+	    l = (ext & 0x4000) ? fpsize[(ext >> 10) & 7] : 0;
+	} else
+	    l = mmu_ea_length (mode, dp->size, p, len, avail);
+	if (l < 0)
+	    return -1;
+	len += l;
+    }
+    return len;
+}
+
+static void mmu_copy_insn (struct mmu_atc *a, uaecptr addr, uae_u8 *buf, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i += 2) {
+	uae_u16 w;
+	if (! (a->tag & MMU_ATC_IO))
+	    w = do_get_mem_word ((uae_u16 *)(a->host + addr + i));
+	else
+	    w = phys_wordget (mmu_phys (a, addr + i));
+	do_put_mem_word ((uae_u16 *)(buf + i), w);
+    }
+}
+
+/* Point regs.pc_p at the instruction at the current PC.  */
+void mmu_fetch_pc (void)
+{
+    uaecptr pc = m68k_getpc ();
+    struct mmu_atc *a = mmu_lookup (pc, MMU_INSN, 2, 0);
+    int pagesize, avail;
+
+    regs.pc = pc;
+    if (! a) {
+	regs.pc_p = regs.pc_oldp = mmu_pc_none;
+	return;
+    }
+    pagesize = a == &mmu_atc_tmp ? mmu_atc_tmp_size : MMU_PAGE_SIZE;
+    avail = pagesize - (pc & (pagesize - 1));
+    if (! (a->tag & MMU_ATC_IO) && avail >= MMU_MAXINSN) {
+	regs.pc_p = regs.pc_oldp = a->host + pc;
+	mmu_pc_start = a->host + (pc & ~MMU_PAGE_MASK);
+	mmu_pc_end = mmu_pc_start + MMU_PAGE_SIZE - MMU_MAXINSN + 1;
+	return;
+    }
+
+    /* Too close to the end of the page, or not in RAM.  */
+    if (avail > MMU_MAXINSN)
+	avail = MMU_MAXINSN;
+    mmu_copy_insn (a, pc, mmu_pc_bounce, avail);
+    if (avail < MMU_MAXINSN) {
+	struct mmu_atc *next = mmu_lookup (pc + avail, MMU_INSN, 2, 1);
+	if (next)
+	    mmu_copy_insn (next, pc + avail, mmu_pc_bounce + avail, MMU_MAXINSN - avail);
+	else {
+	    int len = mmu_insn_length (mmu_pc_bounce, avail);
+	    if (len < 0 || len > avail)
+		mmu_fault (pc + avail, MMU_INSN, 2);
+	    memset (mmu_pc_bounce + avail, 0, MMU_MAXINSN - avail);
+	}
+    }
+    regs.pc_p = regs.pc_oldp = mmu_pc_bounce;
+    mmu_pc_start = mmu_pc_bounce;
+    mmu_pc_end = mmu_pc_bounce + 1;
+}
+
+void mmu_reset (void)
+{
+    mmu_set_enabled (0);
+    mmu_flush_all ();
+}
+
+/* Called when the translation control register or the cpu_mmu setting may
+ * have changed.  The CPU loop is switched when translation goes on or off.  */
+void mmu_update (void)
+{
+    int on = 0;
+
+    if (currprefs.cpu_mmu) {
+	if (currprefs.cpu_model == 68030)
+	    on = (regs.tc_030 & TC030_E) != 0;
+	else if (currprefs.cpu_model == 68040)
+	    on = (regs.tcr & TCR040_E) != 0;
+    }
+    mmu_set_super (regs.s);
+    if (on != mmu_enabled) {
+	uaecptr pc = m68k_getpc ();
+	mmu_flush_all ();
+	mmu_set_enabled (on);
+	m68k_setpc (pc);
+	set_special (SPCFLAG_MODE_CHANGE);
+    }
+}
+
+/* Returns 0 if TC is enabled but its fields don't add up to 32 bits.  */
+int mmu030_set_tc (uae_u32 tc)
+{
+    if (tc & TC030_E) {
+	int ps = (tc >> 20) & 15, bits = ps + ((tc >> 16) & 15), i;
+	for (i = 12; i >= 0; i -= 4) {
+	    int ti = (tc >> i) & 15;
+	    if (ti == 0)
+		break;
+	    bits += ti;
+	}
+	if (ps < 8 || ((tc >> 12) & 15) == 0 || bits != 32)
+	    return 0;
+    }
+    regs.tc_030 = tc;
+    mmu_update ();
+    return 1;
+}
+
+/* The function code field of PTEST, PFLUSH and PLOAD.  */
+static int mmu030_fc (uae_u16 next)
+{
+    if (next & 0x10)
+	return next & 7;
+    if (next & 0x08)
+	return m68k_dreg (regs, next & 7) & 7;
+    return (next & 1) ? regs.dfc : regs.sfc;
+}
+
+void mmu030_ptest (uaecptr addr, uae_u16 next)
+{
+    int fc = mmu030_fc (next), level = (next >> 10) & 7;
+    int write = ! (next & 0x200);
+    struct mmu_walk w;
+
+    if (mmu030_tt (addr, fc, write)) {
+	memset (&w, 0, sizeof w);
+	w.mmusr = MMUSR030_T;
+    } else {
+	mmu030_walk (addr, fc, write, 0, level ? level : 7, &w);
+	/* Level 0 searches the ATC, which only knows these.  */
+	if (level == 0)
+	    w.mmusr &= MMUSR030_B | MMUSR030_W | MMUSR030_I | MMUSR030_M;
+    }
+    regs.mmusr_030 = w.mmusr;
+    if (next & 0x100)
+	m68k_areg (regs, (next >> 5) & 7) = w.descaddr;
+}
+
+void mmu030_pload (uaecptr addr, uae_u16 next)
+{
+    int fc = mmu030_fc (next);
+    struct mmu_walk w;
+
+    if (! mmu030_tt (addr, fc, 0))
+	mmu030_walk (addr, fc, ! (next & 0x200), 1, 7, &w);
+    mmu_flush_set (&mmu_atc[(fc & 4) ? 1 : 0], addr, (regs.tc_030 >> 20) & 15, 0);
+}
+
+void mmu030_pflush (uaecptr addr, uae_u16 next)
+{
+    int mode = (next >> 10) & 7, fc, mask, f;
+
+    if (mode == 1) {
+	mmu_flush_all ();
+	return;
+    }
+    fc = mmu030_fc (next);
+    mask = (next >> 5) & 7;
+    for (f = 1; f < 8; f++) {
+	struct mmu_atcset *set = &mmu_atc[f >> 2];
+	if ((f & 3) == 0 || (f & 3) == 3 || ((f ^ fc) & mask) != 0)
+	    continue;
+	if (mode == 6) {
+	    int ps = (regs.tc_030 >> 20) & 15;
+	    if (f & 2)
+		mmu_flush_page (set->insn, addr, ps, 0);
+	    else {
+		mmu_flush_page (set->read, addr, ps, 0);
+		mmu_flush_page (set->write, addr, ps, 0);
+	    }
+	} else if (f & 2)
+	    mmu_flush_table (set->insn, 0);
+	else {
+	    mmu_flush_table (set->read, 0);
+	    mmu_flush_table (set->write, 0);
+	}
+    }
+    mmu_pc_start = mmu_pc_end = 0;
+}
+
+void mmu040_ptest (uaecptr addr, int write)
+{
+    int super = (regs.dfc & 4) != 0;
+    struct mmu_walk w;
+
+    mmu_translate (addr, super, write ? MMU_WRITE : MMU_READ, 1, &w);
+    regs.mmusr = w.mmusr;
+    mmu_flush_set (&mmu_atc[super], addr, w.pageshift, 0);
+}
+
+/* MODE is the opmode field: PFLUSHN (An), PFLUSH (An), PFLUSHAN, PFLUSHA.  */
+void mmu040_pflush (uaecptr addr, int mode)
+{
+    int shift = (regs.tcr & TCR040_P) ? 13 : 12;
+
+    switch (mode) {
+     case 0:
+     case 1:
+	mmu_flush_set (&mmu_atc[(regs.dfc & 4) ? 1 : 0], addr, shift, mode == 0);
+	break;
+     case 2:
+	mmu_flush_table (mmu_atc[0].read, 1);
+	mmu_flush_table (mmu_atc[0].write, 1);
+	mmu_flush_table (mmu_atc[0].insn, 1);
+	mmu_flush_table (mmu_atc[1].read, 1);
+	mmu_flush_table (mmu_atc[1].write, 1);
+	mmu_flush_table (mmu_atc[1].insn, 1);
+	mmu_pc_start = mmu_pc_end = 0;
+	break;
+     default:
+	mmu_flush_all ();
+	break;
+    }
+}
@@ -16,6 +16,7 @@
 #include "options.h"
 #include "memory.h"
 #include "custom.h"
+#include "events.h"
 #include "newcpu.h"
 #include "disk.h"
 #include "traps.h"
@@ -49,6 +50,7 @@ void uae_ReplyMsg (uaecptr msg)
     write_comm_pipe_u32 (&native2amiga_pending, msg, 1);
 
     uae_int_requested = 1;
+    idle_wakeup ();
 }
 
 void uae_PutMsg (uaecptr port, uaecptr msg)
@@ -60,6 +62,7 @@ void uae_PutMsg (uaecptr port, uaecptr msg)
     write_comm_pipe_u32 (&native2amiga_pending, msg, 1);
 
     uae_int_requested = 1;
+    idle_wakeup ();
 }
 
 void uae_Signal (uaecptr task, uae_u32 mask)
@@ -69,6 +72,7 @@ void uae_Signal (uaecptr task, uae_u32 mask)
     write_comm_pipe_int (&native2amiga_pending, mask, 1);
 
     uae_int_requested = 1;
+    idle_wakeup ();
 }
 #endif
 
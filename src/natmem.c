@@ -0,0 +1,314 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Natively mapped Amiga address space
+  *
+  * Memory that may be mapped into the reserved area comes from memfds, so
+  * that the same pages can appear at the bank's host address and at each
+  * of its Amiga addresses.  map_banks calls natmem_map for every range it
+  * assigns; RAM banks (ABFLAG_RAM) are mapped read/write, ROM banks
+  * (ABFLAG_ROM) read-only, and everything else is left inaccessible.
+  *
+  * The SIGSEGV handler only knows the instructions natmem.h generates:
+  * 32-bit, zero-extending 16 and 8-bit loads, and 32, 16 and 8-bit
+  * stores, with any register and addressing mode.  It does the access with
+  * the bank functions and continues after the instruction.
+  */
+
+/* For the register names in ucontext.h.  */
+#define _GNU_SOURCE
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "memory.h"
+#include "hostmem.h"
+
+#ifdef NATMEM
+
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+/* Room for an access at 0xffffffff to run past 4 GB.  */
+#define NATMEM_SIZE (0x100000000ULL + 0x10000)
+
+uae_u8 *natmem_offset;
+
+struct natmem_piece {
+    uae_u8 *host;
+    size_t size;
+    int fd;
+    struct natmem_piece *next;
+};
+
+static struct natmem_piece *natmem_pieces;
+/* PROT_* of each 64K bank of the reserved area.  */
+static uae_u8 natmem_prot[65536];
+static struct sigaction natmem_oldsa;
+
+/* Take over HOST .. HOST + SIZE - 1, which shows FD from offset 0 on
+ * and is freed by natmem_free.  */
+void natmem_adopt (uae_u8 *host, size_t size, int fd)
+{
+    struct natmem_piece *p = malloc (sizeof *p);
+
+    p->host = host;
+    p->size = size;
+    p->fd = fd;
+    p->next = natmem_pieces;
+    natmem_pieces = p;
+}
+
+uae_u8 *natmem_alloc (size_t size, const char *name)
+{
+    uae_u8 *host;
+    int fd = hostmem_memfd (name);
+
+    if (fd < 0)
+	return 0;
+    if (ftruncate (fd, size) < 0
+	|| (host = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+	close (fd);
+	return 0;
+    }
+    natmem_adopt (host, size, fd);
+    /* Offsets into hugetlbfs files would have to be huge page aligned,
+     * which the 64K granular mirrors aren't.  */
+    hostmem_setup (host, size, name, 0);
+    return host;
+}
+
+/* Returns 0 if P didn't come from natmem_alloc.  */
+int natmem_free (uae_u8 *host)
+{
+    struct natmem_piece **pp, *p;
+
+    for (pp = &natmem_pieces; (p = *pp) != 0; pp = &p->next) {
+	if (p->host == host) {
+	    *pp = p->next;
+	    munmap (p->host, p->size);
+	    close (p->fd);
+	    free (p);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static void natmem_unmap (uae_u64 start, uae_u64 size)
+{
+    if (mmap (natmem_offset + start, size, PROT_NONE,
+	      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+	write_log ("NATMEM: can't unmap %08x: %s\n", (uae_u32)start, strerror (errno));
+}
+
+void natmem_reset (void)
+{
+    if (natmem_offset)
+	natmem_unmap (0, NATMEM_SIZE);
+    memset (natmem_prot, 0, sizeof natmem_prot);
+}
+
+/* Whether ADDR .. ADDR + SIZE - 1 can be used directly by host code that
+ * isn't known to the signal handler, such as memcpy.  */
+int natmem_direct (uaecptr addr, int size, int write)
+{
+    int need = write ? PROT_WRITE : PROT_READ;
+    uae_u32 b, last;
+
+    if (size <= 0 || addr + (uae_u32)size - 1 < addr)
+	return 0;
+    last = bankindex (addr + size - 1);
+    for (b = bankindex (addr); b <= last; b++)
+	if (! (natmem_prot[b] & need))
+	    return 0;
+    return 1;
+}
+
+/* Make START .. START + SIZE - 1 show BANK, whose first byte there is at
+ * host address BANK->xlateaddr (START).  */
+void natmem_map (uaecptr start, uae_u32 size, addrbank *bank)
+{
+    struct natmem_piece *p;
+    uae_u8 *host;
+    int prot;
+
+    if (! natmem_offset)
+	return;
+    natmem_unmap (start, size);
+    memset (natmem_prot + bankindex (start), 0, size >> 16);
+    if (bank->flags & ABFLAG_RAM)
+	prot = PROT_READ | PROT_WRITE;
+    else if (bank->flags & ABFLAG_ROM)
+	prot = PROT_READ;
+    else
+	return;
+    if (! bank->check (start, size))
+	return;
+    host = bank->xlateaddr (start);
+    for (p = natmem_pieces; p; p = p->next)
+	if (host >= p->host && host + size <= p->host + p->size)
+	    break;
+    /* Memory that doesn't come from natmem_alloc is reached through the
+     * signal handler.  */
+    if (! p || ((host - p->host) & (getpagesize () - 1)) != 0)
+	return;
+    if (mmap (natmem_offset + start, size, prot, MAP_SHARED | MAP_FIXED,
+	      p->fd, host - p->host) == MAP_FAILED)
+	write_log ("NATMEM: can't map %s at %08x: %s\n", bank->name, start, strerror (errno));
+    else
+	memset (natmem_prot + bankindex (start), prot, size >> 16);
+}
+
+static const int natmem_regs[16] = {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15
+};
+
+/* Emulate the access at *PC with the bank functions.  Returns the address
+ * of the next instruction, or 0 if it isn't one of ours.  */
+static uae_u8 *natmem_emulate (uae_u8 *pc, greg_t *gr)
+{
+    int size = 4, load, rex = 0, modrm, mod, rm, reg;
+    uae_u64 ea;
+    uaecptr addr;
+
+    if (*pc == 0x66) {
+	size = 2;
+	pc++;
+    }
+    if ((*pc & 0xf0) == 0x40)
+	rex = *pc++;
+    if (rex & 8)
+	return 0;
+    switch (*pc++) {
+     case 0x8b: load = 1; break;
+     case 0x89: load = 0; break;
+     case 0x88: load = 0; size = 1; break;
+     case 0x0f:
+	switch (*pc++) {
+	 case 0xb7: load = 1; size = 2; break;
+	 case 0xb6: load = 1; size = 1; break;
+	 default: return 0;
+	}
+	break;
+     default:
+	return 0;
+    }
+
+    modrm = *pc++;
+    mod = modrm >> 6;
+    reg = ((modrm >> 3) & 7) | ((rex & 4) << 1);
+    rm = modrm & 7;
+    if (mod == 3)
+	return 0;
+    if (rm == 4) {
+	int sib = *pc++;
+	int index = ((sib >> 3) & 7) | ((rex & 2) << 2);
+	int base = (sib & 7) | ((rex & 1) << 3);
+
+	ea = index == 4 ? 0 : (uae_u64)gr[natmem_regs[index]] << (sib >> 6);
+	if ((base & 7) == 5 && mod == 0) {
+	    uae_s32 d;
+	    memcpy (&d, pc, 4);
+	    ea += d;
+	    pc += 4;
+	} else
+	    ea += gr[natmem_regs[base]];
+    } else if (rm == 5 && mod == 0)
+	return 0;
+    else
+	ea = gr[natmem_regs[rm | ((rex & 1) << 3)]];
+    if (mod == 1)
+	ea += (uae_s8)*pc++;
+    else if (mod == 2) {
+	uae_s32 d;
+	memcpy (&d, pc, 4);
+	ea += d;
+	pc += 4;
+    }
+    addr = (uaecptr)(ea - (uae_u64)natmem_offset);
+
+    if (load) {
+	uae_u32 v = 0;
+	switch (size) {
+	 case 4: do_put_mem_long (&v, longget (addr)); break;
+	 case 2: do_put_mem_word ((uae_u16 *)&v, wordget (addr)); break;
+	 default: v = byteget (addr); break;
+	}
+	gr[natmem_regs[reg]] = v;
+    } else {
+	uae_u64 r;
+	uae_u32 v;
+	if (size == 1 && ! rex && reg >= 4)
+	    /* %ah .. %bh */
+	    r = gr[natmem_regs[reg - 4]] >> 8;
+	else
+	    r = gr[natmem_regs[reg]];
+	v = (uae_u32)r;
+	switch (size) {
+	 case 4: longput (addr, do_get_mem_long (&v)); break;
+	 case 2: wordput (addr, do_get_mem_word ((uae_u16 *)&v)); break;
+	 default: byteput (addr, v & 0xff); break;
+	}
+    }
+    return pc;
+}
+
+static void natmem_sigsegv (int sig, siginfo_t *si, void *context)
+{
+    ucontext_t *uc = context;
+    greg_t *gr = uc->uc_mcontext.gregs;
+    uae_u8 *fault = si->si_addr, *next = 0;
+
+    if (natmem_offset && fault >= natmem_offset && fault < natmem_offset + NATMEM_SIZE)
+	next = natmem_emulate ((uae_u8 *)gr[REG_RIP], gr);
+    if (next) {
+	gr[REG_RIP] = (greg_t)next;
+	return;
+    }
+    /* Not ours: fault again with the previous handler.  */
+    sigaction (SIGSEGV, &natmem_oldsa, NULL);
+}
+
+int natmem_init (void)
+{
+    struct sigaction sa;
+    uae_u8 *p;
+
+    if (currprefs.fork_server[0] != '\0') {
+	/* Shared mappings would be shared with the jobs as well.  */
+	write_log ("NATMEM: not used with a fork server.\n");
+	return 0;
+    }
+    p = mmap (0, NATMEM_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+	write_log ("NATMEM: can't reserve 4 GB of address space: %s\n", strerror (errno));
+	return 0;
+    }
+    memset (&sa, 0, sizeof sa);
+    sa.sa_sigaction = natmem_sigsegv;
+    /* Bank functions may touch natmem themselves.  */
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset (&sa.sa_mask);
+    if (sigaction (SIGSEGV, &sa, &natmem_oldsa) < 0) {
+	munmap (p, NATMEM_SIZE);
+	return 0;
+    }
+    natmem_offset = p;
+    write_log ("NATMEM: Amiga address space at %p.\n", p);
+    return 1;
+}
+
+void natmem_cleanup (void)
+{
+    if (! natmem_offset)
+	return;
+    sigaction (SIGSEGV, &natmem_oldsa, NULL);
+    munmap (natmem_offset, NATMEM_SIZE);
+    natmem_offset = 0;
+}
+
+#endif
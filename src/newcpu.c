@@ -22,6 +22,9 @@
 #include "gui.h"
 #include "savestate.h"
 #include "blitter.h"
+#include "idleloop.h"
+#include "metrics.h"
+#include "cputhread.h"
 
 /* Opcode of faulting instruction */
 static uae_u16 last_op_for_exception_3;
@@ -66,10 +69,82 @@ static char *icountfilename (void)
     return COUNT_INSTRS == 2 ? "frequent.68k" : "insncount";
 }
 
+#if COUNT_INSTRS == 2
+/* Counts of pairs of consecutive instructions, for gencpu's fused
+ * handlers.  Pairs that don't fit into the table any more are dropped.  */
+#define PAIRHASH_SIZE 65536
+
+static struct {
+    uae_u32 pair;
+    unsigned long count;
+} paircount[PAIRHASH_SIZE];
+static uae_u32 lasthandler;
+
+STATIC_INLINE void count_pair (uae_u32 handler)
+{
+    uae_u32 pair = (lasthandler << 16) | handler;
+    unsigned int h = (pair * 2654435761u) >> 16;
+    int i;
+
+    lasthandler = handler;
+    for (i = 0; i < 16; i++, h++) {
+	h &= PAIRHASH_SIZE - 1;
+	if (paircount[h].count == 0)
+	    paircount[h].pair = pair;
+	if (paircount[h].pair == pair) {
+	    paircount[h].count++;
+	    return;
+	}
+    }
+}
+
+static int paircompfn (const void *el1, const void *el2)
+{
+    unsigned long c1 = paircount[*(const uae_u16 *)el1].count;
+    unsigned long c2 = paircount[*(const uae_u16 *)el2].count;
+    return c1 < c2 ? 1 : c1 > c2 ? -1 : 0;
+}
+
+static const char *mnemoname (uae_u32 opcode)
+{
+    struct mnemolookup *lookup;
+    for (lookup = lookuptab; lookup->mnemo != table68k[opcode].mnemo; lookup++)
+	;
+    return lookup->name;
+}
+
+static void dump_pairs (void)
+{
+    char *name = getenv ("INSNPAIRCOUNT");
+    FILE *f = fopen (name ? name : "frequent_pairs.68k", "w");
+    unsigned long total = 0;
+    int i;
+
+    if (f == 0)
+	return;
+    for (i = 0; i < PAIRHASH_SIZE; i++) {
+	opcodenums[i] = i;
+	total += paircount[i].count;
+    }
+    qsort (opcodenums, PAIRHASH_SIZE, sizeof (uae_u16), paircompfn);
+
+    fprintf (f, "Total: %lu\n", total);
+    for (i = 0; i < PAIRHASH_SIZE; i++) {
+	uae_u32 pair = paircount[opcodenums[i]].pair;
+	unsigned long cnt = paircount[opcodenums[i]].count;
+	if (!cnt)
+	    break;
+	fprintf (f, "%04x %04x: %lu %s %s\n", pair >> 16, pair & 0xffff, cnt,
+		 mnemoname (pair >> 16), mnemoname (pair & 0xffff));
+    }
+    fclose (f);
+}
+#endif
+
 void dump_counts (void)
 {
     FILE *f = fopen (icountfilename (), "w");
-    unsigned long int total;
+    unsigned long int total = 0;
     int i;
 
     write_log ("Writing instruction count file...\n");
@@ -92,6 +167,9 @@ void dump_counts (void)
 	fprintf (f, "%04x: %lu %s\n", opcodenums[i], cnt, lookup->name);
     }
     fclose (f);
+#if COUNT_INSTRS == 2
+    dump_pairs ();
+#endif
 }
 #else
 void dump_counts (void)
@@ -109,37 +187,71 @@ static unsigned long REGPARAM2 op_illg_1 (uae_u32 opcode)
     return 4;
 }
 
+static void install_pairs (const struct cpupairtbl *ptbl)
+{
+    unsigned long opcode;
+    int i, n = 0;
+
+    for (i = 0; ptbl[i].handler != NULL; i++) {
+	for (opcode = 0; opcode < 65536; opcode++) {
+	    if (cpufunctbl[opcode] != ptbl[i].first)
+		continue;
+	    if (opcode != ptbl[i].opcode && table68k[opcode].handler != ptbl[i].opcode)
+		continue;
+	    cpufunctbl[opcode] = ptbl[i].handler;
+	}
+	n++;
+    }
+    if (n > 0)
+	write_log ("%d fused instruction handlers\n", n);
+}
+
+/* The CPU core that reaches RAM at natmem_offset directly, while natmem is
+ * on.  The MMU needs the accesses to go through the banks.  */
+#ifdef NATMEM
+#define CPUTBL(x) (natmem_offset && ! currprefs.cpu_mmu ? x##_nm : x##_ff)
+#else
+#define CPUTBL(x) x##_ff
+#endif
+
 static void build_cpufunctbl (void)
 {
     int i, opcnt;
     unsigned long opcode;
     const struct cputbl *tbl = 0;
+    const struct cpupairtbl *ptbl = 0;
     int lvl;
 
     switch (currprefs.cpu_model) {
     case 68060:
 	lvl = 5;
-	tbl = op_smalltbl_0_ff;
+	tbl = CPUTBL (op_smalltbl_0);
+	ptbl = CPUTBL (op_pairtbl_0);
 	break;
     case 68040:
 	lvl = 4;
-	tbl = op_smalltbl_1_ff;
+	tbl = CPUTBL (op_smalltbl_1);
+	ptbl = CPUTBL (op_pairtbl_1);
 	break;
     case 68030:
 	lvl = 3;
-	tbl = op_smalltbl_2_ff;
+	tbl = CPUTBL (op_smalltbl_2);
+	ptbl = CPUTBL (op_pairtbl_2);
 	break;
     case 68020:
-	tbl = op_smalltbl_3_ff;
+	tbl = CPUTBL (op_smalltbl_3);
+	ptbl = CPUTBL (op_pairtbl_3);
 	lvl = 2;
 	break;
     case 68010:
-	tbl = op_smalltbl_4_ff;
+	tbl = CPUTBL (op_smalltbl_4);
+	ptbl = CPUTBL (op_pairtbl_4);
 	lvl = 1;
 	break;
     case 68000:
 	lvl = 0;
-	tbl = op_smalltbl_6_ff;
+	tbl = CPUTBL (op_smalltbl_6);
+	ptbl = CPUTBL (op_pairtbl_6);
 	break;
     }
 
@@ -174,6 +286,14 @@ static void build_cpufunctbl (void)
 	if (tbl[i].specific)
 	    cpufunctbl[tbl[i].opcode] = tbl[i].handler;
     }
+    /* Neither knows how to restart after an MMU fault.  */
+    if (currprefs.cpu_idle_skip && ! currprefs.cpu_mmu)
+	idleloop_install (cpufunctbl);
+#if !COUNT_INSTRS
+    /* Last, so that only entries nobody else has hooked get fused.  */
+    if (currprefs.cpu_superinsn && ! currprefs.cpu_mmu)
+	install_pairs (ptbl);
+#endif
     write_log ("Building CPU, %d opcodes (%d). CPU=%d, FPU=%d\n",
 	       opcnt,
 	       currprefs.address_space_24, currprefs.cpu_model, currprefs.fpu_model);
@@ -181,6 +301,9 @@ static void build_cpufunctbl (void)
 
 void fill_prefetch_slow (void)
 {
+    /* Only the 68000 core uses the prefetch registers.  */
+    if (mmu_enabled)
+	return;
 #ifdef CPUEMU_6
     if (currprefs.cpu_cycle_exact) {
 	regs.ir = get_word_ce (m68k_getpc ());
@@ -208,10 +331,24 @@ static void update_68k_cycles (void)
 
 void check_prefs_changed_cpu (void)
 {
-    if (currprefs.m68k_speed != changed_prefs.m68k_speed) {
+    if (currprefs.m68k_speed != changed_prefs.m68k_speed
+	|| currprefs.cpu_thread != changed_prefs.cpu_thread) {
 	currprefs.m68k_speed = changed_prefs.m68k_speed;
+	currprefs.cpu_thread = changed_prefs.cpu_thread;
 	reset_frame_rate_hack ();
 	update_68k_cycles ();
+	/* Decide again whether the CPU gets a thread of its own.  */
+	if (currprefs.cpu_thread || cputhread_running)
+	    set_special (SPCFLAG_MODE_CHANGE);
+    }
+    if (currprefs.cpu_idle_skip != changed_prefs.cpu_idle_skip
+	|| currprefs.cpu_superinsn != changed_prefs.cpu_superinsn
+	|| currprefs.cpu_mmu != changed_prefs.cpu_mmu) {
+	currprefs.cpu_idle_skip = changed_prefs.cpu_idle_skip;
+	currprefs.cpu_superinsn = changed_prefs.cpu_superinsn;
+	currprefs.cpu_mmu = changed_prefs.cpu_mmu;
+	build_cpufunctbl ();
+	mmu_update ();
     }
 }
 
@@ -667,6 +804,10 @@ void MakeFromSR (void)
     regs.s = (regs.sr >> 13) & 1;
     regs.m = (regs.sr >> 12) & 1;
     regs.intmask = (regs.sr >> 8) & 7;
+    mmu_set_super (regs.s);
+    if (olds != regs.s)
+	/* Fetch the next instruction through the other tables.  */
+	mmu_pc_start = mmu_pc_end = 0;
     SET_XFLG ((regs.sr >> 4) & 1);
     SET_NFLG ((regs.sr >> 3) & 1);
     SET_ZFLG ((regs.sr >> 2) & 1);
@@ -751,6 +892,7 @@ void Exception_normal (int nr, uaecptr oldpc)
 	else
 	    m68k_areg (regs, 7) = regs.isp;
 	regs.s = 1;
+	mmu_set_super (1);
     }
     if (currprefs.cpu_model > 68000) {
 	if (nr == 2 || nr == 3) {
@@ -770,7 +912,8 @@ void Exception_normal (int nr, uaecptr oldpc)
 		    m68k_areg (regs, 7) -= 2;
 		    put_word (m68k_areg (regs, 7), 0);
 		    m68k_areg (regs, 7) -= 2;
-		    put_word (m68k_areg (regs, 7), 0x0140 | (sv ? 6 : 2)); /* SSW */
+		    /* SSW */
+		    put_word (m68k_areg (regs, 7), regs.mmu_ssw ? regs.mmu_ssw : 0x0140 | (sv ? 6 : 2));
 		    m68k_areg (regs, 7) -= 4;
 		    put_long (m68k_areg (regs, 7), last_addr_for_exception_3);
 		    m68k_areg (regs, 7) -= 2;
@@ -785,21 +928,26 @@ void Exception_normal (int nr, uaecptr oldpc)
 		uae_u16 ssw = (sv ? 4 : 0) | (last_instructionaccess_for_exception_3 ? 2 : 1);
 		ssw |= last_writeaccess_for_exception_3 ? 0 : 0x40;
 		ssw |= 0x20;
+		if (regs.mmu_ssw)
+		    ssw = regs.mmu_ssw;
 		for (i = 0 ; i < 36; i++) {
 		    m68k_areg (regs, 7) -= 2;
 		    put_word (m68k_areg (regs, 7), 0);
 		}
+		/* Stage B address, for faults on the instruction stream */
+		if (ssw & 0x1000)
+		    put_long (m68k_areg (regs, 7) + 0x10, last_fault_for_exception_3);
 		m68k_areg (regs, 7) -= 4;
 		put_long (m68k_areg (regs, 7), last_fault_for_exception_3);
 		m68k_areg (regs, 7) -= 2;
-		put_word (m68k_areg (regs, 7), 0);
+		put_word (m68k_areg (regs, 7), 0); /* stage B */
 		m68k_areg (regs, 7) -= 2;
-		put_word (m68k_areg (regs, 7), 0);
-		m68k_areg (regs, 7) -= 2;
-		put_word (m68k_areg (regs, 7), 0);
+		put_word (m68k_areg (regs, 7), 0); /* stage C */
 		m68k_areg (regs, 7) -= 2;
 		put_word (m68k_areg (regs, 7), ssw);
 		m68k_areg (regs, 7) -= 2;
+		put_word (m68k_areg (regs, 7), 0);
+		m68k_areg (regs, 7) -= 2;
 		put_word (m68k_areg (regs, 7), 0xb000 + nr * 4);
 	    }
 #if 0
@@ -942,13 +1090,17 @@ int m68k_move2c (int regno, uae_u32 *regp)
 	 /* 68040/060 only */
 	case 3:
 	    regs.tcr = *regp & (currprefs.cpu_model == 68060 ? 0xfffe : 0xc000);
+	    if (currprefs.cpu_mmu) {
+		mmu_flush_all ();
+		mmu_update ();
+	    }
 	    break;
 
 	/* no differences between 68040 and 68060 */
-	case 4: regs.itt0 = *regp & 0xffffe364; break;
-	case 5: regs.itt1 = *regp & 0xffffe364; break;
-	case 6: regs.dtt0 = *regp & 0xffffe364; break;
-	case 7: regs.dtt1 = *regp & 0xffffe364; break;
+	case 4: regs.itt0 = *regp & 0xffffe364; mmu_flush_all (); break;
+	case 5: regs.itt1 = *regp & 0xffffe364; mmu_flush_all (); break;
+	case 6: regs.dtt0 = *regp & 0xffffe364; mmu_flush_all (); break;
+	case 7: regs.dtt1 = *regp & 0xffffe364; mmu_flush_all (); break;
 	/* 68060 only */
 	case 8: regs.buscr = *regp & 0xf0000000; break;
 
@@ -1303,6 +1455,7 @@ void m68k_reset (void)
 
     regs.kick_mask = 0x00F80000;
     regs.spcflags = 0;
+    mmu_reset ();
     if (savestate_state == STATE_RESTORE) {
 	m68k_setpc (regs.pc);
 	/* MakeFromSR() must not swap stack pointer */
@@ -1314,6 +1467,7 @@ void m68k_reset (void)
 	    m68k_areg (regs, 7) = regs.m ? regs.msp : regs.isp;
 	else
 	    m68k_areg (regs, 7) = regs.usp;
+	mmu_update ();
 	return;
     }
 
@@ -1341,6 +1495,13 @@ void m68k_reset (void)
 	regs.tt0_030 = regs.tt1_030 = regs.tc_030 = 0;
     }
     regs.mmusr_030 = 0;
+    regs.tcr &= ~0x8000;
+    regs.itt0 &= ~0x8000;
+    regs.itt1 &= ~0x8000;
+    regs.dtt0 &= ~0x8000;
+    regs.dtt1 &= ~0x8000;
+    regs.mmu_ssw = 0;
+    mmu_set_super (1);
 
     /* 68060 FPU is not compatible with 68040,
      * 68060 accelerators' boot ROM disables the FPU
@@ -1378,7 +1539,9 @@ unsigned long REGPARAM2 op_illg (uae_u32 opcode)
 	    /* This is from the dummy Kickstart replacement */
 	    uae_u16 arg = get_iword (2);
 	    m68k_incpc (4);
+	    cputhread_lock ();
 	    ersatz_perform (arg);
+	    cputhread_unlock ();
 	    fill_prefetch_slow ();
 	    return 4;
 	} else if ((pc & 0xFFFF0000) == RTAREA_BASE) {
@@ -1391,7 +1554,9 @@ unsigned long REGPARAM2 op_illg (uae_u32 opcode)
     if ((opcode & 0xF000) == 0xA000 && (pc & 0xFFFF0000) == RTAREA_BASE) {
 	/* Calltrap. */
 	m68k_incpc (2);
+	cputhread_lock ();
 	m68k_handle_trap (opcode & 0xFFF);
+	cputhread_unlock ();
 	fill_prefetch_slow ();
 	return 4;
     }
@@ -1429,8 +1594,13 @@ static void mmu_op30_pmove (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr ex
 	siz = 4;
 	if (rw)
 	    put_long (extra, regs.tc_030);
-	else
+	else if (! currprefs.cpu_mmu)
 	    regs.tc_030 = get_long (extra);
+	else if (! mmu030_set_tc (get_long (extra))) {
+	    /* MMU configuration error */
+	    Exception (56, pc);
+	    return;
+	}
 	break;
     case 0x12: // SRP
 	reg = "SRP";
@@ -1467,16 +1637,20 @@ static void mmu_op30_pmove (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr ex
 	siz = 4;
 	if (rw)
 	    put_long (extra, regs.tt0_030);
-	else
+	else {
 	    regs.tt0_030 = get_long (extra);
+	    fd = 0;
+	}
 	break;
     case 0x03: // TT1
 	reg = "TT1";
 	siz = 4;
 	if (rw)
 	    put_long (extra, regs.tt1_030);
-	else
+	else {
 	    regs.tt1_030 = get_long (extra);
+	    fd = 0;
+	}
 	break;
     }
 
@@ -1484,6 +1658,10 @@ static void mmu_op30_pmove (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr ex
 	op_illg (opcode);
 	return;
     }
+    /* Translations of the transparent windows are cached as well, so
+     * changing those always flushes.  */
+    if (currprefs.cpu_mmu && ! rw && ! fd && preg != 0x18)
+	mmu_flush_all ();
 #if MMUOP_DEBUG > 0
     {
 	uae_u32 val;
@@ -1520,7 +1698,8 @@ static void mmu_op30_ptest (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr ex
     write_log ("PTEST%c %02X,%08X,#%X%s PC=%08X\n",
 	((next >> 9) & 1) ? 'W' : 'R', (next & 15), extra, (next >> 10) & 7, tmp, pc); 
 #endif
-    //    mmusr_030 = 0;
+    if (currprefs.cpu_mmu)
+	mmu030_ptest (extra, next);
 }
 
 static void mmu_op30_pflush (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr extra)
@@ -1528,9 +1707,15 @@ static void mmu_op30_pflush (uaecptr pc, uae_u32 opcode, uae_u16 next, uaecptr e
 #if MMUOP_DEBUG > 0
     write_log ("PFLUSH PC=%08X\n", pc);
 #endif
+    if (! currprefs.cpu_mmu)
+	return;
+    if (((next >> 10) & 7) == 0)
+	mmu030_pload (extra, next);
+    else
+	mmu030_pflush (extra, next);
 }
 
-void mmu_op30 (uaecptr pc, uae_u32 opcode, int isnext, uaecptr extra)
+void mmu_op30 (uaecptr pc, uae_u32 opcode, int isnext, uae_u16 next, uaecptr extra)
 {
     if (currprefs.cpu_model != 68030) {
 	m68k_setpc (pc);
@@ -1538,14 +1723,12 @@ void mmu_op30 (uaecptr pc, uae_u32 opcode, int isnext, uaecptr extra)
 	return;
     }
     if (isnext) {
-	uae_u16 next = get_word (pc + 2);
 	if (next & 0x8000)
 	    mmu_op30_ptest (pc, opcode, next, extra);
 	else if (next & 0x2000)
 	    mmu_op30_pflush (pc, opcode, next, extra);
 	else
 	    mmu_op30_pmove (pc, opcode, next, extra);
-	m68k_setpc (m68k_getpc () + 2);
     } else {
 #if MMUOP_DEBUG > 0
 	write_log ("MMU030: %04x PC=%08x\n", opcode, m68k_getpc ());
@@ -1565,6 +1748,8 @@ void mmu_op(uae_u32 opcode, uae_u16 extra)
 #if MMUOP_DEBUG > 0
 	write_log ("PFLUSH\n");
 #endif
+	if (currprefs.cpu_mmu)
+	    mmu040_pflush (m68k_areg (regs, opcode & 7), (opcode >> 3) & 3);
 	return;
     } else if ((opcode & 0x0FD8) == 0x548) {
 	if (currprefs.cpu_model < 68060) { /* PTEST not in 68060 */
@@ -1572,6 +1757,8 @@ void mmu_op(uae_u32 opcode, uae_u16 extra)
 #if MMUOP_DEBUG > 0
 	    write_log ("PTEST\n");
 #endif
+	    if (currprefs.cpu_mmu)
+		mmu040_ptest (m68k_areg (regs, opcode & 7), ! (opcode & 0x20));
 	    return;
 	}
     } else if ((opcode & 0x0FB8) == 0x588) {
@@ -1665,7 +1852,10 @@ static int do_specialties (int cycles)
 	Exception (9,last_trace_ad);
 
     while (regs.spcflags & SPCFLAG_STOP) {
-	do_cycles (4 * CYCLE_UNIT);
+	if (regs.spcflags & SPCFLAG_COPPER)
+	    do_cycles (4 * CYCLE_UNIT);
+	else
+	    do_cycles_stopped ();
 	if (regs.spcflags & SPCFLAG_COPPER)
 	    do_copper ();
 	if (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT)) {
@@ -1700,6 +1890,63 @@ static int do_specialties (int cycles)
     return 0;
 }
 
+/* do_specialties for the CPU thread.  The copper and blitter flags are
+   the chipset thread's business.  */
+static int do_specialties_thread (void)
+{
+    if (regs.spcflags & SPCFLAG_PARK)
+	cputhread_park ();
+
+    cputhread_lock ();
+    if (regs.spcflags & SPCFLAG_RESTORE_SANITY) {
+	m68k_setpc (0xF0FFC0);
+	fill_prefetch_slow ();
+	unset_special (SPCFLAG_RESTORE_SANITY);
+    }
+    if (regs.spcflags & SPCFLAG_DOTRACE)
+	Exception (9,last_trace_ad);
+
+    while ((regs.spcflags & (SPCFLAG_STOP | SPCFLAG_BRK | SPCFLAG_MODE_CHANGE)) == SPCFLAG_STOP) {
+	cputhread_unlock ();
+	if (regs.spcflags & SPCFLAG_PARK)
+	    cputhread_park ();
+	else
+	    cputhread_stopped ();
+	cputhread_lock ();
+	if (regs.spcflags & (SPCFLAG_INT | SPCFLAG_DOINT)) {
+	    int intr = intlev ();
+	    unset_special (SPCFLAG_INT | SPCFLAG_DOINT);
+	    if (intr != -1 && intr > regs.intmask) {
+		Interrupt (intr);
+		regs.stopped = 0;
+		unset_special (SPCFLAG_STOP);
+	    }
+	}
+    }
+    if (regs.spcflags & SPCFLAG_TRACE)
+	do_trace ();
+
+    if (regs.spcflags & SPCFLAG_DOINT) {
+	int intr = intlev ();
+	unset_special (SPCFLAG_DOINT);
+	if (intr != -1 && intr > regs.intmask) {
+	    Interrupt (intr);
+	    regs.stopped = 0;
+	}
+    }
+    if (regs.spcflags & SPCFLAG_INT) {
+	unset_special (SPCFLAG_INT);
+	set_special (SPCFLAG_DOINT);
+    }
+    cputhread_unlock ();
+
+    if (regs.spcflags & (SPCFLAG_BRK | SPCFLAG_MODE_CHANGE)) {
+	unset_special (SPCFLAG_BRK | SPCFLAG_MODE_CHANGE);
+	return 1;
+    }
+    return 0;
+}
+
 /* It's really sad to have two almost identical functions for this, but we
    do it all for performance... :( */
 static void m68k_run_1 (void)
@@ -1713,11 +1960,12 @@ static void m68k_run_1 (void)
 #if COUNT_INSTRS == 2
 	if (table68k[opcode].handler != -1)
 	    instrcount[table68k[opcode].handler]++;
+	count_pair (table68k[opcode].handler != -1 ? table68k[opcode].handler : opcode);
 #elif COUNT_INSTRS == 1
 	instrcount[opcode]++;
 #endif
 	cycles = (*cpufunctbl[opcode])(opcode);
-	/*n_insns++;*/
+	METRIC_INC (METRIC_INSNS);
 	cycles &= cycles_mask;
 	cycles |= cycles_val;
 	do_cycles (cycles);
@@ -1742,12 +1990,103 @@ static void m68k_run_2 (void)
 #if COUNT_INSTRS == 2
 	if (table68k[opcode].handler != -1)
 	    instrcount[table68k[opcode].handler]++;
+	count_pair (table68k[opcode].handler != -1 ? table68k[opcode].handler : opcode);
 #elif COUNT_INSTRS == 1
 	instrcount[opcode]++;
 #endif
 	cycles = (*cpufunctbl[opcode])(opcode);
+	METRIC_INC (METRIC_INSNS);
+	cycles &= cycles_mask;
+	cycles |= cycles_val;
+	do_cycles (cycles);
+	if (regs.spcflags) {
+	    if (do_specialties (cycles))
+		return;
+	}
+    }
+}
+
+/* The CPU loop of cpu_thread mode, see cputhread.c.  It may start out
+   halted by STOP, so the flags come first.  */
+static void m68k_run_thread (void)
+{
+    for (;;) {
+	int cycles;
+	uae_u32 opcode;
+
+	if (regs.spcflags & ~CPUTHREAD_CHIPSET_FLAGS) {
+	    if (do_specialties_thread ())
+		return;
+	}
+	opcode = get_iword (0);
+	cycles = (*cpufunctbl[opcode])(opcode);
+	METRIC_INC (METRIC_INSNS);
+	cputhread_do_cycles (cycles);
+    }
+}
+
+static void m68k_run_2_or_thread (void)
+{
+    if (cputhread_usable () && cputhread_run (m68k_run_thread))
+	return;
+    /* The CPU thread may have returned while halted by STOP.  */
+    if ((regs.spcflags & SPCFLAG_STOP) && do_specialties (0))
+	return;
+    m68k_run_2 ();
+}
 
-	/*n_insns++;*/
+/* While the MMU translates, a faulting access longjmps back here.  The
+ * registers are put back as they were before the instruction, which the
+ * bus error handler will restart.  That is enough for the instructions
+ * compilers and operating systems generate; the few that change other
+ * state before their last access may see it changed twice.  */
+static uae_u32 mmu_backup_regs[16];
+static struct flag_struct mmu_backup_flags;
+static uaecptr mmu_backup_pc;
+static int mmu_restartable, mmu_in_fault;
+
+static void mmu_bus_error (void)
+{
+    if (mmu_in_fault || ! mmu_restartable) {
+	write_log ("MMU: %s at %08X, PC=%08X, forcing reboot..\n",
+		   mmu_in_fault ? "double fault" : "fault outside an instruction",
+		   regs.mmu_fault_addr, mmu_backup_pc);
+	mmu_in_fault = 0;
+	regs.mmu_ssw = 0;
+	mmu_reset ();
+	uae_reset (1);
+	set_special (SPCFLAG_BRK);
+	return;
+    }
+    mmu_in_fault = 1;
+    mmu_restartable = 0;
+    memcpy (regs.regs, mmu_backup_regs, sizeof mmu_backup_regs);
+    regflags = mmu_backup_flags;
+    mmu_set_super (regs.s);
+    m68k_setpc (mmu_backup_pc);
+    last_addr_for_exception_3 = regs.mmu_fault_addr;
+    last_fault_for_exception_3 = regs.mmu_fault_addr;
+    Exception (2, mmu_backup_pc);
+    regs.mmu_ssw = 0;
+    mmu_in_fault = 0;
+}
+
+static void m68k_run_mmu_1 (void)
+{
+    for (;;) {
+	int cycles;
+	uae_u32 opcode;
+
+	memcpy (mmu_backup_regs, regs.regs, sizeof mmu_backup_regs);
+	mmu_backup_flags = regflags;
+	mmu_backup_pc = m68k_getpc ();
+	mmu_restartable = 1;
+	if (regs.pc_p < mmu_pc_start || regs.pc_p >= mmu_pc_end)
+	    mmu_fetch_pc ();
+	opcode = get_iword (0);
+	cycles = (*cpufunctbl[opcode])(opcode);
+	mmu_restartable = 0;
+	METRIC_INC (METRIC_INSNS);
 	cycles &= cycles_mask;
 	cycles |= cycles_val;
 	do_cycles (cycles);
@@ -1758,6 +2097,21 @@ static void m68k_run_2 (void)
     }
 }
 
+static void m68k_run_mmu (void)
+{
+    mmu_fault_armed = 1;
+    while (setjmp (mmu_fault_buf)) {
+	mmu_bus_error ();
+	if (regs.spcflags & SPCFLAG_BRK) {
+	    unset_special (SPCFLAG_BRK);
+	    mmu_fault_armed = 0;
+	    return;
+	}
+    }
+    m68k_run_mmu_1 ();
+    mmu_fault_armed = 0;
+}
+
 #define m68k_run1(F) (F) ()
 
 int in_m68k_go = 0;
@@ -1822,9 +2176,12 @@ void m68k_go (int may_quit)
 		uae_reset (1);
 	    }
 	}
-	m68k_run1 (currprefs.cpu_model == 68000 ? m68k_run_1 : m68k_run_2);
+	m68k_run1 (currprefs.cpu_model == 68000 ? m68k_run_1
+		   : mmu_enabled ? m68k_run_mmu : m68k_run_2_or_thread);
     }
     in_m68k_go--;
+    if (currprefs.cpu_idle_skip)
+	idleloop_dump ();
 }
 
 static void m68k_verify (uaecptr addr, uaecptr *nextpc)
@@ -396,12 +396,8 @@ static void build_insn (int insn)
 		}
 		break;
 	    case 'K': srcmode = immi; srcreg = bitval[bitK];
-		if (CPU_EMU_SIZE < 5) {
-		    /* 0..15 */
-		    srcgather = 1;
-		    srctype = 5;
-		    srcpos = bitpos[bitK];
-		}
+		/* Not gathered: FBcc gets a handler per condition, so that
+		 * gencpu can test the condition inline.  */
 		break;
 	    case 'p': srcmode = immi; srcreg = bitval[bitK];
 		if (CPU_EMU_SIZE < 5) {
@@ -10,6 +10,7 @@
 #include "sysdeps.h"
 
 #include "options.h"
+#include "threaddep/thread.h"
 #include "uae.h"
 #include "memory.h"
 #include "romlist.h"
@@ -498,22 +499,14 @@ static struct romdata *checkromdata (uae_u8 *sha1, int size, uae_u32 mask)
     return NULL;
 }
 
-struct romdata *getromdatabydata (uae_u8 *rom, int size)
+/* Identify decrypted ROM data.  Only looks at the roms table, so ROM scan
+   threads can call it.  */
+static struct romdata *identify_rom (uae_u8 *rom, int size)
 {
     uae_u8 sha1[SHA1_SIZE];
     uae_u8 tmp[4];
-    uae_u8 *tmpbuf = NULL;
     struct romdata *ret = NULL;
 
-    if (is_encrypted_rom (rom, size)) {
-	uae_u8 *tmpbuf = (uae_u8*)xmalloc (size);
-	int tmpsize = size - 11;
-	memcpy (tmpbuf, rom + 11, tmpsize);
-	if (!decode_cloanto_rom (tmpbuf, tmpsize, tmpsize, 1))
-	    return 0;
-	rom = tmpbuf;
-	size = tmpsize;
-    }
     get_sha1 (rom, size, sha1);
     ret = checkromdata(sha1, size, -1);
     if (!ret) {
@@ -528,6 +521,36 @@ struct romdata *getromdatabydata (uae_u8 *rom, int size)
 	    memcpy (rom, tmp, 4);
 	}
     }
+    return ret;
+}
+
+/* Returns a malloced copy of an encrypted ROM's contents, decrypted, or 0
+   if we don't have the key.  */
+static uae_u8 *decrypt_rom (uae_u8 *rom, int size, int *outsize)
+{
+    int tmpsize = size - 11;
+    uae_u8 *tmpbuf = (uae_u8*)xmalloc (tmpsize);
+
+    memcpy (tmpbuf, rom + 11, tmpsize);
+    if (!decode_cloanto_rom (tmpbuf, tmpsize, tmpsize, 1)) {
+	free (tmpbuf);
+	return 0;
+    }
+    *outsize = tmpsize;
+    return tmpbuf;
+}
+
+struct romdata *getromdatabydata (uae_u8 *rom, int size)
+{
+    uae_u8 *tmpbuf;
+    struct romdata *ret;
+
+    if (!is_encrypted_rom (rom, size))
+	return identify_rom (rom, size);
+    tmpbuf = decrypt_rom (rom, size, &size);
+    if (!tmpbuf)
+	return 0;
+    ret = identify_rom (tmpbuf, size);
     free (tmpbuf);
     return ret;
 }
@@ -623,14 +646,329 @@ void romwarning(int *ids)
 }
 #endif
 
+/* The ROM index.  scan_roms remembers what it found in each file, keyed
+   by path, size and modification time, so files it has seen before
+   needn't be read again.  The first line holds a checksum of the roms
+   table; when that changes, every file is looked at again.  Encrypted
+   ROMs we couldn't decrypt aren't recorded, since the key may turn up
+   later.  */
+
+#define ROMINDEX_NOROM -1
+
+struct romindex_entry {
+    char *path;
+    long size;
+    long mtime;
+    int id;
+    int seen;
+};
+
+static struct romindex_entry *romindex;
+static int romindex_cnt, romindex_dirty;
+
+static uae_u32 romtable_sum (void)
+{
+    uae_u32 sum = 0;
+    int i;
+
+    for (i = 0; roms[i].name; i++)
+	sum = sum * 31 + (roms[i].id ^ roms[i].crc32 ^ roms[i].size);
+    return sum;
+}
+
+static const char *romindex_file (char *buf, int bufsize)
+{
+    const char *home;
+
+    if (strcmp (currprefs.romindexfile, "none") == 0)
+	return 0;
+    if (currprefs.romindexfile[0] != '\0')
+	return currprefs.romindexfile;
+    home = getenv ("HOME");
+    if (home == 0 || (int)strlen (home) + 16 > bufsize)
+	return 0;
+    sprintf (buf, "%s/.uaeromindex", home);
+    return buf;
+}
+
+static struct romindex_entry *romindex_find (const char *path)
+{
+    int i;
+
+    for (i = 0; i < romindex_cnt; i++)
+	if (strcmp (romindex[i].path, path) == 0)
+	    return romindex + i;
+    return 0;
+}
+
+static void romindex_set (const char *path, struct stat *st, int id)
+{
+    struct romindex_entry *e;
+
+    if (strchr (path, '\n'))
+	return;
+    e = romindex_find (path);
+    if (!e) {
+	romindex = realloc (romindex, sizeof (struct romindex_entry) * (romindex_cnt + 1));
+	e = romindex + romindex_cnt++;
+	e->path = my_strdup (path);
+    }
+    e->size = st->st_size;
+    e->mtime = st->st_mtime;
+    e->id = id;
+    e->seen = 1;
+    romindex_dirty = 1;
+}
+
+static void romindex_forget (const char *path)
+{
+    struct romindex_entry *e = romindex_find (path);
+
+    if (e) {
+	free (e->path);
+	*e = romindex[--romindex_cnt];
+	romindex_dirty = 1;
+    }
+}
+
+static void romindex_free (void)
+{
+    int i;
+
+    for (i = 0; i < romindex_cnt; i++)
+	free (romindex[i].path);
+    free (romindex);
+    romindex = 0;
+    romindex_cnt = 0;
+}
+
+static void romindex_load (void)
+{
+    char buf[512], line[1024];
+    const char *name = romindex_file (buf, sizeof buf);
+    unsigned long sum;
+    FILE *f;
+
+    romindex_free ();
+    romindex_dirty = 0;
+    if (!name)
+	return;
+    f = fopen (name, "r");
+    if (!f)
+	return;
+    if (fgets (line, sizeof line, f) == 0
+	|| sscanf (line, "uaeromindex %lx", &sum) != 1
+	|| (uae_u32)sum != romtable_sum ())
+    {
+	fclose (f);
+	romindex_dirty = 1;
+	return;
+    }
+    while (fgets (line, sizeof line, f)) {
+	struct romindex_entry *e;
+	long size, mtime;
+	int id, pos;
+	char *p = strchr (line, '\n');
+
+	if (p)
+	    *p = '\0';
+	if (sscanf (line, "%d %ld %ld %n", &id, &size, &mtime, &pos) < 3)
+	    continue;
+	romindex = realloc (romindex, sizeof (struct romindex_entry) * (romindex_cnt + 1));
+	e = romindex + romindex_cnt++;
+	e->path = my_strdup (line + pos);
+	e->size = size;
+	e->mtime = mtime;
+	e->id = id;
+	e->seen = 0;
+    }
+    fclose (f);
+}
+
+static int romindex_gone (struct romindex_entry *e, const char *dir, int dirlen)
+{
+    return (!e->seen && strncmp (e->path, dir, dirlen) == 0
+	    && strchr (e->path + dirlen, '/') == 0);
+}
+
+/* Entries for files that have gone from DIR are dropped.  */
+static void romindex_save (const char *dir)
+{
+    char buf[512], tmpname[520];
+    const char *name = romindex_file (buf, sizeof buf);
+    int dirlen = strlen (dir);
+    FILE *f;
+    int i;
+
+    for (i = 0; i < romindex_cnt; i++)
+	if (romindex_gone (romindex + i, dir, dirlen))
+	    romindex_dirty = 1;
+    if (!name || !romindex_dirty)
+	return;
+    sprintf (tmpname, "%.511s.tmp", name);
+    f = fopen (tmpname, "w");
+    if (!f)
+	return;
+    fprintf (f, "uaeromindex %lx\n", (unsigned long)romtable_sum ());
+    for (i = 0; i < romindex_cnt; i++) {
+	struct romindex_entry *e = romindex + i;
+	if (romindex_gone (e, dir, dirlen))
+	    continue;
+	fprintf (f, "%d %ld %ld %s\n", e->id, e->size, e->mtime, e->path);
+    }
+    if (fclose (f) != 0 || rename (tmpname, name) != 0) {
+	write_log ("Could not write the ROM index %s.\n", name);
+	unlink (tmpname);
+    }
+}
+
+/* Files that weren't in the index are read a batch at a time, and their
+   SHA1s computed on as many threads as there are processors.  */
+
+#define SCAN_BATCH 64
+
+struct romscan {
+    char *path;
+    struct stat st;
+    uae_u8 *data;
+    int size;
+    /* What identify_rom looks at: DATA, or its decrypted contents, or 0 if
+       it couldn't be decrypted.  */
+    uae_u8 *plain;
+    int plainsize;
+    struct romdata *rd;
+};
+
+static struct romscan *scan_batch;
+static int scan_cnt;
+
+#ifdef SUPPORT_THREADS
+
+static volatile int scan_next;
+
+static void *scan_thread (void *arg)
+{
+    int i;
+
+    while ((i = __sync_fetch_and_add (&scan_next, 1)) < scan_cnt) {
+	struct romscan *s = scan_batch + i;
+	if (s->plain)
+	    s->rd = identify_rom (s->plain, s->plainsize);
+    }
+    return 0;
+}
+
+static void identify_batch (void)
+{
+    uae_thread_id tids[8];
+    long nthreads = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+    int i, started = 0;
+
+    if (nthreads > scan_cnt - 1)
+	nthreads = scan_cnt - 1;
+    if (nthreads > 8)
+	nthreads = 8;
+    scan_next = 0;
+    for (i = 0; i < nthreads; i++)
+	if (uae_start_thread (scan_thread, 0, tids + started) == 0)
+	    started++;
+    scan_thread (0);
+    for (i = 0; i < started; i++)
+	uae_wait_thread (tids[i]);
+}
+
+#else
+
+static void identify_batch (void)
+{
+    int i;
+
+    for (i = 0; i < scan_cnt; i++) {
+	struct romscan *s = scan_batch + i;
+	if (s->plain)
+	    s->rd = identify_rom (s->plain, s->plainsize);
+    }
+}
+
+#endif
+
+static void flush_batch (int loc, int *keys_added)
+{
+    int i;
+
+    identify_batch ();
+    for (i = 0; i < scan_cnt; i++) {
+	struct romscan *s = scan_batch + i;
+	int encrypted = is_encrypted_rom (s->data, s->size);
+
+	if (s->rd)
+	    romindex_set (s->path, &s->st, s->rd->id);
+	else if (encrypted)
+	    romindex_forget (s->path);
+	else
+	    romindex_set (s->path, &s->st, ROMINDEX_NOROM);
+
+	if (s->rd && s->rd->type == ROMTYPE_KEY) {
+	    char *name = strrchr (s->path, '/');
+	    if (addkey (s->data, s->size, name ? name + 1 : s->path))
+		*keys_added = 1;
+	}
+	/* Add encrypted ROMs even if we don't have the key yet.  */
+	else if (s->rd || encrypted)
+	    romlist_add (s->path, s->rd, loc);
+
+	if (s->plain != s->data)
+	    free (s->plain);
+	free (s->data);
+	free (s->path);
+    }
+    scan_cnt = 0;
+}
+
+/* Reads the file at PATH into the batch, or returns 0 if it's too large
+   to be a ROM.  */
+static int queue_file (const char *path, struct stat *st)
+{
+    struct romscan *s;
+    struct zfile *f;
+    long size;
+
+    f = zfile_open (path, "rb");
+    if (!f)
+	return 1;
+    zfile_fseek (f, 0, SEEK_END);
+    size = zfile_ftell (f);
+
+    /* Weed out too-large files to save time.  */
+    if (size > 1024 * 1024) {
+	zfile_fclose (f);
+	return 0;
+    }
+    s = scan_batch + scan_cnt++;
+    s->path = my_strdup (path);
+    s->st = *st;
+    s->size = size;
+    s->data = (uae_u8*)xmalloc (size > 0 ? size : 1);
+    zfile_fseek (f, 0, SEEK_SET);
+    zfile_fread (s->data, 1, size, f);
+    zfile_fclose (f);
+
+    s->rd = 0;
+    s->plain = s->data;
+    s->plainsize = size;
+    if (is_encrypted_rom (s->data, size))
+	s->plain = decrypt_rom (s->data, size, &s->plainsize);
+    return 1;
+}
+
 void scan_roms (const char *path, int loc)
 {
     DIR *dir;
     int pathlen = strlen (path);
     int bufsz = pathlen + 256;
     char *buffer;
-    uae_u8 *data;
     int keys_added = 0;
+    int nfiles = 0, nindexed = 0;
 
     dir = opendir (path);
     if (!dir)
@@ -639,20 +977,21 @@ void scan_roms (const char *path, int loc)
     buffer = malloc (bufsz);
     if (!buffer)
 	goto out;
-    data = malloc (1024 * 1024);
-    if (!data)
+    scan_batch = malloc (sizeof (struct romscan) * SCAN_BATCH);
+    if (!scan_batch)
 	goto out1;
+    scan_cnt = 0;
     romlist_clear (loc);
+    romindex_load ();
 
     strcpy (buffer, path);
     buffer[pathlen++] = '/';
     buffer[pathlen] = '\0';
     for (;;) {
-	struct zfile *f;
 	struct dirent *ent = readdir (dir);
+	struct romindex_entry *e;
+	struct stat st;
 	int len;
-	struct romdata *rd;
-	long size;
 
 	if (!ent)
 	    break;
@@ -666,39 +1005,35 @@ void scan_roms (const char *path, int loc)
 	    }
 	}
 	strcpy (buffer + pathlen, ent->d_name);
-	f = zfile_open (buffer, "rb");
-	if (!f)
-	    continue;
-
-	zfile_fseek (f, 0, SEEK_END);
-	size = zfile_ftell (f);
-
-	/* Weed out too-large files to save time.  */
-	if (size > 1024 * 1024) {
-	    zfile_fclose (f);
+	if (stat (buffer, &st) != 0 || !S_ISREG (st.st_mode))
 	    continue;
+	nfiles++;
+
+	e = romindex_find (buffer);
+	if (e && e->size == (long)st.st_size && e->mtime == (long)st.st_mtime) {
+	    struct romdata *rd = e->id == ROMINDEX_NOROM ? 0 : getromdatabyid (e->id);
+	    e->seen = 1;
+	    /* Keys are needed for their contents, so read them anyway.  */
+	    if (e->id == ROMINDEX_NOROM || (rd && rd->type != ROMTYPE_KEY)) {
+		if (rd)
+		    romlist_add (buffer, rd, loc);
+		nindexed++;
+		continue;
+	    }
 	}
-	zfile_fseek (f, 0, SEEK_SET);
-	zfile_fread (data, 1, size, f);
-
-	rd = getromdatabydata (data, size);
-	zfile_fclose (f);
-
-	/* Add encrypted ROMs even if we don't have the key yet.  */
-	if (!rd && !is_encrypted_rom (data, size))
-	    continue;
-
-	if (rd && rd->type == ROMTYPE_KEY) {
-	    if (addkey (data, size, ent->d_name))
-		keys_added = 1;
-	} else
-	    romlist_add (buffer, rd, loc);
+	if (!queue_file (buffer, &st))
+	    romindex_set (buffer, &st, ROMINDEX_NOROM);
+	if (scan_cnt == SCAN_BATCH)
+	    flush_batch (loc, &keys_added);
     }
+    flush_batch (loc, &keys_added);
+
     /* Now, if we added any keys, reexamine all encrypted ROMs.  */
     if (keys_added) {
 	int i;
 	for (i = 0; i < romlist_cnt; i++) {
 	    struct romlist *rl = list_of_roms + i;
+	    struct stat st;
 	    if (rl->rd)
 		continue;
 	    struct zfile *f = zfile_open (rl->path, "rb");
@@ -706,12 +1041,21 @@ void scan_roms (const char *path, int loc)
 		continue;
 	    rl->rd = getromdatabyzfile (f);
 	    zfile_fclose (f);
+	    if (rl->rd && stat (rl->path, &st) == 0)
+		romindex_set (rl->path, &st, rl->rd->id);
 	}
     }
     sort_romlist ();
     gui_romlist_changed ();
 
-    free (data);
+    buffer[pathlen] = '\0';
+    romindex_save (buffer);
+    romindex_free ();
+    write_log ("ROM scan of %s: %d files, %d known from the index.\n",
+	       path, nfiles, nindexed);
+
+    free (scan_batch);
+    scan_batch = 0;
   out1:
     free (buffer);
   out:
@@ -17,6 +17,7 @@
 #include "gensound.h"
 #include "sounddep/sound.h"
 #include "threaddep/thread.h"
+#include "metrics.h"
 
 #include <sys/ioctl.h>
 
@@ -51,6 +52,12 @@ static int exact_log2 (int v)
 
 void finish_sound_buffers (void)
 {
+#ifdef SNDCTL_DSP_GETOSPACE
+    audio_buf_info info;
+
+    if (ioctl (sound_fd, SNDCTL_DSP_GETOSPACE, &info) == 0 && info.fragstotal > 0)
+	metrics_sound_fill = 100 - info.bytes * 100 / (info.fragstotal * info.fragsize);
+#endif
     dont_block = currprefs.m68k_speed == -1 && (!regs.stopped || active_fs_packets > 0);
     if (!dont_block) {
 	write (sound_fd, sndbuffer[which_buffer], sndbufsize);
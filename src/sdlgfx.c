@@ -403,15 +403,49 @@ void unlockscr (void)
 	SDL_UnlockSurface (display);
 }
 
+/* The blocks drawn during a frame are collected here and handed to SDL in
+ * one SDL_UpdateRects call by flush_screen, after the surface has been
+ * unlocked.  Blocks at most DIRTY_GAP lines apart are merged, since one
+ * slightly taller update is cheaper than two small ones.  */
+#define MAX_DIRTY_RECTS 64
+#define DIRTY_GAP 4
+
+static SDL_Rect dirty_rects[MAX_DIRTY_RECTS];
+static int n_dirty_rects;
+
+static void flush_dirty_rects (void)
+{
+    if (n_dirty_rects == 0)
+	return;
+    SDL_UpdateRects (display, n_dirty_rects, dirty_rects);
+    n_dirty_rects = 0;
+}
+
 void flush_block (int first_line, int last_line)
 {
+    SDL_Rect *r = dirty_rects + n_dirty_rects - 1;
+
     //    DEBUG_LOG ("Function: flush_block %d %d\n", first_line, last_line);
 
-    SDL_UpdateRect (display, 0, first_line, current_width, last_line - first_line + 1);
+    if (n_dirty_rects > 0 && first_line >= r->y
+	&& first_line <= r->y + r->h + DIRTY_GAP) {
+	if (last_line + 1 - r->y > r->h)
+	    r->h = last_line + 1 - r->y;
+	return;
+    }
+    if (n_dirty_rects == MAX_DIRTY_RECTS)
+	flush_dirty_rects ();
+    r = dirty_rects + n_dirty_rects++;
+    r->x = 0;
+    r->y = first_line;
+    r->w = current_width;
+    r->h = last_line - first_line + 1;
 }
 
 void flush_screen (int first_line, int last_line)
 {
+    flush_dirty_rects ();
+
     if (! (screen->flags & SDL_DOUBLEBUF))
 	return;
 
@@ -623,6 +657,8 @@ void graphics_subshutdown (int final)
 {
     DEBUG_LOG ("Function: graphics_subshutdown\n");
 
+    n_dirty_rects = 0;
+
     if (display && display != screen)
 	SDL_FreeSurface (display);
 
@@ -6,22 +6,33 @@
   * (c) 1996, 1997 Stefan Reinauer <stepan@linux.de>
   * (c) 1997 Christian Schmitt <schmitt@freiburg.linux.de>
   *
+  * The Amiga side is timed by the ev_serial event: a character written to
+  * SERDAT takes as long to shift out as SERPER says, and received ones
+  * arrive at the same rate.  The host side never blocks the emulation.
+  * Characters go through two rings; an I/O thread moves them between the
+  * rings and the endpoint named by serial_port, which can be a tty, a pty,
+  * or a TCP connection made to or accepted from a test harness.
   */
 
+#define _GNU_SOURCE
+
 #include "sysconfig.h"
 #include "sysdeps.h"
 
 #include "options.h"
+#include "threaddep/thread.h"
 #include "uae.h"
 #include "memory.h"
 #include "custom.h"
+#include "events.h"
 #include "newcpu.h"
 #include "cia.h"
+#include "serial.h"
 
 #undef POSIX_SERIAL
 /* Some more or less good way to determine whether we can safely compile in
  * the serial stuff. I'm certain it breaks compilation on some systems. */
-#if defined HAVE_SYS_TERMIOS_H && defined HAVE_POSIX_OPT_H && defined HAVE_SYS_IOCTL_H && defined HAVE_TCGETATTR
+#if defined HAVE_SYS_TERMIOS_H && defined HAVE_SYS_IOCTL_H && defined HAVE_TCGETATTR
 #define POSIX_SERIAL
 #endif
 
@@ -38,132 +49,577 @@
 #undef POSIX_SERIAL
 #endif
 
+#if defined(__unix) && !defined(__BEOS__) && !defined(__DOS__)
+#define SERIAL_SOCKETS
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+/* Where there is poll (), the endpoint is serviced with it, on a thread of
+   its own if we have threads.  Otherwise the emulation tries non-blocking
+   reads and writes every few lines.  */
+#if defined SERIAL_SOCKETS || defined POSIX_SERIAL
+#define SERIAL_POLL
+#include <poll.h>
+#ifdef SUPPORT_THREADS
+#define SERIAL_IO_THREAD
+#endif
+#endif
+
 #ifndef O_NONBLOCK
 #define O_NONBLOCK O_NDELAY
 #endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 #define SERIALDEBUG 1 /* 0, 1, 2 3 */
 #define MODEMTEST   0 /* 0 or 1 */
 
-void serial_open (void);
-void serial_close (void);
-void serial_init (void);
-void serial_exit (void);
-
 void serial_dtr_on (void);
 void serial_dtr_off (void);
 
-void serial_flush_buffer (void);
-static int serial_read (char *buffer);
+static int carrier = 0, dsr = 0, dtr = 0, isbaeh = 0;
+int serstat = -1;
 
-int serial_readstatus (void);
-uae_u16 serial_writestatus (int, int);
+uae_u16 serper = 0, serdat;
 
-uae_u16 SERDATR (void);
+/* Host side.  */
 
-int  SERDATS (void);
-void  SERPER (uae_u16 w);
-void  SERDAT (uae_u16 w);
+enum { SER_CLOSED, SER_TTY, SER_PTY, SER_TCP, SER_TCP_LISTEN };
 
-static char inbuf[1024], outbuf[1024];
-static int inptr, inlast, outlast;
+static int ser_type = SER_CLOSED;
+/* The tty, the pty master or the connected socket; -1 while a listening
+   endpoint waits for a connection.  Only the I/O thread changes it.  */
+static volatile int sd = -1;
+static int listen_sd = -1, pty_slave = -1;
 
-int waitqueue=0,
-    carrier=0,
-    serdev=0,
-    dsr=0,
-    dtr=0,
-    isbaeh=0,
-    doreadser=0,
-    serstat=-1;
+#ifdef POSIX_SERIAL
+static struct termios tios;
+#endif
 
-int sd = -1;
+#define SERIAL_RING_SIZE 65536
 
-#ifdef POSIX_SERIAL
-    struct termios tios;
+/* One producer, one consumer; HEAD and TAIL only ever grow.  */
+struct serial_ring {
+    uae_u8 buf[SERIAL_RING_SIZE];
+    volatile unsigned int head, tail;
+};
+
+static struct serial_ring txring, rxring;
+static unsigned long tx_dropped;
+
+STATIC_INLINE unsigned int ring_used (struct serial_ring *r)
+{
+    return r->head - r->tail;
+}
+
+#ifdef SERIAL_IO_THREAD
+static int wake_pipe[2] = { -1, -1 };
+static volatile int io_quit;
+static uae_thread_id io_tid;
+static int io_running;
+
+static void io_wake (void)
+{
+    char c = 0;
+    if (wake_pipe[1] >= 0)
+	write (wake_pipe[1], &c, 1);
+}
+#else
+#define io_wake() do { } while (0)
 #endif
 
-uae_u16 serper=0,serdat;
+static int ser_write (int fd, const uae_u8 *buf, int len)
+{
+#ifdef SERIAL_SOCKETS
+    if (ser_type == SER_TCP || ser_type == SER_TCP_LISTEN)
+	return send (fd, buf, len, MSG_NOSIGNAL);
+#endif
+    return write (fd, buf, len);
+}
 
-void SERPER (uae_u16 w)
+#ifdef SERIAL_POLL
+static void set_nonblocking (int fd)
 {
-    int baud=0, pspeed;
+    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL, 0) | O_NONBLOCK);
+}
+#endif
 
-    if (!currprefs.use_serial)
+#ifdef SERIAL_SOCKETS
+
+static void set_nodelay (int fd)
+{
+    int one = 1;
+    setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+}
+
+/* SPEC is "host:port", or just "port" for the local host.  */
+static struct addrinfo *lookup (const char *spec, int passive)
+{
+    struct addrinfo hints, *res;
+    char host[256];
+    const char *port = strrchr (spec, ':');
+    int err;
+
+    if (port) {
+	int len = port - spec;
+	if (len >= (int)sizeof host)
+	    len = sizeof host - 1;
+	memcpy (host, spec, len);
+	host[len] = '\0';
+	port++;
+    } else {
+	strcpy (host, "127.0.0.1");
+	port = spec;
+    }
+    memset (&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    err = getaddrinfo (strcmp (host, "*") == 0 ? 0 : host, port, &hints, &res);
+    if (err != 0) {
+	write_log ("Serial: can't resolve %s: %s\n", spec, gai_strerror (err));
+	return 0;
+    }
+    return res;
+}
+
+static int tcp_connect (const char *spec)
+{
+    struct addrinfo *res = lookup (spec, 0), *ai;
+    int fd = -1;
+
+    for (ai = res; ai; ai = ai->ai_next) {
+	fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0)
+	    continue;
+	if (connect (fd, ai->ai_addr, ai->ai_addrlen) == 0)
+	    break;
+	close (fd);
+	fd = -1;
+    }
+    if (res)
+	freeaddrinfo (res);
+    if (fd < 0) {
+	write_log ("Serial: can't connect to %s\n", spec);
+	return -1;
+    }
+    set_nonblocking (fd);
+    set_nodelay (fd);
+    return fd;
+}
+
+static int tcp_listen (const char *spec)
+{
+    struct addrinfo *res = lookup (spec, 1), *ai;
+    int fd = -1, one = 1;
+
+    for (ai = res; ai; ai = ai->ai_next) {
+	fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0)
+	    continue;
+	setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+	if (bind (fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen (fd, 1) == 0)
+	    break;
+	close (fd);
+	fd = -1;
+    }
+    if (res)
+	freeaddrinfo (res);
+    if (fd < 0) {
+	write_log ("Serial: can't listen on %s\n", spec);
+	return -1;
+    }
+    set_nonblocking (fd);
+    write_log ("Serial: waiting for a connection on %s\n", spec);
+    return fd;
+}
+
+static int pty_open (void)
+{
+    int fd = posix_openpt (O_RDWR | O_NOCTTY);
+    char *name;
+
+    if (fd < 0 || grantpt (fd) != 0 || unlockpt (fd) != 0
+	|| (name = ptsname (fd)) == 0)
+    {
+	write_log ("Serial: can't open a pty\n");
+	if (fd >= 0)
+	    close (fd);
+	return -1;
+    }
+    /* Holding the slave open ourselves keeps the master from seeing a
+       hangup whenever nobody else has it open.  */
+    pty_slave = open (name, O_RDWR | O_NOCTTY);
+#ifdef POSIX_SERIAL
+    if (pty_slave >= 0 && tcgetattr (pty_slave, &tios) == 0) {
+	cfmakeraw (&tios);
+	tcsetattr (pty_slave, TCSANOW, &tios);
+    }
+#endif
+    set_nonblocking (fd);
+    write_log ("Serial: the serial port is %s\n", name);
+    return fd;
+}
+
+static void accept_connection (void)
+{
+    int fd = accept (listen_sd, 0, 0);
+
+    if (fd < 0)
 	return;
+    set_nonblocking (fd);
+    set_nodelay (fd);
+    sd = fd;
+    write_log ("Serial: connection accepted\n");
+}
 
-#if defined POSIX_SERIAL
-    if (serper == w)  /* don't set baudrate if it's already ok */
+#endif /* SERIAL_SOCKETS */
+
+/* The other end went away, or the device failed.  A listening endpoint
+   waits for the next connection; anything else stays closed until the
+   port is opened again, like a port with nothing plugged in.  Called on
+   the I/O thread.  */
+static void drop_connection (void)
+{
+    if (ser_type == SER_TCP || ser_type == SER_TCP_LISTEN)
+	write_log ("Serial: connection closed\n");
+    else
+	write_log ("Serial: %s hung up\n", ser_type == SER_PTY ? "the pty" : currprefs.sername);
+    close (sd);
+    sd = -1;
+}
+
+/* Moves characters between the rings and the endpoint, waiting up to
+   TIMEOUT milliseconds for something to do.  */
+static void serial_service (int timeout)
+{
+    int rd, wr;
+#ifdef SERIAL_POLL
+    struct pollfd pfd[3];
+    int n = 0, conn = -1, lst = -1, wk = -1;
+#endif
+
+    /* Without a connection, output goes nowhere, as on a real port with
+       nothing plugged in.  */
+    if (sd < 0)
+	txring.tail = txring.head;
+
+#ifdef SERIAL_POLL
+#ifdef SERIAL_IO_THREAD
+    if (wake_pipe[0] >= 0) {
+	pfd[n].fd = wake_pipe[0];
+	pfd[n].events = POLLIN;
+	wk = n++;
+    }
+#endif
+    if (sd >= 0) {
+	pfd[n].fd = sd;
+	pfd[n].events = 0;
+	if (ring_used (&rxring) < SERIAL_RING_SIZE)
+	    pfd[n].events |= POLLIN;
+	if (ring_used (&txring) > 0)
+	    pfd[n].events |= POLLOUT;
+	/* A hangup is reported whatever we ask for, so with nothing to do,
+	   leave the endpoint out until io_wake says there is.  */
+	if (pfd[n].events)
+	    conn = n++;
+    }
+#ifdef SERIAL_SOCKETS
+    else if (listen_sd >= 0) {
+	pfd[n].fd = listen_sd;
+	pfd[n].events = POLLIN;
+	lst = n++;
+    }
+#endif
+    if (n == 0 || poll (pfd, n, timeout) <= 0)
 	return;
-    serper=w;
-
-    if (w&0x8000)
-	write_log ("SERPER: 9bit transmission not implemented.\n");
-
-    switch (w & 0x7fff) {
-     /* These values should be calculated by the current
-      * color clock value (NTSC/PAL). But this solution is
-      * easy and it works.
-      */
-
-     case 0x2e9b:
-     case 0x2e14: baud=300; pspeed=B300; break;
-     case 0x170a:
-     case 0x0b85: baud=1200; pspeed=B1200; break;
-     case 0x05c2:
-     case 0x05b9: baud=2400; pspeed=B2400; break;
-     case 0x02e9:
-     case 0x02e1: baud=4800; pspeed=B4800; break;
-     case 0x0174:
-     case 0x0170: baud=9600; pspeed=B9600; break;
-     case 0x00b9:
-     case 0x00b8: baud=19200; pspeed=B19200; break;
-     case 0x005c:
-     case 0x005d: baud=38400; pspeed=B38400; break;
-     case 0x003d: baud=57600; pspeed=B57600; break;
-     case 0x001e: baud=115200; pspeed=B115200; break;
-     case 0x000f: baud=230400; pspeed=B230400; break;
-     default:
-	write_log ("SERPER: unsupported baudrate (0x%04x) %d\n",w&0x7fff,
-		 (unsigned int)(3579546.471/(double)((w&0x7fff)+1)));  return;
+
+#ifdef SERIAL_IO_THREAD
+    if (wk >= 0 && (pfd[wk].revents & POLLIN)) {
+	char buf[64];
+	read (wake_pipe[0], buf, sizeof buf);
     }
+#endif
+#ifdef SERIAL_SOCKETS
+    if (lst >= 0 && (pfd[lst].revents & POLLIN))
+	accept_connection ();
+#endif
+    if (conn < 0)
+	return;
+    rd = (pfd[conn].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+    /* After a hangup, POLLOUT may never come; the write will fail.  */
+    wr = (pfd[conn].revents & (POLLOUT | POLLHUP | POLLERR)) != 0
+	&& ring_used (&txring) > 0;
+#else
+    if (sd < 0)
+	return;
+    rd = 1;
+    wr = ring_used (&txring) > 0;
+#endif
 
-    /* Only access hardware when we own it */
-    if (serdev == 1) {
-	if (tcgetattr (sd, &tios) < 0) {
-	    write_log ("SERPER: TCGETATTR failed\n");
-	    return;
+    if (rd) {
+	unsigned int used = ring_used (&rxring);
+	unsigned int start = rxring.head % SERIAL_RING_SIZE;
+	int len = SERIAL_RING_SIZE - used;
+	int got;
+
+	if (len > SERIAL_RING_SIZE - (int)start)
+	    len = SERIAL_RING_SIZE - start;
+	got = len > 0 ? read (sd, rxring.buf + start, len) : -1;
+	if (got > 0) {
+	    __sync_synchronize ();
+	    rxring.head += got;
+	} else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+	    if (len > 0) {
+		drop_connection ();
+		return;
+	    }
 	}
+    }
+    if (wr) {
+	unsigned int used = ring_used (&txring);
+	unsigned int start = txring.tail % SERIAL_RING_SIZE;
+	int len = used, put;
+
+	if (len > SERIAL_RING_SIZE - (int)start)
+	    len = SERIAL_RING_SIZE - start;
+	put = ser_write (sd, txring.buf + start, len);
+	if (put > 0) {
+	    __sync_synchronize ();
+	    txring.tail += put;
+	} else if (put < 0 && errno != EAGAIN && errno != EINTR)
+	    drop_connection ();
+    }
+}
 
-	if (cfsetispeed (&tios, pspeed) < 0) {    /* set serial input speed */
-	    write_log ("SERPER: CFSETISPEED (%d bps) failed\n", baud);
-	    return;
-	}
-	if (cfsetospeed (&tios, pspeed) < 0) {    /* set serial output speed */
-	    write_log ("SERPER: CFSETOSPEED (%d bps) failed\n", baud);
-	    return;
-	}
+#ifdef SERIAL_IO_THREAD
+static void *serial_io_thread (void *arg)
+{
+    while (! io_quit)
+	serial_service (-1);
+    return 0;
+}
+#endif
+
+/* Amiga side.  */
+
+static unsigned long bit_cycles = CYCLE_UNIT;
+static int tx_busy, tx_buffered, rx_busy, rx_waiting;
+static uae_u16 tx_shift, tx_buffer;
+static uae_u8 rx_char;
+static unsigned long tx_due, rx_due;
+
+static unsigned long color_clock (void)
+{
+    return currprefs.ntscmode ? 3579545 : 3546895;
+}
+
+static void serial_schedule (void)
+{
+    unsigned long due = 0;
+    int active = 0;
+
+    if (tx_busy) {
+	due = tx_due;
+	active = 1;
+    }
+    if (rx_busy && (! active || (long int)(rx_due - due) < 0)) {
+	due = rx_due;
+	active = 1;
+    }
+    eventtab[ev_serial].active = active;
+    if (active) {
+	eventtab[ev_serial].oldcycles = get_cycles ();
+	eventtab[ev_serial].evtime = due;
+    }
+    events_schedule ();
+}
+
+/* The start bit, and everything up to and including the last stop bit.  */
+static int frame_bits (uae_u16 w)
+{
+    int n = 10;
+
+    w &= 0x3ff;
+    if (w) {
+	for (n = 1; w; n++)
+	    w >>= 1;
+    }
+    return n;
+}
+
+static void tx_start (uae_u16 w)
+{
+    tx_shift = w;
+    tx_busy = 1;
+    tx_due = get_cycles () + frame_bits (w) * bit_cycles;
+    serdat &= ~0x1000;
+    serdat |= 0x2000;
+    INTREQ (0x8001);
+}
 
-	if (tcsetattr (sd, TCSADRAIN, &tios) < 0) {
-	    write_log ("SERPER: TCSETATTR failed\n");
-	    return;
+static void tx_done (void)
+{
+    if (ring_used (&txring) < SERIAL_RING_SIZE) {
+	unsigned int was = ring_used (&txring);
+	txring.buf[txring.head % SERIAL_RING_SIZE] = (uae_u8)tx_shift;
+	__sync_synchronize ();
+	txring.head++;
+	if (was == 0)
+	    io_wake ();
+    } else if (tx_dropped++ == 0)
+	write_log ("Serial: output buffer full, dropping characters.\n");
+
+#if SERIALDEBUG > 2
+    write_log ("SERDAT: sent 0x%04x\n", tx_shift);
+#endif
+    tx_busy = 0;
+    if (tx_buffered) {
+	tx_buffered = 0;
+	tx_start (tx_buffer);
+    } else
+	serdat |= 0x1000;
+}
+
+static void rx_start (void)
+{
+    int full = ring_used (&rxring) == SERIAL_RING_SIZE;
+
+    rx_char = rxring.buf[rxring.tail % SERIAL_RING_SIZE];
+    __sync_synchronize ();
+    rxring.tail++;
+    if (full)
+	io_wake ();
+    rx_busy = 1;
+    rx_due = get_cycles () + ((serper & 0x8000) ? 11 : 10) * bit_cycles;
+}
+
+/* SERDATR only takes the next character once the last one's RBF has been
+   cleared; until then, it waits in the shift register.  Software that
+   doesn't keep up slows the sender down instead of losing characters.  */
+static void rx_deliver (void)
+{
+    rx_waiting = 0;
+    serdat &= 0x3000;
+    serdat |= 0x4000 | ((serper & 0x8000) ? 0x0200 : 0x0100) | rx_char;
+    INTREQ (0x8800);
+
+#if SERIALDEBUG > 1
+    write_log ("SERDATR: received 0x%02x --> serdat==0x%04x\n",
+	       (unsigned int)rx_char, (unsigned int)serdat);
+#endif
+    if (ring_used (&rxring) > 0)
+	rx_start ();
+}
+
+static void rx_done (void)
+{
+    rx_busy = 0;
+    if (serdat & 0x4000)
+	rx_waiting = 1;
+    else
+	rx_deliver ();
+}
+
+void serial_handler (void)
+{
+    unsigned long now = get_cycles ();
+
+    if (tx_busy && (long int)(now - tx_due) >= 0)
+	tx_done ();
+    if (rx_busy && (long int)(now - rx_due) >= 0)
+	rx_done ();
+    serial_schedule ();
+}
+
+void serial_hsync (void)
+{
+#ifndef SERIAL_IO_THREAD
+    static int count;
+    if ((++count & 7) == 0)
+	serial_service (0);
+#endif
+    if (rx_waiting) {
+	if (! (serdat & 0x4000)) {
+	    rx_deliver ();
+	    serial_schedule ();
 	}
+    } else if (! rx_busy && ring_used (&rxring) > 0) {
+	rx_start ();
+	serial_schedule ();
+    }
+}
+
+void serial_reset (void)
+{
+    tx_busy = tx_buffered = rx_busy = rx_waiting = 0;
+    serdat = 0x3000;
+}
+
+#ifdef POSIX_SERIAL
+static void set_tty_speed (unsigned int baud)
+{
+    static const struct { unsigned int baud; speed_t speed; } speeds[] = {
+	{ 300, B300 }, { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 },
+	{ 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+	{ 115200, B115200 }, { 230400, B230400 }, { 0, 0 }
+    };
+    int i, best = 0;
+
+    /* The closest rate the host has.  */
+    for (i = 1; speeds[i].baud; i++)
+	if (abs ((int)speeds[i].baud - (int)baud) < abs ((int)speeds[best].baud - (int)baud))
+	    best = i;
+
+    if (tcgetattr (sd, &tios) < 0) {
+	write_log ("SERPER: TCGETATTR failed\n");
+	return;
+    }
+    if (cfsetispeed (&tios, speeds[best].speed) < 0) {	/* set serial input speed */
+	write_log ("SERPER: CFSETISPEED (%d bps) failed\n", speeds[best].baud);
+	return;
+    }
+    if (cfsetospeed (&tios, speeds[best].speed) < 0) {	/* set serial output speed */
+	write_log ("SERPER: CFSETOSPEED (%d bps) failed\n", speeds[best].baud);
+	return;
+    }
+    if (tcsetattr (sd, TCSADRAIN, &tios) < 0) {
+	write_log ("SERPER: TCSETATTR failed\n");
+	return;
     }
+}
+#endif
+
+void SERPER (uae_u16 w)
+{
+    unsigned int baud;
+
+    if (!currprefs.use_serial)
+	return;
+
+    if (serper == w)  /* don't set baudrate if it's already ok */
+	return;
+    serper = w;
+    bit_cycles = ((w & 0x7fff) + 1) * CYCLE_UNIT;
+    baud = color_clock () / ((w & 0x7fff) + 1);
+
+#ifdef POSIX_SERIAL
+    /* Only access hardware when we own it */
+    if (ser_type == SER_TTY)
+	set_tty_speed (baud);
 #endif
 
 #if SERIALDEBUG > 0
-    if (serdev == 1)
+    if (ser_type != SER_CLOSED)
 	write_log ("SERPER: baudrate set to %d bit/sec\n", baud);
 #endif
 }
 
 /* Not (fully) implemented yet:
- *
- *  -  Something's wrong with the Interrupts.
- *     (NComm works, TERM does not. TERM switches to a
- *     blind mode after a connect and wait's for the end
- *     of an asynchronous read before switching blind
- *     mode off again. It never gets there on UAE :-< )
  *
  *  -  RTS/CTS handshake, this is not really neccessary,
  *     because you can use RTS/CTS "outside" without
@@ -175,32 +631,30 @@ void SERPER (uae_u16 w)
 
 void SERDAT (uae_u16 w)
 {
-    unsigned char z;
-
     if (!currprefs.use_serial)
 	return;
 
-    z = (unsigned char)(w&0xff);
-
     if (currprefs.serial_demand && !dtr) {
 	if (!isbaeh) {
 	    write_log ("SERDAT: Baeh.. Your software needs SERIAL_ALWAYS to work properly.\n");
 	    isbaeh=1;
 	}
 	return;
-    } else {
-	outbuf[outlast++] = z;
-	if (outlast == sizeof outbuf)
-	    serial_flush_buffer();
     }
 
 #if SERIALDEBUG > 2
     write_log ("SERDAT: wrote 0x%04x\n", w);
 #endif
 
-    serdat|=0x2000; /* Set TBE in the SERDATR ... */
-    intreq|=1;      /* ... and in INTREQ register */
-    return;
+    if (! tx_busy) {
+	tx_start (w);
+	serial_schedule ();
+    } else {
+	/* The shift register is busy; hold it in the buffer.  */
+	tx_buffer = w;
+	tx_buffered = 1;
+	serdat &= ~0x2000;
+    }
 }
 
 uae_u16 SERDATR (void)
@@ -210,37 +664,9 @@ uae_u16 SERDATR (void)
 #if SERIALDEBUG > 2
     write_log ("SERDATR: read 0x%04x\n", serdat);
 #endif
-    waitqueue = 0;
     return serdat;
 }
 
-int SERDATS (void)
-{
-    unsigned char z;
-
-    if (!serdev)           /* || (serdat&0x4000)) */
-	return 0;
-
-    if (waitqueue == 1) {
-	intreq |= 0x0800;
-	return 1;
-    }
-
-    if ((serial_read ((char *)&z)) == 1) {
-	waitqueue = 1;
-	serdat = 0x4100; /* RBF and STP set! */
-	serdat |= ((unsigned int)z) & 0xff;
-	intreq |= 0x0800; /* Set RBF flag (Receive Buffer full) */
-
-#if SERIALDEBUG > 1
-	write_log ("SERDATS: received 0x%02x --> serdat==0x%04x\n",
-		 (unsigned int)z, (unsigned int)serdat);
-#endif
-	return 1;
-    }
-    return 0;
-}
-
 void serial_dtr_on(void)
 {
 #if SERIALDEBUG > 0
@@ -262,51 +688,29 @@ void serial_dtr_off(void)
 	serial_close ();
 }
 
-static int serial_read (char *buffer)
-{
-    if (inptr < inlast) {
-	*buffer = inbuf[inptr++];
-	return 1;
-    }
-
-    if (serdev == 1) {
-	inlast = read (sd, inbuf, sizeof inbuf);
-	inptr = 0;
-	if (inptr < inlast) {
-	    *buffer = inbuf[inptr++];
-	    return 1;
-	}
-    }
-
-    return 0;
-}
-
+/* Without an I/O thread, the emulation services the endpoint itself, in
+   serial_hsync and once a frame here.  */
 void serial_flush_buffer(void)
 {
-    if (serdev == 1) {
-	if (outlast) {
-	    if (sd != 0) {
-		write (sd, outbuf, outlast);
-	    }
-	}
-	outlast = 0;
-    } else {
-      outlast = 0;
-      inptr = 0;
-      inlast = 0;
-    }
+#ifndef SERIAL_IO_THREAD
+    serial_service (0);
+#endif
 }
 
-int serial_readstatus(void)
+/* Shows carrier and DSR on the CIA-B port A bits in PRA.  */
+int serial_readstatus(unsigned int *pra)
 {
     int status = 0;
 
 #ifdef POSIX_SERIAL
-    ioctl (sd, TIOCMGET, &status);
+    if (ser_type == SER_TTY)
+	ioctl (sd, TIOCMGET, &status);
+    else if (sd >= 0)
+	status = TIOCM_CAR | TIOCM_DSR;
 
     if (status & TIOCM_CAR) {
 	if (!carrier) {
-	    ciabpra |= 0x20; /* Push up Carrier Detect line */
+	    *pra |= 0x20; /* Push up Carrier Detect line */
 	    carrier = 1;
 #if SERIALDEBUG > 0
 	    write_log ("Carrier detect.\n");
@@ -314,7 +718,7 @@ int serial_readstatus(void)
 	}
     } else {
 	if (carrier) {
-	    ciabpra &= ~0x20;
+	    *pra &= ~0x20;
 	    carrier = 0;
 #if SERIALDEBUG > 0
 	    write_log ("Carrier lost.\n");
@@ -324,12 +728,12 @@ int serial_readstatus(void)
 
     if (status & TIOCM_DSR) {
 	if (!dsr) {
-	    ciabpra |= 0x08; /* DSR ON */
+	    *pra |= 0x08; /* DSR ON */
 	    dsr = 1;
 	}
     } else {
 	if (dsr) {
-	    ciabpra &= ~0x08;
+	    *pra &= ~0x08;
 	    dsr = 0;
 	}
     }
@@ -353,43 +757,110 @@ uae_u16 serial_writestatus (int old, int nw)
     return nw; /* This value could also be changed here */
 }
 
-void serial_open(void)
+static int tty_open (const char *name)
 {
-    if (serdev == 1)
-	return;
+    int fd;
 
-    if ((sd = open (currprefs.sername, O_RDWR|O_NONBLOCK|O_BINARY, 0)) < 0) {
-	write_log ("Error: Could not open Device %s\n", currprefs.sername);
-	return;
+    if ((fd = open (name, O_RDWR|O_NONBLOCK|O_BINARY, 0)) < 0) {
+	write_log ("Error: Could not open Device %s\n", name);
+	return -1;
     }
 
-    serdev = 1;
-
 #ifdef POSIX_SERIAL
-    if (tcgetattr (sd, &tios) < 0) {		/* Initialize Serial tty */
+    if (tcgetattr (fd, &tios) < 0) {		/* Initialize Serial tty */
 	write_log ("Serial: TCGETATTR failed\n");
-	return;
+	return fd;
     }
     cfmakeraw (&tios);
 
-#ifndef MODEMTEST
+#if !MODEMTEST
     tios.c_cflag &= ~CRTSCTS; /* Disable RTS/CTS */
 #else
     tios.c_cflag |= CRTSCTS; /* Enabled for testing modems */
 #endif
 
-    if (tcsetattr (sd, TCSADRAIN, &tios) < 0) {
+    if (tcsetattr (fd, TCSADRAIN, &tios) < 0)
 	write_log ("Serial: TCSETATTR failed\n");
+#endif
+    return fd;
+}
+
+void serial_open(void)
+{
+    const char *name = currprefs.sername;
+    int fd = -1;
+
+    if (ser_type != SER_CLOSED)
 	return;
+
+    txring.head = txring.tail = 0;
+    rxring.head = rxring.tail = 0;
+    tx_dropped = 0;
+
+#ifdef SERIAL_SOCKETS
+    if (strcmp (name, "pty") == 0) {
+	if ((fd = pty_open ()) >= 0)
+	    ser_type = SER_PTY;
+    } else if (strncmp (name, "tcp-listen:", 11) == 0) {
+	if ((listen_sd = tcp_listen (name + 11)) >= 0)
+	    ser_type = SER_TCP_LISTEN;
+    } else if (strncmp (name, "tcp:", 4) == 0) {
+	if ((fd = tcp_connect (name + 4)) >= 0)
+	    ser_type = SER_TCP;
+    } else
+#endif
+    if ((fd = tty_open (name)) >= 0)
+	ser_type = SER_TTY;
+
+    if (ser_type == SER_CLOSED)
+	return;
+    sd = fd;
+    if (ser_type == SER_TTY && serper != 0) {
+#ifdef POSIX_SERIAL
+	set_tty_speed (color_clock () / ((serper & 0x7fff) + 1));
+#endif
+    }
+
+#ifdef SERIAL_IO_THREAD
+    if (pipe (wake_pipe) == 0) {
+	set_nonblocking (wake_pipe[0]);
+	set_nonblocking (wake_pipe[1]);
+	io_quit = 0;
+	io_running = uae_start_thread (serial_io_thread, 0, &io_tid) == 0;
     }
+    if (! io_running)
+	write_log ("Serial: can't start the I/O thread.\n");
 #endif
 }
 
 void serial_close (void)
 {
+#ifdef SERIAL_IO_THREAD
+    if (io_running) {
+	io_quit = 1;
+	io_wake ();
+	uae_wait_thread (io_tid);
+	io_running = 0;
+    }
+    if (wake_pipe[0] >= 0) {
+	close (wake_pipe[0]);
+	close (wake_pipe[1]);
+	wake_pipe[0] = wake_pipe[1] = -1;
+    }
+#endif
     if (sd >= 0)
 	close (sd);
-    serdev = 0;
+    if (listen_sd >= 0)
+	close (listen_sd);
+    if (pty_slave >= 0)
+	close (pty_slave);
+    sd = listen_sd = pty_slave = -1;
+    ser_type = SER_CLOSED;
+}
+
+int serial_is_open (void)
+{
+    return ser_type != SER_CLOSED;
 }
 
 void serial_init (void)
@@ -400,7 +871,7 @@ void serial_init (void)
     if (!currprefs.serial_demand)
 	serial_open ();
 
-    serdat = 0x2000;
+    serial_reset ();
     return;
 }
 
@@ -17,6 +17,12 @@ typedef int uae_sem_t;
 #define uae_sem_trywait(a) 0
 #define uae_sem_getvalue(a,b) 0
 
+/* Nobody can wake us up, so just sleep.  */
+typedef int uae_wakeup_t;
+#define uae_wakeup_init(a)
+#define uae_wakeup_post(a)
+#define uae_wakeup_wait(a,usecs) (usleep (usecs), 0)
+
 typedef int smp_comm_pipe;
 #define write_comm_pipe_int(a,b,c)
 #define read_comm_pipe_int_blocking(a) 0
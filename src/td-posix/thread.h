@@ -19,6 +19,49 @@ typedef sem_t uae_sem_t;
 #define uae_sem_trywait sem_trywait
 #define uae_sem_getvalue sem_getvalue
 
+/* A condition variable, used to sleep with a timeout until another thread
+ * wakes us up. */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int posted;
+} uae_wakeup_t;
+
+STATIC_INLINE void uae_wakeup_init (uae_wakeup_t *w)
+{
+    pthread_mutex_init (&w->lock, 0);
+    pthread_cond_init (&w->cond, 0);
+    w->posted = 0;
+}
+
+STATIC_INLINE void uae_wakeup_post (uae_wakeup_t *w)
+{
+    pthread_mutex_lock (&w->lock);
+    w->posted = 1;
+    pthread_cond_signal (&w->cond);
+    pthread_mutex_unlock (&w->lock);
+}
+
+/* Returns nonzero if we were woken up before USECS microseconds passed. */
+STATIC_INLINE int uae_wakeup_wait (uae_wakeup_t *w, long usecs)
+{
+    struct timeval tv;
+    struct timespec ts;
+    int posted;
+
+    gettimeofday (&tv, 0);
+    tv.tv_usec += usecs;
+    ts.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+    ts.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+    pthread_mutex_lock (&w->lock);
+    while (!w->posted && pthread_cond_timedwait (&w->cond, &w->lock, &ts) == 0)
+	;
+    posted = w->posted;
+    w->posted = 0;
+    pthread_mutex_unlock (&w->lock);
+    return posted;
+}
+
 #include "commpipe.h"
 
 typedef pthread_t uae_thread_id;
@@ -22,6 +22,43 @@ typedef SDL_sem *uae_sem_t;
 #define uae_sem_trywait(PSEM) SDL_SemTryWait (*PSEM)
 #define uae_sem_getvalue(PSEM) SDL_SemValue (*PSEM)
 
+/* A condition variable, used to sleep with a timeout until another thread
+ * wakes us up. */
+typedef struct {
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    int posted;
+} uae_wakeup_t;
+
+STATIC_INLINE void uae_wakeup_init (uae_wakeup_t *w)
+{
+    w->lock = SDL_CreateMutex ();
+    w->cond = SDL_CreateCond ();
+    w->posted = 0;
+}
+
+STATIC_INLINE void uae_wakeup_post (uae_wakeup_t *w)
+{
+    SDL_mutexP (w->lock);
+    w->posted = 1;
+    SDL_CondSignal (w->cond);
+    SDL_mutexV (w->lock);
+}
+
+/* Returns nonzero if we were woken up before USECS microseconds passed. */
+STATIC_INLINE int uae_wakeup_wait (uae_wakeup_t *w, long usecs)
+{
+    int posted;
+
+    SDL_mutexP (w->lock);
+    if (!w->posted)
+	SDL_CondWaitTimeout (w->cond, w->lock, (usecs + 999) / 1000);
+    posted = w->posted;
+    w->posted = 0;
+    SDL_mutexV (w->lock);
+    return posted;
+}
+
 #include "commpipe.h"
 
 typedef SDL_Thread *uae_thread_id;
@@ -0,0 +1,615 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Differential test of the generated CPU core
+  *
+  * Runs random code through the 68020 handlers from cpuemu.c, against a
+  * flat 64 KB memory that is mirrored over the whole address space, and
+  * prints a checksum of the registers, flags and memory for every case.
+  * The Makefile builds it twice with the md-generic flags code: once with
+  * LAZY_FLAGS and once without, where the handlers compute every flag
+  * straight away.  Both must print the same.  With -p, the fused handlers
+  * for frequent pairs are installed as well, and the output must still be
+  * the same as without them.  -t runs the loop the CPU thread uses
+  * instead, where a fused handler must stop when an interrupt comes in but
+  * doesn't look at events; here, an interrupt comes every few data
+  * accesses.  -f runs FPU instructions instead, one at a time, with their
+  * registers and FPSR looked at after each; -r with it puts back the
+  * handlers that passed every FPP and FBcc straight to fpp_opp and
+  * fbcc_opp, so the two must print the same.
+  *
+  * Nothing here needs to be correct 68k behaviour, only the same in all
+  * runs: exceptions just note their number and carry on at a random
+  * address, and the supervisor stack is never switched.  The registers and
+  * flags are only looked at in events, which come every few instructions
+  * as they would in the main loop, and at exceptions.  So lazy flags stay
+  * pending across most instruction boundaries, and a fused handler has to
+  * stop at an event just like the main loop.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "memory.h"
+#include "custom.h"
+#include "events.h"
+#include "newcpu.h"
+#include "metrics.h"
+#include "cputhread.h"
+#include "savestate.h"
+#include "fpp.h"
+#include "cputbl.h"
+
+#define MEM_SIZE 0x10000
+#define MEM_MASK (MEM_SIZE - 1)
+/* Instruction fetches go through a host pointer and may run this far past
+ * the end of memory, so the start is mirrored there.  */
+#define MEM_SLACK 64
+
+#define CASES 400
+#define EVENTS 2000
+/* Up to how far apart events are.  */
+#define EVENT_GAP (40 * CYCLE_UNIT)
+#define PLANTED_PAIRS 2048
+/* With -t, up to how many data accesses apart interrupts are.  */
+#define ACCESS_GAP 20
+/* Instructions without an interrupt after which a -t case is taken to be
+ * stuck in a loop that never touches memory.  */
+#define STUCK_INSNS 1000000
+/* Instructions in an -f case.  */
+#define FPU_INSNS 2000
+
+struct regstruct regs, lastint_regs;
+struct uae_prefs currprefs, changed_prefs;
+cpuop_func *cpufunctbl[65536];
+addrbank *mem_banks[65536];
+int mmu_enabled;
+struct mmu_atcset mmu_atc[2], *mmu_atc_cur = mmu_atc;
+uae_u8 mmu_pc_none[MMU_MAXINSN];
+#ifdef NATMEM
+uae_u8 *natmem_offset;
+#endif
+
+/* What superinsn_continue looks at.  */
+unsigned long currcycle, nextevent;
+unsigned long cycles_mask = 0xFFFFFFFF, cycles_val;
+int is_lastline;
+volatile int delaying_for_sound;
+uae_u64 metrics_count[METRIC_MAX];
+volatile int cputhread_running;
+volatile unsigned long cputhread_cpu_clock, cputhread_chip_clock;
+unsigned long cputhread_lead;
+
+const int areg_byteinc[] = { 1,1,1,1,1,1,1,2 };
+const int imm8_table[] = { 8,1,2,3,4,5,6,7 };
+int movem_index1[256], movem_index2[256], movem_next[256];
+int fpp_movem_index1[256], fpp_movem_index2[256], fpp_movem_next[256];
+
+static uae_u8 mem[MEM_SIZE + MEM_SLACK];
+static uae_u32 sum;
+static uae_u32 seed;
+static int npairs;
+/* Data accesses until the next interrupt, with -t.  */
+static int countdown;
+
+static uae_u32 rnd (void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void add_sum (uae_u32 v)
+{
+    sum = (sum ^ v) * 16777619;
+}
+
+static void add_flags (void)
+{
+    add_sum (GET_XFLG | GET_NFLG << 1 | GET_ZFLG << 2 | GET_VFLG << 3 | GET_CFLG << 4);
+}
+
+static void add_regs (void)
+{
+    int i;
+    for (i = 0; i < 16; i++)
+	add_sum (regs.regs[i]);
+    add_sum (m68k_getpc ());
+}
+
+void write_log_standard (const char *fmt, ...)
+{
+}
+
+void *xmalloc (size_t n)
+{
+    return malloc (n);
+}
+
+/* Memory.  */
+
+static void tick (void)
+{
+    if (countdown > 0 && --countdown == 0)
+	regs.spcflags |= SPCFLAG_INT;
+}
+
+static void mem_put (uaecptr addr, uae_u8 b)
+{
+    addr &= MEM_MASK;
+    mem[addr] = b;
+    if (addr < MEM_SLACK)
+	mem[MEM_SIZE + addr] = b;
+}
+
+static uae_u32 flat_lget (uaecptr a) { tick (); return mem[a & MEM_MASK] << 24 | mem[(a + 1) & MEM_MASK] << 16 | mem[(a + 2) & MEM_MASK] << 8 | mem[(a + 3) & MEM_MASK]; }
+static uae_u32 flat_wget (uaecptr a) { tick (); return mem[a & MEM_MASK] << 8 | mem[(a + 1) & MEM_MASK]; }
+static uae_u32 flat_bget (uaecptr a) { tick (); return mem[a & MEM_MASK]; }
+static void flat_lput (uaecptr a, uae_u32 v) { tick (); mem_put (a, v >> 24); mem_put (a + 1, v >> 16); mem_put (a + 2, v >> 8); mem_put (a + 3, v); }
+static void flat_wput (uaecptr a, uae_u32 v) { tick (); mem_put (a, v >> 8); mem_put (a + 1, v); }
+static void flat_bput (uaecptr a, uae_u32 v) { tick (); mem_put (a, v); }
+static uae_u8 *flat_xlate (uaecptr a) { return mem + (a & MEM_MASK); }
+static int flat_check (uaecptr a, uae_u32 size) { return 1; }
+
+static addrbank flat_bank = {
+    flat_lget, flat_wget, flat_bget,
+    flat_lput, flat_wput, flat_bput,
+    flat_xlate, flat_check, 0, "flat", ABFLAG_RAM
+};
+
+/* The parts of newcpu.c the handlers call.  */
+
+void Exception (int nr, uaecptr oldpc)
+{
+    add_sum (0x10000 + nr);
+    add_regs ();
+    add_flags ();
+    m68k_setpc (rnd () & MEM_MASK & ~1);
+}
+
+unsigned long op_illg (uae_u32 opcode)
+{
+    Exception (4, 0);
+    return 4;
+}
+
+static unsigned long op_illg_1 (uae_u32 opcode)
+{
+    return op_illg (opcode);
+}
+
+void exception3 (uae_u32 opcode, uaecptr addr, uaecptr fault) { Exception (3, 0); }
+void exception3i (uae_u32 opcode, uaecptr addr, uaecptr fault) { Exception (3, 0); }
+void cpureset (void) { add_sum (0x20000); }
+int m68k_move2c (int regno, uae_u32 *r) { op_illg (0); return 0; }
+int m68k_movec2 (int regno, uae_u32 *r) { op_illg (0); return 0; }
+void m68k_divl (uae_u32 opcode, uae_u32 src, uae_u16 extra, uaecptr oldpc) { op_illg (0); }
+void m68k_mull (uae_u32 opcode, uae_u32 src, uae_u16 extra) { op_illg (0); }
+void mmu_op (uae_u32 opcode, uae_u16 extra) { op_illg (0); }
+void mmu_op30 (uaecptr pc, uae_u32 opcode, int isf, uae_u16 extra, uaecptr extraa) { op_illg (0); }
+
+/* What fpp.c needs for save states, which aren't used here.  */
+void save_u16_func (uae_u8 **dst, uae_u16 v) { }
+void save_u32_func (uae_u8 **dst, uae_u32 v) { }
+uae_u16 restore_u16_func (const uae_u8 **src) { return 0; }
+uae_u32 restore_u32_func (const uae_u8 **src) { return 0; }
+
+uae_u32 get_disp_ea_020 (uae_u32 base, uae_u32 dp)
+{
+    int reg = (dp >> 12) & 15;
+    uae_s32 regd = regs.regs[reg];
+    if ((dp & 0x800) == 0)
+	regd = (uae_s32)(uae_s16)regd;
+    regd <<= (dp >> 9) & 3;
+    if (dp & 0x100) {
+	uae_s32 outer = 0;
+	if (dp & 0x80) base = 0;
+	if (dp & 0x40) regd = 0;
+
+	if ((dp & 0x30) == 0x20) base += (uae_s32)(uae_s16)next_iword();
+	if ((dp & 0x30) == 0x30) base += next_ilong();
+
+	if ((dp & 0x3) == 0x2) outer = (uae_s32)(uae_s16)next_iword();
+	if ((dp & 0x3) == 0x3) outer = next_ilong();
+
+	if ((dp & 0x4) == 0) base += regd;
+	if (dp & 0x3) base = get_long (base);
+	if (dp & 0x4) base += regd;
+
+	return base + outer;
+    } else {
+	return base + (uae_s32)((uae_s8)dp) + regd;
+    }
+}
+
+uae_u32 get_disp_ea_000 (uae_u32 base, uae_u32 dp)
+{
+    int reg = (dp >> 12) & 15;
+    uae_s32 regd = regs.regs[reg];
+    if ((dp & 0x800) == 0)
+	regd = (uae_s32)(uae_s16)regd;
+    return base + (uae_s8)dp + regd;
+}
+
+void MakeSR (void)
+{
+    regs.sr = ((regs.t1 << 15) | (regs.t0 << 14)
+	       | (regs.s << 13) | (regs.m << 12) | (regs.intmask << 8)
+	       | (GET_XFLG << 4) | (GET_NFLG << 3) | (GET_ZFLG << 2) | (GET_VFLG << 1)
+	       | GET_CFLG);
+}
+
+void MakeFromSR (void)
+{
+    regs.t1 = (regs.sr >> 15) & 1;
+    regs.t0 = (regs.sr >> 14) & 1;
+    regs.s = (regs.sr >> 13) & 1;
+    regs.m = (regs.sr >> 12) & 1;
+    regs.intmask = (regs.sr >> 8) & 7;
+    SET_XFLG ((regs.sr >> 4) & 1);
+    SET_NFLG ((regs.sr >> 3) & 1);
+    SET_ZFLG ((regs.sr >> 2) & 1);
+    SET_VFLG ((regs.sr >> 1) & 1);
+    SET_CFLG (regs.sr & 1);
+}
+
+/* As build_cpufunctbl does it for a 68020, without the extras.  */
+static void build_table (int pairs)
+{
+    const struct cputbl *tbl = op_smalltbl_3_ff;
+    int i;
+    unsigned long opcode;
+
+    for (opcode = 0; opcode < 65536; opcode++)
+	cpufunctbl[opcode] = op_illg_1;
+    for (i = 0; tbl[i].handler != NULL; i++)
+	if (! tbl[i].specific)
+	    cpufunctbl[tbl[i].opcode] = tbl[i].handler;
+    for (opcode = 0; opcode < 65536; opcode++) {
+	if (table68k[opcode].mnemo == i_ILLG || table68k[opcode].clev > 2)
+	    continue;
+	if (table68k[opcode].handler != -1)
+	    cpufunctbl[opcode] = cpufunctbl[table68k[opcode].handler];
+    }
+    for (i = 0; tbl[i].handler != NULL; i++)
+	if (tbl[i].specific)
+	    cpufunctbl[tbl[i].opcode] = tbl[i].handler;
+    while (op_pairtbl_3_ff[npairs].handler != NULL)
+	npairs++;
+    if (! pairs)
+	return;
+
+    /* As install_pairs.  */
+    if (npairs == 0) {
+	fprintf (stderr, "cputest: no fused handlers to test\n");
+	exit (1);
+    }
+    for (i = 0; i < npairs; i++) {
+	const struct cpupairtbl *p = op_pairtbl_3_ff + i;
+	for (opcode = 0; opcode < 65536; opcode++)
+	    if (cpufunctbl[opcode] == p->first
+		&& (opcode == p->opcode || table68k[opcode].handler == p->opcode))
+		cpufunctbl[opcode] = p->handler;
+    }
+}
+
+/* The FPP and FBcc handlers as gencpu made them before it did the common
+ * operations and conditions inline.  */
+static unsigned long ref_fpp (uae_u32 opcode)
+{
+    uae_s16 extra = get_iword (2);
+    m68k_incpc (4);
+    fpp_opp (opcode, extra);
+    return 4;
+}
+
+static unsigned long ref_fbcc (uae_u32 opcode)
+{
+    uaecptr pc;
+    uae_u32 extra;
+
+    m68k_incpc (2);
+    pc = m68k_getpc ();
+    if (opcode & 0x40) {
+	extra = get_ilong (0);
+	m68k_incpc (4);
+    } else {
+	extra = (uae_s32)(uae_s16)get_iword (0);
+	m68k_incpc (2);
+    }
+    fbcc_opp (opcode, pc, extra);
+    return 4;
+}
+
+static void install_reference (void)
+{
+    unsigned long opcode;
+
+    for (opcode = 0; opcode < 65536; opcode++) {
+	if (cpufunctbl[opcode] == op_illg_1)
+	    continue;
+	if (table68k[opcode].mnemo == i_FPP)
+	    cpufunctbl[opcode] = ref_fpp;
+	else if (table68k[opcode].mnemo == i_FBcc)
+	    cpufunctbl[opcode] = ref_fbcc;
+    }
+}
+
+static void init (int pairs)
+{
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+	for (j = 0; j < 8; j++)
+	    if (i & (1 << j))
+		break;
+	movem_index1[i] = j;
+	movem_index2[i] = 7 - j;
+	movem_next[i] = i & ~(1 << j);
+	fpp_movem_index1[i] = 7 - j;
+	fpp_movem_index2[i] = j;
+	fpp_movem_next[i] = i & ~(1 << j);
+    }
+    for (i = 0; i < 65536; i++)
+	mem_banks[i] = &flat_bank;
+    currprefs.cpu_model = 68020;
+    regs.address_space_mask = 0xffffffff;
+    read_table68k ();
+    do_merges ();
+    build_table (pairs);
+}
+
+static void setup_case (void)
+{
+    int i;
+
+    for (i = 0; i < MEM_SIZE; i++)
+	mem_put (i, rnd ());
+    /* Random code hardly ever contains one of the pairs, so plant the first
+       instructions, followed by a Bcc or DBcc, which is what comes next in
+       the pairs we have.  Done whether or not the fused handlers are in.  */
+    for (i = 0; i < PLANTED_PAIRS && npairs > 0; i++) {
+	uaecptr a = rnd () & MEM_MASK & ~1;
+	uae_u32 next = rnd () & 1 ? 0x6000 | (rnd () & 0xfff) : 0x50c8 | (rnd () & 0xf07);
+	flat_wput (a, op_pairtbl_3_ff[rnd () % npairs].opcode);
+	flat_wput (a + 2, next);
+    }
+    for (i = 0; i < 16; i++)
+	regs.regs[i] = rnd () << 8 ^ rnd ();
+    regs.sr = 0x2000 | (rnd () & 0x071f);
+    MakeFromSR ();
+    regs.vbr = regs.sfc = regs.dfc = regs.cacr = regs.caar = 0;
+    m68k_setpc (rnd () & MEM_MASK & ~1);
+}
+
+/* Register contents that make for exact results, rounding, overflow to
+ * infinity and NaNs.  */
+static fptype fpu_value (void)
+{
+    switch (rnd () % 8) {
+    case 0:
+	return 0.0;
+    case 1:
+	return -0.0;
+    case 2:
+	return (rnd () & 1 ? 1 : -1) * HUGE_VAL;
+    case 3:
+	return sqrt (-1.0);
+    case 4:
+	return (fptype)(uae_s32)(rnd () << 8 ^ rnd ()) * 1e300;
+    case 5:
+	return (fptype)(uae_s32)(rnd () << 8 ^ rnd ()) / (1 + rnd () % 1000);
+    default:
+	return ((fptype)(rnd () % 2001) - 1000) / 4;
+    }
+}
+
+/* An FPU instruction at a.  Its extension words and operands in memory
+ * are whatever random data follows.  Every addressing mode comes up, with
+ * every source format and store to <ea>, and also what the handlers don't
+ * do inline, so that their decoding is tried as well.  */
+static void plant_fpu (uaecptr a)
+{
+    static const int opmodes[] = { 0x00, 0x20, 0x22, 0x23, 0x28, 0x38, 0x3a, 0x04, 0x18 };
+    int opmode = opmodes[rnd () % (sizeof opmodes / sizeof *opmodes)];
+    uae_u32 extra;
+
+    if (rnd () % 8 == 0) {
+	flat_wput (a, 0xf280 | (rnd () & 0x7f));
+	return;
+    }
+    switch (rnd () % 3) {
+    case 1:
+	opmode |= 0x40;
+	break;
+    case 2:
+	opmode |= 0x44;
+	break;
+    }
+    switch (rnd () % 16) {
+    case 0:
+	extra = rnd ();
+	break;
+    case 1: case 2: case 3: case 4:
+	/* FPm,FPn.  */
+	extra = (rnd () & 0x3f) << 7 | opmode;
+	break;
+    case 5: case 6: case 7: case 8: case 9:
+	/* FMOVE FPn,<ea>; a k-factor only makes sense for packed.  */
+	extra = 0x6000 | (rnd () & 0x1f) << 7;
+	if (rnd () % 4 == 0)
+	    extra |= rnd () & 0x7f;
+	break;
+    default:
+	/* <ea>,FPn.  */
+	extra = 0x4000 | (rnd () & 0x3f) << 7 | opmode;
+	break;
+    }
+    flat_wput (a, 0xf200 | (rnd () & 0x3f));
+    flat_wput (a + 2, extra);
+}
+
+static void add_fpu (void)
+{
+    uae_u64 bits;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+	memcpy (&bits, &regs.fp[i], sizeof bits);
+	add_sum (bits >> 32);
+	add_sum (bits);
+    }
+    add_sum (regs.fpcr);
+    add_sum (regs.fpsr);
+    add_sum (regs.fpiar);
+    /* The condition codes, as get_fpsr has them.  */
+    add_sum (isnan (regs.fp_result) << 3 | isinf (regs.fp_result) << 2
+	     | (regs.fp_result == 0) << 1 | (regs.fp_result < 0));
+}
+
+static void add_mem (void)
+{
+    int i;
+
+    for (i = 0; i < MEM_SIZE; i++)
+	add_sum (mem[i]);
+}
+
+static void run_case (void)
+{
+    int i;
+
+    setup_case ();
+    nextevent = currcycle + 1 + rnd () % EVENT_GAP;
+
+    i = 0;
+    while (i < EVENTS) {
+	uae_u32 opcode;
+	unsigned long cycles;
+
+	/* Straight-line code runs off the end of the host buffer;
+	   wrap it around.  */
+	m68k_setpc (m68k_getpc () & MEM_MASK);
+	opcode = get_iword (0);
+	cycles = (*cpufunctbl[opcode]) (opcode);
+	/* The main loop would deal with these.  */
+	regs.spcflags = 0;
+	/* As do_cycles, but an event that something ran past still comes,
+	   late, instead of never.  */
+	if ((long)(nextevent - currcycle) <= (long)cycles) {
+	    add_regs ();
+	    add_flags ();
+	    nextevent = currcycle + cycles + 1 + rnd () % EVENT_GAP;
+	    i++;
+	}
+	currcycle += cycles;
+    }
+    add_mem ();
+}
+
+/* As m68k_run_thread.  The chipset's clock and events stand still, so a
+ * fused handler that advanced them instead of the CPU clock shows.  */
+static void run_case_thread (void)
+{
+    uae_u64 last = metrics_count[METRIC_INSNS];
+    int i;
+
+    setup_case ();
+    nextevent = currcycle + 0x10000000;
+    cputhread_cpu_clock = cputhread_chip_clock = 0;
+    countdown = 1 + rnd () % ACCESS_GAP;
+
+    i = 0;
+    while (i < EVENTS) {
+	uae_u32 opcode;
+	unsigned long cycles;
+
+	if (regs.spcflags & ~CPUTHREAD_CHIPSET_FLAGS) {
+	    regs.spcflags = 0;
+	    add_regs ();
+	    add_flags ();
+	    add_sum (cputhread_cpu_clock);
+	    cputhread_chip_clock = cputhread_cpu_clock;
+	    countdown = 1 + rnd () % ACCESS_GAP;
+	    last = metrics_count[METRIC_INSNS];
+	    i++;
+	}
+	/* The registers may differ by the second instruction of a pair
+	   then, but the memory can't.  */
+	if (metrics_count[METRIC_INSNS] - last > STUCK_INSNS) {
+	    add_sum (0x30000);
+	    break;
+	}
+	m68k_setpc (m68k_getpc () & MEM_MASK);
+	opcode = get_iword (0);
+	cycles = (*cpufunctbl[opcode]) (opcode);
+	METRIC_INC (METRIC_INSNS);
+	cputhread_do_cycles (cycles);
+    }
+    countdown = 0;
+    add_sum (currcycle);
+    add_sum (nextevent);
+    add_mem ();
+}
+
+/* Every instruction is planted where the last one left the PC, whether it
+ * carried on or branched, so that nothing but FPU instructions run.  */
+static void run_case_fpu (void)
+{
+    int i;
+
+    setup_case ();
+    for (i = 0; i < 8; i++)
+	regs.fp[i] = fpu_value ();
+    regs.fp_result = fpu_value ();
+    regs.fpcr = (rnd () & 3) << 4;
+    regs.fpsr = regs.fpiar = 0;
+
+    for (i = 0; i < FPU_INSNS; i++) {
+	uae_u32 opcode;
+
+	m68k_setpc (m68k_getpc () & MEM_MASK);
+	plant_fpu (m68k_getpc ());
+	opcode = get_iword (0);
+	(*cpufunctbl[opcode]) (opcode);
+	regs.spcflags = 0;
+	add_regs ();
+	add_flags ();
+	add_fpu ();
+    }
+    add_mem ();
+}
+
+int main (int argc, char **argv)
+{
+    int c, pairs = 0, fpu = 0, reference = 0;
+
+    for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+	if (strcmp (argv[1], "-p") == 0)
+	    pairs = 1;
+	else if (strcmp (argv[1], "-t") == 0)
+	    cputhread_running = 1;
+	else if (strcmp (argv[1], "-f") == 0)
+	    fpu = 1;
+	else if (strcmp (argv[1], "-r") == 0)
+	    reference = 1;
+    }
+    init (pairs);
+    if (reference)
+	install_reference ();
+    if (fpu)
+	currprefs.fpu_model = 68882;
+    cputhread_lead = 200 * CYCLE_UNIT;
+    seed = argc > 1 ? atoi (argv[1]) : 1;
+    for (c = 0; c < CASES; c++) {
+	sum = 2166136261u;
+	if (fpu)
+	    run_case_fpu ();
+	else if (cputhread_running)
+	    run_case_thread ();
+	else
+	    run_case ();
+	printf ("case %d: %08x\n", c, sum);
+    }
+    return 0;
+}
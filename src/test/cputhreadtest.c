@@ -0,0 +1,190 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Test of the chipset lock in cputhread.c
+  *
+  * Runs a CPU loop on the CPU thread through cputhread_run, against a
+  * chipset that is nothing but the hsync event.  Two more threads stand in
+  * for the filesystem and bsdsocket threads.  All of them go through a
+  * bank that isn't private to the CPU, so their accesses take the lock,
+  * and the bank checks that no two of them - or the hsync handler on the
+  * chipset thread - are ever inside at once.  Every so often the CPU loop
+  * holds the lock the way a calltrap does and waits for a trap thread that
+  * uses the bank meanwhile; that one must not wait for the lock.  If it
+  * did, the test would hang, so an alarm ends it.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <signal.h>
+
+#include "options.h"
+#include "threaddep/thread.h"
+#include "memory.h"
+#include "custom.h"
+#include "events.h"
+#include "newcpu.h"
+#include "debug.h"
+#include "cputhread.h"
+
+#define CPU_ACCESSES 200000
+/* How often the CPU loop plays calltrap.  */
+#define TRAP_EVERY 1000
+#define TRAP_ACCESSES 100
+#define HOST_THREADS 2
+#define TIMEOUT 60
+
+struct uae_prefs currprefs;
+struct regstruct regs;
+int mmu_enabled, debugging;
+#ifdef NATMEM
+uae_u8 *natmem_offset;
+#endif
+addrbank *mem_banks[65536];
+addrbank chipmem_bank;
+int maxhpos = 227, maxvpos = 312, vpos;
+
+unsigned long currcycle, nextevent;
+int is_lastline;
+volatile int delaying_for_sound;
+struct ev eventtab[ev_max];
+frame_time_t vsyncmintime;
+unsigned long gtod_secs, nr_gtod_to_skip, nr_gtod_done, gtod_counter;
+
+void do_copper (void) { }
+int idle_sleep (frame_time_t until) { return 0; }
+void write_log_standard (const char *fmt, ...) { }
+
+static volatile int inside, host_stop;
+static volatile int errors;
+static volatile unsigned long host_accesses, hsyncs;
+
+static void enter (void)
+{
+    int i;
+
+    if (__sync_fetch_and_add (&inside, 1) != 0)
+	errors++;
+    /* Give anyone else who got in time to notice.  */
+    for (i = 0; i < 100; i++)
+	__asm__ __volatile__ ("" ::: "memory");
+    __sync_fetch_and_sub (&inside, 1);
+}
+
+static uae_u32 test_lget (uaecptr a) { enter (); return 0; }
+static uae_u32 test_wget (uaecptr a) { enter (); return 0; }
+static uae_u32 test_bget (uaecptr a) { enter (); return 0; }
+static void test_lput (uaecptr a, uae_u32 v) { enter (); }
+static void test_wput (uaecptr a, uae_u32 v) { enter (); }
+static void test_bput (uaecptr a, uae_u32 v) { enter (); }
+static uae_u8 *test_xlate (uaecptr a) { return 0; }
+static int test_check (uaecptr a, uae_u32 size) { return 0; }
+
+static addrbank test_bank = {
+    test_lget, test_wget, test_bget,
+    test_lput, test_wput, test_bput,
+    test_xlate, test_check, NULL, "test",
+    0
+};
+
+static void hsync (void)
+{
+    enter ();
+    hsyncs++;
+    if (++vpos >= maxvpos)
+	vpos = 0;
+    eventtab[ev_hsync].evtime += maxhpos * CYCLE_UNIT;
+}
+
+static void *host_thread (void *arg)
+{
+    uaecptr a = 0x10000 * (1 + (long)arg);
+
+    while (! host_stop) {
+	mem_banks[bankindex (a)]->lget (a);
+	host_accesses++;
+    }
+    return 0;
+}
+
+static void *trap_thread (void *arg)
+{
+    int i;
+
+    cputhread_trap_thread ();
+    for (i = 0; i < TRAP_ACCESSES; i++)
+	mem_banks[0]->wput (0, i);
+    return 0;
+}
+
+static void cpu_loop (void)
+{
+    uae_thread_id host[HOST_THREADS], trap;
+    long i;
+
+    /* Once the lock is in use.  */
+    for (i = 0; i < HOST_THREADS; i++)
+	uae_start_thread (host_thread, (void *)i, &host[i]);
+
+    for (i = 0; i < CPU_ACCESSES; i++) {
+	if (regs.spcflags & SPCFLAG_PARK)
+	    cputhread_park ();
+	mem_banks[0]->wput (0, i);
+	if (i % TRAP_EVERY == 0) {
+	    cputhread_lock ();
+	    uae_start_thread (trap_thread, 0, &trap);
+	    uae_wait_thread (trap);
+	    cputhread_unlock ();
+	}
+	cputhread_do_cycles (4 * CYCLE_UNIT);
+    }
+
+    host_stop = 1;
+    for (i = 0; i < HOST_THREADS; i++)
+	uae_wait_thread (host[i]);
+}
+
+static void timeout (int sig)
+{
+    static const char msg[] = "cputhreadtest: deadlock\n";
+    write (2, msg, sizeof msg - 1);
+    _exit (1);
+}
+
+int main (int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < 65536; i++)
+	mem_banks[i] = &test_bank;
+    currprefs.cpu_thread = 1;
+    currprefs.m68k_speed = -1;
+    currprefs.cpu_model = 68020;
+    if (! cputhread_usable ()) {
+	printf ("cputhreadtest: skipped, no thread support\n");
+	return 0;
+    }
+
+    eventtab[ev_hsync].active = 1;
+    eventtab[ev_hsync].evtime = maxhpos * CYCLE_UNIT;
+    eventtab[ev_hsync].handler = hsync;
+    events_schedule ();
+
+    signal (SIGALRM, timeout);
+    alarm (TIMEOUT);
+    if (! cputhread_run (cpu_loop)) {
+	fprintf (stderr, "cputhreadtest: can't start the CPU thread\n");
+	return 1;
+    }
+    if (errors) {
+	fprintf (stderr, "cputhreadtest: %d overlapping accesses\n", errors);
+	return 1;
+    }
+    if (host_accesses == 0 || hsyncs == 0) {
+	fprintf (stderr, "cputhreadtest: not every thread got to run\n");
+	return 1;
+    }
+    printf ("cputhreadtest: ok\n");
+    return 0;
+}
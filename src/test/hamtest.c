@@ -0,0 +1,154 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Checks the table-driven HAM decoder in hamdecode.c against the
+  * switch-based decoder drawing.c used before, on random lines in every
+  * mode.  Lines are split into several spans with palette changes in
+  * between, and start with an unpainted part that is decoded but not
+  * stored, like init_ham_decoding and decode_ham do.
+  *
+  * The old decoder indexed color_regs_ecs past its 32 entries for OCS
+  * pixel values of 32 and above outside HAM; the new one wraps them.  That
+  * case is left out.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "hamdecode.c"
+
+#define LINE 800
+#define LINES 20000
+
+static uae_u16 regs_ecs[32];
+static uae_u32 regs_aga[256];
+
+/* The old decoder, as decode_ham had it, for COUNT pixels from SRC.  */
+static uae_u32 old_decode (int ham, int planes, int aga, const uae_u8 *src,
+			   uae_u32 *dst, int count, uae_u32 c)
+{
+    while (count-- > 0) {
+	int pv = *src++;
+	if (! ham || (planes != 6 && (! aga || planes != 8))) {
+	    c = aga ? regs_aga[pv] : regs_ecs[pv];
+	} else if (aga && planes == 8) {
+	    switch (pv & 0x3) {
+	    case 0x0: c = regs_aga[pv >> 2]; break;
+	    case 0x1: c &= 0xFFFF03; c |= (pv & 0xFC); break;
+	    case 0x2: c &= 0x03FFFF; c |= (pv & 0xFC) << 16; break;
+	    case 0x3: c &= 0xFF03FF; c |= (pv & 0xFC) << 8; break;
+	    }
+	} else if (aga) {
+	    switch (pv & 0x30) {
+	    case 0x00: c = regs_aga[pv]; break;
+	    case 0x10: c &= 0xFFFF00; c |= (pv & 0xF) << 4; break;
+	    case 0x20: c &= 0x00FFFF; c |= (pv & 0xF) << 20; break;
+	    case 0x30: c &= 0xFF00FF; c |= (pv & 0xF) << 12; break;
+	    }
+	} else {
+	    switch (pv & 0x30) {
+	    case 0x00: c = regs_ecs[pv]; break;
+	    case 0x10: c &= 0xFF0; c |= (pv & 0xF); break;
+	    case 0x20: c &= 0x0FF; c |= (pv & 0xF) << 8; break;
+	    case 0x30: c &= 0xF0F; c |= (pv & 0xF) << 4; break;
+	    }
+	}
+	if (dst)
+	    *dst++ = c;
+    }
+    return c;
+}
+
+static void random_regs (void)
+{
+    int i;
+    for (i = 0; i < 32; i++)
+	regs_ecs[i] = rand () & 0xFFF;
+    for (i = 0; i < 256; i++)
+	regs_aga[i] = ((uae_u32)rand () << 8 ^ rand ()) & 0xFFFFFF;
+}
+
+/* Mostly runs, as in real pictures, with some noise.  */
+static void random_line (uae_u8 *line, int mask)
+{
+    int i = 0;
+    while (i < LINE) {
+	int pv = rand () & mask;
+	int run = rand () % 4 == 0 ? 1 + rand () % 40 : 1;
+	while (run-- > 0 && i < LINE)
+	    line[i++] = pv;
+    }
+}
+
+static int test_line (int ham, int planes, int aga)
+{
+    static uae_u8 line[LINE];
+    static uae_u32 oldbuf[LINE], newbuf[LINE];
+    enum ham_mode mode = ham_select_mode (ham, planes, aga);
+    int mask = (1 << planes) - 1;
+    int pos, unpainted;
+    uae_u32 oldc, newc;
+
+    if (! aga && mode == ham_none)
+	mask &= 31;
+    random_line (line, mask);
+    random_regs ();
+    memset (oldbuf, 0, sizeof oldbuf);
+    memset (newbuf, 0, sizeof newbuf);
+
+    oldc = newc = aga ? regs_aga[0] : regs_ecs[0];
+    unpainted = rand () % 100;
+    oldc = old_decode (ham, planes, aga, line, 0, unpainted, oldc);
+    ham_build_tables (mode, aga, regs_ecs, regs_aga);
+    if (mode == ham_none) {
+	if (unpainted > 0)
+	    newc = ham_or[line[unpainted - 1]];
+    } else
+	newc = ham_decode_span (line, 0, unpainted, newc);
+    /* init_ham_decoding doesn't advance past the unpainted part outside
+       HAM, so neither does the test.  */
+    pos = mode == ham_none ? 0 : unpainted;
+
+    while (pos < LINE) {
+	int count = 1 + rand () % 200;
+	if (count > LINE - pos)
+	    count = LINE - pos;
+	if (rand () % 2) {
+	    int i;
+	    for (i = 0; i < 4; i++) {
+		regs_ecs[rand () % 32] = rand () & 0xFFF;
+		regs_aga[rand () % 256] = ((uae_u32)rand () << 8 ^ rand ()) & 0xFFFFFF;
+	    }
+	}
+	oldc = old_decode (ham, planes, aga, line + pos, oldbuf + pos, count, oldc);
+	ham_build_tables (mode, aga, regs_ecs, regs_aga);
+	newc = ham_decode_span (line + pos, newbuf + pos, count, newc);
+	pos += count;
+    }
+    if (oldc != newc || memcmp (oldbuf, newbuf, sizeof oldbuf) != 0) {
+	int i;
+	for (i = 0; i < LINE && oldbuf[i] == newbuf[i]; i++)
+	    ;
+	printf ("hamtest: ham=%d planes=%d aga=%d: pixel %d is %06x, expected %06x\n",
+		ham, planes, aga, i, i < LINE ? newbuf[i] : newc, i < LINE ? oldbuf[i] : oldc);
+	return 0;
+    }
+    return 1;
+}
+
+int main (int argc, char **argv)
+{
+    static const struct { int ham, planes, aga; } modes[] = {
+	{ 1, 6, 0 }, { 1, 6, 1 }, { 1, 8, 1 },
+	{ 0, 5, 0 }, { 0, 6, 0 }, { 0, 8, 1 }, { 1, 5, 0 }, { 1, 7, 1 }
+    };
+    int m, i;
+
+    srand (argc > 1 ? atoi (argv[1]) : 1);
+    for (m = 0; m < (int)(sizeof modes / sizeof *modes); m++)
+	for (i = 0; i < LINES; i++)
+	    if (! test_line (modes[m].ham, modes[m].planes, modes[m].aga))
+		return 1;
+    printf ("hamtest: ok\n");
+    return 0;
+}
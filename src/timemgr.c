@@ -20,6 +20,7 @@
 #include "events.h"
 #include "memory.h"
 #include "custom.h"
+#include "inputrec.h"
 
 /* Events */
 
@@ -33,6 +34,8 @@ frame_time_t vsynctime;
 frame_time_t vsyncmintime;
 
 int vsyncmintime_valid;
+/* How far past vsyncmintime the last frame ended with cpu_speed=max.  */
+long int vsync_lateness;
 
 /* Set if gettimeofday has high enough resolution for our purposes.  */
 int use_gtod = 0;
@@ -63,9 +66,19 @@ volatile int delaying_for_sound;
 
 unsigned long gtod_resolution, gtod_secs;
 
+/* Posted by threads that have queued work for the Amiga side, so that an
+   emulator sleeping in idle_sleep () gets on with it.  */
+static uae_wakeup_t idle_wakeup_cond;
+
+/* When waiting for real time to catch up, sleep until this close to the
+   deadline and spin for the rest, to keep the frame rate steady.  */
+#define IDLE_SPIN_USECS 1000
+
 void init_gtod (void)
 {
     struct timeval tv1, tv2;
+
+    uae_wakeup_init (&idle_wakeup_cond);
     gettimeofday (&tv1, NULL);
     do {
 	gettimeofday (&tv2, NULL);
@@ -130,6 +143,7 @@ void time_vsync (void)
 
     if (currprefs.m68k_speed == -1) {
 	frame_time_t curr_time = get_current_time (1);
+	vsync_lateness = vsyncmintime_valid ? (long int)(curr_time - vsyncmintime) : 0;
 	/* If we got behind in one frame, try catching up by using the
 	   previous vsyncmintime as a base.  If we get too far behind,
 	   give up and reset.  */
@@ -144,14 +158,50 @@ void time_vsync (void)
     } else {
 	/* No sound, and not using maximum CPU speed: delay until the frame
 	   has taken 20ms.  */
-	if (currprefs.produce_sound < 2 && vsyncmintime_valid && use_gtod) {
-	    frame_time_t curr_time;
-	    do
-		curr_time = get_current_time (0);
-	    while ((long int)(get_current_time (0) - vsyncmintime) < 0);
+	if (currprefs.produce_sound < 2 && vsyncmintime_valid && use_gtod
+	    && ! (inputrec_mode == INPUTREC_PLAY && currprefs.input_benchmark)) {
+	    while ((long int)(get_current_time (0) - vsyncmintime) < -IDLE_SPIN_USECS)
+		idle_sleep (vsyncmintime - IDLE_SPIN_USECS);
+	    while ((long int)(get_current_time (0) - vsyncmintime) < 0)
+		;
 	}
 	vsyncmintime = get_current_time (1) + vsynctime;
 	vsyncmintime_valid = 1;
 	nr_gtod_done = 0;
     }
 }
+
+/* Sleep until the time UNTIL, or until another thread calls idle_wakeup ().
+   Returns nonzero in the latter case.  */
+int idle_sleep (frame_time_t until)
+{
+    long int delta = until - get_current_time (0);
+
+    if (delta <= 0)
+	return 0;
+    return uae_wakeup_wait (&idle_wakeup_cond, delta);
+}
+
+void idle_wakeup (void)
+{
+    uae_wakeup_post (&idle_wakeup_cond);
+}
+
+/* Called while the CPU is halted by STOP.  Nothing can happen before the
+   next event, so go there directly.  If the frame rate hack won't let us
+   finish the last line because we are ahead of real time, sleep until the
+   frame is due.  When an I/O thread wakes us up earlier, end the frame
+   right away so that its interrupt is delivered without delay.  */
+void do_cycles_stopped (void)
+{
+    unsigned long cycles = nextevent - currcycle;
+
+    if (is_lastline && eventtab[ev_hsync].evtime - currcycle <= cycles
+	&& (long int)(get_current_time (0) - vsyncmintime) < 0)
+    {
+	if (idle_sleep (vsyncmintime))
+	    vsyncmintime = get_current_time (0);
+	gtod_counter = nr_gtod_to_skip;
+    }
+    do_cycles (cycles);
+}
@@ -20,6 +20,7 @@
 #include "threaddep/thread.h"
 #include "autoconf.h"
 #include "traps.h"
+#include "cputhread.h"
 
 /*
  * Traps are the mechanism via which 68k code can call emulator code
@@ -205,6 +206,8 @@ static void *trap_thread (void *arg)
 {
     TrapContext *context = (TrapContext *) arg;
 
+    cputhread_trap_thread ();
+
     /* Wait until main thread is ready to switch to the
      * this trap context. */
     uae_sem_wait (&context->switch_to_trap_sem);
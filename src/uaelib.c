@@ -27,6 +27,7 @@
 #include "debug.h"
 #include "gensound.h"
 #include "picasso96.h"
+#include "metrics.h"
 
 /* We don't get a numerical version from autoconf, but this is the only place
    that wants it, and it doesn't matter - so cheat.  */
@@ -289,6 +290,30 @@ static uae_u32 emulib_Debug (void)
     return 1;
 }
 
+/*
+ * Copies the performance counters, as text, to the given buffer.
+ * Returns the length of the whole text; if that is not less than size,
+ * the text was cut off.
+ */
+static uae_u32 emulib_GetMetrics (uaecptr place, uae_u32 size)
+{
+    char *buf;
+    uae_u32 i;
+    int len;
+
+    if (size == 0 || ! valid_address (place, size))
+	return 0;
+    buf = malloc (size);
+    if (buf == 0)
+	return 0;
+    len = metrics_format (buf, size);
+    for (i = 0; i < size && buf[i]; i++)
+	put_byte (place + i, buf[i]);
+    put_byte (place + (i < size ? i : size - 1), 0);
+    free (buf);
+    return len;
+}
+
 /* We simply find the first "text" hunk, get the offset of its actual code segment (20 bytes away)
  * and add that offset to the base address of the object.  Now we've got code to execute.
  *
@@ -378,6 +403,7 @@ static uae_u32 uaelib_demux (TrapContext *dummy)
      case 13: return emulib_ExitEmu ();
      case 14: return emulib_GetDisk (ARG1, ARG2);
      case 15: return emulib_Debug ();
+     case 36: return emulib_GetMetrics (ARG1, ARG2);
 
 #ifdef PICASSO96
      case 16: return picasso_FindCard ();
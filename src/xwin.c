@@ -340,6 +340,323 @@ static void leave_dga_mode (void)
 }
 #endif
 
+#ifdef SUPPORT_THREADS
+/* Background presentation of the Amiga screen.  drawing.c renders into
+ * present_drawbuf, which only the emulation thread touches.  At the end of
+ * a frame, the lines that were drawn are copied into one of two staging
+ * buffers and handed to present_thread, which compares them against the
+ * XImage a machine word at a time, merges the changed spans of adjacent
+ * lines into rectangles and uploads those.  If the X server falls behind,
+ * new frames are merged into the staging buffer that is still waiting, so
+ * the emulation thread never waits for the server.  */
+
+#define PRESENT_NONE -1
+
+struct present_buf {
+    char *mem;
+    char *dirty;
+    int first, last;
+};
+
+static int present_on;
+static char *present_drawbuf, *present_drawn;
+static int present_first, present_last;
+static struct present_buf present_bufs[2];
+static int present_pending, present_busy, present_full, present_quit;
+static uae_sem_t present_lock, present_ready;
+static uae_thread_id present_tid;
+static long present_frames, present_merged, present_rects;
+
+/* The screen as present_start found it.  The image and its geometry only
+ * change after present_stop, so the thread works from this copy and never
+ * looks at ami_dinfo or gfxvidinfo, which belong to the emulation thread.  */
+static XImage *present_ximg;
+static uae_u8 *present_image;
+static int present_bpl, present_len, present_pixbytes;
+static int present_width, present_height, present_shm;
+
+/* Find the first and last byte in which the LEN byte lines NEWP and OLDP
+ * differ.  Returns 0 if they are equal.  Both lines are at the same offset
+ * into buffers from malloc or shmat, so they are aligned alike: the bytes
+ * up to the first word boundary and after the last one are compared one
+ * at a time, the rest a machine word at a time.  */
+static int present_diff (const uae_u8 *newp, const uae_u8 *oldp, int len, int *pxs, int *pxe)
+{
+    int head = (int)(-(unsigned long)newp & (sizeof (unsigned long) - 1));
+    const unsigned long *nw, *ow;
+    int nwords, wordend, i, xs, xe;
+
+    if (head > len)
+	head = len;
+    nw = (const unsigned long *)(newp + head);
+    ow = (const unsigned long *)(oldp + head);
+    nwords = (len - head) / sizeof (unsigned long);
+    wordend = head + nwords * sizeof (unsigned long);
+
+    for (xs = 0; xs < head && newp[xs] == oldp[xs]; xs++)
+	;
+    if (xs == head) {
+	for (i = 0; i < nwords && nw[i] == ow[i]; i++)
+	    ;
+	for (xs = head + i * sizeof (unsigned long); xs < len && newp[xs] == oldp[xs]; xs++)
+	    ;
+	if (xs == len)
+	    return 0;
+    }
+
+    for (xe = len - 1; xe >= wordend && newp[xe] == oldp[xe]; xe--)
+	;
+    if (xe < wordend) {
+	/* Stops at the latest in the word, or the head, that has XS.  */
+	for (i = nwords - 1; i >= 0 && nw[i] == ow[i]; i--)
+	    ;
+	for (xe = head + (i + 1) * sizeof (unsigned long) - 1; newp[xe] == oldp[xe]; xe--)
+	    ;
+    }
+    *pxs = xs;
+    *pxe = xe;
+    return 1;
+}
+
+static void present_put (int x0, int y0, int w, int h)
+{
+#if SHM_SUPPORT_LINKS == 1
+    if (present_shm)
+	XShmPutImage (display, mywin, mygc, present_ximg, x0, y0, x0, y0, w, h, 0);
+    else
+#endif
+	XPutImage (display, mywin, mygc, present_ximg, x0, y0, x0, y0, w, h);
+}
+
+static void present_put_span (int x0, int x1, int y0, int y1)
+{
+    x0 /= present_pixbytes;
+    x1 /= present_pixbytes;
+    present_put (x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    present_rects++;
+}
+
+static void present_upload (struct present_buf *pb)
+{
+    int rx0 = 0, rx1 = 0, ry0 = -1;
+    int y;
+
+    for (y = pb->first; y <= pb->last; y++) {
+	uae_u8 *src = (uae_u8 *)pb->mem + y * present_bpl;
+	uae_u8 *dst = present_image + y * present_bpl;
+	int xs, xe;
+
+	if (! pb->dirty[y] || ! present_diff (src, dst, present_len, &xs, &xe)) {
+	    pb->dirty[y] = 0;
+	    if (ry0 >= 0)
+		present_put_span (rx0, rx1, ry0, y - 1);
+	    ry0 = -1;
+	    continue;
+	}
+	pb->dirty[y] = 0;
+	xs -= xs % present_pixbytes;
+	xe += present_pixbytes - 1 - xe % present_pixbytes;
+	memcpy (dst + xs, src + xs, xe - xs + 1);
+
+	/* Grow the current rectangle if the spans overlap.  */
+	if (ry0 >= 0 && xs <= rx1 && xe >= rx0) {
+	    if (xs < rx0)
+		rx0 = xs;
+	    if (xe > rx1)
+		rx1 = xe;
+	    continue;
+	}
+	if (ry0 >= 0)
+	    present_put_span (rx0, rx1, ry0, y - 1);
+	rx0 = xs;
+	rx1 = xe;
+	ry0 = y;
+    }
+    if (ry0 >= 0)
+	present_put_span (rx0, rx1, ry0, pb->last);
+    pb->first = present_height;
+    pb->last = -1;
+}
+
+static void *present_thread (void *dummy)
+{
+    for (;;) {
+	int b, full;
+
+	uae_sem_wait (&present_ready);
+	uae_sem_wait (&present_lock);
+	if (present_quit) {
+	    uae_sem_post (&present_lock);
+	    break;
+	}
+	b = present_pending;
+	present_pending = PRESENT_NONE;
+	present_busy = b;
+	full = present_full;
+	present_full = 0;
+	uae_sem_post (&present_lock);
+
+	if (b != PRESENT_NONE)
+	    present_upload (present_bufs + b);
+	if (full)
+	    present_put (0, 0, present_width, present_height);
+	if (b != PRESENT_NONE || full) {
+	    if (present_shm)
+		XSync (display, 0);
+	    else
+		XFlush (display);
+	}
+
+	uae_sem_wait (&present_lock);
+	present_busy = PRESENT_NONE;
+	uae_sem_post (&present_lock);
+    }
+    return 0;
+}
+
+/* Called by flush_screen: hand the lines drawn in this frame over to the
+ * presentation thread.  */
+static void present_submit (void)
+{
+    int bpl = present_bpl;
+    int len = present_len;
+    struct present_buf *pb;
+    int y;
+
+    if (present_first > present_last)
+	return;
+
+    uae_sem_wait (&present_lock);
+    if (present_pending != PRESENT_NONE) {
+	pb = present_bufs + present_pending;
+	present_merged++;
+    } else {
+	present_pending = present_busy == 0 ? 1 : 0;
+	pb = present_bufs + present_pending;
+    }
+    for (y = present_first; y <= present_last; y++) {
+	if (! present_drawn[y])
+	    continue;
+	present_drawn[y] = 0;
+	memcpy (pb->mem + y * bpl, present_drawbuf + y * bpl, len);
+	pb->dirty[y] = 1;
+    }
+    if (present_first < pb->first)
+	pb->first = present_first;
+    if (present_last > pb->last)
+	pb->last = present_last;
+    present_frames++;
+    uae_sem_post (&present_lock);
+    uae_sem_post (&present_ready);
+
+    present_first = present_height;
+    present_last = -1;
+}
+
+static void present_mark (int ystart, int ystop)
+{
+    memset (present_drawn + ystart, 1, ystop - ystart + 1);
+    if (ystart < present_first)
+	present_first = ystart;
+    if (ystop > present_last)
+	present_last = ystop;
+}
+
+static void present_refresh (void)
+{
+    uae_sem_wait (&present_lock);
+    present_full = 1;
+    uae_sem_post (&present_lock);
+    uae_sem_post (&present_ready);
+}
+
+static void present_free (void)
+{
+    int i;
+
+    free (present_drawbuf);
+    free (present_drawn);
+    for (i = 0; i < 2; i++) {
+	free (present_bufs[i].mem);
+	free (present_bufs[i].dirty);
+    }
+}
+
+static int present_start (void)
+{
+    int size = gfxvidinfo.height * ami_dinfo.ximg->bytes_per_line;
+    int i;
+
+    present_on = 0;
+    if (! currprefs.x11_present_thread || screen_is_picasso || need_dither || dgamode)
+	return 0;
+
+    present_ximg = ami_dinfo.ximg;
+    present_image = (uae_u8 *)ami_dinfo.image_mem;
+    present_bpl = ami_dinfo.ximg->bytes_per_line;
+    present_pixbytes = gfxvidinfo.pixbytes;
+    present_len = gfxvidinfo.width * gfxvidinfo.pixbytes;
+    present_width = current_width;
+    present_height = gfxvidinfo.height;
+#if SHM_SUPPORT_LINKS == 1
+    present_shm = currprefs.x11_use_mitshm && shmavail;
+#else
+    present_shm = 0;
+#endif
+
+    present_drawbuf = (char *)calloc (size, 1);
+    present_drawn = (char *)calloc (gfxvidinfo.height, 1);
+    for (i = 0; i < 2; i++) {
+	present_bufs[i].mem = (char *)malloc (size);
+	present_bufs[i].dirty = (char *)calloc (gfxvidinfo.height, 1);
+	present_bufs[i].first = gfxvidinfo.height;
+	present_bufs[i].last = -1;
+    }
+    present_first = gfxvidinfo.height;
+    present_last = -1;
+    present_pending = present_busy = PRESENT_NONE;
+    present_full = present_quit = 0;
+    present_frames = present_merged = present_rects = 0;
+
+    uae_sem_init (&present_lock, 0, 1);
+    uae_sem_init (&present_ready, 0, 0);
+    if (uae_start_thread (present_thread, 0, &present_tid) != 0) {
+	write_log ("Can't start presentation thread, drawing directly.\n");
+	uae_sem_destroy (&present_lock);
+	uae_sem_destroy (&present_ready);
+	present_free ();
+	return 0;
+    }
+    write_log ("Using presentation thread.\n");
+    return present_on = 1;
+}
+
+static void present_stop (void)
+{
+    if (! present_on)
+	return;
+    uae_sem_wait (&present_lock);
+    present_quit = 1;
+    uae_sem_post (&present_lock);
+    uae_sem_post (&present_ready);
+    uae_wait_thread (present_tid);
+    uae_sem_destroy (&present_lock);
+    uae_sem_destroy (&present_ready);
+
+    write_log ("Presentation thread: %ld frames, %ld merged, %ld rectangles\n",
+	       present_frames, present_merged, present_rects);
+    present_free ();
+    present_on = 0;
+}
+#else
+#define present_on 0
+#define present_mark(a, b)
+#define present_submit()
+#define present_refresh()
+#define present_start() 0
+#define present_stop()
+#endif
+
 static char *oldpixbuf;
 
 void flush_line (int y)
@@ -348,6 +665,10 @@ void flush_line (int y)
     int xs, xe;
     int len;
 
+    if (present_on) {
+	present_mark (y, y);
+	return;
+    }
     if (linebuf == NULL)
 	linebuf = y*gfxvidinfo.rowbytes + gfxvidinfo.bufmem;
 
@@ -430,6 +751,10 @@ void flush_block (int ystart, int ystop)
 {
     if (dgamode)
 	return;
+    if (present_on) {
+	present_mark (ystart, ystop);
+	return;
+    }
 
     DO_PUTIMAGE (ami_dinfo.ximg, 0, ystart, 0, ystart, gfxvidinfo.width, ystop - ystart + 1);
 }
@@ -438,6 +763,10 @@ void flush_screen (int ystart, int ystop)
 {
     if (dgamode)
 	return;
+    if (present_on) {
+	present_submit ();
+	return;
+    }
 
 #if SHM_SUPPORT_LINKS == 1
     if (currprefs.x11_use_mitshm && shmavail)
@@ -673,6 +1002,10 @@ int graphics_setup (void)
 {
     char *display_name = 0;
 
+#ifdef SUPPORT_THREADS
+    /* The presentation thread talks to the server as well.  */
+    XInitThreads ();
+#endif
     display = XOpenDisplay (display_name);
     if (display == 0)  {
 	write_log ("Can't connect to X server %s\n", XDisplayName (display_name));
@@ -827,7 +1160,11 @@ int graphics_subinit (void)
 	gfxvidinfo.linemem = 0;
 	gfxvidinfo.bufmem = ami_dinfo.image_mem;
 	gfxvidinfo.rowbytes = ami_dinfo.ximg->bytes_per_line;
-	if (currprefs.x11_use_low_bandwidth) {
+	if (present_start ()) {
+	    /* The presentation thread does its own diffing.  */
+	    gfxvidinfo.bufmem = present_drawbuf;
+	    gfxvidinfo.maxblocklines = 100;
+	} else if (currprefs.x11_use_low_bandwidth) {
 	    gfxvidinfo.maxblocklines = 0;
 	    gfxvidinfo.rowbytes = ami_dinfo.ximg->bytes_per_line;
 	    gfxvidinfo.linemem = (char *)malloc (gfxvidinfo.rowbytes);
@@ -996,6 +1333,7 @@ static void destroy_dinfo (struct disp_info *dinfo)
 
 void graphics_subshutdown (int final)
 {
+    present_stop ();
     XSync (display, 0);
 #ifdef USE_DGA_EXTENSION
     if (dgamode)
@@ -1216,7 +1554,10 @@ void handle_events (void)
 
     if (! dgamode) {
 	if (! screen_is_picasso && refresh_necessary) {
-	    DO_PUTIMAGE (ami_dinfo.ximg, 0, 0, 0, 0, current_width, current_height);
+	    if (present_on)
+		present_refresh ();
+	    else
+		DO_PUTIMAGE (ami_dinfo.ximg, 0, 0, 0, 0, current_width, current_height);
 	    refresh_necessary = 0;
 	}
 	if (cursorOn && !currprefs.x11_hide_cursor) {
@@ -1699,13 +2040,15 @@ void target_save_options (FILE *f, const struct uae_prefs *p)
     fprintf (f, "x11.low_bandwidth=%s\n", p->x11_use_low_bandwidth ? "true" : "false");
     fprintf (f, "x11.use_mitshm=%s\n", p->x11_use_mitshm ? "true" : "false");
     fprintf (f, "x11.hide_cursor=%s\n", p->x11_hide_cursor ? "true" : "false");
+    fprintf (f, "x11.present_thread=%s\n", p->x11_present_thread ? "true" : "false");
 }
 
 int target_parse_option (struct uae_prefs *p, const char *option, const char *value)
 {
     return (cfgfile_yesno (option, value, "low_bandwidth", &p->x11_use_low_bandwidth)
 	    || cfgfile_yesno (option, value, "use_mitshm", &p->x11_use_mitshm)
-	    || cfgfile_yesno (option, value, "hide_cursor", &p->x11_hide_cursor));
+	    || cfgfile_yesno (option, value, "hide_cursor", &p->x11_hide_cursor)
+	    || cfgfile_yesno (option, value, "present_thread", &p->x11_present_thread));
 }
 
 void target_default_options (struct uae_prefs *p)
@@ -1713,4 +2056,5 @@ void target_default_options (struct uae_prefs *p)
     p->x11_use_low_bandwidth = 0;
     p->x11_use_mitshm = 1;
     p->x11_hide_cursor = 1;
+    p->x11_present_thread = 0;
 }